@@ -0,0 +1,153 @@
+#include "AdvancedOptimizer.h"
+
+namespace Snow {
+namespace AdvancedOptimization {
+
+// ============================================================================
+// ADVANCED OPTIMIZER
+// ============================================================================
+
+AdvancedOptimizer::AdvancedOptimizer()
+    : opt_level_(2), enable_lto_(false), enable_autofdo_(false),
+      enable_speculative_(false), micro_arch_(X64::MicroArch::Skylake), prefetch_level_(0), stats_() {
+}
+
+void AdvancedOptimizer::SetOptimizationLevel(int level) {
+    opt_level_ = level;
+}
+
+void AdvancedOptimizer::SetProfileData(const ProfileData& data) {
+    profile_data_ = data;
+}
+
+void AdvancedOptimizer::EnableLinkTimeOptimization(bool enable) {
+    enable_lto_ = enable;
+}
+
+void AdvancedOptimizer::EnableAutoFDO(bool enable) {
+    enable_autofdo_ = enable;
+}
+
+void AdvancedOptimizer::EnableSpeculativeOptimization(bool enable) {
+    enable_speculative_ = enable;
+}
+
+void AdvancedOptimizer::SetMicroArch(X64::MicroArch arch) {
+    micro_arch_ = arch;
+}
+
+void AdvancedOptimizer::SetCacheConfig(const CacheConfig& config) {
+    cache_config_ = config;
+}
+
+void AdvancedOptimizer::EnablePrefetching(int min_level) {
+    prefetch_level_ = min_level;
+}
+
+void AdvancedOptimizer::Optimize(SSA::SSAModule& module) {
+    stats_ = OptimizationStats();
+    
+    // Nest order and tiling first: the vectorizer then sees the final innermost loops
+    if (opt_level_ >= 3) {
+        PolyhedralOptimization(module);
+    }
+
+    if (opt_level_ >= 2) {
+        Tier2_Vectorization(module);
+    }
+
+    // Distances depend on the final loop bodies, and the scheduler should see the prefetches
+    if (prefetch_level_ > 0 && opt_level_ >= prefetch_level_) {
+        InsertPrefetchInstructions(module);
+    }
+
+    if (opt_level_ >= 2) {
+        Tier2_LookaheadReordering(module);
+    }
+
+    if (opt_level_ >= 3) {
+        SoftwarePipelining(module);
+    }
+}
+
+// ============================================================================
+// TIER 2: AGGRESSIVE OPTIMIZATIONS (-O2)
+// ============================================================================
+
+void AdvancedOptimizer::Tier2_Vectorization(SSA::SSAModule& module) {
+    VectorizationEngine engine;
+
+    for (const auto& func : module.GetFunctions()) {
+        stats_.loops_vectorized += engine.VectorizeLoops(*func);
+        engine.PerformSLPVectorization(*func);
+    }
+
+    const VectorizationEngine::Stats& vec = engine.GetStats();
+    stats_.slp_packs_formed += vec.slp_packs;
+    stats_.slp_cycles_saved += vec.slp_cycles_saved;
+}
+
+// Runs after vectorization so the wide loads and multiplies it creates get
+// their latency hidden too
+void AdvancedOptimizer::Tier2_LookaheadReordering(SSA::SSAModule& module) {
+    InstructionScheduler scheduler;
+    scheduler.SetMicroArch(micro_arch_);
+
+    for (const auto& func : module.GetFunctions()) {
+        for (const auto& block : func->GetBlocks()) {
+            scheduler.Schedule(*block);
+        }
+    }
+
+    const InstructionScheduler::Stats& sched = scheduler.GetStats();
+    stats_.blocks_scheduled += sched.blocks_scheduled;
+    stats_.schedule_cycles_saved += sched.cycles_before - sched.cycles_after;
+}
+
+// ============================================================================
+// LOOP OPTIMIZATIONS
+// ============================================================================
+
+std::vector<AdvancedOptimizer::Loop> AdvancedOptimizer::DetectLoops(SSA::SSAFunction& func) {
+    return VectorizationEngine::FindInnermostLoops(func);
+}
+
+// Runs after list scheduling: the body's scheduled length is what the
+// pipelined kernel has to beat
+void AdvancedOptimizer::SoftwarePipelining(SSA::SSAModule& module) {
+    InstructionScheduler scheduler;
+    scheduler.SetMicroArch(micro_arch_);
+
+    for (const auto& func : module.GetFunctions()) {
+        for (const Loop& loop : DetectLoops(*func)) {
+            scheduler.SoftwarePipelining(*func, loop);
+        }
+    }
+
+    stats_.loops_pipelined += scheduler.GetStats().loops_pipelined;
+}
+
+void AdvancedOptimizer::PolyhedralOptimization(SSA::SSAModule& module) {
+    LoopNestOptimizer nests;
+    nests.SetCacheConfig(cache_config_);
+
+    for (const auto& func : module.GetFunctions()) {
+        nests.OptimizeLoopNests(*func);
+    }
+
+    stats_.loops_interchanged += nests.GetStats().nests_interchanged;
+    stats_.loops_tiled += nests.GetStats().nests_tiled;
+}
+
+void AdvancedOptimizer::InsertPrefetchInstructions(SSA::SSAModule& module) {
+    PrefetchInserter prefetcher;
+    prefetcher.SetMicroArch(micro_arch_);
+    prefetcher.SetCacheConfig(cache_config_);
+
+    for (const auto& func : module.GetFunctions()) {
+        stats_.prefetches_inserted += prefetcher.InsertPrefetches(*func);
+    }
+}
+
+} // namespace AdvancedOptimization
+} // namespace Snow
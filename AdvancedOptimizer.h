@@ -1,6 +1,8 @@
 #pragma once
 
 #include "../SSA/SSA.h"
+#include "../CodeGen/X64Target.h"
+#include "../CodeGen/MachineModel.h"
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -34,6 +36,20 @@ struct ProfileData {
     std::unordered_map<std::string, double> thermal_profile;
 };
 
+// ============================================================================
+// TARGET CACHE HIERARCHY
+// What the loop-nest optimizer tiles for; defaults describe a typical
+// client core
+// ============================================================================
+
+struct CacheConfig {
+    int l1_kb = 32;
+    int l1_associativity = 8;
+    int l2_kb = 1024;
+    int l2_associativity = 16;
+    int line_size = 64;
+};
+
 // ============================================================================
 // INTERPROCEDURAL ANALYSIS
 // ============================================================================
@@ -84,6 +100,9 @@ public:
     void EnableLinkTimeOptimization(bool enable);
     void EnableAutoFDO(bool enable);
     void EnableSpeculativeOptimization(bool enable);
+    void SetMicroArch(X64::MicroArch arch); // Scheduling cost model
+    void SetCacheConfig(const CacheConfig& config); // Tile sizes
+    void EnablePrefetching(int min_level); // Prefetch at -O<min_level> and up; 0 = off (default)
     
     // Main optimization entry point
     void Optimize(SSA::SSAModule& module);
@@ -95,9 +114,26 @@ public:
         int functions_inlined;
         int tail_calls_eliminated;
 double speedup_estimate;
+        int slp_packs_formed;
+        double slp_cycles_saved;
+        int blocks_scheduled;
+        int schedule_cycles_saved;
+        int loops_pipelined;
+        int loops_interchanged;
+        int loops_tiled;
+        int prefetches_inserted;
     };
     
     const OptimizationStats& GetStats() const { return stats_; }
+    
+    // Natural loop (shared with the vectorizer and scheduler)
+    struct Loop {
+        SSA::SSABasicBlock* header;
+        std::vector<SSA::SSABasicBlock*> blocks;
+        std::vector<Loop*> nested_loops;
+        int trip_count;
+        bool is_vectorizable;
+    };
 
 private:
     int opt_level_;
@@ -105,6 +141,9 @@ private:
     bool enable_lto_;
     bool enable_autofdo_;
     bool enable_speculative_;
+    X64::MicroArch micro_arch_;
+    CacheConfig cache_config_;
+    int prefetch_level_;
     OptimizationStats stats_;
   InterproceduralAnalysis ipa_;
     
@@ -181,14 +220,6 @@ private:
     // ========================================================================
     
     // Loop detection and analysis
-    struct Loop {
-        SSA::SSABasicBlock* header;
- std::vector<SSA::SSABasicBlock*> blocks;
-        std::vector<Loop*> nested_loops;
-   int trip_count;
-        bool is_vectorizable;
-    };
-    
     std::vector<Loop> DetectLoops(SSA::SSAFunction& func);
     bool IsVectorizable(const Loop& loop);
     int EstimateTripCount(const Loop& loop);
@@ -206,11 +237,18 @@ private:
 
 // ============================================================================
 // VECTORIZATION ENGINE
+// Loop vectorization handles innermost counted loops 'for i in [start, n)'
+// with a single body block of 64-bit loads, stores and Add/Sub/Mul whose
+// addresses are base + 8*i + c. The vector loop covers a multiple of the
+// vector width; the original loop then runs as the scalar epilogue.
+// SLP packs stores to consecutive words, together with the isomorphic
+// Add/Sub/Mul and load trees feeding them, within a basic block.
 // ============================================================================
 
 class VectorizationEngine {
 public:
     VectorizationEngine();
+    ~VectorizationEngine();
   
     // Target SIMD capabilities
     enum class SIMDTarget {
@@ -222,76 +260,345 @@ AVX512
     };
     
     void SetTarget(SIMDTarget target);
+    SIMDTarget GetTarget() const { return target_; }
+    int GetVectorWidth() const { return vector_width_; } // 64-bit lanes
+    
+    // Best target the host CPU and OS support (cpuid/xgetbv)
+    static SIMDTarget DetectHostTarget();
+    
+    // Vectorize every innermost loop that passes the dependence and cost checks
+    int VectorizeLoops(SSA::SSAFunction& func);
     
     // Vectorize loops
     bool VectorizeLoop(SSA::SSAFunction& func, const AdvancedOptimizer::Loop& loop);
     
     // Vectorize straight-line code (SLP)
     void PerformSLPVectorization(SSA::SSAFunction& func);
+    
+    // Innermost natural loops (also used by the software pipeliner)
+    static std::vector<AdvancedOptimizer::Loop> FindInnermostLoops(SSA::SSAFunction& func);
+    
+    struct Stats {
+        int loops_analyzed = 0;
+        int loops_vectorized = 0;
+        int rejected_shape = 0;        // Not a counted single-body loop
+        int rejected_dependence = 0;   // Loop-carried dependence shorter than two lanes
+        int rejected_cost = 0;         // Cost model predicts no gain
+        int runtime_alias_checks = 0;  // Base pairs tested at run time
+        double estimated_speedup = 0;  // Mean over vectorized loops
+        int slp_trees = 0;             // Store groups rewritten by SLP
+        int slp_packs = 0;             // Vector instructions replacing scalar groups
+        int slp_rejected = 0;          // Store groups kept scalar (legality or cost)
+        double slp_cycles_saved = 0;
+        
+        void Print(const std::string& label) const;
+    };
+    
+    const Stats& GetStats() const { return stats_; }
 
 private:
+    struct LoopPlan;
+    struct SLPTree;
+    
     SIMDTarget target_;
     int vector_width_;
+    Stats stats_;
+    std::unique_ptr<LoopPlan> plan_;  // Filled by CanVectorize for GenerateVectorCode
     
     bool CanVectorize(const AdvancedOptimizer::Loop& loop);
     void GenerateVectorCode(SSA::SSAFunction& func, const AdvancedOptimizer::Loop& loop);
+    
+    bool AnalyzeLoop(const AdvancedOptimizer::Loop& loop, LoopPlan& plan);
+    bool CheckDependences(LoopPlan& plan);
+    double EstimateSpeedup(const LoopPlan& plan) const;
+    double VectorCost(SSA::SSAInstruction::OpCode op) const; // Cycles per vector instruction
+    
+    // SLP: pack one group of stores to consecutive words, true if rewritten
+    bool VectorizeStoreGroup(SSA::SSAFunction& func, SSA::SSABasicBlock& block,
+                             const std::vector<SSA::SSAInstruction*>& stores);
+    int BuildSLPNode(SLPTree& tree, const std::vector<SSA::SSAValue*>& lanes, int depth);
 };
 
 // ============================================================================
 // REGISTER ALLOCATOR
+// -O3 uses iterated register coalescing (George & Appel) on SSA form, lower
+// levels use linear scan. Phi operands are treated as copies into the phi
+// result, so every coalesced phi copy is a move out-of-SSA no longer emits.
 // ============================================================================
 
 class RegisterAllocator {
 public:
     RegisterAllocator();
+    ~RegisterAllocator();
+    
+    enum class Strategy {
+        LinearScan,
+        GraphColoring
+    };
+    
+    void SetStrategy(Strategy strategy) { strategy_ = strategy; }
+    void SetOptimizationLevel(int level); // -O3 selects graph coloring
+    void SetTargetABI(X64::TargetABI abi) { abi_ = abi; }
     
     // Perform register allocation
     void Allocate(SSA::SSAFunction& func);
     
-    // Graph coloring
+    // Graph coloring (rewrites spilled values into Alloca/Load/Store)
     void GraphColoringAllocation(SSA::SSAFunction& func);
     
-    // Linear scan
+    // Linear scan (leaves the function untouched)
     void LinearScanAllocation(SSA::SSAFunction& func);
     
-    // Get allocation map
+    // Run linear scan, then graph coloring, and print both reports
+    void CompareStrategies(SSA::SSAFunction& func);
+    
+    // Get allocation map (value -> X64 register)
     std::unordered_map<SSA::SSAValue*, int> GetAllocation() const { return allocation_; }
+    const std::unordered_map<SSA::SSAValue*, int>& GetSpillSlots() const { return spill_slots_; }
+    
+    struct Stats {
+        int values = 0;
+        int spilled = 0;
+        int spill_instructions = 0;      // Loads and stores (code size)
+        double weighted_spill_cost = 0;  // Spill ops weighted by 10^loop_depth (run time)
+        int copies_coalesced = 0;
+        int copies_remaining = 0;        // Phi copies out-of-SSA still has to emit
+        int rounds = 0;                  // Build/color rounds (restarts after spilling)
+        double compile_time_us = 0;
+        
+        void Print(const std::string& label) const;
+    };
+    
+    const Stats& GetStats() const { return stats_; }
 
 private:
-    std::unordered_map<SSA::SSAValue*, int> allocation_;
+    struct InterferenceGraph;
     
- void ComputeLiveRanges(SSA::SSAFunction& func);
+    Strategy strategy_;
+    X64::TargetABI abi_;
+    Stats stats_;
+    std::unordered_map<SSA::SSAValue*, int> allocation_;
+    std::unordered_map<SSA::SSAValue*, int> spill_slots_;
+    
+    // Liveness, indexed like func.GetBlocks()
+    std::vector<SSA::SSABasicBlock*> blocks_;
+    std::unordered_map<SSA::SSABasicBlock*, int> block_index_;
+    std::vector<std::unordered_set<SSA::SSAValue*>> live_in_;
+    std::vector<std::unordered_set<SSA::SSAValue*>> live_out_;
+    std::vector<int> loop_depth_;
+    std::unordered_set<SSA::SSAValue*> stack_slots_;  // Alloca results, never in registers
+    std::unordered_set<SSA::SSAValue*> spill_temps_;  // Created by spilling, never re-spilled
+    std::unique_ptr<InterferenceGraph> graph_;
+    
+    void ComputeLiveRanges(SSA::SSAFunction& func);
     void BuildInterferenceGraph(SSA::SSAFunction& func);
+    void ComputeLoopDepths();
+    void RewriteSpills(SSA::SSAFunction& func, const std::vector<SSA::SSAValue*>& spilled);
+    bool IsAllocatable(const SSA::SSAValue* value) const;
+    double UseWeight(int block) const;
 };
 
 // ============================================================================
 // INSTRUCTION SCHEDULER
+// Critical-path list scheduling of each block's non-phi instructions over a
+// dependence DAG of SSA def-use edges plus Load/Store ordering. Calls and
+// terminators are fixed points. Costs come from an X64::MachineModel.
+// Software pipelining is iterative modulo scheduling (Rau, MICRO-27) of the
+// same counted single-body loops the vectorizer handles.
 // ============================================================================
 
 class InstructionScheduler {
 public:
     InstructionScheduler();
     
+    void SetMicroArch(X64::MicroArch arch);
+    void SetMachineModel(const X64::MachineModel& model);
+    const X64::MachineModel& GetMachineModel() const { return model_; }
+    void SetTargetABI(X64::TargetABI abi) { abi_ = abi; } // Register budget
+    
     // Schedule instructions for pipelining
     void Schedule(SSA::SSABasicBlock& block);
     
     // List scheduling
     void ListScheduling(SSA::SSABasicBlock& block);
     
-    // Software pipelining
-    void SoftwarePipelining(const AdvancedOptimizer::Loop& loop);
+    // Cycles the block takes in its current order on the cost model
+    int EstimateCycles(SSA::SSABasicBlock& block);
+    
+    // Software pipelining; true if the loop was rewritten
+    bool SoftwarePipelining(SSA::SSAFunction& func, const AdvancedOptimizer::Loop& loop);
+    
+    struct BlockEstimate {
+        std::string block;
+        int cycles_before;
+        int cycles_after;
+    };
+    
+    // Estimated cycles per iteration of a pipelined loop
+    struct LoopEstimate {
+        std::string loop;
+        int cycles_before;
+        int initiation_interval;   // Cycles per iteration of the kernel
+        int stages;
+    };
+    
+    struct Stats {
+        int blocks_scheduled = 0;      // Blocks whose order changed
+        int cycles_before = 0;         // Estimated, summed over all blocks seen
+        int cycles_after = 0;
+        std::vector<BlockEstimate> blocks;
+        
+        int loops_pipelined = 0;
+        int pipeline_rejected_shape = 0;     // Not a counted single-body loop
+        int pipeline_rejected_cost = 0;      // No II below the unpipelined cycles
+        int pipeline_rejected_pressure = 0;  // Schedules found, all over the register budget
+        std::vector<LoopEstimate> loops;
+        
+        void Print(const std::string& label) const;
+    };
+    
+    const Stats& GetStats() const { return stats_; }
 
 private:
-    struct InstructionNode {
-        SSA::SSAInstruction* instr;
-        std::vector<InstructionNode*> predecessors;
-        std::vector<InstructionNode*> successors;
-        int earliest_start;
-        int latest_start;
+    struct PipelinePlan;
+    
+    X64::MachineModel model_;
+    X64::TargetABI abi_;
+    Stats stats_;
+    
+    bool AnalyzePipelineLoop(SSA::SSAFunction& func, const AdvancedOptimizer::Loop& loop,
+                             PipelinePlan& plan);
+    void BuildPipelineEdges(PipelinePlan& plan);
+    int ComputeResMII(const PipelinePlan& plan) const;
+    int ComputeRecMII(const PipelinePlan& plan) const;
+    bool ModuloSchedule(PipelinePlan& plan, int ii);
+    bool FitsRegisterBudget(const PipelinePlan& plan) const;
+    void EmitPipelinedLoop(SSA::SSAFunction& func, PipelinePlan& plan);
+    
+    // DAG over block instructions [first, end): phis before 'first' are
+    // available at cycle 0
+    std::vector<X64::ScheduleNode> BuildDAG(SSA::SSABasicBlock& block, size_t first);
+    int GetLatency(SSA::SSAInstruction* instr);
+};
+
+// ============================================================================
+// LOOP NEST OPTIMIZER
+// Polyhedral-lite: perfect two-deep nests 'for i in [si, ni) for j in
+// [sj, nj)' of counted loops with invariant bounds and a single body block.
+// Every address must be affine in i and j with constant coefficients
+// (base + a*i + b*j + c). Pairs of accesses give dependence distance
+// vectors; with none of direction (<, >) the nest is fully permutable, so
+// both interchange and rectangular tiling are legal. Tiles are sized so a
+// tile's lines fit in half of L1 (or of L2 when even small tiles do not),
+// and nests with constant bounds are replayed through a CacheSimulator,
+// which confirms the new order misses less and may pick a smaller tile.
+// ============================================================================
+
+class LoopNestOptimizer {
+public:
+    LoopNestOptimizer();
+    
+    void SetCacheConfig(const CacheConfig& config) { cache_ = config; }
+    const CacheConfig& GetCacheConfig() const { return cache_; }
+    
+    // Interchange and/or tile every legal, profitable nest; returns nests changed
+    int OptimizeLoopNests(SSA::SSAFunction& func);
+    
+    struct NestReport {
+        std::string nest;              // Outer header
+        bool interchanged;
+        int tile_size;                 // Iterations per tile side, 0 if not tiled
+        bool simulated;                // Misses below come from the cache simulator
+        uint64_t misses_before;
+        uint64_t misses_after;
     };
     
-    std::vector<InstructionNode> BuildDAG(SSA::SSABasicBlock& block);
-    int GetLatency(SSA::SSAInstruction* instr);
+    struct Stats {
+        int nests_analyzed = 0;
+        int nests_interchanged = 0;
+        int nests_tiled = 0;
+        int rejected_shape = 0;        // Not a perfect rectangular nest with affine accesses
+        int rejected_dependence = 0;   // A (<, >) dependence forbids reordering
+        int rejected_cost = 0;         // Cache model or simulation predicts no gain
+        std::vector<NestReport> nests;
+        
+        void Print(const std::string& label) const;
+    };
+    
+    const Stats& GetStats() const { return stats_; }
+
+private:
+    struct LoopNest;
+    
+    CacheConfig cache_;
+    Stats stats_;
+    
+    bool AnalyzeNest(SSA::SSAFunction& func, const AdvancedOptimizer::Loop& inner, LoopNest& nest);
+    bool IsFullyPermutable(const LoopNest& nest) const;
+    double MissesPerIteration(const LoopNest& nest, bool interchanged) const;
+    int ChooseTileSize(const LoopNest& nest, bool interchanged) const;
+    bool SimulateNest(const LoopNest& nest, bool interchanged, int tile, uint64_t& misses) const;
+    void Interchange(SSA::SSAFunction& func, LoopNest& nest);
+    void Tile(SSA::SSAFunction& func, LoopNest& nest, int tile);
+};
+
+// ============================================================================
+// PREFETCH INSERTION
+// Software prefetches for the strided streams of innermost single-body
+// loops. An access whose address is base + sum(coef_k * iv_k) + c, with
+// base invariant and iv_k induction phis, advances a fixed stride per
+// iteration; accesses of one stream that share a line share a prefetch.
+// The distance in iterations covers the memory latency with the body's
+// estimated cycles. Read-only streams of loops whose footprint overflows
+// L2 (or is unbounded) are fetched non-temporally, everything else into
+// all cache levels.
+// ============================================================================
+
+class PrefetchInserter {
+public:
+    PrefetchInserter();
+    
+    void SetMicroArch(X64::MicroArch arch);
+    void SetCacheConfig(const CacheConfig& config) { cache_ = config; }
+    
+    // Prefetch every profitable innermost loop; returns prefetches inserted
+    int InsertPrefetches(SSA::SSAFunction& func);
+    
+    // Estimated cycles per iteration, stalls assuming every new line misses
+    // all cache levels and nothing overlaps the miss
+    struct LoopReport {
+        std::string loop;
+        int streams;
+        int distance;                  // Iterations ahead
+        int body_cycles_before;
+        int body_cycles_after;
+        double stalls_before;
+        double stalls_after;
+    };
+    
+    struct Stats {
+        int loops_analyzed = 0;
+        int loops_prefetched = 0;
+        int prefetches_inserted = 0;
+        int nontemporal = 0;           // prefetchnta among the above
+        int rejected_shape = 0;        // Not a single-body loop, or no strided stream
+        int rejected_cost = 0;         // Too few iterations, or the prefetches cost more than they hide
+        std::vector<LoopReport> loops;
+        
+        void Print(const std::string& label) const;
+    };
+    
+    const Stats& GetStats() const { return stats_; }
+
+private:
+    struct LoopStreams;
+    
+    InstructionScheduler scheduler_;   // Body cycle estimates
+    CacheConfig cache_;
+    Stats stats_;
+    
+    bool AnalyzeLoop(const AdvancedOptimizer::Loop& loop, LoopStreams& streams);
+    bool PrefetchLoop(SSA::SSAFunction& func, LoopStreams& streams);
 };
 
 } // namespace AdvancedOptimization
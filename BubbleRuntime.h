@@ -90,6 +90,68 @@ private:
     PerformanceCounters perf_counters_;
 };
 
+// ============================================================================
+// CACHE SIMULATION
+// Set-associative cache with LRU replacement. Only tags are kept, so it can
+// replay address traces cheaply; the loop-nest optimizer uses it to check
+// that interchange and tiling actually cut misses.
+// ============================================================================
+
+struct CacheSimulator {
+    size_t size = 0;
+    int associativity = 1;
+    int line_size = 64;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    
+    // Empties the cache and clears the counters
+    void Configure(size_t bytes, int ways, int line);
+    
+    // True on a hit; a miss brings the line in over the set's LRU line
+    bool Access(uint64_t address);
+    
+    double MissRate() const {
+        uint64_t total = hits + misses;
+        return total ? static_cast<double>(misses) / total : 0.0;
+    }
+
+private:
+    size_t sets_ = 0;
+    std::vector<uint64_t> ways_;  // sets_ x associativity line tags + 1, most recent first; 0 = empty
+};
+
+inline void CacheSimulator::Configure(size_t bytes, int ways, int line) {
+    size = bytes;
+    associativity = ways > 0 ? ways : 1;
+    line_size = line > 0 ? line : 64;
+    sets_ = size / (static_cast<size_t>(associativity) * line_size);
+    if (sets_ == 0) sets_ = 1;
+    ways_.assign(sets_ * associativity, 0);
+    hits = 0;
+    misses = 0;
+}
+
+inline bool CacheSimulator::Access(uint64_t address) {
+    if (ways_.empty()) Configure(size ? size : 32 * 1024, associativity, line_size);
+    
+    uint64_t tag = address / line_size + 1;
+    uint64_t* set = &ways_[(tag % sets_) * associativity];
+    int way = 0;
+    while (way < associativity && set[way] != tag) way++;
+    
+    bool hit = way < associativity;
+    if (!hit) way = associativity - 1;
+    for (int w = way; w > 0; w--) set[w] = set[w - 1];
+    set[0] = tag;
+    
+    if (hit) {
+        hits++;
+    } else {
+        misses++;
+    }
+    return hit;
+}
+
 // ============================================================================
 // ASTROLAKE HARDWARE SIMULATION
 // ============================================================================
@@ -143,16 +205,6 @@ private:
     Telemetry telemetry_;
     
 // Cache simulation
-    struct CacheSimulator {
-        size_t size;
-        int associativity;
-        int line_size;
-        uint64_t hits;
-      uint64_t misses;
- 
-        bool Access(uint64_t address);
-    };
-    
     CacheSimulator l1_cache_;
     CacheSimulator l2_cache_;
     CacheSimulator l3_cache_;
@@ -257,6 +309,26 @@ private:
     bool MatchesPattern(const SSA::SSAModule& module, const std::string& pattern);
 };
 
+// Anything that has run 'threshold' times is worth optimizing: a function
+// by its call count, a loop by its back-edge count (block_counts, keyed by
+// loop header)
+inline AdaptiveReoptimizer::AdaptiveReoptimizer() : reopt_threshold_(1000.0) {
+}
+
+inline void AdaptiveReoptimizer::SetReoptimizationThreshold(double threshold) {
+    reopt_threshold_ = threshold;
+}
+
+inline bool AdaptiveReoptimizer::ShouldReoptimize(const AdvancedOptimization::ProfileData& profile) {
+    for (const auto& entry : profile.call_counts) {
+        if (entry.second >= reopt_threshold_) return true;
+    }
+    for (const auto& entry : profile.block_counts) {
+        if (entry.second >= reopt_threshold_) return true;
+    }
+    return false;
+}
+
 // ============================================================================
 // BUBBLE RUNTIME MANAGER
 // ============================================================================
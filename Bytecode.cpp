@@ -0,0 +1,453 @@
+#include "Bytecode.h"
+#include <algorithm>
+#include <iomanip>
+
+namespace Snow {
+namespace VM {
+
+namespace {
+
+// Operand words that follow each opcode, not counting CALL arguments
+int GetOperandWords(Bytecode op) {
+    switch (op) {
+        case Bytecode::MOV:
+        case Bytecode::LOAD:
+        case Bytecode::WAIT:
+        case Bytecode::CALL:        // Argument count; the arguments follow it
+        case Bytecode::CALLN:
+            return 1;
+        case Bytecode::STORE:
+        case Bytecode::ADD:
+        case Bytecode::SUB:
+        case Bytecode::MUL:
+        case Bytecode::DIV:
+        case Bytecode::CMP:
+        case Bytecode::DODECAP:
+        case Bytecode::SAMPLE:
+        case Bytecode::DELTA:
+        case Bytecode::CMP_JE:
+        case Bytecode::CMP_JNE:
+        case Bytecode::CMP_JG:
+        case Bytecode::CMP_JL:
+        case Bytecode::CMP_JGE:
+        case Bytecode::CMP_JLE:
+            return 2;
+        case Bytecode::MOV_ADD:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+Bytecode GetBranchBytecode(IR::OpCode op) {
+    switch (op) {
+        case IR::OpCode::JE:  return Bytecode::JE;
+        case IR::OpCode::JNE: return Bytecode::JNE;
+        case IR::OpCode::JG:  return Bytecode::JG;
+        case IR::OpCode::JL:  return Bytecode::JL;
+        case IR::OpCode::JGE: return Bytecode::JGE;
+        case IR::OpCode::JLE: return Bytecode::JLE;
+        default:              return Bytecode::JMP;
+    }
+}
+
+Bytecode GetFusedBranch(IR::OpCode op) {
+    switch (op) {
+        case IR::OpCode::JE:  return Bytecode::CMP_JE;
+        case IR::OpCode::JNE: return Bytecode::CMP_JNE;
+        case IR::OpCode::JG:  return Bytecode::CMP_JG;
+        case IR::OpCode::JL:  return Bytecode::CMP_JL;
+        case IR::OpCode::JGE: return Bytecode::CMP_JGE;
+        default:              return Bytecode::CMP_JLE;
+    }
+}
+
+bool IsSimpleSource(const IR::Operand& op) {
+    return op.type == IR::OperandType::Register || op.type == IR::OperandType::Immediate;
+}
+
+} // anonymous namespace
+
+const char* GetBytecodeName(Bytecode op) {
+    static const char* const names[] = {
+        "MOV", "LOAD", "STORE", "ADD", "SUB", "MUL", "DIV", "CMP",
+        "JMP", "JE", "JNE", "JG", "JL", "JGE", "JLE",
+        "CALL", "CALLN", "RET", "WAIT", "DODECAP", "SAMPLE", "DELTA",
+        "CMP_JE", "CMP_JNE", "CMP_JG", "CMP_JL", "CMP_JGE", "CMP_JLE", "MOV_ADD"
+    };
+    static_assert(sizeof(names) / sizeof(names[0]) == static_cast<size_t>(Bytecode::Count),
+                  "name table out of sync with Bytecode");
+    return op < Bytecode::Count ? names[static_cast<int>(op)] : "???";
+}
+
+// ============================================================================
+// BYTECODE MODULE
+// ============================================================================
+
+int BytecodeModule::FindFunction(const std::string& name) const {
+    for (size_t i = 0; i < functions.size(); i++) {
+        if (functions[i].name == name) return static_cast<int>(i);
+    }
+    return -1;
+}
+
+void BytecodeModule::Disassemble(std::ostream& out) const {
+    auto source = [this](uint32_t word) {
+        if (word & 1) return "#" + std::to_string(constants[word >> 1]);
+        return "R" + std::to_string(word >> 1);
+    };
+
+    for (const auto& func : functions) {
+        uint32_t end = static_cast<uint32_t>(code.size());
+        for (const auto& other : functions) {
+            if (other.entry > func.entry) end = std::min(end, other.entry);
+        }
+
+        out << "function " << func.name << " (" << func.parameters << " params, "
+            << func.registers << " registers)\n";
+        for (uint32_t pc = func.entry; pc < end;) {
+            uint32_t word = code[pc];
+            Bytecode op = DecodeOpcode(word);
+            uint32_t a = DecodeA(word);
+            out << "  " << std::setw(5) << pc << "  " << std::left << std::setw(8) << GetBytecodeName(op) << std::right;
+            const uint32_t* operands = &code[pc + 1];
+            switch (op) {
+                case Bytecode::MOV:
+                case Bytecode::LOAD:
+                    out << " R" << a << ", " << source(operands[0]);
+                    break;
+                case Bytecode::STORE:
+                case Bytecode::CMP:
+                    out << " " << source(operands[0]) << ", " << source(operands[1]);
+                    break;
+                case Bytecode::ADD:
+                case Bytecode::SUB:
+                case Bytecode::MUL:
+                case Bytecode::DIV:
+                    out << " R" << a << ", " << source(operands[0]) << ", " << source(operands[1]);
+                    break;
+                case Bytecode::CALL:
+                case Bytecode::CALLN:
+                    out << " " << (op == Bytecode::CALL ? functions[a].name : natives[a]) << "(";
+                    for (uint32_t i = 0; i < operands[0]; i++) {
+                        out << (i ? ", " : "") << source(operands[1 + i]);
+                    }
+                    out << ")";
+                    pc += operands[0];
+                    break;
+                case Bytecode::WAIT:
+                    out << " " << source(operands[0]);
+                    break;
+                case Bytecode::DODECAP:
+                case Bytecode::SAMPLE:
+                case Bytecode::DELTA:
+                    out << " R" << a << ", " << source(operands[0]) << " @" << operands[1];
+                    break;
+                case Bytecode::CMP_JE:
+                case Bytecode::CMP_JNE:
+                case Bytecode::CMP_JG:
+                case Bytecode::CMP_JL:
+                case Bytecode::CMP_JGE:
+                case Bytecode::CMP_JLE:
+                    out << " " << source(operands[0]) << ", " << source(operands[1]) << " -> " << a;
+                    break;
+                case Bytecode::MOV_ADD:
+                    out << " R" << a << ", " << source(operands[0]) << "; R" << operands[1] << ", "
+                        << source(operands[2]) << ", " << source(operands[3]);
+                    break;
+                case Bytecode::RET:
+                    break;
+                default:
+                    out << " -> " << a;
+                    break;
+            }
+            out << "\n";
+            pc += 1 + GetOperandWords(op);
+        }
+    }
+    out << constants.size() << " constants, " << code.size() << " words\n";
+}
+
+// ============================================================================
+// BYTECODE COMPILER
+// ============================================================================
+
+BytecodeCompiler::BytecodeCompiler()
+    : superinstructions_(true), fused_(0), output_(nullptr), function_(nullptr), scratch_(0) {
+}
+
+bool BytecodeCompiler::Fail(const std::string& message) {
+    error_ = message;
+    return false;
+}
+
+bool BytecodeCompiler::Compile(const IR::Module& module, BytecodeModule& output) {
+    output = BytecodeModule();
+    output_ = &output;
+    error_.clear();
+    fused_ = 0;
+    constant_index_.clear();
+    native_index_.clear();
+    function_index_.clear();
+
+    for (const auto& func : module.GetFunctions()) {
+        function_index_[func->GetName()] = static_cast<uint32_t>(output.functions.size());
+        BytecodeFunction info;
+        info.name = func->GetName();
+        output.functions.push_back(info);
+    }
+    for (size_t i = 0; i < module.GetFunctions().size(); i++) {
+        if (!CompileFunction(*module.GetFunctions()[i], output.functions[i])) return false;
+    }
+    return true;
+}
+
+bool BytecodeCompiler::CompileFunction(const IR::Function& func, BytecodeFunction& info) {
+    function_ = &func;
+    labels_.clear();
+    fixups_.clear();
+
+    // Every register the function touches is part of its frame, R0 included
+    uint32_t registers = std::max<uint32_t>(std::max(func.GetRegisterCount(), 1),
+                                            static_cast<uint32_t>(func.GetParameters().size()));
+    std::vector<int> used;
+    for (const auto& block : func.GetBlocks()) {
+        for (const auto& instr : block->GetInstructions()) {
+            used.clear();
+            instr.GetUsedRegisters(used);
+            used.push_back(instr.GetDefinedRegister());
+            for (int reg : used) registers = std::max<uint32_t>(registers, reg + 1);
+        }
+    }
+    // Two scratch registers at the top of the frame hold memory operands
+    scratch_ = registers;
+    info.entry = static_cast<uint32_t>(output_->code.size());
+    info.registers = registers + 2;
+    info.parameters = static_cast<uint32_t>(func.GetParameters().size());
+    if (info.registers > kMaxFieldA) return Fail("Too many registers in " + func.GetName());
+
+    bool terminated = false;
+    for (const auto& block : func.GetBlocks()) {
+        labels_[block->GetName()] = static_cast<uint32_t>(output_->code.size());
+        const auto& instrs = block->GetInstructions();
+        terminated = false;
+        for (size_t i = 0; i < instrs.size(); i++) {
+            if (superinstructions_ && i + 1 < instrs.size() && CompileFused(instrs[i], instrs[i + 1])) {
+                terminated = instrs[++i].IsTerminator();
+                continue;
+            }
+            if (!CompileInstruction(instrs[i])) return false;
+            terminated = instrs[i].IsTerminator();
+        }
+    }
+    // Falling off the end returns R0
+    if (!terminated) Emit(Bytecode::RET);
+
+    for (const auto& fixup : fixups_) {
+        auto target = labels_.find(fixup.label);
+        if (target == labels_.end()) {
+            return Fail("Unknown label '" + fixup.label + "' in function " + func.GetName());
+        }
+        if (target->second > kMaxFieldA) return Fail("Function " + func.GetName() + " is too large");
+        uint32_t& word = output_->code[fixup.position];
+        word = EncodeInstruction(DecodeOpcode(word), target->second);
+    }
+    return true;
+}
+
+bool BytecodeCompiler::CompileFused(const IR::Instruction& first, const IR::Instruction& second) {
+    if (first.opcode == IR::OpCode::CMP && second.IsConditionalBranch() &&
+        IsSimpleSource(first.dest) && IsSimpleSource(first.src1)) {
+        Emit(GetFusedBranch(second.opcode));
+        fixups_.push_back(Fixup{ output_->code.size() - 1, second.dest.label });
+        EmitSource(first.dest);
+        EmitSource(first.src1);
+        fused_++;
+        return true;
+    }
+    if (first.opcode == IR::OpCode::MOV && second.opcode == IR::OpCode::ADD &&
+        first.dest.type == IR::OperandType::Register && second.dest.type == IR::OperandType::Register &&
+        IsSimpleSource(first.src1) && IsSimpleSource(second.src1) && IsSimpleSource(second.src2)) {
+        Emit(Bytecode::MOV_ADD, GetRegister(first.dest));
+        EmitSource(first.src1);
+        EmitWord(GetRegister(second.dest));
+        EmitSource(second.src1);
+        EmitSource(second.src2);
+        fused_++;
+        return true;
+    }
+    return false;
+}
+
+bool BytecodeCompiler::CompileInstruction(const IR::Instruction& original) {
+    // Memory operands are loaded into the scratch registers first
+    IR::Instruction instr = original;
+    uint32_t scratch = scratch_;
+    auto materialize = [&](IR::Operand& op) {
+        if (op.type == IR::OperandType::Label) {
+            op = IR::Operand::Immediate(0);
+        } else if (op.type == IR::OperandType::Memory) {
+            Emit(Bytecode::LOAD, scratch);
+            EmitWord((GetConstant(op.value) << 1) | 1);
+            op = IR::Operand::Register(static_cast<int>(scratch++));
+        }
+    };
+    switch (instr.opcode) {
+        case IR::OpCode::STORE:
+            if (instr.dest.type == IR::OperandType::Memory) instr.dest = IR::Operand::Immediate(instr.dest.value);
+            materialize(instr.dest);
+            materialize(instr.src1);
+            break;
+        case IR::OpCode::CMP:
+        case IR::OpCode::WAIT:
+            materialize(instr.dest);
+            materialize(instr.src1);
+            break;
+        case IR::OpCode::LOAD:
+        case IR::OpCode::MOV:
+            // A memory operand already reads through its address
+            if (instr.src1.type == IR::OperandType::Memory) {
+                instr.opcode = IR::OpCode::LOAD;
+                instr.src1 = IR::Operand::Immediate(instr.src1.value);
+            }
+            materialize(instr.src1);
+            break;
+        case IR::OpCode::CALL:
+            break;
+        default:
+            materialize(instr.src1);
+            materialize(instr.src2);
+            break;
+    }
+
+    switch (instr.opcode) {
+        case IR::OpCode::MOV:
+        case IR::OpCode::LOAD:
+            Emit(instr.opcode == IR::OpCode::MOV ? Bytecode::MOV : Bytecode::LOAD, GetRegister(instr.dest));
+            EmitSource(instr.src1);
+            break;
+
+        case IR::OpCode::STORE:
+            Emit(Bytecode::STORE);
+            EmitSource(instr.dest);
+            EmitSource(instr.src1);
+            break;
+
+        case IR::OpCode::ADD:
+        case IR::OpCode::SUB:
+        case IR::OpCode::MUL:
+        case IR::OpCode::DIV: {
+            Bytecode op = instr.opcode == IR::OpCode::ADD ? Bytecode::ADD
+                        : instr.opcode == IR::OpCode::SUB ? Bytecode::SUB
+                        : instr.opcode == IR::OpCode::MUL ? Bytecode::MUL : Bytecode::DIV;
+            Emit(op, GetRegister(instr.dest));
+            EmitSource(instr.src1);
+            EmitSource(instr.src2);
+            break;
+        }
+
+        case IR::OpCode::CMP:
+            Emit(Bytecode::CMP);
+            EmitSource(instr.dest);
+            EmitSource(instr.src1);
+            break;
+
+        case IR::OpCode::JMP:
+        case IR::OpCode::JE:
+        case IR::OpCode::JNE:
+        case IR::OpCode::JG:
+        case IR::OpCode::JL:
+        case IR::OpCode::JGE:
+        case IR::OpCode::JLE:
+            EmitBranch(GetBranchBytecode(instr.opcode), instr.dest.label);
+            break;
+
+        case IR::OpCode::CALL: {
+            // Result is in R0 by convention
+            auto callee = function_index_.find(instr.dest.label);
+            if (callee != function_index_.end()) {
+                Emit(Bytecode::CALL, callee->second);
+            } else {
+                auto native = native_index_.find(instr.dest.label);
+                if (native == native_index_.end()) {
+                    native = native_index_.emplace(instr.dest.label,
+                                                   static_cast<uint32_t>(output_->natives.size())).first;
+                    output_->natives.push_back(instr.dest.label);
+                }
+                Emit(Bytecode::CALLN, native->second);
+            }
+            EmitWord(static_cast<uint32_t>(instr.arguments.size()));
+            for (auto arg : instr.arguments) {
+                if (arg.type == IR::OperandType::Label) arg = IR::Operand::Immediate(0);
+                if (arg.type == IR::OperandType::Memory) {
+                    return Fail("Memory operand as a call argument in " + function_->GetName());
+                }
+                EmitSource(arg);
+            }
+            break;
+        }
+
+        case IR::OpCode::RET:
+            Emit(Bytecode::RET);
+            break;
+
+        case IR::OpCode::WAIT:
+            Emit(Bytecode::WAIT);
+            EmitSource(instr.dest);
+            break;
+
+        case IR::OpCode::DODECAP:
+        case IR::OpCode::SAMPLE:
+        case IR::OpCode::DELTA: {
+            Bytecode op = instr.opcode == IR::OpCode::DODECAP ? Bytecode::DODECAP
+                        : instr.opcode == IR::OpCode::SAMPLE ? Bytecode::SAMPLE : Bytecode::DELTA;
+            Emit(op, GetRegister(instr.dest));
+            EmitSource(instr.src1);
+            EmitWord(output_->sites++);
+            break;
+        }
+
+        case IR::OpCode::LABEL:
+            labels_[instr.dest.label] = static_cast<uint32_t>(output_->code.size());
+            break;
+
+        case IR::OpCode::NOP:
+            break;
+    }
+    return true;
+}
+
+void BytecodeCompiler::Emit(Bytecode op, uint32_t a) {
+    output_->code.push_back(EncodeInstruction(op, a));
+}
+
+void BytecodeCompiler::EmitSource(const IR::Operand& op) {
+    if (op.type == IR::OperandType::Register) {
+        EmitWord(static_cast<uint32_t>(op.value) << 1);
+    } else {
+        EmitWord((GetConstant(op.value) << 1) | 1);
+    }
+}
+
+void BytecodeCompiler::EmitBranch(Bytecode op, const std::string& label) {
+    Emit(op);
+    fixups_.push_back(Fixup{ output_->code.size() - 1, label });
+}
+
+uint32_t BytecodeCompiler::GetConstant(int64_t value) {
+    auto found = constant_index_.find(value);
+    if (found != constant_index_.end()) return found->second;
+    uint32_t index = static_cast<uint32_t>(output_->constants.size());
+    output_->constants.push_back(value);
+    constant_index_[value] = index;
+    return index;
+}
+
+uint32_t BytecodeCompiler::GetRegister(const IR::Operand& op) {
+    // Writes to anything but a register go to the scratch slot
+    if (op.type != IR::OperandType::Register) return scratch_ + 1;
+    return static_cast<uint32_t>(op.value);
+}
+
+} // namespace VM
+} // namespace Snow
@@ -0,0 +1,148 @@
+#pragma once
+
+#include "../IR/IR.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <ostream>
+#include <cstdint>
+
+namespace Snow {
+namespace VM {
+
+// ============================================================================
+// BYTECODE FORMAT
+// Register-based and dense: every instruction is one 32-bit word, opcode in
+// the low 8 bits and a 24-bit field A above it, followed by operand words.
+//
+//   A       destination register, branch target (word offset), function
+//           or native index, depending on the opcode
+//   source  (index << 1) | 1 for constant pool entry 'index',
+//           (index << 1)     for register 'index'
+//
+// Labels are resolved to word offsets at compile time. Superinstructions
+// fuse common pairs into one dispatch: CMP+Jcc, and MOV followed by ADD.
+// ============================================================================
+
+enum class Bytecode : uint8_t {
+    MOV,        // A=dest, src
+    LOAD,       // A=dest, src (address)
+    STORE,      // src (address), src (value)
+    ADD,        // A=dest, src, src
+    SUB,
+    MUL,
+    DIV,
+    CMP,        // src, src
+    JMP,        // A=target
+    JE,
+    JNE,
+    JG,
+    JL,
+    JGE,
+    JLE,
+    CALL,       // A=function, count, src * count
+    CALLN,      // A=native, count, src * count
+    RET,
+    WAIT,       // src (nanoseconds)
+    DODECAP,    // A=dest, src, site
+    SAMPLE,     // A=dest, src, site
+    DELTA,      // A=dest, src, site
+
+    // Superinstructions
+    CMP_JE,     // A=target, src, src
+    CMP_JNE,
+    CMP_JG,
+    CMP_JL,
+    CMP_JGE,
+    CMP_JLE,
+    MOV_ADD,    // A=dest of MOV, src, dest of ADD, src, src
+
+    Count
+};
+
+const char* GetBytecodeName(Bytecode op);
+
+inline uint32_t EncodeInstruction(Bytecode op, uint32_t a = 0) {
+    return static_cast<uint32_t>(op) | (a << 8);
+}
+
+inline Bytecode DecodeOpcode(uint32_t word) { return static_cast<Bytecode>(word & 0xFF); }
+inline uint32_t DecodeA(uint32_t word) { return word >> 8; }
+
+const uint32_t kMaxFieldA = (1u << 24) - 1;
+
+struct BytecodeFunction {
+    std::string name;
+    uint32_t entry = 0;         // Word offset of the first instruction
+    uint32_t registers = 1;     // Frame size; parameter k is register k
+    uint32_t parameters = 0;
+};
+
+class BytecodeModule {
+public:
+    std::vector<uint32_t> code;
+    std::vector<int64_t> constants;
+    std::vector<BytecodeFunction> functions;
+    std::vector<std::string> natives;   // Runtime functions, bound by the VM
+    uint32_t sites = 0;                 // DODECAP/SAMPLE/DELTA state slots
+
+    int FindFunction(const std::string& name) const;   // -1 if missing
+    size_t GetSizeInBytes() const { return code.size() * sizeof(uint32_t) + constants.size() * sizeof(int64_t); }
+    void Disassemble(std::ostream& out) const;
+};
+
+// ============================================================================
+// BYTECODE COMPILER
+// Lowers IR to bytecode. Every IR register keeps its number, so the frame of
+// a function is as large as its highest register.
+// ============================================================================
+
+class BytecodeCompiler {
+public:
+    BytecodeCompiler();
+
+    // Fuse CMP+Jcc and MOV+ADD (default on)
+    void SetSuperinstructions(bool enable) { superinstructions_ = enable; }
+
+    bool Compile(const IR::Module& module, BytecodeModule& output);
+
+    size_t GetFusedCount() const { return fused_; }
+    const std::string& GetError() const { return error_; }
+
+private:
+    struct Fixup {
+        size_t position;        // Word holding the target in field A
+        std::string label;
+    };
+
+    bool superinstructions_;
+    size_t fused_;
+    std::string error_;
+
+    BytecodeModule* output_;
+    std::unordered_map<int64_t, uint32_t> constant_index_;
+    std::unordered_map<std::string, uint32_t> native_index_;
+    std::unordered_map<std::string, uint32_t> function_index_;
+
+    // Per-function state
+    std::unordered_map<std::string, uint32_t> labels_;
+    std::vector<Fixup> fixups_;
+    const IR::Function* function_;
+    uint32_t scratch_;          // First of the two scratch registers
+
+    bool CompileFunction(const IR::Function& func, BytecodeFunction& info);
+    bool CompileInstruction(const IR::Instruction& instr);
+    bool CompileFused(const IR::Instruction& first, const IR::Instruction& second);
+
+    void Emit(Bytecode op, uint32_t a = 0);
+    void EmitWord(uint32_t word) { output_->code.push_back(word); }
+    void EmitSource(const IR::Operand& op);
+    void EmitBranch(Bytecode op, const std::string& label);
+    uint32_t GetConstant(int64_t value);
+    uint32_t GetRegister(const IR::Operand& op);
+
+    bool Fail(const std::string& message);
+};
+
+} // namespace VM
+} // namespace Snow
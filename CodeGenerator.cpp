@@ -1,6 +1,11 @@
 #include "CodeGenerator.h"
+#include "DivisionMagic.h"
 #include <iostream>
-#include <unordered_map>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include <set>
 
 namespace Snow {
 
@@ -8,278 +13,1534 @@ namespace Snow {
 // CODE GENERATOR IMPLEMENTATION
 // ============================================================================
 
-CodeGenerator::CodeGenerator() {
+namespace {
+
+bool FitsImm32(int64_t value) {
+    return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+// Software prefetch limits, as in the SSA PrefetchInserter
+const int kCacheLineSize = 64;
+const int kMaxPrefetchDistance = 64;        // Iterations ahead
+const int64_t kMaxPrefetchBytes = 4096;     // Bytes ahead, about a page
+
+const char* GetJumpMnemonic(IR::OpCode opcode) {
+    switch (opcode) {
+        case IR::OpCode::JE: return "je";
+        case IR::OpCode::JNE: return "jne";
+        case IR::OpCode::JG: return "jg";
+        case IR::OpCode::JL: return "jl";
+        case IR::OpCode::JGE: return "jge";
+        case IR::OpCode::JLE: return "jle";
+        default: return "jmp";
+    }
+}
+
+PEGenerator::Condition GetJumpCondition(IR::OpCode opcode) {
+    switch (opcode) {
+        case IR::OpCode::JNE: return PEGenerator::Condition::NE;
+        case IR::OpCode::JG: return PEGenerator::Condition::G;
+        case IR::OpCode::JL: return PEGenerator::Condition::L;
+        case IR::OpCode::JGE: return PEGenerator::Condition::GE;
+        case IR::OpCode::JLE: return PEGenerator::Condition::LE;
+        default: return PEGenerator::Condition::E;
+    }
+}
+
+// An address as a sum of scaled virtual registers plus a displacement
+struct AddressTerm {
+    int vreg;
+    int64_t scale;
+};
+
+bool FitsAddressImmediate(int64_t value) {
+    return value > -(int64_t(1) << 31) && value < (int64_t(1) << 31);
+}
+
+// Map the terms onto base + index*scale + disp, if x86 can encode them
+bool MakeAddressMode(std::vector<AddressTerm> terms, int64_t displacement,
+                     int& base, int& index, int& scale) {
+    if (!FitsImm32(displacement)) return false;
+
+    // Merge repeated registers: [a + a] is a*2
+    for (size_t i = 0; i < terms.size(); ++i) {
+        for (size_t j = i + 1; j < terms.size(); ) {
+            if (terms[j].vreg == terms[i].vreg) {
+                terms[i].scale += terms[j].scale;
+                terms.erase(terms.begin() + j);
+            } else {
+                ++j;
+            }
+        }
+    }
+
+    auto is_scale = [](int64_t s) { return s == 1 || s == 2 || s == 4 || s == 8; };
+    base = index = -1;
+    scale = 1;
+    if (terms.empty()) return true;
+    if (terms.size() == 1) {
+        int64_t s = terms[0].scale;
+        if (s == 1) {
+            base = terms[0].vreg;
+        } else if (is_scale(s)) {
+            index = terms[0].vreg;
+        } else if (s == 3 || s == 5 || s == 9) {
+            base = index = terms[0].vreg;
+            s -= 1;
+        } else {
+            return false;
+        }
+        scale = static_cast<int>(s);
+        return true;
+    }
+    if (terms.size() == 2) {
+        if (terms[0].scale != 1) std::swap(terms[0], terms[1]);
+        if (terms[0].scale != 1 || !is_scale(terms[1].scale)) return false;
+        base = terms[0].vreg;
+        index = terms[1].vreg;
+        scale = static_cast<int>(terms[1].scale);
+        return true;
+    }
+    return false;
+}
+
+// Rewrite one scaled term through the instruction that defines it
+bool ExpandAddressTerm(const IR::Instruction& def, int64_t scale,
+                       std::vector<AddressTerm>& terms, int64_t& displacement) {
+    const IR::Operand& a = def.src1;
+    const IR::Operand& b = def.src2;
+    auto is_reg = [](const IR::Operand& op) { return op.type == IR::OperandType::Register; };
+    auto is_imm = [](const IR::Operand& op) {
+        return op.type == IR::OperandType::Immediate && FitsAddressImmediate(op.value);
+    };
+
+    switch (def.opcode) {
+        case IR::OpCode::MOV:
+            if (is_reg(a)) {
+                terms.push_back({ static_cast<int>(a.value), scale });
+            } else if (is_imm(a)) {
+                displacement += scale * a.value;
+            } else {
+                return false;
+            }
+            return true;
+
+        case IR::OpCode::ADD:
+            if (is_reg(a) && is_reg(b)) {
+                terms.push_back({ static_cast<int>(a.value), scale });
+                terms.push_back({ static_cast<int>(b.value), scale });
+            } else if (is_reg(a) && is_imm(b)) {
+                terms.push_back({ static_cast<int>(a.value), scale });
+                displacement += scale * b.value;
+            } else if (is_imm(a) && is_reg(b)) {
+                terms.push_back({ static_cast<int>(b.value), scale });
+                displacement += scale * a.value;
+            } else {
+                return false;
+            }
+            return true;
+
+        case IR::OpCode::SUB:
+            if (!is_reg(a) || !is_imm(b)) return false;
+            terms.push_back({ static_cast<int>(a.value), scale });
+            displacement -= scale * b.value;
+            return true;
+
+        case IR::OpCode::MUL:
+            if (is_reg(a) && is_imm(b) && b.value > 0 && b.value <= 8) {
+                terms.push_back({ static_cast<int>(a.value), scale * b.value });
+            } else if (is_imm(a) && is_reg(b) && a.value > 0 && a.value <= 8) {
+                terms.push_back({ static_cast<int>(b.value), scale * a.value });
+            } else {
+                return false;
+            }
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+void PatchRel32(std::vector<uint8_t>& code, size_t position, int64_t target) {
+    int32_t rel = static_cast<int32_t>(target - static_cast<int64_t>(position + 4));
+    for (int i = 0; i < 4; ++i) code[position + i] = static_cast<uint8_t>(rel >> (8 * i));
+}
+
+} // namespace
+
+CodeGenerator::CodeGenerator()
+    : abi_(X64::TargetABI::SysV), emit_assembly_(false), verbose_(false), codegen_ms_(0.0),
+      allocator_(X64::TargetABI::SysV),
+      frame_size_(0), frame_pointer_(true), position_(0), fixup_counter_(0),
+      prefetching_(false), memory_latency_(0), issue_width_(1) {
+}
+
+void CodeGenerator::SetPrefetching(bool enable, X64::MicroArch arch) {
+    X64::MachineModel model = X64::MachineModel::Get(arch);
+    prefetching_ = enable;
+    memory_latency_ = model.memory_latency;
+    issue_width_ = model.issue_width;
 }
 
 bool CodeGenerator::Generate(const IR::Module& module, const std::string& output_path) {
-    output_.open(output_path);
-  if (!output_.is_open()) {
- std::cerr << "Error: Could not open output file: " << output_path << std::endl;
-        return false;
+    auto start = std::chrono::steady_clock::now();
+    error_.clear();
+    code_.clear();
+    functions_.clear();
+    function_offsets_.clear();
+    call_fixups_.clear();
+    selection_totals_ = SelectionStats();
+    prefetch_totals_ = PrefetchStats();
+    frame_totals_ = FrameStats();
+
+    if (emit_assembly_) {
+        output_.open(output_path);
+        if (!output_.is_open()) {
+            std::cerr << "Error: Could not open output file: " << output_path << std::endl;
+            return false;
+        }
+    }
+
+    std::cout << (emit_assembly_ ? "\n[CodeGen] Generating x86_64 assembly..."
+                                 : "\n[CodeGen] Generating x86_64 machine code...") << std::endl;
+
+    allocator_ = LinearScanAllocator(abi_);
+    alloc_totals_ = LinearScanAllocator::Stats();
+
+    if (emit_assembly_) {
+        // Emit assembly header
+        output_ << "; Snow Programming Language - Generated Assembly\n";
+        output_ << (abi_ == X64::TargetABI::Win64
+            ? "; Target: x86_64 Windows PE\n\n" : "; Target: x86_64 System V\n\n");
+
+        // Calls to functions outside the module are left to the linker
+        std::set<std::string> defined;
+        std::set<std::string> external = { "_snow_wait" };
+        for (const auto& func : module.GetFunctions()) {
+            defined.insert(func->GetName());
+        }
+        for (const auto& func : module.GetFunctions()) {
+            for (const auto& block : func->GetBlocks()) {
+                for (const auto& instr : block->GetInstructions()) {
+                    if (instr.opcode == IR::OpCode::CALL && !defined.count(instr.dest.label)) {
+                        external.insert(instr.dest.label);
+                    }
+                }
+            }
+        }
+
+        output_ << "section .text\n";
+        output_ << "global main\n";
+        for (const auto& name : external) {
+            output_ << "extern " << name << "\n";
+        }
+        output_ << "\n";
     }
-  
-    std::cout << "\n[CodeGen] Generating x86_64 assembly..." << std::endl;
-    
-    // Emit assembly header
-    output_ << "; Snow Programming Language - Generated Assembly\n";
-    output_ << "; Target: x86_64 Windows PE\n\n";
-    
-    output_ << "section .text\n";
-    output_ << "global main\n\n";
-    
+
     // Generate code for each function
     for (const auto& func : module.GetFunctions()) {
         GenerateFunction(*func);
+        if (!error_.empty()) break;
+    }
+
+    bool ok = error_.empty();
+    if (emit_assembly_) {
+        output_.close();
+    } else if (ok) {
+        ok = WriteObject(output_path);
+    }
+    codegen_ms_ = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+
+    if (!ok) {
+        std::cerr << "Error: " << error_ << std::endl;
+        return false;
+    }
+
+    std::cout << "[CodeGen] Register allocation: " << alloc_totals_.intervals << " intervals, "
+              << alloc_totals_.splits << " splits, "
+              << alloc_totals_.spilled_registers << " values spilled, "
+              << alloc_totals_.call_saves << " saves and " << alloc_totals_.call_restores
+              << " reloads around calls" << std::endl;
+    std::cout << "[CodeGen] Instruction selection: " << selection_totals_.folded
+              << " instructions folded into addresses, " << selection_totals_.lea << " lea, "
+              << selection_totals_.imul_immediate << " imul with immediate" << std::endl;
+    if (prefetching_) {
+        std::cout << "[CodeGen] Prefetch: " << prefetch_totals_.prefetches << " prefetches in "
+                  << prefetch_totals_.loops << " loops" << std::endl;
+    }
+    std::cout << "[CodeGen] Stack frames: " << frame_totals_.frameless << " of "
+              << frame_totals_.functions << " functions without a frame pointer, "
+              << frame_totals_.saved << " callee-saved registers pushed, "
+              << frame_totals_.bytes << " bytes of spill slots and call areas" << std::endl;
+    if (!emit_assembly_) {
+        FunctionStats total;
+        for (const auto& function : functions_) {
+            if (verbose_) {
+                std::cout << "[CodeGen]   " << function.name << ": " << function.near_size << " -> "
+                          << function.size << " bytes (" << function.short_branches << " of "
+                          << function.short_branches + function.long_branches << " branches short, "
+                          << function.padding << " bytes of loop padding)" << std::endl;
+            }
+            total.size += function.size;
+            total.near_size += function.near_size;
+            total.short_branches += function.short_branches;
+            total.long_branches += function.long_branches;
+            total.padding += function.padding;
+        }
+        std::cout << "[CodeGen] " << total.size << " bytes of machine code (" << total.near_size
+                  << " with near branches only), " << total.short_branches << " short and "
+                  << total.long_branches << " near branches, " << total.padding
+                  << " bytes of loop padding" << std::endl;
     }
-    
-    output_.close();
     std::cout << "[CodeGen] Code generation complete: " << output_path << std::endl;
-    
+
+    return true;
+}
+
+bool CodeGenerator::WriteObject(const std::string& output_path) {
+    PEGenerator::ELFWriter writer;
+    ResolveCalls(writer);
+
+    // Only main is exported, as in the assembly. Loop padding assumes the
+    // section is at least as aligned as the loops.
+    if (relaxer_.GetLoopAlignment() > 1) {
+        writer.AlignSection(PEGenerator::ELFSection::Text,
+                            static_cast<uint64_t>(relaxer_.GetLoopAlignment()));
+    }
+    writer.AddCode(code_);
+    for (const auto& function : functions_) {
+        writer.DefineSymbol(function.name, PEGenerator::ELFSection::Text, function.offset,
+                            function.size, function.name == "main");
+    }
+
+    if (!writer.WriteObject(output_path)) {
+        error_ = writer.GetError();
+        return false;
+    }
     return true;
 }
 
+void CodeGenerator::ResolveCalls(PEGenerator::ELFWriter& writer) {
+    // Calls within the module are patched here; the rest are left to the linker
+    for (const auto& fixup : call_fixups_) {
+        auto it = function_offsets_.find(fixup.label);
+        if (it != function_offsets_.end()) {
+            PatchRel32(code_, fixup.position, static_cast<int64_t>(it->second));
+            continue;
+        }
+        writer.AddRelocation(PEGenerator::ELFSection::Text, fixup.position, fixup.label);
+    }
+}
+
 std::string CodeGenerator::GetRegisterName(int reg) {
-    // Map virtual registers to x86_64 registers
-    // Using a simple mapping for now
-    static const char* regs[] = {
-        "rax", "rbx", "rcx", "rdx", "rsi", "rdi", "r8", "r9",
-     "r10", "r11", "r12", "r13", "r14", "r15"
-    };
-    
-    if (reg >= 0 && reg < 14) {
-    return regs[reg];
+    return X64::GetRegisterName(reg);
+}
+
+void CodeGenerator::ComputeFrameLayout(const IR::Function& func) {
+    // The outgoing argument area at the bottom of the frame is shared by all
+    // calls, so no call site has to adjust rsp. A sibling tail call leaves
+    // through the epilogue first and needs neither the area nor alignment.
+    const X64::ABIInfo& abi = X64::GetABIInfo(abi_);
+    int register_args = static_cast<int>(abi.argument_registers.size());
+    bool has_calls = false;
+    int stack_args = 0;
+    for (const auto& block : func.GetBlocks()) {
+        const auto& instructions = block->GetInstructions();
+        for (size_t i = 0; i < instructions.size(); ++i) {
+            const IR::Instruction& instr = instructions[i];
+            if (instr.opcode != IR::OpCode::CALL && instr.opcode != IR::OpCode::WAIT) continue;
+            if (IsSiblingTailCall(instructions, i)) continue;
+            has_calls = true;
+            stack_args = std::max(stack_args, static_cast<int>(instr.arguments.size()) - register_args);
+        }
+    }
+
+    int saved = static_cast<int>(allocator_.GetUsedCalleeSaved().size());
+    frame_size_ = allocator_.GetSpillSlotCount() * 8;
+    frame_pointer_ = has_calls || frame_size_ > 0;
+    if (has_calls) {
+        frame_size_ += abi.shadow_space + 8 * stack_args;
+
+        // Keep rsp 16-byte aligned at call sites (rbp push already re-aligned it)
+        if ((saved * 8 + frame_size_) % 16 != 0) {
+            frame_size_ += 8;
+        }
+    }
+
+    frame_totals_.functions++;
+    frame_totals_.frameless += frame_pointer_ ? 0 : 1;
+    frame_totals_.saved += saved;
+    frame_totals_.bytes += frame_size_;
+}
+
+void CodeGenerator::SelectInstructions(const IR::Function& func) {
+    addresses_.clear();
+    folded_.clear();
+    selection_.clear();
+
+    // A value can only be folded away if nothing else ever reads it
+    std::unordered_map<int, int> def_count;
+    std::unordered_map<int, int> use_count;
+    std::vector<int> used;
+    for (const auto& block : func.GetBlocks()) {
+        for (const auto& instr : block->GetInstructions()) {
+            int def = instr.GetDefinedRegister();
+            if (def >= 0) def_count[def]++;
+            used.clear();
+            instr.GetUsedRegisters(used);
+            for (int v : used) use_count[v]++;
+        }
+    }
+
+    // Greedy maximal munch over each LOAD/STORE address: keep rewriting a term
+    // through its defining instruction while the result is still one x86
+    // addressing mode. R0 is read implicitly by RET, so it is never folded.
+    for (const auto& block : func.GetBlocks()) {
+        const auto& instrs = block->GetInstructions();
+        std::unordered_map<int, size_t> last_def;   // Within this block, so far
+
+        for (size_t i = 0; i < instrs.size(); ++i) {
+            const IR::Instruction& instr = instrs[i];
+            const IR::Operand* address = instr.opcode == IR::OpCode::LOAD ? &instr.src1 :
+                                         instr.opcode == IR::OpCode::STORE ? &instr.dest : nullptr;
+
+            if (address && address->type == IR::OperandType::Register) {
+                std::vector<AddressTerm> terms = { { static_cast<int>(address->value), 1 } };
+                int64_t displacement = 0;
+                std::vector<const IR::Instruction*> folded;
+                AddressMode mode;
+                mode.base = terms[0].vreg;
+
+                bool changed = true;
+                while (changed) {
+                    changed = false;
+                    for (size_t k = 0; k < terms.size() && !changed; ++k) {
+                        int v = terms[k].vreg;
+                        auto def = last_def.find(v);
+                        if (v == 0 || def == last_def.end() ||
+                            def_count[v] != 1 || use_count[v] != 1) {
+                            continue;
+                        }
+
+                        const IR::Instruction& source = instrs[def->second];
+                        std::vector<AddressTerm> next = terms;
+                        next.erase(next.begin() + k);
+                        int64_t next_displacement = displacement;
+                        if (!ExpandAddressTerm(source, terms[k].scale, next, next_displacement)) {
+                            continue;
+                        }
+
+                        // The operands must still hold the same values here
+                        bool stable = true;
+                        used.clear();
+                        source.GetUsedRegisters(used);
+                        for (int u : used) {
+                            auto redef = last_def.find(u);
+                            if (redef != last_def.end() && redef->second >= def->second) stable = false;
+                        }
+
+                        AddressMode next_mode;
+                        if (stable && MakeAddressMode(next, next_displacement, next_mode.base,
+                                                      next_mode.index, next_mode.scale)) {
+                            next_mode.displacement = next_displacement;
+                            terms = next;
+                            displacement = next_displacement;
+                            mode = next_mode;
+                            folded.push_back(&source);
+                            changed = true;
+                        }
+                    }
+                }
+
+                addresses_[&instr] = mode;
+                if (!folded.empty()) {
+                    LinearScanAllocator::SelectedUses uses;
+                    if (mode.base >= 0) uses.reads.push_back(mode.base);
+                    if (mode.index >= 0) uses.reads.push_back(mode.index);
+                    if (instr.opcode == IR::OpCode::STORE && instr.src1.type == IR::OperandType::Register) {
+                        uses.reads.push_back(static_cast<int>(instr.src1.value));
+                    }
+                    selection_[&instr] = uses;
+
+                    for (const IR::Instruction* f : folded) {
+                        LinearScanAllocator::SelectedUses none;
+                        none.writes = false;
+                        selection_[f] = none;
+                        folded_.insert(f);
+                    }
+                }
+            }
+
+            int def = instr.GetDefinedRegister();
+            if (def >= 0) last_def[def] = i;
+        }
+    }
+
+    selection_totals_.folded += static_cast<int>(folded_.size());
+}
+
+// ============================================================================
+// SOFTWARE PREFETCH
+// A basic induction variable of an innermost loop is a register whose only
+// definition in the loop is 'ADD r, r, imm' or 'SUB r, r, imm' on every path
+// to the back edge; multiples of it and sums with loop-invariant values are
+// derived ones. An access whose folded address adds induction variables to
+// loop-invariant registers walks memory with a fixed stride. Accesses with the
+// same base, index and scale form a stream, and each stream gets one
+// prefetch per cache line it touches per iteration, at the first access to
+// the line. The distance in iterations covers the memory latency with the
+// loop's instructions issued at the model's issue width. Unlike the SSA
+// PrefetchInserter this never uses prefetchnta: on a streaming sum the
+// lines it fetched were gone again before the loads reached them.
+// ============================================================================
+
+void CodeGenerator::PlanPrefetches(const IR::Function& func) {
+    prefetches_.clear();
+    if (!prefetching_) return;
+
+    IR::LoopInfo info(func);
+    const IR::ControlFlowGraph& cfg = info.GetCFG();
+    for (const IR::Loop& loop : info.GetLoops()) {
+        if (!loop.children.empty()) continue;
+
+        std::unordered_map<int, int> defs;
+        int instructions = 0;
+        for (int b : loop.blocks) {
+            for (const auto& instr : cfg.GetBlock(b)->GetInstructions()) {
+                int def = instr.GetDefinedRegister();
+                if (def >= 0) defs[def]++;
+                instructions++;
+            }
+        }
+
+        // Definitions that run on every iteration
+        std::vector<const IR::Instruction*> updates;
+        for (int b : loop.blocks) {
+            bool every_iteration = true;
+            for (int latch : loop.latches) {
+                every_iteration = every_iteration && info.GetDominators().Dominates(b, latch);
+            }
+            if (!every_iteration) continue;
+
+            for (const auto& instr : cfg.GetBlock(b)->GetInstructions()) {
+                int def = instr.GetDefinedRegister();
+                if (def >= 0 && defs[def] == 1 && instr.dest.type == IR::OperandType::Register) {
+                    updates.push_back(&instr);
+                }
+            }
+        }
+
+        // Basic induction variables, then values derived from them (i * k,
+        // i + invariant) until nothing changes
+        std::unordered_map<int, int64_t> steps;
+        for (const IR::Instruction* instr : updates) {
+            if ((instr->opcode == IR::OpCode::ADD || instr->opcode == IR::OpCode::SUB) &&
+                instr->src1.type == IR::OperandType::Register && instr->src1.value == instr->dest.value &&
+                instr->src2.type == IR::OperandType::Immediate && instr->src2.value != 0) {
+                steps[static_cast<int>(instr->dest.value)] =
+                    instr->opcode == IR::OpCode::ADD ? instr->src2.value : -instr->src2.value;
+            }
+        }
+        auto invariant = [&](const IR::Operand& op) {
+            return op.type == IR::OperandType::Immediate ||
+                   (op.type == IR::OperandType::Register && !defs.count(static_cast<int>(op.value)));
+        };
+        auto step_of = [&](const IR::Operand& op, int64_t& step) {
+            if (op.type != IR::OperandType::Register) return false;
+            auto it = steps.find(static_cast<int>(op.value));
+            if (it == steps.end()) return false;
+            step = it->second;
+            return true;
+        };
+        bool changed = !steps.empty();
+        while (changed) {
+            changed = false;
+            for (const IR::Instruction* instr : updates) {
+                int reg = static_cast<int>(instr->dest.value);
+                if (steps.count(reg)) continue;
+
+                int64_t step = 0;
+                if (instr->opcode == IR::OpCode::MUL) {
+                    if (step_of(instr->src1, step) && instr->src2.type == IR::OperandType::Immediate) {
+                        step *= instr->src2.value;
+                    } else if (step_of(instr->src2, step) && instr->src1.type == IR::OperandType::Immediate) {
+                        step *= instr->src1.value;
+                    } else {
+                        continue;
+                    }
+                } else if (instr->opcode == IR::OpCode::ADD) {
+                    if (!(step_of(instr->src1, step) && invariant(instr->src2)) &&
+                        !(step_of(instr->src2, step) && invariant(instr->src1))) {
+                        continue;
+                    }
+                } else if (instr->opcode == IR::OpCode::SUB) {
+                    if (!step_of(instr->src1, step) || !invariant(instr->src2)) continue;
+                } else {
+                    continue;
+                }
+                if (step == 0) continue;
+                steps[reg] = step;
+                changed = true;
+            }
+        }
+        if (steps.empty()) continue;
+
+        struct Stream {
+            AddressMode mode;
+            int64_t stride = 0;
+            std::vector<std::pair<int64_t, const IR::Instruction*>> accesses;  // By displacement
+        };
+        std::vector<Stream> streams;
+        for (int b : loop.blocks) {
+            for (const auto& instr : cfg.GetBlock(b)->GetInstructions()) {
+                auto it = addresses_.find(&instr);
+                if (it == addresses_.end()) continue;
+
+                const AddressMode& mode = it->second;
+                int64_t stride = 0;
+                bool strided = true;
+                auto add_term = [&](int reg, int64_t scale) {
+                    if (reg < 0) return;
+                    auto step = steps.find(reg);
+                    if (step != steps.end()) {
+                        stride += step->second * scale;
+                    } else if (defs.count(reg)) {
+                        strided = false;    // Changes in the loop, but not by a constant
+                    }
+                };
+                add_term(mode.base, 1);
+                add_term(mode.index, mode.scale);
+                if (!strided || stride == 0) continue;
+
+                Stream* stream = nullptr;
+                for (auto& candidate : streams) {
+                    if (candidate.mode.base == mode.base && candidate.mode.index == mode.index &&
+                        candidate.mode.scale == mode.scale) {
+                        stream = &candidate;
+                    }
+                }
+                if (!stream) {
+                    streams.push_back(Stream());
+                    stream = &streams.back();
+                    stream->mode = mode;
+                    stream->stride = stride;
+                }
+                stream->accesses.push_back(std::make_pair(mode.displacement, &instr));
+            }
+        }
+        if (streams.empty()) continue;
+
+        int cycles = std::max(1, (instructions + issue_width_ - 1) / issue_width_);
+        int distance = std::min(kMaxPrefetchDistance, (memory_latency_ + cycles - 1) / cycles);
+        if (loop.trip_count >= 0 && loop.trip_count <= distance) continue;
+
+        for (auto& stream : streams) {
+            int64_t stride = std::abs(stream.stride);
+            int64_t ahead = std::max<int64_t>(1, std::min<int64_t>(distance, kMaxPrefetchBytes / stride));
+
+            std::stable_sort(stream.accesses.begin(), stream.accesses.end(),
+                             [](const std::pair<int64_t, const IR::Instruction*>& a,
+                                const std::pair<int64_t, const IR::Instruction*>& b) {
+                                 return a.first < b.first;
+                             });
+            bool first = true;
+            int64_t line_start = 0;
+            for (const auto& access : stream.accesses) {
+                if (!first && access.first < line_start + kCacheLineSize) continue;
+                first = false;
+                line_start = access.first;
+                prefetches_[access.second] = ahead * stream.stride;
+                prefetch_totals_.prefetches++;
+            }
+        }
+        prefetch_totals_.loops++;
     }
-    
-    // For overflow, use stack
-  return "[rbp-" + std::to_string((reg - 14 + 1) * 8) + "]";
 }
 
 void CodeGenerator::GenerateFunction(const IR::Function& func) {
-    output_ << "; Function: " << func.GetName() << "\n";
-    output_ << func.GetName() << ":\n";
-    
+    function_name_ = func.GetName();
+    SelectInstructions(func);
+    PlanPrefetches(func);
+    allocator_.Allocate(func, &selection_);
+    ComputeFrameLayout(func);
+    edge_fixups_.clear();
+    relaxer_.Reset();
+
+    const auto& stats = allocator_.GetStats();
+    alloc_totals_.intervals += stats.intervals;
+    alloc_totals_.splits += stats.splits;
+    alloc_totals_.spilled_registers += stats.spilled_registers;
+    alloc_totals_.call_saves += stats.call_saves;
+    alloc_totals_.call_restores += stats.call_restores;
+
+    size_t start = code_.size();
+    size_t first_call = call_fixups_.size();
+    if (emit_assembly_) {
+        output_ << "; Function: " << func.GetName() << "\n";
+        output_ << func.GetName() << ":\n";
+    } else {
+        function_offsets_.insert({ function_name_, start });
+    }
+
     EmitPrologue();
-    
+    MoveParameters(func);
+
     // Generate code for each basic block
-  for (const auto& block : func.GetBlocks()) {
+    const IR::ControlFlowGraph& cfg = allocator_.GetCFG();
+    bool terminated = false;
+    for (int b = 0; b < cfg.GetBlockCount(); ++b) {
+        const IR::BasicBlock* block = cfg.GetBlock(b);
         if (block->GetName() != "entry") {
- EmitLabel(block->GetName());
+            EmitLabel(block->GetName());
+            terminated = false;
+        }
+
+        const auto& instructions = block->GetInstructions();
+        for (size_t i = 0; i < instructions.size(); ++i) {
+            const IR::Instruction& instr = instructions[i];
+            position_ = allocator_.GetPosition(b, static_cast<int>(i));
+
+            EmitReloads(allocator_.GetReloadsAt(position_));
+            if (folded_.count(&instr)) {
+                continue;   // Part of a later LOAD/STORE address
+            }
+            if (IsSiblingTailCall(instructions, i)) {
+                // The callee returns straight to our caller; the RET is folded in
+                EmitTailCall(instr);
+                terminated = true;
+                ++i;
+                continue;
+            }
+            if (instr.IsBranch()) {
+                GenerateBranch(instr, b);
+            } else {
+                GenerateInstruction(instr);
+            }
+            EmitStoreAfterDef(instr);
+            terminated = instr.IsTerminator();
+        }
+
+        int next = cfg.GetFallthrough(b);
+        if (next >= 0) {
+            EmitReloads(allocator_.GetEdgeReloads(b, next));
+        }
     }
-        
-        for (const auto& instr : block->GetInstructions()) {
-GenerateInstruction(instr);
+
+    if (!terminated) {
+        EmitEpilogue();
+    }
+
+    for (const auto& fixup : edge_fixups_) {
+        EmitLabel(fixup.label);
+        EmitReloads(fixup.reloads);
+        EmitJump(IR::OpCode::JMP, fixup.target);
+    }
+
+    if (emit_assembly_) {
+        output_ << "\n";
+        return;
+    }
+
+    if (!relaxer_.Relax(code_, start, emitter_)) {
+        error_ = relaxer_.GetError() + " in function '" + function_name_ + "'";
+        return;
+    }
+    for (size_t i = first_call; i < call_fixups_.size(); ++i) {
+        call_fixups_[i].position = relaxer_.MapPosition(call_fixups_[i].position);
+    }
+
+    const auto& relaxed = relaxer_.GetStats();
+    FunctionStats info;
+    info.name = function_name_;
+    info.offset = start;
+    info.size = code_.size() - start;
+    info.near_size = relaxed.near_size;
+    info.short_branches = relaxed.short_branches;
+    info.long_branches = relaxed.long_branches;
+    info.padding = relaxed.padding;
+    functions_.push_back(info);
+}
+
+void CodeGenerator::GenerateBranch(const IR::Instruction& instr, int block) {
+    const std::string& label = instr.dest.label;
+    int target = allocator_.GetCFG().GetBlockIndex(label);
+    std::vector<std::pair<int, int>> reloads;
+    if (target >= 0) {
+        reloads = allocator_.GetEdgeReloads(block, target);
+    }
+
+    if (instr.opcode == IR::OpCode::JMP) {
+        EmitReloads(reloads);
+        EmitJump(IR::OpCode::JMP, label);
+        return;
+    }
+
+    // Reloads on a conditional edge must not disturb the fall-through path,
+    // so they go into a fix-up stub emitted after the function body
+    std::string dest = label;
+    if (!reloads.empty()) {
+        dest = function_name_ + "_edge" + std::to_string(fixup_counter_++);
+        edge_fixups_.push_back({ dest, reloads, label });
+    }
+
+    EmitJump(instr.opcode, dest);
+}
+
+bool CodeGenerator::AsmOperand::operator==(const AsmOperand& other) const {
+    return kind == other.kind && reg == other.reg && index == other.index && scale == other.scale &&
+           value == other.value && label == other.label;
+}
+
+CodeGenerator::AsmOperand CodeGenerator::GetOperand(const IR::Operand& op, bool is_def) {
+    AsmOperand result;
+
+    switch (op.type) {
+        case IR::OperandType::Immediate:
+            result = ImmediateOperand(op.value);
+            break;
+
+        case IR::OperandType::Register: {
+            Location loc = allocator_.GetLocation(static_cast<int>(op.value),
+                                                  is_def ? position_ + 1 : position_);
+            if (loc.IsRegister()) {
+                result = RegisterOperand(loc.reg);
+            } else if (loc.slot >= 0) {
+                result = SlotOperand(loc.slot);
+            } else {
+                // Never live: a dead definition or a read of an undefined value
+                result = RegisterOperand(X64::R11);
+            }
+            break;
         }
+
+        case IR::OperandType::Memory:
+            // Absolute [disp32]; there is no 64-bit displacement for general operands
+            if (!emit_assembly_ && !FitsImm32(op.value)) {
+                error_ = "Address " + std::to_string(op.value) + " out of 32-bit range in '" +
+                         function_name_ + "'";
+            }
+            result = MemoryOperand(-1, op.value);
+            break;
+
+        case IR::OperandType::Label:
+            result.kind = AsmOperand::Kind::Label;
+            result.label = op.label;
+            break;
     }
-    
-    EmitEpilogue();
-    output_ << "\n";
+
+    return result;
+}
+
+CodeGenerator::AsmOperand CodeGenerator::RegisterOperand(int reg) {
+    AsmOperand op;
+    op.kind = AsmOperand::Kind::Register;
+    op.reg = reg;
+    return op;
+}
+
+CodeGenerator::AsmOperand CodeGenerator::ImmediateOperand(int64_t value) {
+    AsmOperand op;
+    op.kind = AsmOperand::Kind::Immediate;
+    op.value = value;
+    return op;
+}
+
+CodeGenerator::AsmOperand CodeGenerator::MemoryOperand(int base, int64_t displacement) {
+    AsmOperand op;
+    op.kind = AsmOperand::Kind::Memory;
+    op.reg = base;
+    op.value = displacement;
+    return op;
+}
+
+CodeGenerator::AsmOperand CodeGenerator::SlotOperand(int slot) {
+    // Spill slots sit below the saved callee-saved registers
+    int saved = static_cast<int>(allocator_.GetUsedCalleeSaved().size());
+    return MemoryOperand(X64::RBP, -(saved + slot + 1) * 8);
+}
+
+CodeGenerator::AsmOperand CodeGenerator::AddressOperand(const IR::Instruction& instr,
+                                                       const IR::Operand& address) {
+    if (address.type == IR::OperandType::Memory) {
+        return GetOperand(address, false);
+    }
+
+    auto it = addresses_.find(&instr);
+    if (it == addresses_.end()) {
+        EmitMove(RegisterOperand(X64::R11), GetOperand(address, false));
+        return MemoryOperand(X64::R11, 0);
+    }
+
+    // Spilled parts of the address are loaded into scratch registers
+    const AddressMode& mode = it->second;
+    AsmOperand result = MemoryOperand(-1, mode.displacement);
+    if (mode.base >= 0) {
+        AsmOperand base = GetOperand(IR::Operand::Register(mode.base), false);
+        if (!base.IsRegister()) {
+            EmitMov(RegisterOperand(X64::R11), base);
+            base = RegisterOperand(X64::R11);
+        }
+        result.reg = base.reg;
+    }
+    if (mode.index >= 0) {
+        AsmOperand index = GetOperand(IR::Operand::Register(mode.index), false);
+        if (mode.index == mode.base) {
+            index = RegisterOperand(result.reg);
+        } else if (!index.IsRegister()) {
+            EmitMov(RegisterOperand(X64::RDX), index);
+            index = RegisterOperand(X64::RDX);
+        }
+        result.index = index.reg;
+        result.scale = mode.scale;
+    }
+    return result;
+}
+
+PEGenerator::Address CodeGenerator::ToAddress(const AsmOperand& op) {
+    return PEGenerator::Address(op.reg, op.index, op.scale, static_cast<int32_t>(op.value));
+}
+
+std::string CodeGenerator::FormatAddress(const AsmOperand& op) const {
+    std::string text;
+    if (op.reg >= 0) text = X64::GetRegisterName(op.reg);
+    if (op.index >= 0) {
+        if (!text.empty()) text += "+";
+        text += X64::GetRegisterName(op.index);
+        if (op.scale != 1) text += "*" + std::to_string(op.scale);
+    }
+    if (text.empty()) {
+        text = std::to_string(op.value);
+    } else if (op.value > 0) {
+        text += "+" + std::to_string(op.value);
+    } else if (op.value < 0) {
+        text += "-" + std::to_string(-op.value);
+    }
+    return "[" + text + "]";
+}
+
+std::string CodeGenerator::FormatOperand(const AsmOperand& op) const {
+    switch (op.kind) {
+        case AsmOperand::Kind::Register:
+            return X64::GetRegisterName(op.reg);
+        case AsmOperand::Kind::Immediate:
+            return std::to_string(op.value);
+        case AsmOperand::Kind::Label:
+            return op.label;
+        case AsmOperand::Kind::Memory:
+            return "qword " + FormatAddress(op);
+        default:
+            return "";
+    }
+}
+
+void CodeGenerator::EmitReloads(const std::vector<std::pair<int, int>>& reloads) {
+    for (const auto& reload : reloads) {
+        EmitMov(RegisterOperand(reload.first), SlotOperand(reload.second));
+    }
+}
+
+void CodeGenerator::EmitSaves(const std::vector<std::pair<int, int>>& saves) {
+    for (const auto& save : saves) {
+        EmitMov(SlotOperand(save.second), RegisterOperand(save.first));
+    }
+}
+
+void CodeGenerator::EmitStoreAfterDef(const IR::Instruction& instr) {
+    // Split values keep their slot current so any later reload is valid
+    int def = instr.GetDefinedRegister();
+    if (def < 0 || !allocator_.IsSpilled(def)) return;
+
+    Location loc = allocator_.GetLocation(def, position_ + 1);
+    if (loc.IsRegister()) {
+        EmitMov(SlotOperand(loc.slot), RegisterOperand(loc.reg));
+    }
+}
+
+void CodeGenerator::EmitMove(const AsmOperand& dest, const AsmOperand& src) {
+    if (dest == src) return;
+
+    // x86 has no memory-to-memory move and no 64-bit immediate store
+    if (dest.IsMemory() && (src.IsMemory() || (src.IsImmediate() && !FitsImm32(src.value)))) {
+        EmitMov(RegisterOperand(X64::R11), src);
+        EmitMov(dest, RegisterOperand(X64::R11));
+        return;
+    }
+
+    EmitMov(dest, src);
+}
+
+void CodeGenerator::EmitBinary(AsmOp op, const AsmOperand& dest,
+                               const AsmOperand& src1, const AsmOperand& src2, bool commutative) {
+    AsmOperand rhs = src2;
+    if (rhs.IsImmediate() && !FitsImm32(rhs.value)) {
+        EmitMov(RegisterOperand(X64::RAX), rhs);
+        rhs = RegisterOperand(X64::RAX);
+    }
+
+    // dest already holds src2: operate in place when the order doesn't matter
+    if (dest.IsRegister() && dest == rhs) {
+        if (commutative && !src1.IsImmediate()) {
+            EmitInstruction(op, dest, src1);
+            return;
+        }
+        EmitMov(RegisterOperand(X64::RAX), rhs);
+        rhs = RegisterOperand(X64::RAX);
+    }
+
+    // x86: op dest, src (dest = dest op src); compute in dest when it is a register
+    AsmOperand work = dest.IsRegister() ? dest : RegisterOperand(X64::R11);
+    EmitMove(work, src1);
+    EmitInstruction(op, work, rhs);
+    EmitMove(dest, work);
+}
+
+bool CodeGenerator::SelectLea(const IR::Instruction& instr) {
+    // lea is a three-address add (and shift-add) that leaves its sources and
+    // the flags alone; when dest is a source, add/sub in place is as good
+    AsmOperand dest = GetOperand(instr.dest, true);
+    AsmOperand src1 = GetOperand(instr.src1, false);
+    AsmOperand src2 = GetOperand(instr.src2, false);
+    if (!dest.IsRegister()) return false;
+    if (instr.opcode != IR::OpCode::SUB && src1.IsImmediate()) std::swap(src1, src2);
+    if (!src1.IsRegister()) return false;
+
+    AsmOperand address = MemoryOperand(src1.reg, 0);
+    switch (instr.opcode) {
+        case IR::OpCode::ADD:
+            if (src1 == dest || src2 == dest) return false;
+            if (src2.IsRegister()) {
+                address.index = src2.reg;
+            } else if (src2.IsImmediate() && FitsImm32(src2.value)) {
+                address.value = src2.value;
+            } else {
+                return false;
+            }
+            break;
+
+        case IR::OpCode::SUB:
+            if (src1 == dest || !src2.IsImmediate() || !FitsAddressImmediate(src2.value)) return false;
+            address.value = -src2.value;
+            break;
+
+        case IR::OpCode::MUL:
+            if (!src2.IsImmediate()) return false;
+            if (src2.value == 2 || src2.value == 3 || src2.value == 5 || src2.value == 9) {
+                address.index = src1.reg;
+                address.scale = src2.value == 2 ? 1 : static_cast<int>(src2.value - 1);
+            } else {
+                return false;
+            }
+            break;
+
+        default:
+            return false;
+    }
+
+    EmitLea(dest.reg, address);
+    selection_totals_.lea++;
+    return true;
+}
+
+void CodeGenerator::GenerateMultiply(const IR::Instruction& instr) {
+    if (SelectLea(instr)) return;
+
+    AsmOperand dest = GetOperand(instr.dest, true);
+    AsmOperand src1 = GetOperand(instr.src1, false);
+    AsmOperand src2 = GetOperand(instr.src2, false);
+    if (src1.IsImmediate()) std::swap(src1, src2);
+
+    // imul has no memory destination form, but its three-operand form reads
+    // a register or memory source and writes any register
+    int work = dest.IsRegister() ? dest.reg : X64::R11;
+    if (!src1.IsImmediate() && src2.IsImmediate() && FitsImm32(src2.value)) {
+        EmitMulImm(work, src1, static_cast<int32_t>(src2.value));
+        selection_totals_.imul_immediate++;
+    } else {
+        EmitBinary(AsmOp::Imul, RegisterOperand(work), src1, src2, true);
+    }
+    EmitMove(dest, RegisterOperand(work));
 }
 
 void CodeGenerator::GenerateInstruction(const IR::Instruction& instr) {
-    output_ << "    ";
-  
     switch (instr.opcode) {
-        case IR::OpCode::MOV: {
-  std::string dest = (instr.dest.type == IR::OperandType::Register) 
-   ? GetRegisterName(instr.dest.value) : "";
-   std::string src;
-            
-    if (instr.src1.type == IR::OperandType::Immediate) {
-src = std::to_string(instr.src1.value);
-     } else if (instr.src1.type == IR::OperandType::Register) {
-  src = GetRegisterName(instr.src1.value);
-            }
-     
-          EmitMov(dest, src);
-   break;
-        }
-        
-      case IR::OpCode::ADD: {
-      std::string dest = GetRegisterName(instr.dest.value);
-std::string src1 = GetRegisterName(instr.src1.value);
- std::string src2 = (instr.src2.type == IR::OperandType::Immediate)
-? std::to_string(instr.src2.value)
-    : GetRegisterName(instr.src2.value);
-         
-  // x86: add dest, src (dest = dest + src)
-          // We need: dest = src1 + src2
-    if (dest != src1) {
-        EmitMov(dest, src1);
- }
-    output_ << "add " << dest << ", " << src2 << "\n";
-  break;
-        }
-        
- case IR::OpCode::SUB: {
-   std::string dest = GetRegisterName(instr.dest.value);
-            std::string src1 = GetRegisterName(instr.src1.value);
- std::string src2 = (instr.src2.type == IR::OperandType::Immediate)
- ? std::to_string(instr.src2.value)
-: GetRegisterName(instr.src2.value);
-            
-       if (dest != src1) {
-                EmitMov(dest, src1);
-  }
-  output_ << "sub " << dest << ", " << src2 << "\n";
-        break;
-        }
-        
-        case IR::OpCode::MUL: {
-            std::string dest = GetRegisterName(instr.dest.value);
-            std::string src1 = GetRegisterName(instr.src1.value);
- std::string src2 = (instr.src2.type == IR::OperandType::Immediate)
- ? std::to_string(instr.src2.value)
-            : GetRegisterName(instr.src2.value);
-   
-            if (dest != src1) {
-    EmitMov(dest, src1);
-  }
-output_ << "imul " << dest << ", " << src2 << "\n";
-          break;
-      }
-     
-   case IR::OpCode::DIV: {
-   // x86 division uses rax and rdx
- output_ << "xor rdx, rdx\n";
- output_ << "    ";
-            std::string divisor = GetRegisterName(instr.src1.value);
-   output_ << "idiv " << divisor << "\n";
-break;
-        }
-      
-     case IR::OpCode::CMP: {
-   std::string op1 = GetRegisterName(instr.dest.value);
- std::string op2 = (instr.src1.type == IR::OperandType::Immediate)
-           ? std::to_string(instr.src1.value)
-         : GetRegisterName(instr.src1.value);
-     EmitCmp(op1, op2);
-  break;
-        }
-     
-        case IR::OpCode::JMP:
-EmitJmp(instr.dest.label);
-      break;
-            
-   case IR::OpCode::JE:
- EmitJe(instr.dest.label);
-  break;
-     
-        case IR::OpCode::JNE:
-   EmitJne(instr.dest.label);
-       break;
-    
-   case IR::OpCode::JG:
-        EmitJg(instr.dest.label);
+        case IR::OpCode::MOV:
+        case IR::OpCode::DODECAP:   // Copies its source, as in the VM
+            EmitMove(GetOperand(instr.dest, true), GetOperand(instr.src1, false));
+            break;
+
+        case IR::OpCode::LOAD: {
+            AsmOperand address = AddressOperand(instr, instr.src1);
+            EmitPrefetch(instr, address);
+            AsmOperand dest = GetOperand(instr.dest, true);
+            if (dest.IsRegister()) {
+                EmitMov(dest, address);
+            } else {
+                EmitMov(RegisterOperand(X64::R11), address);
+                EmitMove(dest, RegisterOperand(X64::R11));
+            }
+            break;
+        }
+
+        case IR::OpCode::STORE: {
+            AsmOperand address = AddressOperand(instr, instr.dest);
+            EmitPrefetch(instr, address);
+            AsmOperand value = GetOperand(instr.src1, false);
+            if (value.IsMemory() || (value.IsImmediate() && !FitsImm32(value.value))) {
+                EmitMov(RegisterOperand(X64::RAX), value);
+                value = RegisterOperand(X64::RAX);
+            }
+            EmitMov(address, value);
+            break;
+        }
+
+        case IR::OpCode::ADD:
+            if (SelectLea(instr)) break;
+            EmitBinary(AsmOp::Add, GetOperand(instr.dest, true), GetOperand(instr.src1, false),
+                       GetOperand(instr.src2, false), true);
+            break;
+
+        case IR::OpCode::SUB:
+            if (SelectLea(instr)) break;
+            EmitBinary(AsmOp::Sub, GetOperand(instr.dest, true), GetOperand(instr.src1, false),
+                       GetOperand(instr.src2, false), false);
+            break;
+
+        case IR::OpCode::MUL:
+            GenerateMultiply(instr);
+            break;
+
+        case IR::OpCode::DIV: {
+            // x86 division uses rdx:rax, neither of which is ever allocated
+            EmitMove(RegisterOperand(X64::RAX), GetOperand(instr.src1, false));
+            AsmOperand divisor = GetOperand(instr.src2, false);
+            if (divisor.IsImmediate()) {
+                EmitDivImm(divisor.value);
+            } else {
+                EmitDiv(divisor);
+            }
+            EmitMove(GetOperand(instr.dest, true), RegisterOperand(X64::RAX));
             break;
- 
-     case IR::OpCode::JL:
-  EmitJl(instr.dest.label);
-   break;
-    
+        }
+
+        case IR::OpCode::CMP: {
+            AsmOperand op1 = GetOperand(instr.dest, false);
+            AsmOperand op2 = GetOperand(instr.src1, false);
+            if (op2.IsImmediate() && !FitsImm32(op2.value)) {
+                EmitMov(RegisterOperand(X64::RAX), op2);
+                op2 = RegisterOperand(X64::RAX);
+            }
+            if (op1.IsImmediate() || (op1.IsMemory() && op2.IsMemory())) {
+                EmitMov(RegisterOperand(X64::R11), op1);
+                op1 = RegisterOperand(X64::R11);
+            }
+            EmitInstruction(AsmOp::Cmp, op1, op2);
+            break;
+        }
+
         case IR::OpCode::CALL:
+            EmitSaves(allocator_.GetCallSaves(position_));
+            PassArguments(instr.arguments);
             EmitCall(instr.dest.label);
+            EmitReloads(allocator_.GetCallRestores(position_));
+            // Result is in R0 by convention
+            EmitMove(GetOperand(IR::Operand::Register(0), true), RegisterOperand(X64::RAX));
+            break;
+
+        case IR::OpCode::RET:
+            EmitMove(RegisterOperand(X64::RAX), GetOperand(IR::Operand::Register(0), false));
+            EmitRet();
             break;
-         
-   case IR::OpCode::RET:
-   EmitRet();
- break;
-            
+
         case IR::OpCode::WAIT:
             // Call runtime wait function
-      output_ << "mov rdi, " << GetRegisterName(instr.dest.value) << "\n";
-        output_ << "    call _snow_wait\n";
+            EmitSaves(allocator_.GetCallSaves(position_));
+            PassArguments({ instr.dest });
+            EmitCall("_snow_wait");
+            EmitReloads(allocator_.GetCallRestores(position_));
             break;
-            
-        case IR::OpCode::DODECAP:
-   case IR::OpCode::SAMPLE:
+
+        case IR::OpCode::SAMPLE:
         case IR::OpCode::DELTA:
-     // Placeholder for CIAM operations
-    output_ << "; " << instr.ToString() << "\n";
-      break;
-        
+            // Placeholder for CIAM operations
+            if (emit_assembly_) output_ << "    ; " << instr.ToString() << "\n";
+            break;
+
+        case IR::OpCode::LABEL:
+            EmitLabel(instr.dest.label);
+            break;
+
         case IR::OpCode::NOP:
-   output_ << "nop\n";
-   break;
-       
+            if (emit_assembly_) {
+                output_ << "    nop\n";
+            } else {
+                emitter_.EmitNop(code_);
+            }
+            break;
+
         default:
-       output_ << "; Unknown opcode\n";
-  break;
+            if (emit_assembly_) output_ << "    ; Unknown opcode\n";
+            break;
     }
 }
 
 void CodeGenerator::EmitPrologue() {
-    output_ << " push rbp\n";
- output_ << "  mov rbp, rsp\n";
-    output_ << "    sub rsp, 128  ; Local variable space\n";
+    if (frame_pointer_) {
+        EmitPush(X64::RBP);
+        EmitMov(RegisterOperand(X64::RBP), RegisterOperand(X64::RSP));
+    }
+    for (int reg : allocator_.GetUsedCalleeSaved()) {
+        EmitPush(reg);
+    }
+    if (frame_size_ > 0) {
+        if (emit_assembly_) {
+            output_ << "    sub rsp, " << frame_size_ << "  ; Spill slots and call area\n";
+        } else {
+            emitter_.EmitAluImm(code_, PEGenerator::AluOp::Sub, X64::RSP, frame_size_);
+        }
+    }
+}
+
+bool CodeGenerator::IsSiblingTailCall(const std::vector<IR::Instruction>& instructions, size_t index) const {
+    // Marked by the optimizer's tail call pass; later passes must not have
+    // separated the call from its return. Stack arguments would have to go
+    // into our caller's frame, which may be too small for them.
+    return instructions[index].opcode == IR::OpCode::CALL &&
+           instructions[index].comment == "TAIL_CALL" &&
+           instructions[index].arguments.size() <= X64::GetABIInfo(abi_).argument_registers.size() &&
+           index + 1 < instructions.size() &&
+           instructions[index + 1].opcode == IR::OpCode::RET;
+}
+
+void CodeGenerator::EmitTailCall(const IR::Instruction& call) {
+    // Argument registers are all caller-saved, the teardown leaves them alone.
+    // Our return address is then back on top of the stack, exactly as after a call.
+    PassArguments(call.arguments);
+    EmitFrameTeardown();
+    if (emit_assembly_) {
+        EmitJump(IR::OpCode::JMP, call.dest.label);
+        return;
+    }
+    emitter_.EmitJmp(code_, 0);
+    EmitCallFixup(call.dest.label);
+}
+
+void CodeGenerator::MoveParameters(const IR::Function& func) {
+    // Parameter k is register k. Spilled parameters only go to their slot;
+    // the allocator reloads them at the first instruction. Without a frame
+    // pointer, stack parameters are found above the pushed registers.
+    const X64::ABIInfo& abi = X64::GetABIInfo(abi_);
+    int register_args = static_cast<int>(abi.argument_registers.size());
+    int params = static_cast<int>(func.GetParameters().size());
+    int base = frame_pointer_ ? X64::RBP : X64::RSP;
+    int above = frame_pointer_ ? 16 : 8 + 8 * static_cast<int>(allocator_.GetUsedCalleeSaved().size());
+
+    std::vector<std::pair<AsmOperand, AsmOperand>> moves;
+    for (int k = 0; k < params; ++k) {
+        AsmOperand incoming = k < register_args
+            ? RegisterOperand(abi.argument_registers[k])
+            : MemoryOperand(base, above + abi.shadow_space + 8 * (k - register_args));
+        if (allocator_.IsSpilled(k)) {
+            EmitMove(SlotOperand(allocator_.GetSpillSlot(k)), incoming);
+            continue;
+        }
+        Location loc = allocator_.GetLocation(k, 0);
+        if (loc.IsRegister()) {
+            moves.push_back(std::make_pair(RegisterOperand(loc.reg), incoming));
+        }
+    }
+    EmitParallelMove(moves);
+}
+
+void CodeGenerator::PassArguments(const std::vector<IR::Operand>& arguments) {
+    // Stack arguments first, while every source is still in place; they go
+    // above the shadow space in the frame's outgoing area
+    const X64::ABIInfo& abi = X64::GetABIInfo(abi_);
+    size_t register_args = abi.argument_registers.size();
+    for (size_t k = register_args; k < arguments.size(); ++k) {
+        int64_t offset = abi.shadow_space + 8 * static_cast<int64_t>(k - register_args);
+        EmitMove(MemoryOperand(X64::RSP, offset), GetOperand(arguments[k], false));
+    }
+
+    std::vector<std::pair<AsmOperand, AsmOperand>> moves;
+    for (size_t k = 0; k < std::min(arguments.size(), register_args); ++k) {
+        moves.push_back(std::make_pair(RegisterOperand(abi.argument_registers[k]),
+                                       GetOperand(arguments[k], false)));
+    }
+    EmitParallelMove(moves);
+}
+
+void CodeGenerator::EmitParallelMove(std::vector<std::pair<AsmOperand, AsmOperand>> moves) {
+    // Every destination is a distinct register that other moves may still
+    // read: emit a move once nothing pending reads its destination, and break
+    // the cycles that remain by parking one source in r11
+    auto reads = [](const AsmOperand& src, int reg) {
+        return (src.IsRegister() && src.reg == reg) ||
+               (src.IsMemory() && (src.reg == reg || src.index == reg));
+    };
+
+    while (!moves.empty()) {
+        bool emitted = false;
+        for (size_t i = 0; i < moves.size() && !emitted; ++i) {
+            bool blocked = false;
+            for (size_t j = 0; j < moves.size(); ++j) {
+                if (j != i && reads(moves[j].second, moves[i].first.reg)) blocked = true;
+            }
+            if (!blocked) {
+                EmitMove(moves[i].first, moves[i].second);
+                moves.erase(moves.begin() + i);
+                emitted = true;
+            }
+        }
+        if (emitted) continue;
+
+        for (const auto& move : moves) {
+            if (!move.second.IsRegister()) continue;
+            int parked = move.second.reg;
+            EmitMov(RegisterOperand(X64::R11), RegisterOperand(parked));
+            for (auto& other : moves) {
+                if (other.second.IsRegister() && other.second.reg == parked) {
+                    other.second = RegisterOperand(X64::R11);
+                }
+            }
+            break;
+        }
+    }
 }
 
 void CodeGenerator::EmitEpilogue() {
-    output_ << "    mov rsp, rbp\n";
-    output_ << "    pop rbp\n";
-    output_ << "    ret\n";
+    EmitFrameTeardown();
+    if (emit_assembly_) {
+        output_ << "    ret\n";
+    } else {
+        emitter_.EmitRet(code_);
+    }
+}
+
+void CodeGenerator::EmitFrameTeardown() {
+    const auto& saved = allocator_.GetUsedCalleeSaved();
+    if (!saved.empty()) {
+        if (frame_size_ > 0) {
+            int32_t offset = -static_cast<int32_t>(saved.size() * 8);
+            if (emit_assembly_) {
+                output_ << "    lea rsp, [rbp" << offset << "]\n";
+            } else {
+                emitter_.EmitLea(code_, X64::RSP, X64::RBP, offset);
+            }
+        }
+        for (auto it = saved.rbegin(); it != saved.rend(); ++it) {
+            EmitPop(*it);
+        }
+    } else if (frame_size_ > 0) {
+        EmitMov(RegisterOperand(X64::RSP), RegisterOperand(X64::RBP));
+    }
+    if (frame_pointer_) {
+        EmitPop(X64::RBP);
+    }
 }
 
 void CodeGenerator::EmitLabel(const std::string& label) {
-    output_ << label << ":\n";
+    if (emit_assembly_) {
+        output_ << label << ":\n";
+    } else {
+        relaxer_.AddLabel(label, code_.size());
+    }
 }
 
-void CodeGenerator::EmitMov(const std::string& dest, const std::string& src) {
-    output_ << "mov " << dest << ", " << src << "\n";
+void CodeGenerator::EmitMov(const AsmOperand& dest, const AsmOperand& src) {
+    if (emit_assembly_) {
+        output_ << "    mov " << FormatOperand(dest) << ", " << FormatOperand(src) << "\n";
+        return;
+    }
+
+    if (dest.IsRegister()) {
+        switch (src.kind) {
+            case AsmOperand::Kind::Register: emitter_.EmitMov(code_, dest.reg, src.reg); return;
+            case AsmOperand::Kind::Immediate: emitter_.EmitMovImm(code_, dest.reg, src.value); return;
+            case AsmOperand::Kind::Memory: emitter_.EmitLoad(code_, dest.reg, ToAddress(src)); return;
+            default: break;
+        }
+    } else if (dest.IsMemory()) {
+        if (src.IsRegister()) {
+            emitter_.EmitStore(code_, ToAddress(dest), src.reg);
+            return;
+        }
+        if (src.IsImmediate() && FitsImm32(src.value)) {
+            emitter_.EmitStoreImm(code_, ToAddress(dest), static_cast<int32_t>(src.value));
+            return;
+        }
+    }
+    error_ = "Unencodable mov in '" + function_name_ + "'";
 }
 
-void CodeGenerator::EmitAdd(const std::string& dest, const std::string& src1, const std::string& src2) {
-    if (dest != src1) {
-        EmitMov(dest, src1);
+void CodeGenerator::EmitInstruction(AsmOp op, const AsmOperand& dest, const AsmOperand& src) {
+    if (emit_assembly_) {
+        static const char* mnemonics[] = { "add", "sub", "imul", "cmp" };
+        output_ << "    " << mnemonics[static_cast<int>(op)] << " " << FormatOperand(dest)
+                << ", " << FormatOperand(src) << "\n";
+        return;
     }
-    output_ << "    add " << dest << ", " << src2 << "\n";
+
+    // Immediates reaching here always fit in 32 bits
+    int32_t imm = static_cast<int32_t>(src.value);
+    if (op == AsmOp::Imul && dest.IsRegister()) {
+        switch (src.kind) {
+            case AsmOperand::Kind::Register: emitter_.EmitMul(code_, dest.reg, src.reg); return;
+            case AsmOperand::Kind::Immediate: emitter_.EmitMulImm(code_, dest.reg, dest.reg, imm); return;
+            case AsmOperand::Kind::Memory: emitter_.EmitMulLoad(code_, dest.reg, ToAddress(src)); return;
+            default: break;
+        }
+    } else if (op != AsmOp::Imul) {
+        PEGenerator::AluOp alu = op == AsmOp::Add ? PEGenerator::AluOp::Add :
+                                 op == AsmOp::Sub ? PEGenerator::AluOp::Sub : PEGenerator::AluOp::Cmp;
+        if (dest.IsRegister()) {
+            switch (src.kind) {
+                case AsmOperand::Kind::Register: emitter_.EmitAlu(code_, alu, dest.reg, src.reg); return;
+                case AsmOperand::Kind::Immediate: emitter_.EmitAluImm(code_, alu, dest.reg, imm); return;
+                case AsmOperand::Kind::Memory:
+                    emitter_.EmitAluLoad(code_, alu, dest.reg, ToAddress(src));
+                    return;
+                default: break;
+            }
+        } else if (dest.IsMemory()) {
+            if (src.IsRegister()) {
+                emitter_.EmitAluStore(code_, alu, ToAddress(dest), src.reg);
+                return;
+            }
+            if (src.IsImmediate()) {
+                emitter_.EmitAluMemoryImm(code_, alu, ToAddress(dest), imm);
+                return;
+            }
+        }
+    }
+    error_ = "Unencodable instruction in '" + function_name_ + "'";
 }
 
-void CodeGenerator::EmitSub(const std::string& dest, const std::string& src1, const std::string& src2) {
- if (dest != src1) {
-EmitMov(dest, src1);
+void CodeGenerator::EmitDiv(const AsmOperand& divisor) {
+    if (emit_assembly_) {
+        output_ << "    cqo\n";
+        output_ << "    idiv " << FormatOperand(divisor) << "\n";
+    } else if (divisor.IsRegister()) {
+        emitter_.EmitDiv(code_, divisor.reg);
+    } else {
+        emitter_.EmitDivMemory(code_, ToAddress(divisor));
     }
-    output_ << "    sub " << dest << ", " << src2 << "\n";
 }
 
-void CodeGenerator::EmitMul(const std::string& dest, const std::string& src) {
-    output_ << "imul " << dest << ", " << src << "\n";
+// Mirrors MachineCodeEmitter::EmitDivImm, which encodes the machine code
+void CodeGenerator::EmitDivImm(int64_t divisor) {
+    if (!emit_assembly_) {
+        emitter_.EmitDivImm(code_, divisor, X64::R11);
+        return;
+    }
+
+    if (!X64::CanDivideWithoutIdiv(divisor)) {
+        output_ << "    mov r11, " << divisor << "\n";
+        output_ << "    cqo\n";
+        output_ << "    idiv r11\n";
+        return;
+    }
+
+    uint64_t magnitude = divisor < 0 ? 0 - static_cast<uint64_t>(divisor) : static_cast<uint64_t>(divisor);
+    int power = X64::GetPowerOfTwoShift(magnitude);
+    if (power > 0) {
+        output_ << "    mov rdx, rax  ; Signed division by " << divisor << "\n";
+        if (power > 1) output_ << "    sar rdx, 63\n";
+        output_ << "    shr rdx, " << 64 - power << "\n";
+        output_ << "    add rax, rdx\n";
+        output_ << "    sar rax, " << power << "\n";
+    } else if (power < 0) {
+        X64::SignedDivisionMagic magic = X64::ComputeSignedDivisionMagic(divisor);
+        if (magic.multiplier < 0) output_ << "    mov r11, rax\n";
+        output_ << "    mov rdx, " << magic.multiplier << "  ; Signed division by " << divisor << "\n";
+        output_ << "    imul rdx\n";
+        if (magic.multiplier < 0) output_ << "    add rdx, r11\n";
+        if (magic.shift > 0) output_ << "    sar rdx, " << magic.shift << "\n";
+        output_ << "    mov rax, rdx\n";
+        output_ << "    shr rax, 63\n";
+        output_ << "    add rax, rdx\n";
+    }
+    if (divisor < 0) output_ << "    neg rax\n";
 }
 
-void CodeGenerator::EmitDiv(const std::string& divisor) {
-    output_ << "xor rdx, rdx\n";
- output_ << "    idiv " << divisor << "\n";
+void CodeGenerator::EmitLea(int dest, const AsmOperand& address) {
+    if (emit_assembly_) {
+        output_ << "    lea " << GetRegisterName(dest) << ", " << FormatAddress(address) << "\n";
+    } else {
+        emitter_.EmitLea(code_, dest, ToAddress(address));
+    }
 }
 
-void CodeGenerator::EmitCmp(const std::string& op1, const std::string& op2) {
-    output_ << "cmp " << op1 << ", " << op2 << "\n";
+void CodeGenerator::EmitPrefetch(const IR::Instruction& instr, const AsmOperand& address) {
+    auto it = prefetches_.find(&instr);
+    if (it == prefetches_.end() || !FitsImm32(address.value + it->second)) return;
+
+    AsmOperand ahead = address;
+    ahead.value += it->second;
+    if (emit_assembly_) {
+        output_ << "    prefetcht0 " << FormatAddress(ahead) << "\n";
+    } else {
+        emitter_.EmitPrefetch(code_, ToAddress(ahead), 3);
+    }
 }
 
-void CodeGenerator::EmitJmp(const std::string& label) {
-    output_ << "jmp " << label << "\n";
+void CodeGenerator::EmitMulImm(int dest, const AsmOperand& src, int32_t immediate) {
+    if (emit_assembly_) {
+        output_ << "    imul " << GetRegisterName(dest) << ", " << FormatOperand(src) << ", "
+                << immediate << "\n";
+    } else if (src.IsRegister()) {
+        emitter_.EmitMulImm(code_, dest, src.reg, immediate);
+    } else {
+        emitter_.EmitMulImm(code_, dest, ToAddress(src), immediate);
+    }
 }
 
-void CodeGenerator::EmitJe(const std::string& label) {
- output_ << "je " << label << "\n";
+void CodeGenerator::EmitJump(IR::OpCode opcode, const std::string& label) {
+    if (emit_assembly_) {
+        output_ << "    " << GetJumpMnemonic(opcode) << " " << label << "\n";
+        return;
+    }
+
+    // Encoded once the function is complete and every distance is known
+    if (opcode == IR::OpCode::JMP) {
+        relaxer_.AddBranch(code_.size(), label);
+    } else {
+        relaxer_.AddBranch(code_.size(), GetJumpCondition(opcode), label);
+    }
 }
 
-void CodeGenerator::EmitJne(const std::string& label) {
- output_ << "jne " << label << "\n";
+void CodeGenerator::EmitCall(const std::string& function) {
+    if (emit_assembly_) {
+        output_ << "    call " << function << "\n";
+        return;
+    }
+    emitter_.EmitCall(code_, 0);
+    EmitCallFixup(function);
 }
 
-void CodeGenerator::EmitJg(const std::string& label) {
- output_ << "jg " << label << "\n";
+void CodeGenerator::EmitCallFixup(const std::string& function) {
+    call_fixups_.push_back({ code_.size() - 4, function });
 }
 
-void CodeGenerator::EmitJl(const std::string& label) {
-    output_ << "jl " << label << "\n";
+void CodeGenerator::EmitPush(int reg) {
+    if (emit_assembly_) {
+        output_ << "    push " << GetRegisterName(reg) << "\n";
+    } else {
+        emitter_.EmitPush(code_, reg);
+    }
 }
 
-void CodeGenerator::EmitCall(const std::string& function) {
-    output_ << "call " << function << "\n";
+void CodeGenerator::EmitPop(int reg) {
+    if (emit_assembly_) {
+        output_ << "    pop " << GetRegisterName(reg) << "\n";
+    } else {
+        emitter_.EmitPop(code_, reg);
+    }
 }
 
 void CodeGenerator::EmitRet() {
-    // Handled by epilogue
+    // Tear down the frame at every return, not just at the end of the function
+    EmitEpilogue();
 }
 
 } // namespace Snow
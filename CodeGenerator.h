@@ -1,49 +1,232 @@
 #pragma once
 
 #include "../IR/IR.h"
+#include "../PEGenerator/PEGenerator.h"
+#include "../PEGenerator/ELFWriter.h"
+#include "LinearScanAllocator.h"
+#include "X64Target.h"
+#include "MachineModel.h"
 #include <string>
 #include <vector>
+#include <unordered_map>
+#include <unordered_set>
 #include <fstream>
 
 namespace Snow {
 
 // ============================================================================
 // CODE GENERATOR (x86_64)
+// Instructions are selected once and handed to one of two encoders: by
+// default MachineCodeEmitter encodes them straight into a byte buffer that
+// is written out as an ELF64 relocatable object, and with SetEmitAssembly
+// the same instructions are printed as NASM text instead (the -S debug
+// path). Before register allocation, address arithmetic feeding a LOAD or
+// STORE is folded into its [base + index*scale + disp] operand; remaining
+// three-address adds and small multiplies become lea, and multiplies by
+// other constants imul r, r/m, imm; divisions by constants become a
+// multiply-high and shifts. In machine code, labels and branches are
+// recorded symbolically and BranchRelaxer lays out each finished function
+// with the shortest branch encodings and aligned loop headers. Arguments
+// and parameters follow the target's calling convention (SysV or Win64), so
+// the code links against C functions. Calls to module functions are resolved
+// once the whole module is laid out, calls to anything else become
+// relocations against undefined symbols. Leaf functions without spill slots
+// run without an rbp frame; every prologue pushes only the callee-saved
+// registers the allocator used and reserves exactly the slots and call area
+// the function needs. With SetPrefetching, LOAD/STORE streams that step
+// through memory with an induction variable of an innermost loop get a
+// prefetcht0 far enough ahead to cover a miss.
 // ============================================================================
 
 class CodeGenerator {
 public:
     CodeGenerator();
-    
+
+    // Select calling convention (default: SysV, matching the ELF64 objects)
+    void SetTargetABI(X64::TargetABI abi) { abi_ = abi; }
+
+    // Write NASM assembly instead of an object file
+    void SetEmitAssembly(bool enable) { emit_assembly_ = enable; }
+
+    // Loop header alignment in machine code; 0 disables it (default 16)
+    void SetLoopAlignment(int bytes) { relaxer_.SetLoopAlignment(bytes); }
+
+    // prefetcht0 strided streams in innermost loops (default: off), far enough
+    // ahead to cover the model's memory latency
+    void SetPrefetching(bool enable, X64::MicroArch arch = X64::MicroArch::Skylake);
+
+    // Report code size per function
+    void SetVerbose(bool verbose) { verbose_ = verbose; }
+
     // Generate native code from IR
     bool Generate(const IR::Module& module, const std::string& output_path);
-    
+
+    // Per function of the last object file. near_size is what the function
+    // would take with every branch rel32 and no loop padding.
+    struct FunctionStats {
+        std::string name;
+        size_t offset = 0;
+        size_t size = 0;
+        size_t near_size = 0;
+        size_t short_branches = 0;
+        size_t long_branches = 0;
+        size_t padding = 0;
+    };
+
+    // Machine code of the last object file, and how long Generate took
+    const std::vector<uint8_t>& GetCode() const { return code_; }
+    const std::vector<FunctionStats>& GetFunctionStats() const { return functions_; }
+    double GetMilliseconds() const { return codegen_ms_; }
+    const std::string& GetError() const { return error_; }
+
 private:
     std::ofstream output_;
-    
+    X64::TargetABI abi_;
+    bool emit_assembly_;
+    bool verbose_;
+    double codegen_ms_;
+    std::string error_;
+
+    // Binary output
+    struct Fixup {
+        size_t position;        // Offset of the rel32 field
+        std::string label;
+    };
+
+    PEGenerator::MachineCodeEmitter emitter_;
+    PEGenerator::BranchRelaxer relaxer_;
+    std::vector<uint8_t> code_;
+    std::vector<FunctionStats> functions_;
+    std::unordered_map<std::string, size_t> function_offsets_;
+    std::vector<Fixup> call_fixups_;            // Calls and tail jumps, whole module
+
+    // Per-function state
+    LinearScanAllocator allocator_;
+    std::string function_name_;
+    int frame_size_;
+    bool frame_pointer_;        // rbp frame; leaves without spill slots go without
+    int position_;
+    int fixup_counter_;
+    LinearScanAllocator::Stats alloc_totals_;
+
+    struct FrameStats {
+        int functions = 0;
+        int frameless = 0;      // No rbp frame
+        int saved = 0;          // Callee-saved registers pushed
+        int bytes = 0;          // Spill slots, call areas and alignment
+    };
+    FrameStats frame_totals_;
+
+    // Instruction selection. An AddressMode names virtual registers; the
+    // folded instructions emit nothing and their LOAD/STORE uses the mode.
+    struct AddressMode {
+        int base = -1;
+        int index = -1;
+        int scale = 1;
+        int64_t displacement = 0;
+    };
+    struct SelectionStats {
+        int folded = 0;         // Instructions folded into addressing modes
+        int lea = 0;
+        int imul_immediate = 0;
+    };
+    std::unordered_map<const IR::Instruction*, AddressMode> addresses_;
+    std::unordered_set<const IR::Instruction*> folded_;
+    LinearScanAllocator::SelectionMap selection_;
+    SelectionStats selection_totals_;
+
+    // Accesses prefetched at their own address plus this many bytes
+    struct PrefetchStats {
+        int loops = 0;
+        int prefetches = 0;
+    };
+    bool prefetching_;
+    int memory_latency_;
+    int issue_width_;
+    std::unordered_map<const IR::Instruction*, int64_t> prefetches_;
+    PrefetchStats prefetch_totals_;
+
+    // Reloads on a conditional edge, emitted after the function body
+    struct EdgeFixup {
+        std::string label;
+        std::vector<std::pair<int, int>> reloads;
+        std::string target;
+    };
+    std::vector<EdgeFixup> edge_fixups_;
+
     // Code generation methods
     void GenerateFunction(const IR::Function& func);
+    void SelectInstructions(const IR::Function& func);
+    void PlanPrefetches(const IR::Function& func);
     void GenerateInstruction(const IR::Instruction& instr);
-    
-    // Helper methods
+    void GenerateBranch(const IR::Instruction& instr, int block);
+    void ComputeFrameLayout(const IR::Function& func);
+    void ResolveCalls(PEGenerator::ELFWriter& writer);
+    bool WriteObject(const std::string& output_path);
+
+    // Operand helpers
+    struct AsmOperand {
+        enum class Kind { None, Register, Memory, Immediate, Label };
+        Kind kind = Kind::None;
+        int reg = -1;           // Register, or the base of a Memory operand (-1: none)
+        int index = -1;         // Memory: index register (-1: none)
+        int scale = 1;
+        int64_t value = 0;      // Immediate, or the displacement of a Memory operand
+        std::string label;
+
+        bool IsRegister() const { return kind == Kind::Register; }
+        bool IsMemory() const { return kind == Kind::Memory; }
+        bool IsImmediate() const { return kind == Kind::Immediate; }
+        bool operator==(const AsmOperand& other) const;
+    };
+
+    enum class AsmOp { Add, Sub, Imul, Cmp };
+
+    AsmOperand GetOperand(const IR::Operand& op, bool is_def);
+    static AsmOperand RegisterOperand(int reg);
+    static AsmOperand ImmediateOperand(int64_t value);
+    static AsmOperand MemoryOperand(int base, int64_t displacement);
+    AsmOperand SlotOperand(int slot);
+    AsmOperand AddressOperand(const IR::Instruction& instr, const IR::Operand& address);
+    static PEGenerator::Address ToAddress(const AsmOperand& op);
+    std::string FormatOperand(const AsmOperand& op) const;
+    std::string FormatAddress(const AsmOperand& op) const;
     std::string GetRegisterName(int reg);
+    void EmitReloads(const std::vector<std::pair<int, int>>& reloads);
+    void EmitSaves(const std::vector<std::pair<int, int>>& saves);
+    void EmitStoreAfterDef(const IR::Instruction& instr);
+    void EmitMove(const AsmOperand& dest, const AsmOperand& src);
+    void EmitBinary(AsmOp op, const AsmOperand& dest,
+                    const AsmOperand& src1, const AsmOperand& src2, bool commutative);
+    bool SelectLea(const IR::Instruction& instr);
+    void GenerateMultiply(const IR::Instruction& instr);
+
     void EmitPrologue();
     void EmitEpilogue();
+    void EmitFrameTeardown();   // Epilogue without the ret
+    bool IsSiblingTailCall(const std::vector<IR::Instruction>& instructions, size_t index) const;
+    void EmitTailCall(const IR::Instruction& call);
+
+    // Calling convention: incoming parameters, outgoing arguments, and the
+    // register shuffles between them and the allocator's choices
+    void MoveParameters(const IR::Function& func);
+    void PassArguments(const std::vector<IR::Operand>& arguments);
+    void EmitParallelMove(std::vector<std::pair<AsmOperand, AsmOperand>> moves);
     void EmitLabel(const std::string& label);
-    
-    // x86_64 instruction emission
-    void EmitMov(const std::string& dest, const std::string& src);
-    void EmitAdd(const std::string& dest, const std::string& src1, const std::string& src2);
-    void EmitSub(const std::string& dest, const std::string& src1, const std::string& src2);
-    void EmitMul(const std::string& dest, const std::string& src);
- void EmitDiv(const std::string& divisor);
-    void EmitCmp(const std::string& op1, const std::string& op2);
-    void EmitJmp(const std::string& label);
-  void EmitJe(const std::string& label);
-    void EmitJne(const std::string& label);
-    void EmitJg(const std::string& label);
-  void EmitJl(const std::string& label);
+
+    // x86_64 instruction emission, to text or machine code
+    void EmitMov(const AsmOperand& dest, const AsmOperand& src);
+    void EmitInstruction(AsmOp op, const AsmOperand& dest, const AsmOperand& src);
+    void EmitLea(int dest, const AsmOperand& address);
+    void EmitPrefetch(const IR::Instruction& instr, const AsmOperand& address);
+    void EmitMulImm(int dest, const AsmOperand& src, int32_t immediate);
+    void EmitDiv(const AsmOperand& divisor);
+    void EmitDivImm(int64_t divisor);
+    void EmitJump(IR::OpCode opcode, const std::string& label);
     void EmitCall(const std::string& function);
+    void EmitCallFixup(const std::string& function);
+    void EmitPush(int reg);
+    void EmitPop(int reg);
     void EmitRet();
 };
 
@@ -0,0 +1,99 @@
+#include "DivisionMagic.h"
+#include <climits>
+
+namespace Snow {
+namespace X64 {
+
+// ============================================================================
+// MAGIC NUMBERS (Hacker's Delight, figures 10-1 and 10-2, widened to 64 bits)
+// ============================================================================
+
+SignedDivisionMagic ComputeSignedDivisionMagic(int64_t divisor) {
+    const uint64_t two63 = uint64_t(1) << 63;
+    uint64_t ad = divisor < 0 ? 0 - static_cast<uint64_t>(divisor) : static_cast<uint64_t>(divisor);
+    uint64_t anc = two63 - 1 - (two63 % ad);   // |nc|, the largest multiple of ad minus 1
+
+    int p = 63;
+    uint64_t q1 = two63 / anc;
+    uint64_t r1 = two63 - q1 * anc;
+    uint64_t q2 = two63 / ad;
+    uint64_t r2 = two63 - q2 * ad;
+    uint64_t delta;
+    do {
+        p++;
+        q1 *= 2;
+        r1 *= 2;
+        if (r1 >= anc) {
+            q1++;
+            r1 -= anc;
+        }
+        q2 *= 2;
+        r2 *= 2;
+        if (r2 >= ad) {
+            q2++;
+            r2 -= ad;
+        }
+        delta = ad - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+
+    SignedDivisionMagic magic;
+    magic.multiplier = static_cast<int64_t>(q2 + 1);
+    magic.shift = p - 64;
+    return magic;
+}
+
+UnsignedDivisionMagic ComputeUnsignedDivisionMagic(uint64_t divisor) {
+    const uint64_t two63 = uint64_t(1) << 63;
+    uint64_t nc = UINT64_MAX - (0 - divisor) % divisor;
+
+    UnsignedDivisionMagic magic;
+    magic.add = false;
+
+    int p = 63;
+    uint64_t q1 = two63 / nc;
+    uint64_t r1 = two63 - q1 * nc;
+    uint64_t q2 = (two63 - 1) / divisor;
+    uint64_t r2 = (two63 - 1) - q2 * divisor;
+    uint64_t delta;
+    do {
+        p++;
+        if (r1 >= nc - r1) {
+            q1 = 2 * q1 + 1;
+            r1 = 2 * r1 - nc;
+        } else {
+            q1 = 2 * q1;
+            r1 = 2 * r1;
+        }
+        if (r2 + 1 >= divisor - r2) {
+            if (q2 >= two63 - 1) magic.add = true;
+            q2 = 2 * q2 + 1;
+            r2 = 2 * r2 + 1 - divisor;
+        } else {
+            if (q2 >= two63) magic.add = true;
+            q2 = 2 * q2;
+            r2 = 2 * r2 + 1;
+        }
+        delta = divisor - 1 - r2;
+    } while (p < 128 && (q1 < delta || (q1 == delta && r1 == 0)));
+
+    magic.multiplier = q2 + 1;
+    magic.shift = p - 64;
+    return magic;
+}
+
+int GetPowerOfTwoShift(uint64_t value) {
+    if (value == 0 || (value & (value - 1)) != 0) return -1;
+    int shift = 0;
+    while (value > 1) {
+        value >>= 1;
+        shift++;
+    }
+    return shift;
+}
+
+bool CanDivideWithoutIdiv(int64_t divisor) {
+    return divisor != 0 && divisor != INT64_MIN;
+}
+
+} // namespace X64
+} // namespace Snow
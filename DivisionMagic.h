@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+
+namespace Snow {
+namespace X64 {
+
+// ============================================================================
+// DIVISION BY CONSTANTS
+// Magic numbers for replacing a 64-bit division by a constant with a
+// multiply-high and shifts (Granlund and Montgomery, "Division by Invariant
+// Integers using Multiplication", in the form given by Hacker's Delight,
+// chapter 10). Both code generators emit the sequences; the optimizer uses
+// the same tests for its cost model and annotations.
+//
+// Signed, for a divisor d with |d| >= 2 and not a power of two:
+//   q = mulhs(n, multiplier)
+//   if multiplier < 0: q += n
+//   q = (q >> shift) + (q >>> 63)       // round toward zero
+//   if d < 0: q = -q
+// Unsigned, for d >= 2 and not a power of two:
+//   q = mulhu(n, multiplier)
+//   add == false: q >>= shift
+//   add == true:  q = (((n - q) >> 1) + q) >> (shift - 1)
+// ============================================================================
+
+struct SignedDivisionMagic {
+    int64_t multiplier;
+    int shift;
+};
+
+struct UnsignedDivisionMagic {
+    uint64_t multiplier;
+    int shift;
+    bool add;
+};
+
+// For |divisor| >= 2; the sign of divisor is ignored
+SignedDivisionMagic ComputeSignedDivisionMagic(int64_t divisor);
+
+// For divisor >= 2
+UnsignedDivisionMagic ComputeUnsignedDivisionMagic(uint64_t divisor);
+
+// log2 of a power of two, -1 for anything else
+int GetPowerOfTwoShift(uint64_t value);
+
+// Whether a signed division by 'divisor' can be emitted without idiv: every
+// divisor except 0 (which must still trap) and INT64_MIN
+bool CanDivideWithoutIdiv(int64_t divisor);
+
+} // namespace X64
+} // namespace Snow
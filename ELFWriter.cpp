@@ -0,0 +1,534 @@
+#include "ELFWriter.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+namespace Snow {
+namespace PEGenerator {
+
+namespace {
+
+const int kSectionCount = static_cast<int>(ELFSection::Count);
+const char* const kSectionNames[kSectionCount] = { ".text", ".data", ".rodata" };
+
+const uint16_t ET_REL = 1;
+const uint16_t ET_EXEC = 2;
+const uint16_t EM_X86_64 = 62;
+
+const uint32_t SHT_PROGBITS = 1;
+const uint32_t SHT_SYMTAB = 2;
+const uint32_t SHT_STRTAB = 3;
+const uint32_t SHT_RELA = 4;
+
+const uint64_t SHF_WRITE = 0x1;
+const uint64_t SHF_ALLOC = 0x2;
+const uint64_t SHF_EXECINSTR = 0x4;
+const uint64_t SHF_INFO_LINK = 0x40;
+
+const uint32_t PT_LOAD = 1;
+const uint32_t PT_GNU_STACK = 0x6474E551;
+const uint32_t PF_X = 1;
+const uint32_t PF_W = 2;
+const uint32_t PF_R = 4;
+
+const uint8_t STB_LOCAL = 0;
+const uint8_t STB_GLOBAL = 1;
+const uint8_t STT_NOTYPE = 0;
+const uint8_t STT_OBJECT = 1;
+const uint8_t STT_FUNC = 2;
+const uint8_t STT_SECTION = 3;
+
+const uint64_t kPageSize = 0x1000;
+
+const uint64_t kSectionFlags[kSectionCount] = {
+    SHF_ALLOC | SHF_EXECINSTR,
+    SHF_ALLOC | SHF_WRITE,
+    SHF_ALLOC
+};
+
+const uint32_t kSegmentFlags[kSectionCount] = { PF_R | PF_X, PF_R | PF_W, PF_R };
+
+uint64_t AlignUp(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// Null-terminated names, offset 0 being the empty string
+class StringTable {
+public:
+    StringTable() : data_(1, 0) {}
+
+    uint32_t Add(const std::string& name) {
+        if (name.empty()) return 0;
+        uint32_t offset = static_cast<uint32_t>(data_.size());
+        data_.insert(data_.end(), name.begin(), name.end());
+        data_.push_back(0);
+        return offset;
+    }
+
+    const std::vector<uint8_t>& GetData() const { return data_; }
+
+private:
+    std::vector<uint8_t> data_;
+};
+
+template <typename T>
+void Append(std::vector<uint8_t>& image, const T& value) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+    image.insert(image.end(), bytes, bytes + sizeof(T));
+}
+
+void Append(std::vector<uint8_t>& image, const std::vector<uint8_t>& bytes) {
+    image.insert(image.end(), bytes.begin(), bytes.end());
+}
+
+void PadTo(std::vector<uint8_t>& image, uint64_t offset) {
+    if (image.size() < offset) image.resize(offset, 0);
+}
+
+template <typename T>
+void Patch(std::vector<uint8_t>& bytes, uint64_t offset, T value) {
+    std::memcpy(&bytes[offset], &value, sizeof(T));
+}
+
+ELFHeader MakeHeader(uint16_t type) {
+    ELFHeader header;
+    std::memset(&header, 0, sizeof(header));
+    const uint8_t ident[] = { 0x7F, 'E', 'L', 'F', 2 /* 64-bit */, 1 /* little endian */, 1 /* version */ };
+    std::memcpy(header.e_ident, ident, sizeof(ident));
+    header.e_type = type;
+    header.e_machine = EM_X86_64;
+    header.e_version = 1;
+    header.e_ehsize = sizeof(ELFHeader);
+    header.e_shentsize = sizeof(ELFSectionHeader);
+    return header;
+}
+
+ELFSectionHeader MakeSectionHeader(uint32_t name, uint32_t type, uint64_t flags,
+                                   uint64_t offset, uint64_t size, uint64_t alignment) {
+    ELFSectionHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.sh_name = name;
+    header.sh_type = type;
+    header.sh_flags = flags;
+    header.sh_offset = offset;
+    header.sh_size = size;
+    header.sh_addralign = alignment;
+    return header;
+}
+
+} // anonymous namespace
+
+// ============================================================================
+// CONTENTS
+// ============================================================================
+
+ELFWriter::ELFWriter() : entry_symbol_("_start"), base_address_(0x400000) {
+    alignments_[static_cast<int>(ELFSection::Text)] = 16;
+    alignments_[static_cast<int>(ELFSection::Data)] = 8;
+    alignments_[static_cast<int>(ELFSection::ROData)] = 16;
+}
+
+uint64_t ELFWriter::AddCode(const std::vector<uint8_t>& code) {
+    return AddBytes(ELFSection::Text, code);
+}
+
+uint64_t ELFWriter::AddData(const std::vector<uint8_t>& data) {
+    return AddBytes(ELFSection::Data, data);
+}
+
+uint64_t ELFWriter::AddReadOnlyData(const std::vector<uint8_t>& data) {
+    return AddBytes(ELFSection::ROData, data);
+}
+
+uint64_t ELFWriter::AddBytes(ELFSection section, const std::vector<uint8_t>& bytes) {
+    std::vector<uint8_t>& contents = sections_[static_cast<int>(section)];
+    uint64_t offset = contents.size();
+    contents.insert(contents.end(), bytes.begin(), bytes.end());
+    return offset;
+}
+
+void ELFWriter::AlignSection(ELFSection section, uint64_t alignment) {
+    int index = static_cast<int>(section);
+    std::vector<uint8_t>& contents = sections_[index];
+    uint8_t fill = section == ELFSection::Text ? 0xCC : 0x00;
+    contents.resize(AlignUp(contents.size(), alignment), fill);
+    alignments_[index] = std::max(alignments_[index], alignment);
+}
+
+uint64_t ELFWriter::GetSectionSize(ELFSection section) const {
+    return sections_[static_cast<int>(section)].size();
+}
+
+size_t ELFWriter::GetOrAddSymbol(const std::string& name) {
+    auto it = symbol_index_.find(name);
+    if (it != symbol_index_.end()) return it->second;
+
+    Symbol symbol = { name, ELFSection::Text, 0, 0, true, false };
+    symbols_.push_back(symbol);
+    symbol_index_[name] = symbols_.size() - 1;
+    return symbols_.size() - 1;
+}
+
+void ELFWriter::DefineSymbol(const std::string& name, ELFSection section, uint64_t offset,
+                             uint64_t size, bool global) {
+    Symbol& symbol = symbols_[GetOrAddSymbol(name)];
+    symbol.section = section;
+    symbol.offset = offset;
+    symbol.size = size;
+    symbol.global = global;
+    symbol.defined = true;
+}
+
+bool ELFWriter::HasSymbol(const std::string& name) const {
+    auto it = symbol_index_.find(name);
+    return it != symbol_index_.end() && symbols_[it->second].defined;
+}
+
+void ELFWriter::AddRelocation(ELFSection section, uint64_t offset, const std::string& symbol,
+                              uint32_t type, int64_t addend) {
+    GetOrAddSymbol(symbol);
+    ELFRelocation relocation = { section, offset, symbol, type, addend };
+    relocations_.push_back(relocation);
+}
+
+void ELFWriter::SetEntryPoint(const std::string& symbol) {
+    entry_symbol_ = symbol;
+}
+
+void ELFWriter::SetBaseAddress(uint64_t base) {
+    base_address_ = base;
+}
+
+bool ELFWriter::Fail(const std::string& message) {
+    error_ = message;
+    return false;
+}
+
+bool ELFWriter::WriteFile(const std::string& filename, const std::vector<uint8_t>& image, bool executable) {
+    std::ofstream file(filename, std::ios::binary);
+    if (!file) return Fail("Cannot open output file: " + filename);
+    file.write(reinterpret_cast<const char*>(image.data()), image.size());
+    file.close();
+    if (!file) return Fail("Cannot write output file: " + filename);
+
+#ifndef _WIN32
+    if (executable) chmod(filename.c_str(), 0755);
+#endif
+    return true;
+}
+
+// ============================================================================
+// RELOCATABLE OBJECT
+// Section order: null, .text, .data, .rodata, one .rela.* per section that
+// has relocations, .symtab, .strtab, .note.GNU-stack (non-executable stack),
+// .shstrtab. Locals precede globals in .symtab, as the format requires.
+// ============================================================================
+
+bool ELFWriter::WriteObject(const std::string& filename) {
+    for (const auto& relocation : relocations_) {
+        if (relocation.offset + (relocation.type == ELFRelocation::R_X86_64_64 ? 8 : 4) >
+            GetSectionSize(relocation.section)) {
+            return Fail("Relocation outside " + std::string(kSectionNames[static_cast<int>(relocation.section)]) +
+                        " for symbol: " + relocation.symbol);
+        }
+    }
+
+    StringTable section_names;
+    StringTable symbol_names;
+
+    // Symbol table: null, one section symbol per content section, then
+    // locals, then globals
+    std::vector<ELFSymbol> symtab(1 + kSectionCount);
+    std::memset(symtab.data(), 0, symtab.size() * sizeof(ELFSymbol));
+    for (int s = 0; s < kSectionCount; s++) {
+        symtab[1 + s].st_info = static_cast<uint8_t>((STB_LOCAL << 4) | STT_SECTION);
+        symtab[1 + s].st_shndx = static_cast<uint16_t>(1 + s);
+    }
+
+    std::vector<uint32_t> final_index(symbols_.size());
+    uint32_t first_global = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        bool want_global = pass == 1;
+        if (want_global) first_global = static_cast<uint32_t>(symtab.size());
+        for (size_t i = 0; i < symbols_.size(); i++) {
+            const Symbol& symbol = symbols_[i];
+            bool global = symbol.global || !symbol.defined;
+            if (global != want_global) continue;
+
+            ELFSymbol entry;
+            std::memset(&entry, 0, sizeof(entry));
+            entry.st_name = symbol_names.Add(symbol.name);
+            uint8_t type = STT_NOTYPE;
+            if (symbol.defined) {
+                type = symbol.section == ELFSection::Text ? STT_FUNC : STT_OBJECT;
+                entry.st_shndx = static_cast<uint16_t>(1 + static_cast<int>(symbol.section));
+                entry.st_value = symbol.offset;
+                entry.st_size = symbol.size;
+            }
+            entry.st_info = static_cast<uint8_t>(((global ? STB_GLOBAL : STB_LOCAL) << 4) | type);
+            final_index[i] = static_cast<uint32_t>(symtab.size());
+            symtab.push_back(entry);
+        }
+    }
+
+    // Relocations grouped by the section they patch
+    std::vector<ELFRela> relas[kSectionCount];
+    for (const auto& relocation : relocations_) {
+        ELFRela rela;
+        rela.r_offset = relocation.offset;
+        rela.r_info = (static_cast<uint64_t>(final_index[symbol_index_[relocation.symbol]]) << 32) | relocation.type;
+        rela.r_addend = relocation.addend;
+        relas[static_cast<int>(relocation.section)].push_back(rela);
+    }
+
+    // Lay out the file
+    std::vector<uint8_t> image;
+    ELFHeader header = MakeHeader(ET_REL);
+    Append(image, header);
+
+    std::vector<ELFSectionHeader> headers(1);
+    std::memset(&headers[0], 0, sizeof(ELFSectionHeader));
+
+    for (int s = 0; s < kSectionCount; s++) {
+        PadTo(image, AlignUp(image.size(), alignments_[s]));
+        headers.push_back(MakeSectionHeader(section_names.Add(kSectionNames[s]), SHT_PROGBITS,
+                                            kSectionFlags[s], image.size(), sections_[s].size(),
+                                            alignments_[s]));
+        Append(image, sections_[s]);
+    }
+
+    uint32_t symtab_index = static_cast<uint32_t>(headers.size());
+    for (int s = 0; s < kSectionCount; s++) {
+        if (!relas[s].empty()) symtab_index++;
+    }
+
+    for (int s = 0; s < kSectionCount; s++) {
+        if (relas[s].empty()) continue;
+        PadTo(image, AlignUp(image.size(), 8));
+        ELFSectionHeader rela = MakeSectionHeader(section_names.Add(std::string(".rela") + kSectionNames[s]),
+                                                  SHT_RELA, SHF_INFO_LINK, image.size(),
+                                                  relas[s].size() * sizeof(ELFRela), 8);
+        rela.sh_link = symtab_index;
+        rela.sh_info = static_cast<uint32_t>(1 + s);
+        rela.sh_entsize = sizeof(ELFRela);
+        headers.push_back(rela);
+        for (const auto& entry : relas[s]) Append(image, entry);
+    }
+
+    PadTo(image, AlignUp(image.size(), 8));
+    ELFSectionHeader symtab_header = MakeSectionHeader(section_names.Add(".symtab"), SHT_SYMTAB, 0, image.size(),
+                                                       symtab.size() * sizeof(ELFSymbol), 8);
+    symtab_header.sh_link = symtab_index + 1;
+    symtab_header.sh_info = first_global;
+    symtab_header.sh_entsize = sizeof(ELFSymbol);
+    headers.push_back(symtab_header);
+    for (const auto& entry : symtab) Append(image, entry);
+
+    headers.push_back(MakeSectionHeader(section_names.Add(".strtab"), SHT_STRTAB, 0, image.size(),
+                                        symbol_names.GetData().size(), 1));
+    Append(image, symbol_names.GetData());
+
+    headers.push_back(MakeSectionHeader(section_names.Add(".note.GNU-stack"), SHT_PROGBITS, 0,
+                                        image.size(), 0, 1));
+
+    uint32_t shstrtab_name = section_names.Add(".shstrtab");
+    headers.push_back(MakeSectionHeader(shstrtab_name, SHT_STRTAB, 0, image.size(),
+                                        section_names.GetData().size(), 1));
+    Append(image, section_names.GetData());
+
+    PadTo(image, AlignUp(image.size(), 8));
+    header.e_shoff = image.size();
+    header.e_shnum = static_cast<uint16_t>(headers.size());
+    header.e_shstrndx = static_cast<uint16_t>(headers.size() - 1);
+    for (const auto& entry : headers) Append(image, entry);
+    Patch(image, 0, header);
+
+    return WriteFile(filename, image, false);
+}
+
+// ============================================================================
+// STATIC EXECUTABLE
+// The headers and .text share the first R+X segment; .rodata (R) and .data
+// (R+W) each get their own page-aligned segment, so no page is both writable
+// and executable. File offsets and addresses stay congruent modulo the page
+// size, which is all the kernel loader needs. A symbol table is kept for
+// debuggers and profilers.
+// ============================================================================
+
+bool ELFWriter::WriteExecutable(const std::string& filename) {
+    auto entry = symbol_index_.find(entry_symbol_);
+    if (entry == symbol_index_.end() || !symbols_[entry->second].defined ||
+        symbols_[entry->second].section != ELFSection::Text) {
+        return Fail("Entry point not defined in .text: " + entry_symbol_);
+    }
+
+    // Segment order in the file: .text, .rodata, .data
+    const int order[kSectionCount] = {
+        static_cast<int>(ELFSection::Text),
+        static_cast<int>(ELFSection::ROData),
+        static_cast<int>(ELFSection::Data)
+    };
+
+    uint16_t segment_count = 1;  // PT_GNU_STACK
+    for (int s = 0; s < kSectionCount; s++) {
+        if (!sections_[s].empty()) segment_count++;
+    }
+
+    uint64_t offsets[kSectionCount];
+    uint64_t cursor = sizeof(ELFHeader) + segment_count * sizeof(ELFProgramHeader);
+    for (int k = 0; k < kSectionCount; k++) {
+        int s = order[k];
+        cursor = k == 0 ? AlignUp(cursor, alignments_[s]) : AlignUp(cursor, kPageSize);
+        offsets[s] = cursor;
+        cursor += sections_[s].size();
+    }
+
+    auto address_of = [&](int section, uint64_t offset) {
+        return base_address_ + offsets[section] + offset;
+    };
+
+    // Resolve relocations in place
+    std::vector<uint8_t> contents[kSectionCount];
+    for (int s = 0; s < kSectionCount; s++) contents[s] = sections_[s];
+
+    for (const auto& relocation : relocations_) {
+        const Symbol& symbol = symbols_[symbol_index_[relocation.symbol]];
+        if (!symbol.defined) return Fail("Undefined symbol: " + relocation.symbol);
+
+        int section = static_cast<int>(relocation.section);
+        uint64_t width = relocation.type == ELFRelocation::R_X86_64_64 ? 8 : 4;
+        if (relocation.offset + width > contents[section].size()) {
+            return Fail("Relocation outside " + std::string(kSectionNames[section]) +
+                        " for symbol: " + relocation.symbol);
+        }
+
+        int64_t target = static_cast<int64_t>(address_of(static_cast<int>(symbol.section), symbol.offset)) +
+                         relocation.addend;
+        int64_t value;
+        switch (relocation.type) {
+            case ELFRelocation::R_X86_64_64:
+                Patch(contents[section], relocation.offset, static_cast<uint64_t>(target));
+                continue;
+            case ELFRelocation::R_X86_64_PC32:
+            case ELFRelocation::R_X86_64_PLT32:
+                value = target - static_cast<int64_t>(address_of(section, relocation.offset));
+                break;
+            case ELFRelocation::R_X86_64_32S:
+                value = target;
+                break;
+            default:
+                return Fail("Unsupported relocation type " + std::to_string(relocation.type) +
+                            " for symbol: " + relocation.symbol);
+        }
+        if (value < INT32_MIN || value > INT32_MAX) {
+            return Fail("Relocation out of range for symbol: " + relocation.symbol);
+        }
+        Patch(contents[section], relocation.offset, static_cast<int32_t>(value));
+    }
+
+    std::vector<uint8_t> image;
+    ELFHeader header = MakeHeader(ET_EXEC);
+    const Symbol& entry_symbol = symbols_[entry->second];
+    header.e_entry = address_of(static_cast<int>(ELFSection::Text), entry_symbol.offset);
+    header.e_phoff = sizeof(ELFHeader);
+    header.e_phentsize = sizeof(ELFProgramHeader);
+    header.e_phnum = segment_count;
+    Append(image, header);
+
+    for (int k = 0; k < kSectionCount; k++) {
+        int s = order[k];
+        if (sections_[s].empty()) continue;
+        ELFProgramHeader segment;
+        std::memset(&segment, 0, sizeof(segment));
+        segment.p_type = PT_LOAD;
+        segment.p_flags = kSegmentFlags[s];
+        // The first segment also maps the headers in front of .text
+        segment.p_offset = k == 0 ? 0 : offsets[s];
+        segment.p_vaddr = base_address_ + segment.p_offset;
+        segment.p_paddr = segment.p_vaddr;
+        segment.p_filesz = offsets[s] + sections_[s].size() - segment.p_offset;
+        segment.p_memsz = segment.p_filesz;
+        segment.p_align = kPageSize;
+        Append(image, segment);
+    }
+
+    ELFProgramHeader stack;
+    std::memset(&stack, 0, sizeof(stack));
+    stack.p_type = PT_GNU_STACK;
+    stack.p_flags = PF_R | PF_W;
+    stack.p_align = 16;
+    Append(image, stack);
+
+    for (int k = 0; k < kSectionCount; k++) {
+        int s = order[k];
+        PadTo(image, offsets[s]);
+        Append(image, contents[s]);
+    }
+
+    // Section headers and symbol table for tools; the loader ignores them
+    StringTable section_names;
+    StringTable symbol_names;
+    std::vector<ELFSectionHeader> headers(1);
+    std::memset(&headers[0], 0, sizeof(ELFSectionHeader));
+    for (int s = 0; s < kSectionCount; s++) {
+        ELFSectionHeader section = MakeSectionHeader(section_names.Add(kSectionNames[s]), SHT_PROGBITS,
+                                                     kSectionFlags[s], offsets[s], sections_[s].size(),
+                                                     alignments_[s]);
+        section.sh_addr = address_of(s, 0);
+        headers.push_back(section);
+    }
+
+    std::vector<ELFSymbol> symtab(1);
+    std::memset(symtab.data(), 0, sizeof(ELFSymbol));
+    uint32_t first_global = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        bool want_global = pass == 1;
+        if (want_global) first_global = static_cast<uint32_t>(symtab.size());
+        for (const auto& symbol : symbols_) {
+            if (!symbol.defined || symbol.global != want_global) continue;
+            ELFSymbol entry;
+            std::memset(&entry, 0, sizeof(entry));
+            entry.st_name = symbol_names.Add(symbol.name);
+            uint8_t type = symbol.section == ELFSection::Text ? STT_FUNC : STT_OBJECT;
+            entry.st_info = static_cast<uint8_t>(((symbol.global ? STB_GLOBAL : STB_LOCAL) << 4) | type);
+            entry.st_shndx = static_cast<uint16_t>(1 + static_cast<int>(symbol.section));
+            entry.st_value = address_of(static_cast<int>(symbol.section), symbol.offset);
+            entry.st_size = symbol.size;
+            symtab.push_back(entry);
+        }
+    }
+
+    PadTo(image, AlignUp(image.size(), 8));
+    ELFSectionHeader symtab_header = MakeSectionHeader(section_names.Add(".symtab"), SHT_SYMTAB, 0, image.size(),
+                                                       symtab.size() * sizeof(ELFSymbol), 8);
+    symtab_header.sh_link = static_cast<uint32_t>(headers.size() + 1);
+    symtab_header.sh_info = first_global;
+    symtab_header.sh_entsize = sizeof(ELFSymbol);
+    headers.push_back(symtab_header);
+    for (const auto& symbol : symtab) Append(image, symbol);
+
+    headers.push_back(MakeSectionHeader(section_names.Add(".strtab"), SHT_STRTAB, 0, image.size(),
+                                        symbol_names.GetData().size(), 1));
+    Append(image, symbol_names.GetData());
+
+    uint32_t shstrtab_name = section_names.Add(".shstrtab");
+    headers.push_back(MakeSectionHeader(shstrtab_name, SHT_STRTAB, 0, image.size(),
+                                        section_names.GetData().size(), 1));
+    Append(image, section_names.GetData());
+
+    PadTo(image, AlignUp(image.size(), 8));
+    header.e_shoff = image.size();
+    header.e_shnum = static_cast<uint16_t>(headers.size());
+    header.e_shstrndx = static_cast<uint16_t>(headers.size() - 1);
+    for (const auto& section : headers) Append(image, section);
+    Patch(image, 0, header);
+
+    return WriteFile(filename, image, true);
+}
+
+} // namespace PEGenerator
+} // namespace Snow
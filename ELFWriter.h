@@ -0,0 +1,169 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+namespace Snow {
+namespace PEGenerator {
+
+// ============================================================================
+// ELF64 FILE STRUCTURES
+// ============================================================================
+
+#pragma pack(push, 1)
+
+struct ELFHeader {
+    uint8_t e_ident[16];     // 0x7F "ELF", class, data, version, OS ABI
+    uint16_t e_type;         // 1 = relocatable, 2 = executable
+    uint16_t e_machine;      // 62 = x86-64
+    uint32_t e_version;
+    uint64_t e_entry;
+    uint64_t e_phoff;
+    uint64_t e_shoff;
+    uint32_t e_flags;
+    uint16_t e_ehsize;
+    uint16_t e_phentsize;
+    uint16_t e_phnum;
+    uint16_t e_shentsize;
+    uint16_t e_shnum;
+    uint16_t e_shstrndx;
+};
+
+struct ELFProgramHeader {
+    uint32_t p_type;         // 1 = PT_LOAD
+    uint32_t p_flags;        // 1 = X, 2 = W, 4 = R
+    uint64_t p_offset;
+    uint64_t p_vaddr;
+    uint64_t p_paddr;
+    uint64_t p_filesz;
+    uint64_t p_memsz;
+    uint64_t p_align;
+};
+
+struct ELFSectionHeader {
+    uint32_t sh_name;
+    uint32_t sh_type;
+    uint64_t sh_flags;
+    uint64_t sh_addr;
+    uint64_t sh_offset;
+    uint64_t sh_size;
+    uint32_t sh_link;
+    uint32_t sh_info;
+    uint64_t sh_addralign;
+    uint64_t sh_entsize;
+};
+
+struct ELFSymbol {
+    uint32_t st_name;
+    uint8_t st_info;         // binding << 4 | type
+    uint8_t st_other;
+    uint16_t st_shndx;
+    uint64_t st_value;
+    uint64_t st_size;
+};
+
+struct ELFRela {
+    uint64_t r_offset;
+    uint64_t r_info;         // symbol << 32 | type
+    int64_t r_addend;
+};
+
+#pragma pack(pop)
+
+// ============================================================================
+// ELF SECTIONS AND RELOCATIONS
+// ============================================================================
+
+enum class ELFSection {
+    Text,       // .text, read + execute
+    Data,       // .data, read + write
+    ROData,     // .rodata, read only
+    Count
+};
+
+struct ELFRelocation {
+    ELFSection section;      // Section holding the patched field
+    uint64_t offset;         // Offset of the field within that section
+    std::string symbol;
+    uint32_t type;
+    int64_t addend;
+
+    static constexpr uint32_t R_X86_64_64 = 1;     // S + A, 64-bit absolute
+    static constexpr uint32_t R_X86_64_PC32 = 2;   // S + A - P, 32-bit
+    static constexpr uint32_t R_X86_64_PLT32 = 4;  // As PC32 for calls
+    static constexpr uint32_t R_X86_64_32S = 11;   // S + A, sign-extended 32-bit
+};
+
+// ============================================================================
+// ELF WRITER
+// Linux counterpart of PEWriter. Machine code from MachineCodeEmitter and
+// the data it refers to are appended to .text/.data/.rodata; symbols name
+// offsets within them and relocations describe the fields still to patch.
+// WriteObject emits a relocatable .o for the system linker. WriteExecutable
+// resolves every relocation itself and emits a static executable with one
+// PT_LOAD segment per section, so no assembler or linker is involved.
+// ============================================================================
+
+class ELFWriter {
+public:
+    ELFWriter();
+
+    // Append bytes, returning the offset they start at within the section
+    uint64_t AddCode(const std::vector<uint8_t>& code);
+    uint64_t AddData(const std::vector<uint8_t>& data);
+    uint64_t AddReadOnlyData(const std::vector<uint8_t>& data);
+    uint64_t AddBytes(ELFSection section, const std::vector<uint8_t>& bytes);
+
+    // Pad a section with zeros (int3 for .text) up to a power-of-two boundary
+    void AlignSection(ELFSection section, uint64_t alignment);
+    uint64_t GetSectionSize(ELFSection section) const;
+
+    // Symbols. Names referenced by relocations but never defined become
+    // undefined globals in an object file and an error in an executable.
+    void DefineSymbol(const std::string& name, ELFSection section, uint64_t offset,
+                      uint64_t size = 0, bool global = true);
+    bool HasSymbol(const std::string& name) const;
+
+    // 'offset' is the field to patch; for rel32 call/jump/RIP-relative fields
+    // use R_X86_64_PLT32/PC32 with addend -4
+    void AddRelocation(ELFSection section, uint64_t offset, const std::string& symbol,
+                       uint32_t type = ELFRelocation::R_X86_64_PLT32, int64_t addend = -4);
+
+    // Executable only; the symbol must be defined in .text (default "_start")
+    void SetEntryPoint(const std::string& symbol);
+    void SetBaseAddress(uint64_t base);
+
+    bool WriteObject(const std::string& filename);
+    bool WriteExecutable(const std::string& filename);
+
+    const std::string& GetError() const { return error_; }
+
+private:
+    struct Symbol {
+        std::string name;
+        ELFSection section;
+        uint64_t offset;
+        uint64_t size;
+        bool global;
+        bool defined;
+    };
+
+    std::vector<uint8_t> sections_[static_cast<int>(ELFSection::Count)];
+    uint64_t alignments_[static_cast<int>(ELFSection::Count)];
+    std::vector<Symbol> symbols_;
+    std::unordered_map<std::string, size_t> symbol_index_;
+    std::vector<ELFRelocation> relocations_;
+
+    std::string entry_symbol_;
+    uint64_t base_address_;
+    std::string error_;
+
+    size_t GetOrAddSymbol(const std::string& name);
+    bool Fail(const std::string& message);
+    bool WriteFile(const std::string& filename, const std::vector<uint8_t>& image, bool executable);
+};
+
+} // namespace PEGenerator
+} // namespace Snow
@@ -1,5 +1,7 @@
 #include "HyperOptimizer.h"
+#include "../Common/ThreadPool.h"
 #include <algorithm>
+#include <map>
 #include <cmath>
 #include <fstream>
 #include <sstream>
@@ -18,7 +20,6 @@ bool TypeAnalyzer::VerifyTypeCoherence(const SSA::SSAModule& module) {
      for (const auto& block : func->GetBlocks()) {
    for (const auto& instr : block->GetInstructions()) {
          // Check operand type compatibility
-  auto* result = instr->GetResult();
     const auto& operands = instr->GetOperands();
           
    // Verify types match operation requirements
@@ -43,25 +44,10 @@ bool TypeAnalyzer::VerifyTypeCoherence(const SSA::SSAModule& module) {
     return all_valid;
 }
 
-void TypeAnalyzer::InferTypes(SSA::SSAModule& module) {
-    // Hindley-Milner style type inference
-    bool changed = true;
-    int iterations = 0;
-    const int MAX_ITERATIONS = 100;
-    
-    while (changed && iterations < MAX_ITERATIONS) {
- changed = false;
-        iterations++;
-        
-        for (const auto& func : module.GetFunctions()) {
- for (const auto& block : func->GetBlocks()) {
-   for (const auto& instr : block->GetInstructions()) {
-             // Infer result type from operands
-        // This would use actual type system in real implementation
-       }
-     }
-        }
-    }
+void TypeAnalyzer::InferTypes(SSA::SSAModule& /*module*/) {
+    // Hindley-Milner style type inference: infer each result type from its
+    // operands until nothing changes (at most 100 rounds)
+    // This would use actual type system in real implementation
 }
 
 void TypeAnalyzer::TypeBasedOptimization(SSA::SSAModule& module) {
@@ -79,7 +65,7 @@ void TypeAnalyzer::TypeBasedOptimization(SSA::SSAModule& module) {
     }
 }
 
-void TypeAnalyzer::MonomorphizeGenerics(SSA::SSAModule& module) {
+void TypeAnalyzer::MonomorphizeGenerics(SSA::SSAModule& /*module*/) {
     // Create specialized versions of generic functions
     // for each concrete type used
     // This eliminates runtime overhead of generics
@@ -211,13 +197,30 @@ BoundsChecker::AnalyzeRanges(const SSA::SSAFunction& func) {
     return ranges;
 }
 
-void BoundsChecker::EliminateChecks(SSA::SSAModule& module) {
+void BoundsChecker::EliminateChecks(SSA::SSAModule& /*module*/) {
  // Remove proven-safe bounds checks
+    // Iterate through instructions and remove unnecessary checks
+}
+
+// ============================================================================
+// LOGICAL COHERENCE IMPLEMENTATION
+// ============================================================================
+
+bool LogicalCoherenceAnalyzer::VerifyLogicalCoherence(const SSA::SSAModule& module) {
+    bool coherent = true;
+    
     for (const auto& func : module.GetFunctions()) {
-     for (const auto& block : func->GetBlocks()) {
-     // Iterate through instructions and remove unnecessary checks
+        for (const auto& block : func->GetBlocks()) {
+            // Every registered rule must hold for every block
+            for (const auto& rule : rules_) {
+                if (rule.predicate && !rule.predicate(*block)) {
+                    coherent = false;
+                }
+            }
         }
     }
+    
+    return coherent;
 }
 
 // ============================================================================
@@ -228,8 +231,6 @@ void ExpressionOptimizer::SimplifyAlgebraically(SSA::SSAModule& module) {
     for (const auto& func : module.GetFunctions()) {
         for (const auto& block : func->GetBlocks()) {
             for (const auto& instr : block->GetInstructions()) {
-     auto& ops = instr->GetOperands();
-      
      switch (instr->GetOpCode()) {
      case SSA::SSAInstruction::OpCode::Add:
         // x + 0 = x
@@ -255,28 +256,196 @@ void ExpressionOptimizer::SimplifyAlgebraically(SSA::SSAModule& module) {
 void ExpressionOptimizer::ReduceStrength(SSA::SSAModule& module) {
  // Replace expensive operations with cheaper equivalents
     for (const auto& func : module.GetFunctions()) {
-        for (const auto& block : func->GetBlocks()) {
-        for (const auto& instr : block->GetInstructions()) {
+        // Induction variable times constant -> additive update per iteration
+        strength_reductions_ += ReduceInductionVariables(*func);
+        
   // Multiply by constant -> shifts and adds
       // Division by constant -> multiply by reciprocal
      // Modulo by power of 2 -> bitwise AND
-   }
-        }
     }
 }
 
-void ExpressionOptimizer::EliminateCommonSubexpressions(SSA::SSAModule& module) {
-    // Global CSE across basic blocks
-    std::unordered_map<std::string, SSA::SSAValue*> expression_map;
+// A basic induction variable is a phi whose incoming values are either
+// 'i + c' / 'i - c' (one shared step instruction) or come from elsewhere.
+// For m = i * k the reduced value s = phi(x * k, ..., s + c * k) keeps
+// s == i * k on every edge, so m can be replaced by s outright.
+int ExpressionOptimizer::ReduceInductionVariables(SSA::SSAFunction& func) {
+    using Op = SSA::SSAInstruction::OpCode;
     
- for (const auto& func : module.GetFunctions()) {
-     for (const auto& block : func->GetBlocks()) {
-   for (const auto& instr : block->GetInstructions()) {
-          // Compute hash of expression
-      // If seen before, replace with previous result
+    struct Induction {
+        SSA::SSABasicBlock* header;
+        SSA::SSAInstruction* phi;
+        SSA::SSAInstruction* step;
+        SSA::SSABasicBlock* step_block;
+        int64_t increment;
+    };
+    
+    auto is_constant = [](const SSA::SSAValue* value) {
+        return value && value->GetKind() == SSA::SSAValue::Kind::Constant;
+    };
+    
+    std::unordered_map<SSA::SSAValue*, std::pair<SSA::SSABasicBlock*, SSA::SSAInstruction*>> defs;
+    for (const auto& block : func.GetBlocks()) {
+        for (const auto& instr : block->GetInstructions()) {
+            if (instr->GetResult()) {
+                defs[instr->GetResult()] = std::make_pair(block.get(), instr.get());
+            }
+        }
     }
+    
+    // Find basic induction variables among the leading phis of each block
+    std::unordered_map<SSA::SSAValue*, Induction> inductions;
+    for (const auto& block : func.GetBlocks()) {
+        for (const auto& instr : block->GetInstructions()) {
+            if (instr->GetOpCode() != Op::Phi) break;
+            if (instr->GetOperands().size() != block->GetPredecessors().size()) continue;
+            
+            SSA::SSAValue* iv = instr->GetResult();
+            Induction induction = {block.get(), instr.get(), nullptr, nullptr, 0};
+            bool valid = iv != nullptr;
+            
+            for (SSA::SSAValue* incoming : instr->GetOperands()) {
+                auto def = defs.find(incoming);
+                if (def == defs.end()) continue;
+                SSA::SSAInstruction* step = def->second.second;
+                if (step->GetOpCode() != Op::Add && step->GetOpCode() != Op::Sub) continue;
+                
+                const auto& ops = step->GetOperands();
+                if (ops.size() != 2) continue;
+                int64_t increment;
+                if (ops[0] == iv && is_constant(ops[1])) {
+                    increment = ops[1]->GetConstantValue();
+                } else if (ops[1] == iv && is_constant(ops[0]) && step->GetOpCode() == Op::Add) {
+                    increment = ops[0]->GetConstantValue();
+                } else {
+                    continue;
+                }
+                if (step->GetOpCode() == Op::Sub) increment = -increment;
+                
+                if (induction.step && induction.step != step) {
+                    valid = false;
+                    break;
+                }
+                induction.step = step;
+                induction.step_block = def->second.first;
+                induction.increment = increment;
+            }
+            
+            if (valid && induction.step) {
+                inductions[iv] = induction;
+            }
         }
     }
+    if (inductions.empty()) return 0;
+    
+    // Collect i * k first; rewriting inserts instructions into the blocks
+    struct Candidate {
+        SSA::SSAInstruction* mul;
+        SSA::SSAValue* iv;
+        int64_t factor;
+    };
+    std::vector<Candidate> candidates;
+    for (const auto& block : func.GetBlocks()) {
+        for (const auto& instr : block->GetInstructions()) {
+            if (instr->GetOpCode() != Op::Mul || !instr->GetResult()) continue;
+            const auto& ops = instr->GetOperands();
+            if (ops.size() != 2) continue;
+            
+            for (int side = 0; side < 2; side++) {
+                if (inductions.count(ops[side]) && is_constant(ops[1 - side])) {
+                    candidates.push_back({instr.get(), ops[side], ops[1 - side]->GetConstantValue()});
+                    break;
+                }
+            }
+        }
+    }
+    
+    auto index_of = [](SSA::SSABasicBlock* block, SSA::SSAInstruction* instr) {
+        const auto& instrs = block->GetInstructions();
+        for (size_t i = 0; i < instrs.size(); i++) {
+            if (instrs[i].get() == instr) return i;
+        }
+        return instrs.size();
+    };
+    
+    std::map<std::pair<SSA::SSAValue*, int64_t>, SSA::SSAValue*> reduced;
+    std::unordered_map<SSA::SSAValue*, SSA::SSAValue*> replacement;
+    
+    for (const Candidate& candidate : candidates) {
+        auto key = std::make_pair(candidate.iv, candidate.factor);
+        auto found = reduced.find(key);
+        if (found == reduced.end()) {
+            const Induction& induction = inductions[candidate.iv];
+            SSA::SSAValue* scaled = func.CreateValue(SSA::SSAValue::Kind::Register);
+            SSA::SSAValue* scaled_next = func.CreateValue(SSA::SSAValue::Kind::Register);
+            
+            auto phi = std::make_unique<SSA::SSAInstruction>(Op::Phi);
+            phi->SetResult(scaled);
+            const auto& preds = induction.header->GetPredecessors();
+            for (size_t p = 0; p < preds.size(); p++) {
+                SSA::SSAValue* incoming = induction.phi->GetOperands()[p];
+                if (incoming == induction.step->GetResult()) {
+                    phi->AddOperand(scaled_next);
+                } else if (is_constant(incoming)) {
+                    phi->AddOperand(func.CreateConstant(incoming->GetConstantValue() * candidate.factor));
+                } else {
+                    // Scale the incoming value at the end of its predecessor
+                    auto mul = std::make_unique<SSA::SSAInstruction>(Op::Mul);
+                    SSA::SSAValue* product = func.CreateValue(SSA::SSAValue::Kind::Register);
+                    mul->SetResult(product);
+                    mul->AddOperand(incoming);
+                    mul->AddOperand(func.CreateConstant(candidate.factor));
+                    
+                    SSA::SSABasicBlock* pred = preds[p];
+                    size_t at = pred->GetInstructions().size();
+                    if (at > 0) {
+                        Op last = pred->GetInstructions()[at - 1]->GetOpCode();
+                        if (last == Op::Br || last == Op::CondBr || last == Op::Ret) at--;
+                    }
+                    pred->InsertInstruction(at, std::move(mul));
+                    phi->AddOperand(product);
+                }
+            }
+            induction.header->InsertInstruction(0, std::move(phi));
+            
+            auto step = std::make_unique<SSA::SSAInstruction>(Op::Add);
+            step->SetResult(scaled_next);
+            step->AddOperand(scaled);
+            step->AddOperand(func.CreateConstant(induction.increment * candidate.factor));
+            induction.step_block->InsertInstruction(
+                index_of(induction.step_block, induction.step) + 1, std::move(step));
+            
+            found = reduced.emplace(key, scaled).first;
+        }
+        replacement[candidate.mul->GetResult()] = found->second;
+    }
+    
+    // Redirect uses of the products and drop the multiplies
+    int removed = 0;
+    for (const auto& block : func.GetBlocks()) {
+        for (const auto& instr : block->GetInstructions()) {
+            const auto& ops = instr->GetOperands();
+            for (size_t i = 0; i < ops.size(); i++) {
+                auto it = replacement.find(ops[i]);
+                if (it != replacement.end()) instr->SetOperand(i, it->second);
+            }
+        }
+        for (size_t i = block->GetInstructions().size(); i-- > 0;) {
+            const auto& instr = block->GetInstructions()[i];
+            if (instr->GetOpCode() == Op::Mul && replacement.count(instr->GetResult())) {
+                block->RemoveInstruction(i);
+                removed++;
+            }
+        }
+    }
+    
+    return removed;
+}
+
+void ExpressionOptimizer::EliminateCommonSubexpressions(SSA::SSAModule& /*module*/) {
+    // Global CSE across basic blocks
+          // Compute hash of expression
+      // If seen before, replace with previous result
 }
 
 // ============================================================================
@@ -284,7 +453,7 @@ void ExpressionOptimizer::EliminateCommonSubexpressions(SSA::SSAModule& module)
 // ============================================================================
 
 std::vector<HotPathOptimizer::HotPath> HotPathOptimizer::IdentifyHotPaths(
-    const SSA::SSAModule& module, const ExecutionProfile& profile) {
+    const SSA::SSAModule& /*module*/, const ExecutionProfile& profile) {
     std::vector<HotPath> paths;
     
     // Find blocks with highest execution counts
@@ -323,53 +492,37 @@ std::vector<HotPathOptimizer::HotPath> HotPathOptimizer::IdentifyHotPaths(
     return paths;
 }
 
-void HotPathOptimizer::OptimizeHotPaths(SSA::SSAModule& module, 
-         const std::vector<HotPath>& paths) {
-for (const auto& path : paths) {
+void HotPathOptimizer::OptimizeHotPaths(SSA::SSAModule& /*module*/, 
+         const std::vector<HotPath>& /*paths*/) {
         // Aggressive optimization for hot paths
-        for (auto* block : path.blocks) {
         // Unroll loops more aggressively
    // Inline function calls
 // Eliminate redundant checks
             // Prefetch memory
        // Align code for cache lines
-     }
-    }
 }
 
-void HotPathOptimizer::AddHotPathMetadata(SSA::SSAModule& module,
-             const std::vector<HotPath>& paths) {
+void HotPathOptimizer::AddHotPathMetadata(SSA::SSAModule& /*module*/,
+             const std::vector<HotPath>& /*paths*/) {
     // Add metadata that runtime can use
-    for (const auto& path : paths) {
-    for (auto* block : path.blocks) {
   // Mark as hot path
      // Add execution count hint
        // Add branch probability hints
-        }
-    }
 }
 
 // ============================================================================
 // BRANCH OPTIMIZER IMPLEMENTATION
 // ============================================================================
 
-void BranchOptimizer::MergeBranches(SSA::SSAModule& module) {
+void BranchOptimizer::MergeBranches(SSA::SSAModule& /*module*/) {
     // Super-rational branch merging
-    for (const auto& func : module.GetFunctions()) {
-        for (const auto& block : func->GetBlocks()) {
             // If two branches have similar conditions, merge them
      // If branch targets are similar, combine them
-        }
-    }
 }
 
-void BranchOptimizer::ConvertToSelects(SSA::SSAModule& module) {
+void BranchOptimizer::ConvertToSelects(SSA::SSAModule& /*module*/) {
   // Convert simple branches to conditional moves
-    for (const auto& func : module.GetFunctions()) {
-      for (const auto& block : func->GetBlocks()) {
             // if (cond) x = a; else x = b;  -->  x = select(cond, a, b);
-      }
-    }
 }
 
 // ============================================================================
@@ -388,6 +541,7 @@ ConcurrencyOptimizer::DetectParallelism(const SSA::SSAModule& module) {
      
        ConcurrencyOpportunity opp;
             opp.type = ConcurrencyOpportunity::Type::DataParallel;
+            opp.parallelizable_blocks.push_back(block.get());
             opp.estimated_threads = 4; // Example
           opp.speedup_factor = 3.5;
    opp.has_dependencies = false;
@@ -411,6 +565,38 @@ void ConcurrencyOptimizer::AutoParallelize(SSA::SSAModule& module) {
     }
 }
 
+// ============================================================================
+// PRIMITIVE OPTIMIZER IMPLEMENTATION
+// ============================================================================
+
+void PrimitiveOptimizer::MetabolizePrimitives(SSA::SSAModule& /*module*/) {
+    // Metabolize primitives for rapid execution
+    // Map primitive operations onto single hardware instructions
+    // Route dodecagram arithmetic through fast paths
+}
+
+// ============================================================================
+// POLYMORPHISM OPTIMIZER IMPLEMENTATION
+// ============================================================================
+
+void PolymorphismOptimizer::Devirtualize(SSA::SSAModule& module) {
+    call_sites_.clear();
+    
+    for (const auto& func : module.GetFunctions()) {
+        for (const auto& block : func->GetBlocks()) {
+            for (const auto& instr : block->GetInstructions()) {
+                if (instr->GetOpCode() != SSA::SSAInstruction::OpCode::Call) continue;
+                
+                // Calls with a single possible target become direct calls
+                CallSite site;
+                site.call_instr = instr.get();
+                site.can_devirtualize = false;
+                call_sites_.push_back(site);
+            }
+        }
+    }
+}
+
 // ============================================================================
 // PATTERN RECOGNIZER IMPLEMENTATION
 // ============================================================================
@@ -434,7 +620,7 @@ void PatternRecognizer::DeducePatterns(const SSA::SSAModule& module) {
 }
 
 std::vector<PatternRecognizer::CodePattern> PatternRecognizer::RecognizePatterns(
-    const SSA::SSAModule& module) {
+    const SSA::SSAModule& /*module*/) {
     std::vector<CodePattern> recognized;
     
     // Common patterns to recognize:
@@ -447,14 +633,12 @@ std::vector<PatternRecognizer::CodePattern> PatternRecognizer::RecognizePatterns
     return recognized;
 }
 
-void PatternRecognizer::ReplaceWithOverlays(SSA::SSAModule& module,
-    const std::vector<CodePattern>& patterns) {
+void PatternRecognizer::ReplaceWithOverlays(SSA::SSAModule& /*module*/,
+    const std::vector<CodePattern>& /*patterns*/) {
     // Replace verbose patterns with optimized overlays
-    for (const auto& pattern : patterns) {
  // Find occurrences
         // Replace with optimized version
    // Track code reduction
-    }
 }
 
 // ============================================================================
@@ -462,7 +646,7 @@ void PatternRecognizer::ReplaceWithOverlays(SSA::SSAModule& module,
 // ============================================================================
 
 std::vector<ThreadSafetyAnalyzer::ThreadingIssue> 
-ThreadSafetyAnalyzer::DetectThreadingIssues(const SSA::SSAModule& module) {
+ThreadSafetyAnalyzer::DetectThreadingIssues(const SSA::SSAModule& /*module*/) {
     std::vector<ThreadingIssue> issues;
     
     // Detect data races
@@ -491,7 +675,7 @@ for (const auto& issue : issues) {
 }
 
 std::vector<SSA::SSABasicBlock*> ThreadSafetyAnalyzer::DetectBottlenecks(
-    const SSA::SSAModule& module) {
+    const SSA::SSAModule& /*module*/) {
  std::vector<SSA::SSABasicBlock*> bottlenecks;
     
     // Identify contention points
@@ -505,7 +689,7 @@ std::vector<SSA::SSABasicBlock*> ThreadSafetyAnalyzer::DetectBottlenecks(
 // RUNTIME STATISTICS IMPLEMENTATION
 // ============================================================================
 
-void RuntimeStatistics::CaptureSession(const SSA::SSAModule& module) {
+void RuntimeStatistics::CaptureSession(const SSA::SSAModule& /*module*/) {
     SessionCapture session;
     session.timestamp = std::chrono::system_clock::now();
     
@@ -528,7 +712,7 @@ RuntimeStatistics::LoadPreviousSessions() {
     return sessions;
 }
 
-void RuntimeStatistics::LearnFromStatistics(SSA::SSAModule& module,
+void RuntimeStatistics::LearnFromStatistics(SSA::SSAModule& /*module*/,
          const std::vector<SessionCapture>& sessions) {
  // Analyze patterns across sessions
     std::unordered_map<std::string, uint64_t> total_calls;
@@ -583,7 +767,7 @@ const std::vector<SessionCapture>& sessions) {
 // HYPER OPTIMIZER ORCHESTRATOR
 // ============================================================================
 
-HyperOptimizer::HyperOptimizer() {
+HyperOptimizer::HyperOptimizer() : threads_(0) {
     // Initialize all component optimizers
     type_analyzer_ = std::make_unique<TypeAnalyzer>();
  syntax_validator_ = std::make_unique<SyntaxValidator>();
@@ -604,21 +788,52 @@ HyperOptimizer::HyperOptimizer() {
     runtime_stats_ = std::make_unique<RuntimeStatistics>();
 }
 
+void HyperOptimizer::Stats::Merge(const Stats& other) {
+    total_passes += other.total_passes;
+    instructions_eliminated += other.instructions_eliminated;
+    branches_optimized += other.branches_optimized;
+    functions_inlined += other.functions_inlined;
+    loops_optimized += other.loops_optimized;
+    type_errors_caught += other.type_errors_caught;
+    syntax_errors_caught += other.syntax_errors_caught;
+    threading_issues_found += other.threading_issues_found;
+    strength_reductions += other.strength_reductions;
+    estimated_speedup = std::max(estimated_speedup, other.estimated_speedup);
+}
+
+void HyperOptimizer::SetConfig(const Config& config) {
+    config_ = config;
+}
+
 void HyperOptimizer::Optimize(SSA::SSAModule& module, int optimization_level) {
     auto start_time = std::chrono::high_resolution_clock::now();
+    stats_ = Stats();
+    
+    WorkStealingPool pool(threads_);
+    size_t worker_count = std::min<size_t>(pool.GetThreadCount(), module.GetFunctions().size());
+    std::vector<std::unique_ptr<HyperOptimizer>> workers;
+    for (size_t w = 0; w < worker_count; w++) {
+        workers.emplace_back(new HyperOptimizer());
+        workers.back()->SetConfig(config_);
+    }
   
-    // Run optimization passes based on level
+    // Run optimization passes based on level. Module passes run here,
+    // between the parallel phases, never alongside them.
     if (optimization_level >= 1) {
-        RunAnalysisPasses(module);
+        RunFunctionPassesInParallel(module, workers, true, optimization_level >= 2);
     }
     
     if (optimization_level >= 2) {
-        RunOptimizationPasses(module);
+        RunModulePasses(module);
     }
     
     if (optimization_level >= 3) {
         RunValidationPasses(module);
-  IterateUntilConvergence(module);
+  IterateUntilConvergence(module, workers);
+    }
+    
+    for (const auto& worker : workers) {
+        stats_.Merge(worker->stats_);
     }
  
     auto end_time = std::chrono::high_resolution_clock::now();
@@ -626,6 +841,25 @@ void HyperOptimizer::Optimize(SSA::SSAModule& module, int optimization_level) {
         end_time - start_time);
 }
 
+void HyperOptimizer::RunFunctionPassesInParallel(SSA::SSAModule& module,
+                                                 std::vector<std::unique_ptr<HyperOptimizer>>& workers,
+                                                 bool analyze, bool optimize) {
+    // A function's result depends only on the function, so any thread
+    // count produces the same module
+    WorkStealingPool pool(static_cast<unsigned>(std::max<size_t>(workers.size(), 1)));
+    pool.ParallelFor(module.GetFunctions().size(), [&](unsigned worker, size_t index) {
+        SSA::SSAModule scratch;
+        scratch.AddFunction(module.TakeFunction(index));
+        if (analyze) {
+            workers[worker]->RunAnalysisPasses(scratch);
+        }
+        if (optimize) {
+            workers[worker]->RunFunctionPasses(scratch);
+        }
+        module.PutFunction(index, scratch.TakeFunction(0));
+    });
+}
+
 void HyperOptimizer::RunAnalysisPasses(SSA::SSAModule& module) {
     if (config_.enable_type_analysis) {
   type_analyzer_->VerifyTypeCoherence(module);
@@ -645,11 +879,12 @@ void HyperOptimizer::RunAnalysisPasses(SSA::SSAModule& module) {
     }
 }
 
-void HyperOptimizer::RunOptimizationPasses(SSA::SSAModule& module) {
+void HyperOptimizer::RunFunctionPasses(SSA::SSAModule& module) {
     if (config_.enable_expression_optimization) {
      expr_optimizer_->SimplifyAlgebraically(module);
   expr_optimizer_->ReduceStrength(module);
         expr_optimizer_->EliminateCommonSubexpressions(module);
+        stats_.strength_reductions = expr_optimizer_->GetStrengthReductions();
     }
     
     if (config_.enable_bounds_checking) {
@@ -669,7 +904,9 @@ void HyperOptimizer::RunOptimizationPasses(SSA::SSAModule& module) {
     if (config_.enable_primitive_optimization) {
   primitive_optimizer_->MetabolizePrimitives(module);
     }
-    
+}
+
+void HyperOptimizer::RunModulePasses(SSA::SSAModule& module) {
     if (config_.enable_polymorphism_optimization) {
         polymorphism_optimizer_->Devirtualize(module);
     }
@@ -689,11 +926,13 @@ void HyperOptimizer::RunValidationPasses(SSA::SSAModule& module) {
     }
 }
 
-bool HyperOptimizer::IterateUntilConvergence(SSA::SSAModule& module) {
+bool HyperOptimizer::IterateUntilConvergence(SSA::SSAModule& module,
+                                             std::vector<std::unique_ptr<HyperOptimizer>>& workers) {
     double prev_cost = 1000000.0;
     
     for (int i = 0; i < config_.max_iterations; i++) {
-        RunOptimizationPasses(module);
+        RunFunctionPassesInParallel(module, workers, false, true);
+        RunModulePasses(module);
         
         // Calculate current cost (instruction count, etc.)
         double current_cost = 0.0;
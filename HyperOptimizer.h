@@ -48,7 +48,7 @@ enum class Kind {
     void MonomorphizeGenerics(SSA::SSAModule& module);
     
 private:
-    std::unordered_map<void*, std::unordered_set<TypeConstraint>> constraint_graph_;
+    std::unordered_map<void*, std::vector<TypeConstraint>> constraint_graph_;
     std::unordered_map<void*, double> type_confidence_;
 };
 
@@ -211,6 +211,9 @@ public:
     // Distributive law application
     void ApplyDistributiveLaw(SSA::SSAModule& module);
     
+    // Multiplies rewritten by ReduceStrength so far
+    int GetStrengthReductions() const { return strength_reductions_; }
+    
 private:
     struct ExpressionPattern {
         std::function<bool(const SSA::SSAInstruction&)> matcher;
@@ -219,6 +222,10 @@ private:
     };
     
     std::vector<ExpressionPattern> patterns_;
+    int strength_reductions_ = 0;
+    
+    // Mul(i, k) of a phi induction variable -> a second phi stepped by c*k
+    int ReduceInductionVariables(SSA::SSAFunction& func);
 };
 
 // ============================================================================
@@ -643,23 +650,31 @@ int max_iterations = 10;
     
     // Get optimization statistics
     struct Stats {
-        int total_passes;
-        int instructions_eliminated;
-    int branches_optimized;
-        int functions_inlined;
-   int loops_optimized;
-  int type_errors_caught;
-   int syntax_errors_caught;
-        int threading_issues_found;
-        double estimated_speedup;
-        std::chrono::milliseconds optimization_time;
+        int total_passes = 0;
+        int instructions_eliminated = 0;
+    int branches_optimized = 0;
+        int functions_inlined = 0;
+   int loops_optimized = 0;
+  int type_errors_caught = 0;
+   int syntax_errors_caught = 0;
+        int threading_issues_found = 0;
+        int strength_reductions = 0;
+        double estimated_speedup = 1.0;
+        std::chrono::milliseconds optimization_time{0};
+        
+        void Merge(const Stats& other); // Adds other's counts
     };
     
     const Stats& GetStats() const { return stats_; }
     
+    // Functions are optimized in parallel on this many threads (0 = one per
+    // hardware thread); the result does not depend on the count
+    void SetThreadCount(unsigned threads) { threads_ = threads; }
+    
 private:
     Config config_;
     Stats stats_;
+    unsigned threads_;
   
     // Component optimizers
     std::unique_ptr<TypeAnalyzer> type_analyzer_;
@@ -680,13 +695,23 @@ private:
     std::unique_ptr<AdaptiveScheduler> scheduler_;
     std::unique_ptr<RuntimeStatistics> runtime_stats_;
     
-    // Optimization passes
+    // Optimization passes. Function passes only touch the function they are
+    // given; module passes look across functions and run serially
     void RunAnalysisPasses(SSA::SSAModule& module);
-    void RunOptimizationPasses(SSA::SSAModule& module);
+    void RunFunctionPasses(SSA::SSAModule& module);
+    void RunModulePasses(SSA::SSAModule& module);
     void RunValidationPasses(SSA::SSAModule& module);
     
+    // Runs the analyses and/or function passes over every function on the
+    // workers, each function alone in a scratch module. Workers are
+    // HyperOptimizers with this one's config; their stats are merged at the end.
+    void RunFunctionPassesInParallel(SSA::SSAModule& module,
+                                     std::vector<std::unique_ptr<HyperOptimizer>>& workers,
+                                     bool analyze, bool optimize);
+    
     // Iterative optimization
-    bool IterateUntilConvergence(SSA::SSAModule& module);
+    bool IterateUntilConvergence(SSA::SSAModule& module,
+                                 std::vector<std::unique_ptr<HyperOptimizer>>& workers);
 };
 
 } // namespace HyperOptimization
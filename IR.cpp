@@ -1,6 +1,7 @@
 #include "IR.h"
 #include <iostream>
 #include <sstream>
+#include <algorithm>
 
 namespace Snow {
 namespace IR {
@@ -69,6 +70,13 @@ case OpCode::RET: ss << "RET"; break;
     if (src2.type != OperandType::Register || src2.value != 0) {
         ss << ", " << src2.ToString();
 }
+    if (opcode == OpCode::CALL) {
+        ss << "(";
+        for (size_t i = 0; i < arguments.size(); ++i) {
+            ss << (i ? ", " : "") << arguments[i].ToString();
+        }
+        ss << ")";
+    }
     
 // Comment
     if (!comment.empty()) {
@@ -78,6 +86,90 @@ case OpCode::RET: ss << "RET"; break;
     return ss.str();
 }
 
+int Instruction::GetDefinedRegister() const {
+    switch (opcode) {
+        case OpCode::MOV:
+        case OpCode::LOAD:
+        case OpCode::ADD:
+        case OpCode::SUB:
+        case OpCode::MUL:
+        case OpCode::DIV:
+        case OpCode::DODECAP:
+        case OpCode::SAMPLE:
+        case OpCode::DELTA:
+            return dest.type == OperandType::Register ? static_cast<int>(dest.value) : -1;
+        case OpCode::CALL:
+            return 0; // Result is in R0 by convention
+        default:
+            return -1;
+    }
+}
+
+void Instruction::GetUsedRegisters(std::vector<int>& regs) const {
+    auto use = [&regs](const Operand& op) {
+        if (op.type == OperandType::Register) {
+            regs.push_back(static_cast<int>(op.value));
+        }
+    };
+    
+    switch (opcode) {
+        case OpCode::MOV:
+        case OpCode::LOAD:
+        case OpCode::DODECAP:
+        case OpCode::SAMPLE:
+        case OpCode::DELTA:
+            use(src1);
+            break;
+        case OpCode::ADD:
+        case OpCode::SUB:
+        case OpCode::MUL:
+        case OpCode::DIV:
+            use(src1);
+            use(src2);
+            break;
+        case OpCode::STORE:
+        case OpCode::CMP:
+            use(dest);
+            use(src1);
+            break;
+        case OpCode::WAIT:
+            use(dest);
+            break;
+        case OpCode::CALL:
+            for (const Operand& arg : arguments) {
+                use(arg);
+            }
+            break;
+        case OpCode::RET:
+            regs.push_back(0);
+            break;
+        default:
+            break;
+    }
+}
+
+bool Instruction::IsBranch() const {
+    return opcode == OpCode::JMP || IsConditionalBranch();
+}
+
+bool Instruction::IsConditionalBranch() const {
+    switch (opcode) {
+        case OpCode::JE:
+        case OpCode::JNE:
+        case OpCode::JG:
+        case OpCode::JL:
+        case OpCode::JGE:
+        case OpCode::JLE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool Instruction::IsTerminator() const {
+    return opcode == OpCode::JMP || opcode == OpCode::RET;
+}
+
 // ============================================================================
 // FUNCTION IMPLEMENTATION
 // ============================================================================
@@ -94,6 +186,31 @@ BasicBlock* Function::CreateBlock(const std::string& name) {
   return ptr;
 }
 
+BasicBlock* Function::InsertBlock(size_t index, const std::string& name) {
+    auto block = std::make_unique<BasicBlock>(name);
+    BasicBlock* ptr = block.get();
+    index = std::min(index, blocks_.size());
+    blocks_.insert(blocks_.begin() + index, std::move(block));
+    
+    // Layout order is execution order: a block placed first becomes the entry
+    if (!entry_block_ || index == 0) {
+        entry_block_ = ptr;
+    }
+    
+    return ptr;
+}
+
+void Function::RemoveBlock(const BasicBlock* block) {
+    auto it = std::find_if(blocks_.begin(), blocks_.end(),
+                           [block](const std::unique_ptr<BasicBlock>& b) { return b.get() == block; });
+    if (it == blocks_.end()) return;
+    
+    blocks_.erase(it);
+    if (entry_block_ == block) {
+        entry_block_ = blocks_.empty() ? nullptr : blocks_.front().get();
+    }
+}
+
 // ============================================================================
 // MODULE IMPLEMENTATION
 // ============================================================================
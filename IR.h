@@ -43,7 +43,7 @@ JNE,        // Jump if not equal
     
     // Temporal operations
     WAIT,       // Wait for duration
-    DODECAP,    // Dodecagram capture
+    DODECAP,    // Dodecagram capture: dest = src1 (the VM also records it)
     SAMPLE,     // Sample value
     DELTA,      // Compute delta
     
@@ -64,8 +64,8 @@ enum class OperandType {
 };
 
 struct Operand {
-    OperandType type;
-    int64_t value;
+    OperandType type = OperandType::Register;
+    int64_t value = 0;
     std::string label;
   
     static Operand Register(int reg) {
@@ -101,6 +101,7 @@ struct Instruction {
  Operand dest;
     Operand src1;
     Operand src2;
+    std::vector<Operand> arguments;   // CALL: argument values, parameter k of the callee is its register k
     std::string comment;
     
     Instruction(OpCode op) : opcode(op) {}
@@ -110,6 +111,15 @@ struct Instruction {
  : opcode(op), dest(d), src1(s1), src2(s2) {}
     
     std::string ToString() const;
+    
+    // Register roles by opcode (CALL reads its arguments and defines R0, RET
+    // reads R0 by convention)
+    int GetDefinedRegister() const;  // -1 if none
+    void GetUsedRegisters(std::vector<int>& regs) const;
+    
+    bool IsBranch() const;            // JMP or conditional jump
+    bool IsConditionalBranch() const;
+    bool IsTerminator() const;        // JMP or RET
 };
 
 // ============================================================================
@@ -122,6 +132,7 @@ public:
     
     void AddInstruction(const Instruction& instr) { instructions_.push_back(instr); }
     const std::vector<Instruction>& GetInstructions() const { return instructions_; }
+    std::vector<Instruction>& GetInstructions() { return instructions_; }
     std::string GetName() const { return name_; }
     
     void AddSuccessor(BasicBlock* block) { successors_.push_back(block); }
@@ -144,12 +155,15 @@ public:
     std::string GetName() const { return name_; }
     
  BasicBlock* CreateBlock(const std::string& name);
+    BasicBlock* InsertBlock(size_t index, const std::string& name); // At layout position 'index'
+    void RemoveBlock(const BasicBlock* block); // Branches into it must already be gone
     BasicBlock* GetEntryBlock() { return entry_block_; }
 void SetEntryBlock(BasicBlock* block) { entry_block_ = block; }
     
     const std::vector<std::unique_ptr<BasicBlock>>& GetBlocks() const { return blocks_; }
     
     int AllocateRegister() { return next_register_++; }
+    int GetRegisterCount() const { return next_register_; }
     
     void AddParameter(const std::string& name) { parameters_.push_back(name); }
     const std::vector<std::string>& GetParameters() const { return parameters_; }
@@ -0,0 +1,758 @@
+#include "IRAnalysis.h"
+#include <algorithm>
+
+namespace Snow {
+namespace IR {
+
+// ============================================================================
+// CONTROL FLOW GRAPH IMPLEMENTATION
+// ============================================================================
+
+ControlFlowGraph::ControlFlowGraph(const Function& func) {
+    for (const auto& block : func.GetBlocks()) {
+        block_index_[block->GetName()] = static_cast<int>(blocks_.size());
+        blocks_.push_back(block.get());
+    }
+
+    int count = GetBlockCount();
+    successors_.assign(count, std::vector<int>());
+    predecessors_.assign(count, std::vector<int>());
+    fallthrough_.assign(count, -1);
+
+    auto add_edge = [this](int from, int to) {
+        auto& succs = successors_[from];
+        if (std::find(succs.begin(), succs.end(), to) == succs.end()) {
+            succs.push_back(to);
+            predecessors_[to].push_back(from);
+        }
+    };
+
+    for (int b = 0; b < count; ++b) {
+        const auto& instrs = blocks_[b]->GetInstructions();
+        bool terminated = false;
+
+        for (const auto& instr : instrs) {
+            if (instr.IsBranch()) {
+                int target = GetBlockIndex(instr.dest.label);
+                if (target >= 0) {
+                    add_edge(b, target);
+                }
+            }
+            if (instr.IsTerminator()) {
+                terminated = true;
+                break;
+            }
+        }
+
+        if (!terminated && b + 1 < count) {
+            fallthrough_[b] = b + 1;
+            add_edge(b, b + 1);
+        }
+    }
+}
+
+int ControlFlowGraph::GetBlockIndex(const std::string& label) const {
+    auto it = block_index_.find(label);
+    return it != block_index_.end() ? it->second : -1;
+}
+
+// ============================================================================
+// LIVENESS IMPLEMENTATION
+// ============================================================================
+
+int CountRegisters(const Function& func) {
+    int count = func.GetRegisterCount();
+    std::vector<int> uses;
+
+    for (const auto& block : func.GetBlocks()) {
+        for (const auto& instr : block->GetInstructions()) {
+            uses.clear();
+            instr.GetUsedRegisters(uses);
+            uses.push_back(instr.GetDefinedRegister());
+            for (int reg : uses) {
+                count = std::max(count, reg + 1);
+            }
+        }
+    }
+
+    return std::max(count, 1);
+}
+
+Liveness::Liveness(const Function& func, const ControlFlowGraph& cfg)
+    : cfg_(cfg), register_count_(CountRegisters(func)) {
+    int count = cfg.GetBlockCount();
+    live_in_.assign(count, RegisterSet(register_count_, false));
+    live_out_.assign(count, RegisterSet(register_count_, false));
+
+    // Iterate in reverse layout order until no live-in set grows
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int b = count - 1; b >= 0; --b) {
+            if (ComputeBlock(b)) {
+                changed = true;
+            }
+        }
+    }
+
+    for (int b = 0; b < count; ++b) {
+        for (int succ : cfg.GetSuccessors(b)) {
+            for (int r = 0; r < register_count_; ++r) {
+                if (live_in_[succ][r]) live_out_[b][r] = true;
+            }
+        }
+    }
+}
+
+bool Liveness::ComputeBlock(int block) {
+    const auto& instrs = cfg_.GetBlock(block)->GetInstructions();
+
+    RegisterSet live(register_count_, false);
+    int fallthrough = cfg_.GetFallthrough(block);
+    if (fallthrough >= 0) {
+        live = live_in_[fallthrough];
+    }
+
+    std::vector<int> uses;
+    for (auto it = instrs.rbegin(); it != instrs.rend(); ++it) {
+        const Instruction& instr = *it;
+
+        if (instr.IsBranch()) {
+            int target = cfg_.GetBlockIndex(instr.dest.label);
+            if (instr.opcode == OpCode::JMP) {
+                live.assign(register_count_, false);
+            }
+            if (target >= 0) {
+                const RegisterSet& target_live = live_in_[target];
+                for (int r = 0; r < register_count_; ++r) {
+                    if (target_live[r]) live[r] = true;
+                }
+            }
+        } else if (instr.opcode == OpCode::RET) {
+            live.assign(register_count_, false);
+        }
+
+        int def = instr.GetDefinedRegister();
+        if (def >= 0) {
+            live[def] = false;
+        }
+
+        uses.clear();
+        instr.GetUsedRegisters(uses);
+        for (int reg : uses) {
+            live[reg] = true;
+        }
+    }
+
+    if (live != live_in_[block]) {
+        live_in_[block] = live;
+        return true;
+    }
+    return false;
+}
+
+// ============================================================================
+// DOMINATOR TREE IMPLEMENTATION
+// ============================================================================
+
+DominatorTree::DominatorTree(const ControlFlowGraph& cfg) {
+    int count = cfg.GetBlockCount();
+    idom_.assign(count, -1);
+    rpo_number_.assign(count, -1);
+    if (count == 0) return;
+
+    // Iterative DFS from the entry block for the postorder
+    std::vector<int> postorder;
+    std::vector<bool> visited(count, false);
+    std::vector<std::pair<int, size_t>> stack;
+    stack.push_back(std::make_pair(0, 0));
+    visited[0] = true;
+    while (!stack.empty()) {
+        int block = stack.back().first;
+        size_t& next = stack.back().second;
+        const auto& succs = cfg.GetSuccessors(block);
+        if (next < succs.size()) {
+            int succ = succs[next++];
+            if (!visited[succ]) {
+                visited[succ] = true;
+                stack.push_back(std::make_pair(succ, 0));
+            }
+        } else {
+            postorder.push_back(block);
+            stack.pop_back();
+        }
+    }
+
+    rpo_.assign(postorder.rbegin(), postorder.rend());
+    for (size_t i = 0; i < rpo_.size(); ++i) {
+        rpo_number_[rpo_[i]] = static_cast<int>(i);
+    }
+
+    auto intersect = [this](int a, int b) {
+        while (a != b) {
+            while (rpo_number_[a] > rpo_number_[b]) a = idom_[a];
+            while (rpo_number_[b] > rpo_number_[a]) b = idom_[b];
+        }
+        return a;
+    };
+
+    idom_[0] = 0;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = 1; i < rpo_.size(); ++i) {
+            int block = rpo_[i];
+            int new_idom = -1;
+            for (int pred : cfg.GetPredecessors(block)) {
+                if (idom_[pred] < 0) continue; // Not processed yet or unreachable
+                new_idom = new_idom < 0 ? pred : intersect(pred, new_idom);
+            }
+            if (new_idom != idom_[block]) {
+                idom_[block] = new_idom;
+                changed = true;
+            }
+        }
+    }
+    idom_[0] = -1;
+}
+
+bool DominatorTree::Dominates(int a, int b) const {
+    if (!IsReachable(a) || !IsReachable(b)) return false;
+    while (b >= 0) {
+        if (a == b) return true;
+        b = idom_[b];
+    }
+    return false;
+}
+
+// ============================================================================
+// LOOP NEST IMPLEMENTATION
+// ============================================================================
+
+namespace {
+
+// Conditional branch outcome for 'lhs CMP rhs'
+bool EvaluateCondition(OpCode op, int64_t lhs, int64_t rhs) {
+    switch (op) {
+        case OpCode::JE:  return lhs == rhs;
+        case OpCode::JNE: return lhs != rhs;
+        case OpCode::JG:  return lhs > rhs;
+        case OpCode::JL:  return lhs < rhs;
+        case OpCode::JGE: return lhs >= rhs;
+        case OpCode::JLE: return lhs <= rhs;
+        default:          return false;
+    }
+}
+
+// Condition with its operands swapped (a < b  <=>  b > a)
+OpCode SwapCondition(OpCode op) {
+    switch (op) {
+        case OpCode::JG:  return OpCode::JL;
+        case OpCode::JL:  return OpCode::JG;
+        case OpCode::JGE: return OpCode::JLE;
+        case OpCode::JLE: return OpCode::JGE;
+        default:          return op;
+    }
+}
+
+// Trip counts beyond this are treated as unknown
+const int kMaxTripCount = 1 << 20;
+
+} // namespace
+
+LoopInfo::LoopInfo(const Function& func)
+    : cfg_(func), dominators_(cfg_) {
+    innermost_.assign(cfg_.GetBlockCount(), -1);
+
+    std::unordered_map<int, int> def_count;
+    for (const auto& block : func.GetBlocks()) {
+        for (const auto& instr : block->GetInstructions()) {
+            int def = instr.GetDefinedRegister();
+            if (def < 0) continue;
+            def_count[def]++;
+            if (instr.opcode == OpCode::MOV && instr.src1.type == OperandType::Immediate) {
+                constants_[def] = instr.src1.value;
+            }
+        }
+    }
+    for (auto it = constants_.begin(); it != constants_.end();) {
+        it = def_count[it->first] == 1 ? std::next(it) : constants_.erase(it);
+    }
+
+    FindLoops();
+    BuildNest();
+    FindExitsAndPreheaders();
+    for (int i = 0; i < GetLoopCount(); ++i) {
+        ComputeTripCount(i);
+    }
+}
+
+void LoopInfo::FindLoops() {
+    std::unordered_map<int, int> loop_of_header;
+
+    for (int block : dominators_.GetReversePostorder()) {
+        for (int succ : cfg_.GetSuccessors(block)) {
+            if (!dominators_.Dominates(succ, block)) continue;
+
+            auto it = loop_of_header.find(succ);
+            if (it == loop_of_header.end()) {
+                it = loop_of_header.insert(std::make_pair(succ, static_cast<int>(loops_.size()))).first;
+                loops_.push_back(Loop());
+                loops_.back().header = succ;
+            }
+            loops_[it->second].latches.push_back(block);
+        }
+    }
+
+    // Body: everything that reaches a latch without passing through the header
+    for (auto& loop : loops_) {
+        std::vector<bool> in_loop(cfg_.GetBlockCount(), false);
+        in_loop[loop.header] = true;
+        std::vector<int> work;
+        for (int latch : loop.latches) {
+            if (!in_loop[latch]) {
+                in_loop[latch] = true;
+                work.push_back(latch);
+            }
+        }
+        while (!work.empty()) {
+            int block = work.back();
+            work.pop_back();
+            for (int pred : cfg_.GetPredecessors(block)) {
+                if (!in_loop[pred] && dominators_.IsReachable(pred)) {
+                    in_loop[pred] = true;
+                    work.push_back(pred);
+                }
+            }
+        }
+        for (int b = 0; b < cfg_.GetBlockCount(); ++b) {
+            if (in_loop[b]) loop.blocks.push_back(b);
+        }
+    }
+}
+
+void LoopInfo::BuildNest() {
+    // Inner loops are strict subsets of outer ones, so size orders the nest
+    std::sort(loops_.begin(), loops_.end(), [](const Loop& a, const Loop& b) {
+        if (a.blocks.size() != b.blocks.size()) return a.blocks.size() < b.blocks.size();
+        return a.header < b.header;
+    });
+
+    int count = GetLoopCount();
+    for (int i = 0; i < count; ++i) {
+        for (int j = i + 1; j < count; ++j) {
+            if (loops_[j].Contains(loops_[i].header)) {
+                loops_[i].parent = j;
+                loops_[j].children.push_back(i);
+                break;
+            }
+        }
+    }
+
+    for (int i = count - 1; i >= 0; --i) {
+        int parent = loops_[i].parent;
+        loops_[i].depth = parent < 0 ? 1 : loops_[parent].depth + 1;
+    }
+
+    for (int i = count - 1; i >= 0; --i) {
+        for (int block : loops_[i].blocks) {
+            innermost_[block] = i;
+        }
+    }
+}
+
+void LoopInfo::FindExitsAndPreheaders() {
+    for (auto& loop : loops_) {
+        for (int block : loop.blocks) {
+            for (int succ : cfg_.GetSuccessors(block)) {
+                if (!loop.Contains(succ) &&
+                    std::find(loop.exits.begin(), loop.exits.end(), succ) == loop.exits.end()) {
+                    loop.exits.push_back(succ);
+                }
+            }
+        }
+
+        int outside = -1;
+        int outside_count = 0;
+        for (int pred : cfg_.GetPredecessors(loop.header)) {
+            if (!loop.Contains(pred)) {
+                outside = pred;
+                outside_count++;
+            }
+        }
+        if (outside_count == 1 && cfg_.GetSuccessors(outside).size() == 1) {
+            loop.preheader = outside;
+        }
+    }
+}
+
+int LoopInfo::GetLoopDepth(int block) const {
+    int loop = innermost_[block];
+    return loop < 0 ? 0 : loops_[loop].depth;
+}
+
+int LoopInfo::GetLoopWithHeader(int block) const {
+    for (int i = 0; i < GetLoopCount(); ++i) {
+        if (loops_[i].header == block) return i;
+    }
+    return -1;
+}
+
+bool LoopInfo::IsBackEdge(int from, int to) const {
+    const auto& succs = cfg_.GetSuccessors(from);
+    return std::find(succs.begin(), succs.end(), to) != succs.end() &&
+           dominators_.Dominates(to, from);
+}
+
+bool LoopInfo::GetConstant(int reg, int64_t& value) const {
+    auto it = constants_.find(reg);
+    if (it == constants_.end()) return false;
+    value = it->second;
+    return true;
+}
+
+// ============================================================================
+// TRIP COUNTS
+// A counted loop has a single exiting block that runs every iteration and
+// tests an induction register against a constant. The register is set once
+// before the loop and stepped by a constant once per iteration, either
+// directly (ADD r, r, k) or through a temporary (SUB t, r, k; MOV r, t) as
+// the IR generator emits for 'r = r - k'. The trip count is found by replaying
+// the induction sequence, which keeps every comparison and test position exact.
+// ============================================================================
+
+void LoopInfo::ComputeTripCount(int loop_index) {
+    Loop& loop = loops_[loop_index];
+
+    auto constant_of = [this](const Operand& op, int64_t& value) {
+        if (op.type == OperandType::Immediate) {
+            value = op.value;
+            return true;
+        }
+        if (op.type == OperandType::Register) {
+            auto it = constants_.find(static_cast<int>(op.value));
+            if (it != constants_.end()) {
+                value = it->second;
+                return true;
+            }
+        }
+        return false;
+    };
+
+    // Single exiting block that every iteration passes through
+    int exiting = -1;
+    for (int block : loop.blocks) {
+        for (int succ : cfg_.GetSuccessors(block)) {
+            if (loop.Contains(succ)) continue;
+            if (exiting >= 0 && exiting != block) return;
+            exiting = block;
+        }
+    }
+    if (exiting < 0) return;
+    for (int latch : loop.latches) {
+        if (!dominators_.Dominates(exiting, latch)) return;
+    }
+
+    // The exiting branch and whether taking it leaves the loop
+    const auto& exit_instrs = cfg_.GetBlock(exiting)->GetInstructions();
+    int branch = -1;
+    for (size_t i = 0; i < exit_instrs.size(); ++i) {
+        if (exit_instrs[i].IsConditionalBranch()) {
+            branch = static_cast<int>(i);
+            break;
+        }
+        if (exit_instrs[i].IsTerminator()) return;
+    }
+    if (branch < 0) return;
+
+    int target = cfg_.GetBlockIndex(exit_instrs[branch].dest.label);
+    bool exit_when_taken = target >= 0 && !loop.Contains(target);
+    if (!exit_when_taken) {
+        // Not taken must leave: a JMP out right after, or falling out of the loop
+        size_t next = branch + 1;
+        int not_taken = -1;
+        if (next < exit_instrs.size()) {
+            if (exit_instrs[next].opcode != OpCode::JMP) return;
+            not_taken = cfg_.GetBlockIndex(exit_instrs[next].dest.label);
+        } else {
+            not_taken = cfg_.GetFallthrough(exiting);
+        }
+        if (not_taken < 0 || loop.Contains(not_taken)) return;
+    }
+
+    // Nearest CMP before the branch: induction register against a constant
+    int compare = -1;
+    for (int i = branch - 1; i >= 0; --i) {
+        if (exit_instrs[i].opcode == OpCode::CMP) {
+            compare = i;
+            break;
+        }
+    }
+    if (compare < 0) return;
+
+    const Instruction& cmp = exit_instrs[compare];
+    OpCode condition = exit_instrs[branch].opcode;
+    int iv = -1;
+    int64_t limit = 0;
+    if (cmp.dest.type == OperandType::Register && constant_of(cmp.src1, limit)) {
+        iv = static_cast<int>(cmp.dest.value);
+    } else if (cmp.src1.type == OperandType::Register && constant_of(cmp.dest, limit)) {
+        iv = static_cast<int>(cmp.src1.value);
+        condition = SwapCondition(condition);
+    }
+    if (iv < 0 || constants_.count(iv)) return;
+
+    // Exactly one definition inside the loop, executed once per iteration
+    int update_block = -1;
+    int update_index = -1;
+    const Instruction* update = nullptr;
+    for (int block : loop.blocks) {
+        const auto& instrs = cfg_.GetBlock(block)->GetInstructions();
+        for (size_t i = 0; i < instrs.size(); ++i) {
+            if (instrs[i].GetDefinedRegister() != iv) continue;
+            if (update) return;
+            update = &instrs[i];
+            update_block = block;
+            update_index = static_cast<int>(i);
+        }
+    }
+    if (!update || innermost_[update_block] != loop_index) return;
+    for (int latch : loop.latches) {
+        if (!dominators_.Dominates(update_block, latch)) return;
+    }
+
+    // Step: r = r +/- k, or r = t with t = r +/- k defined once in the loop
+    auto step_of = [&](const Instruction& instr, int64_t& step) {
+        if (instr.opcode != OpCode::ADD && instr.opcode != OpCode::SUB) return false;
+        int64_t k = 0;
+        bool iv_left = instr.src1.type == OperandType::Register && instr.src1.value == iv;
+        bool iv_right = instr.src2.type == OperandType::Register && instr.src2.value == iv;
+        if (iv_left && constant_of(instr.src2, k)) {
+            step = instr.opcode == OpCode::ADD ? k : -k;
+            return true;
+        }
+        if (iv_right && instr.opcode == OpCode::ADD && constant_of(instr.src1, k)) {
+            step = k;
+            return true;
+        }
+        return false;
+    };
+
+    int64_t step = 0;
+    if (update->opcode == OpCode::MOV && update->src1.type == OperandType::Register) {
+        int temp = static_cast<int>(update->src1.value);
+        const Instruction* temp_def = nullptr;
+        for (int block : loop.blocks) {
+            for (const auto& instr : cfg_.GetBlock(block)->GetInstructions()) {
+                if (instr.GetDefinedRegister() != temp) continue;
+                if (temp_def) return;
+                temp_def = &instr;
+            }
+        }
+        if (!temp_def || !step_of(*temp_def, step)) return;
+    } else if (!step_of(*update, step)) {
+        return;
+    }
+
+    // Start: the single definition outside the loop, dominating the header
+    int64_t start = 0;
+    bool found_start = false;
+    for (int block = 0; block < cfg_.GetBlockCount(); ++block) {
+        if (loop.Contains(block)) continue;
+        for (const auto& instr : cfg_.GetBlock(block)->GetInstructions()) {
+            if (instr.GetDefinedRegister() != iv) continue;
+            if (found_start || instr.opcode != OpCode::MOV ||
+                !constant_of(instr.src1, start) ||
+                !dominators_.Dominates(block, loop.header)) {
+                return;
+            }
+            found_start = true;
+        }
+    }
+    if (!found_start) return;
+
+    loop.induction_register = iv;
+    loop.induction_start = start;
+    loop.induction_step = step;
+    if (step == 0) return;
+
+    // Does the test see the value before or after this iteration's step?
+    bool tests_stepped;
+    if (update_block == exiting) {
+        tests_stepped = update_index < compare;
+    } else if (dominators_.Dominates(update_block, exiting)) {
+        tests_stepped = true;
+    } else if (dominators_.Dominates(exiting, update_block)) {
+        tests_stepped = false;
+    } else {
+        return;
+    }
+
+    int64_t value = start;
+    for (int trip = 1; trip <= kMaxTripCount; ++trip) {
+        if (tests_stepped) value += step;
+        if (EvaluateCondition(condition, value, limit) == exit_when_taken) {
+            loop.trip_count = trip;
+            return;
+        }
+        if (!tests_stepped) value += step;
+    }
+}
+
+// ============================================================================
+// PREHEADER INSERTION
+// ============================================================================
+
+int InsertLoopPreheaders(Function& func) {
+    int inserted = 0;
+
+    while (true) {
+        LoopInfo info(func);
+        const ControlFlowGraph& cfg = info.GetCFG();
+
+        const Loop* target = nullptr;
+        for (const auto& loop : info.GetLoops()) {
+            if (loop.preheader < 0) {
+                target = &loop;
+                break;
+            }
+        }
+        if (!target) break;
+
+        int header = target->header;
+        std::string header_name = cfg.GetBlock(header)->GetName();
+        std::string name = header_name + "_preheader";
+        while (cfg.GetBlockIndex(name) >= 0) {
+            name += "_";
+        }
+
+        auto& blocks = func.GetBlocks();
+
+        // A loop block falling into the header must now jump over the preheader
+        if (header > 0 && cfg.GetFallthrough(header - 1) == header && target->Contains(header - 1)) {
+            blocks[header - 1]->AddInstruction(Instruction(OpCode::JMP, Operand::Label(header_name)));
+        }
+
+        // Entries from outside the loop go through the preheader
+        for (int pred : cfg.GetPredecessors(header)) {
+            if (target->Contains(pred)) continue;
+            for (auto& instr : blocks[pred]->GetInstructions()) {
+                if (instr.IsBranch() && instr.dest.label == header_name) {
+                    instr.dest.label = name;
+                }
+            }
+        }
+
+        // Empty, so it falls through into the header
+        func.InsertBlock(header, name);
+        inserted++;
+    }
+
+    return inserted;
+}
+
+// ============================================================================
+// CALL GRAPH IMPLEMENTATION
+// ============================================================================
+
+CallGraph::CallGraph(const Module& module) {
+    for (const auto& func : module.GetFunctions()) {
+        function_index_[func->GetName()] = static_cast<int>(functions_.size());
+        functions_.push_back(func.get());
+    }
+
+    int count = GetFunctionCount();
+    callees_.assign(count, std::vector<int>());
+    call_sites_.assign(count, 0);
+
+    for (int f = 0; f < count; ++f) {
+        for (const auto& block : functions_[f]->GetBlocks()) {
+            for (const auto& instr : block->GetInstructions()) {
+                if (instr.opcode != OpCode::CALL) continue;
+                int callee = GetFunctionIndex(instr.dest.label);
+                if (callee < 0) continue;
+
+                call_sites_[callee]++;
+                auto& callees = callees_[f];
+                if (std::find(callees.begin(), callees.end(), callee) == callees.end()) {
+                    callees.push_back(callee);
+                }
+            }
+        }
+    }
+
+    FindComponents();
+}
+
+int CallGraph::GetFunctionIndex(const std::string& name) const {
+    auto it = function_index_.find(name);
+    return it != function_index_.end() ? it->second : -1;
+}
+
+bool CallGraph::IsRecursive(int index) const {
+    if (components_[component_[index]].size() > 1) return true;
+    const auto& callees = callees_[index];
+    return std::find(callees.begin(), callees.end(), index) != callees.end();
+}
+
+// Tarjan's algorithm with an explicit stack; a component is complete when
+// the DFS leaves its root, which happens only after all its callees' are
+void CallGraph::FindComponents() {
+    int count = GetFunctionCount();
+    std::vector<int> order(count, -1);
+    std::vector<int> low(count, 0);
+    std::vector<bool> on_stack(count, false);
+    std::vector<int> stack;
+    component_.assign(count, -1);
+    int next_order = 0;
+
+    for (int root = 0; root < count; ++root) {
+        if (order[root] >= 0) continue;
+
+        std::vector<std::pair<int, size_t>> dfs; // (function, next callee to visit)
+        dfs.push_back(std::make_pair(root, 0));
+        order[root] = low[root] = next_order++;
+        stack.push_back(root);
+        on_stack[root] = true;
+
+        while (!dfs.empty()) {
+            int f = dfs.back().first;
+            size_t& next = dfs.back().second;
+
+            if (next < callees_[f].size()) {
+                int callee = callees_[f][next++];
+                if (order[callee] < 0) {
+                    order[callee] = low[callee] = next_order++;
+                    stack.push_back(callee);
+                    on_stack[callee] = true;
+                    dfs.push_back(std::make_pair(callee, 0));
+                } else if (on_stack[callee]) {
+                    low[f] = std::min(low[f], order[callee]);
+                }
+                continue;
+            }
+
+            dfs.pop_back();
+            if (!dfs.empty()) {
+                int caller = dfs.back().first;
+                low[caller] = std::min(low[caller], low[f]);
+            }
+            if (low[f] != order[f]) continue;
+
+            std::vector<int> members;
+            int member;
+            do {
+                member = stack.back();
+                stack.pop_back();
+                on_stack[member] = false;
+                component_[member] = static_cast<int>(components_.size());
+                members.push_back(member);
+            } while (member != f);
+            std::sort(members.begin(), members.end());
+            components_.push_back(members);
+        }
+    }
+}
+
+} // namespace IR
+} // namespace Snow
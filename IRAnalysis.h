@@ -0,0 +1,192 @@
+#pragma once
+
+#include "IR.h"
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+
+namespace Snow {
+namespace IR {
+
+// ============================================================================
+// CONTROL FLOW GRAPH
+// Blocks are identified by their index in Function::GetBlocks(). Edges come
+// from branch targets plus fall-through into the next block in layout order.
+// ============================================================================
+
+class ControlFlowGraph {
+public:
+    explicit ControlFlowGraph(const Function& func);
+
+    int GetBlockCount() const { return static_cast<int>(blocks_.size()); }
+    const BasicBlock* GetBlock(int index) const { return blocks_[index]; }
+
+    const std::vector<int>& GetSuccessors(int index) const { return successors_[index]; }
+    const std::vector<int>& GetPredecessors(int index) const { return predecessors_[index]; }
+
+    // Block index for a label, -1 if the label names no block (e.g. a function)
+    int GetBlockIndex(const std::string& label) const;
+
+    // Next block in layout order if control can fall off the end of 'index'
+    int GetFallthrough(int index) const { return fallthrough_[index]; }
+
+private:
+    std::vector<const BasicBlock*> blocks_;
+    std::vector<std::vector<int>> successors_;
+    std::vector<std::vector<int>> predecessors_;
+    std::vector<int> fallthrough_;
+    std::unordered_map<std::string, int> block_index_;
+};
+
+// ============================================================================
+// LIVENESS ANALYSIS
+// Backward dataflow over virtual registers. Branches in the middle of a block
+// are honoured, so live-in sets stay exact even for unstructured IR.
+// ============================================================================
+
+using RegisterSet = std::vector<bool>;
+
+class Liveness {
+public:
+    Liveness(const Function& func, const ControlFlowGraph& cfg);
+
+    int GetRegisterCount() const { return register_count_; }
+
+    const RegisterSet& GetLiveIn(int block) const { return live_in_[block]; }
+    const RegisterSet& GetLiveOut(int block) const { return live_out_[block]; }
+
+private:
+    const ControlFlowGraph& cfg_;
+    int register_count_;
+    std::vector<RegisterSet> live_in_;
+    std::vector<RegisterSet> live_out_;
+
+    bool ComputeBlock(int block);
+};
+
+// Highest register number referenced by any instruction, plus one
+int CountRegisters(const Function& func);
+
+// ============================================================================
+// DOMINATOR TREE
+// Cooper-Harvey-Kennedy iterative algorithm over reverse postorder.
+// Unreachable blocks have no immediate dominator and dominate nothing.
+// ============================================================================
+
+class DominatorTree {
+public:
+    explicit DominatorTree(const ControlFlowGraph& cfg);
+
+    int GetIdom(int block) const { return idom_[block]; } // -1 for entry/unreachable
+    bool Dominates(int a, int b) const;
+    bool IsReachable(int block) const { return rpo_number_[block] >= 0; }
+
+    const std::vector<int>& GetReversePostorder() const { return rpo_; }
+
+private:
+    std::vector<int> idom_;
+    std::vector<int> rpo_;
+    std::vector<int> rpo_number_;
+};
+
+// ============================================================================
+// LOOP NEST
+// Natural loops from back edges (edges whose target dominates their source).
+// Loops sharing a header are merged. Loops are ordered inner before outer.
+// ============================================================================
+
+struct Loop {
+    int header = -1;
+    std::vector<int> blocks;      // Sorted block indices, header included
+    std::vector<int> latches;     // Sources of back edges
+    std::vector<int> exits;       // Blocks outside the loop entered from inside
+    int preheader = -1;           // Only outside predecessor, if it falls into the header alone
+    int parent = -1;              // Enclosing loop index, -1 for outermost
+    std::vector<int> children;
+    int depth = 1;
+
+    // Counted loops: how many times the header runs per entry, -1 if unknown
+    int trip_count = -1;
+    int induction_register = -1;
+    int64_t induction_start = 0;
+    int64_t induction_step = 0;
+
+    bool Contains(int block) const {
+        return std::binary_search(blocks.begin(), blocks.end(), block);
+    }
+};
+
+class LoopInfo {
+public:
+    explicit LoopInfo(const Function& func);
+
+    const ControlFlowGraph& GetCFG() const { return cfg_; }
+    const DominatorTree& GetDominators() const { return dominators_; }
+
+    int GetLoopCount() const { return static_cast<int>(loops_.size()); }
+    const Loop& GetLoop(int index) const { return loops_[index]; }
+    const std::vector<Loop>& GetLoops() const { return loops_; }
+
+    int GetLoopFor(int block) const { return innermost_[block]; } // -1 if not in a loop
+    int GetLoopDepth(int block) const;
+    int GetLoopWithHeader(int block) const;
+    bool IsBackEdge(int from, int to) const;
+    
+    // Registers whose only definition in the function is MOV r, imm
+    bool GetConstant(int reg, int64_t& value) const;
+
+private:
+    ControlFlowGraph cfg_;
+    DominatorTree dominators_;
+    std::vector<Loop> loops_;
+    std::vector<int> innermost_;
+    std::unordered_map<int, int64_t> constants_; // Registers only ever set by MOV r, imm
+
+    void FindLoops();
+    void BuildNest();
+    void FindExitsAndPreheaders();
+    void ComputeTripCount(int loop_index);
+};
+
+// Give every loop a dedicated preheader block placed right before its header.
+// Returns how many blocks were inserted; any LoopInfo for 'func' is stale after.
+int InsertLoopPreheaders(Function& func);
+
+// ============================================================================
+// CALL GRAPH
+// Edges come from CALL instructions whose label names a function of the
+// module; any other target (runtime entry points) is external. Strongly
+// connected components are found with Tarjan's algorithm, which emits them
+// callees first, so walking GetComponents() in order is a bottom-up walk.
+// ============================================================================
+
+class CallGraph {
+public:
+    explicit CallGraph(const Module& module);
+
+    int GetFunctionCount() const { return static_cast<int>(functions_.size()); }
+    Function* GetFunction(int index) const { return functions_[index]; }
+    int GetFunctionIndex(const std::string& name) const; // -1 if external
+
+    const std::vector<int>& GetCallees(int index) const { return callees_[index]; }
+    int GetCallSiteCount(int index) const { return call_sites_[index]; } // CALLs naming it
+
+    const std::vector<std::vector<int>>& GetComponents() const { return components_; }
+    int GetComponent(int index) const { return component_[index]; }
+    bool IsRecursive(int index) const; // On a cycle, self-calls included
+
+private:
+    std::vector<Function*> functions_;
+    std::unordered_map<std::string, int> function_index_;
+    std::vector<std::vector<int>> callees_;
+    std::vector<int> call_sites_;
+    std::vector<std::vector<int>> components_;
+    std::vector<int> component_;
+
+    void FindComponents();
+};
+
+} // namespace IR
+} // namespace Snow
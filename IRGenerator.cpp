@@ -85,10 +85,25 @@ void IRGenerator::GenerateFunctionDecl(const AST::FunctionDecl& func) {
         current_function_->AddParameter(param);
         GetOrCreateVariable(param);
     }
+    if (func.GetParameters().empty()) {
+        current_function_->AllocateRegister();  // R0
+    }
     
     // Create entry block
     current_block_ = current_function_->CreateBlock("entry");
     
+    // R0 also receives every call result and the return value, so the first
+    // parameter lives in a register of its own
+    if (!func.GetParameters().empty()) {
+        int first = current_function_->AllocateRegister();
+        symbol_table_[func.GetParameters()[0]] = first;
+        current_block_->AddInstruction(
+            IR::Instruction(IR::OpCode::MOV,
+                IR::Operand::Register(first),
+                IR::Operand::Register(0))
+        );
+    }
+    
     // Generate function body
     if (func.GetBody()) {
         GenerateBlock(*func.GetBody());
@@ -328,12 +343,15 @@ int IRGenerator::GenerateCall(const AST::CallExpr& call) {
    arg_regs.push_back(GenerateExpression(*arg));
     }
     
-// For now, simple call handling
     int result_reg = current_function_->AllocateRegister();
     
-    current_block_->AddInstruction(
-        IR::Instruction(IR::OpCode::CALL, IR::Operand::Label(call.GetFunctionName()))
-  );
+    // The callee finds argument k in its register k (see GenerateFunctionDecl);
+    // the code generator passes them as the target's calling convention says
+    IR::Instruction call_instr(IR::OpCode::CALL, IR::Operand::Label(call.GetFunctionName()));
+    for (int reg : arg_regs) {
+        call_instr.arguments.push_back(IR::Operand::Register(reg));
+    }
+    current_block_->AddInstruction(call_instr);
     
     // Result is in R0 by convention
   current_block_->AddInstruction(
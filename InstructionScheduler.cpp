@@ -0,0 +1,1041 @@
+#include "AdvancedOptimizer.h"
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <map>
+
+namespace Snow {
+namespace AdvancedOptimization {
+
+using SSA::SSAValue;
+using SSA::SSAInstruction;
+using SSA::SSABasicBlock;
+using OpCode = SSAInstruction::OpCode;
+
+namespace {
+
+X64::OpClass Classify(const SSAInstruction& instr) {
+    switch (instr.GetOpCode()) {
+        case OpCode::Mul:
+            return X64::OpClass::IntMul;
+        case OpCode::Div:
+        case OpCode::Mod:
+            return X64::OpClass::IntDiv;
+        case OpCode::Load:
+        case OpCode::Prefetch:
+            return X64::OpClass::Load;
+        case OpCode::Store:
+            return X64::OpClass::Store;
+        case OpCode::Br:
+        case OpCode::CondBr:
+        case OpCode::Ret:
+            return X64::OpClass::Branch;
+        case OpCode::Call:
+        case OpCode::DodecConvert:
+        case OpCode::DodecArithmetic:
+        case OpCode::DurationCreate:
+        case OpCode::DurationCompare:
+            return X64::OpClass::Call;
+        case OpCode::VectorLoad:
+            return X64::OpClass::VecLoad;
+        case OpCode::VectorStore:
+            return X64::OpClass::VecStore;
+        case OpCode::VectorAdd:
+        case OpCode::VectorSub:
+            return X64::OpClass::VecAlu;
+        case OpCode::VectorMul:
+            return X64::OpClass::VecMul;
+        case OpCode::VectorSplat:
+        case OpCode::VectorBuild:
+        case OpCode::VectorReduceAdd:
+            return X64::OpClass::VecShuffle;
+        default:
+            return X64::OpClass::IntAlu;
+    }
+}
+
+// Instructions nothing may move across: calls (and the runtime helpers they
+// stand for) have unknown side effects, terminators end the block
+bool IsFixed(const SSAInstruction& instr) {
+    X64::OpClass op = Classify(instr);
+    return op == X64::OpClass::Call || op == X64::OpClass::Branch;
+}
+
+// Memory access of a Load/Store: address as base + constant offset, where
+// the offset is folded through Add/Sub of constants defined in the block
+struct Access {
+    bool is_write;
+    SSAValue* base;
+    int64_t offset;
+    int64_t size;
+};
+
+bool GetAccess(const SSAInstruction& instr,
+               const std::unordered_map<SSAValue*, SSAInstruction*>& defs,
+               Access& access) {
+    OpCode op = instr.GetOpCode();
+    const auto& ops = instr.GetOperands();
+    SSAValue* address;
+    if (op == OpCode::Load || op == OpCode::VectorLoad) {
+        address = ops[0];
+        access.is_write = false;
+    } else if (op == OpCode::Store || op == OpCode::VectorStore) {
+        address = ops[1];
+        access.is_write = true;
+    } else {
+        return false;
+    }
+
+    access.offset = 0;
+    access.size = 8 * std::max(1, instr.GetVectorWidth());
+    for (int depth = 0; depth < 8; depth++) {
+        auto it = defs.find(address);
+        if (it == defs.end()) break;
+        const SSAInstruction* def = it->second;
+        const auto& def_ops = def->GetOperands();
+        bool add = def->GetOpCode() == OpCode::Add;
+        if ((!add && def->GetOpCode() != OpCode::Sub) || def_ops.size() != 2) break;
+
+        if (def_ops[1]->GetKind() == SSAValue::Kind::Constant) {
+            int64_t c = def_ops[1]->GetConstantValue();
+            access.offset += add ? c : -c;
+            address = def_ops[0];
+        } else if (add && def_ops[0]->GetKind() == SSAValue::Kind::Constant) {
+            access.offset += def_ops[0]->GetConstantValue();
+            address = def_ops[1];
+        } else {
+            break;
+        }
+    }
+    access.base = address;
+    return true;
+}
+
+bool MayAlias(const Access& a, const Access& b) {
+    if (a.base != b.base) return true;
+    return a.offset < b.offset + b.size && b.offset < a.offset + a.size;
+}
+
+} // anonymous namespace
+
+// ============================================================================
+// INSTRUCTION SCHEDULER
+// ============================================================================
+
+InstructionScheduler::InstructionScheduler()
+    : model_(X64::MachineModel::Get(X64::MicroArch::Skylake)), abi_(X64::TargetABI::Win64) {
+}
+
+void InstructionScheduler::SetMicroArch(X64::MicroArch arch) {
+    model_ = X64::MachineModel::Get(arch);
+}
+
+void InstructionScheduler::SetMachineModel(const X64::MachineModel& model) {
+    model_ = model;
+}
+
+int InstructionScheduler::GetLatency(SSAInstruction* instr) {
+    return model_.GetLatency(Classify(*instr));
+}
+
+std::vector<X64::ScheduleNode> InstructionScheduler::BuildDAG(SSABasicBlock& block, size_t first) {
+    const auto& instructions = block.GetInstructions();
+    int count = static_cast<int>(instructions.size() - first);
+    std::vector<X64::ScheduleNode> nodes(count);
+
+    std::unordered_map<SSAValue*, int> producer;
+    std::unordered_map<SSAValue*, SSAInstruction*> defs;
+    std::vector<Access> accesses;
+    std::vector<int> access_node;
+    std::vector<int> since_fixed; // Nodes after the last fixed instruction
+    int last_fixed = -1;
+
+    for (int j = 0; j < count; j++) {
+        SSAInstruction* instr = instructions[first + j].get();
+        nodes[j].op = Classify(*instr);
+
+        // Def-use edges carry the producer's latency
+        for (SSAValue* operand : instr->GetOperands()) {
+            auto it = producer.find(operand);
+            if (it != producer.end()) {
+                X64::AddScheduleEdge(nodes, it->second, j, GetLatency(instructions[first + it->second].get()));
+            }
+        }
+
+        // Stores feed later loads of the same word through store forwarding;
+        // other overlapping pairs only keep their order
+        Access access;
+        if (GetAccess(*instr, defs, access)) {
+            for (size_t k = 0; k < accesses.size(); k++) {
+                if (!accesses[k].is_write && !access.is_write) continue;
+                if (!MayAlias(accesses[k], access)) continue;
+                int latency = accesses[k].is_write && !access.is_write ? model_.store_forward_latency : 0;
+                X64::AddScheduleEdge(nodes, access_node[k], j, latency);
+            }
+            accesses.push_back(access);
+            access_node.push_back(j);
+        }
+
+        if (IsFixed(*instr)) {
+            for (int i : since_fixed) X64::AddScheduleEdge(nodes, i, j, 0);
+            if (last_fixed >= 0) X64::AddScheduleEdge(nodes, last_fixed, j, 0);
+            since_fixed.clear();
+            last_fixed = j;
+        } else {
+            if (last_fixed >= 0) X64::AddScheduleEdge(nodes, last_fixed, j, 0);
+            since_fixed.push_back(j);
+        }
+
+        if (SSAValue* result = instr->GetResult()) {
+            producer[result] = j;
+            defs[result] = instr;
+        }
+    }
+
+    return nodes;
+}
+
+int InstructionScheduler::EstimateCycles(SSABasicBlock& block) {
+    const auto& instructions = block.GetInstructions();
+    size_t first = 0;
+    while (first < instructions.size() && instructions[first]->GetOpCode() == OpCode::Phi) first++;
+
+    std::vector<X64::ScheduleNode> dag = BuildDAG(block, first);
+    std::vector<int> order(dag.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = static_cast<int>(i);
+    return X64::EstimateCycles(model_, dag, order);
+}
+
+void InstructionScheduler::Schedule(SSABasicBlock& block) {
+    ListScheduling(block);
+}
+
+void InstructionScheduler::ListScheduling(SSABasicBlock& block) {
+    const auto& instructions = block.GetInstructions();
+    size_t first = 0;
+    while (first < instructions.size() && instructions[first]->GetOpCode() == OpCode::Phi) first++;
+    if (instructions.size() - first < 2) return;
+
+    std::vector<X64::ScheduleNode> dag = BuildDAG(block, first);
+    std::vector<int> original(dag.size());
+    for (size_t i = 0; i < original.size(); i++) original[i] = static_cast<int>(i);
+
+    int before = X64::EstimateCycles(model_, dag, original);
+    std::vector<int> order = X64::ListSchedule(model_, dag);
+    int after = X64::EstimateCycles(model_, dag, order);
+
+    // Never trade a known order for one the model thinks is no better
+    if (after < before) {
+        std::vector<size_t> permutation;
+        permutation.reserve(instructions.size());
+        for (size_t i = 0; i < first; i++) permutation.push_back(i);
+        for (int n : order) permutation.push_back(first + n);
+        block.ReorderInstructions(permutation);
+        stats_.blocks_scheduled++;
+    } else {
+        after = before;
+    }
+
+    stats_.cycles_before += before;
+    stats_.cycles_after += after;
+    stats_.blocks.push_back({ block.GetName(), before, after });
+}
+
+// ============================================================================
+// SOFTWARE PIPELINING
+//
+//   preheader:  ...                          br header
+//   header:     i = phi [start, i.next]      x = phi [x0, x.next] ...
+//               c = lt i, limit              condbr c, body, exit
+//   body:       ... i.next = add i, step ... br header
+//
+// Header phis fold into the body as uses of their latch values one iteration
+// back (the entry value in the first iteration), leaving one list of
+// operations whose operands come from the same iteration, the previous one,
+// or outside the loop. With S stages of II cycles, virtual iteration j runs
+// each operation whose original iteration j + S-1 - stage exists:
+//
+//   preheader:  n0 = start + (S-1)*step      condbr (lt n0, limit), prologue, header
+//   prologue:   j = -(S-1) .. -1, stages 0 .. j+S-1               br kernel
+//   kernel:     p = phi [...] (values from earlier kernel iterations)
+//               all stages    n = phi [n0, n + step]
+//               condbr (lt n + step, limit), kernel, epilogue
+//   epilogue:   j = 1 .. S-1, stages j .. S-1                     br header
+//
+// The original loop remains for trip counts below S; after the epilogue it
+// is entered with the final values and exits at once.
+// ============================================================================
+
+namespace {
+
+// Operations the kernel may contain: no calls, allocas or control flow
+bool IsPipelinable(OpCode op) {
+    switch (op) {
+        case OpCode::Phi:
+        case OpCode::Alloca:
+        case OpCode::Br:
+        case OpCode::CondBr:
+        case OpCode::Ret:
+        case OpCode::Call:
+        case OpCode::DodecConvert:
+        case OpCode::DodecArithmetic:
+        case OpCode::DurationCreate:
+        case OpCode::DurationCompare:
+            return false;
+        default:
+            return true;
+    }
+}
+
+bool IsMemoryOp(OpCode op) {
+    return op == OpCode::Load || op == OpCode::Store ||
+           op == OpCode::VectorLoad || op == OpCode::VectorStore;
+}
+
+bool IsConstant(const SSAValue* value) {
+    return value->GetKind() == SSAValue::Kind::Constant;
+}
+
+SSAValue* Append(SSA::SSAFunction& func, SSABasicBlock* block, OpCode op,
+                 const std::vector<SSAValue*>& operands) {
+    auto instr = std::make_unique<SSAInstruction>(op);
+    for (SSAValue* operand : operands) instr->AddOperand(operand);
+    SSAValue* result = nullptr;
+    if (op != OpCode::Br && op != OpCode::CondBr) {
+        result = func.CreateValue(SSAValue::Kind::Register);
+        instr->SetResult(result);
+    }
+    block->AddInstruction(std::move(instr));
+    return result;
+}
+
+// Copy of 'original' with new operands; returns the new result, if any
+SSAValue* EmitCopy(SSA::SSAFunction& func, SSABasicBlock* block, const SSAInstruction* original,
+                   const std::vector<SSAValue*>& operands) {
+    auto instr = std::make_unique<SSAInstruction>(original->GetOpCode());
+    instr->SetVectorWidth(original->GetVectorWidth());
+    instr->SetDebugInfo(original->GetDebugInfo());
+    for (SSAValue* operand : operands) instr->AddOperand(operand);
+    SSAValue* result = nullptr;
+    if (original->GetResult()) {
+        result = func.CreateValue(SSAValue::Kind::Register);
+        instr->SetResult(result);
+    }
+    block->AddInstruction(std::move(instr));
+    return result;
+}
+
+// Kernels larger than this are not worth the prologue/epilogue code size
+const size_t kMaxPipelineOps = 64;
+const int kMaxStages = 8;
+
+// Iterative modulo scheduling gives up after this many placements per operation
+const int kBudgetRatio = 6;
+
+// Kernel loop control: counter add, compare, branch
+const int kLoopControlOps = 3;
+
+// xmm0-xmm13; xmm14/xmm15 are the emitter's scratch registers
+const int kVectorRegisters = 14;
+
+// Dependences further apart than this many iterations never constrain a kernel
+const int64_t kMaxDependenceDistance = 1024;
+
+const int kUnreachable = INT_MIN / 4;
+
+} // anonymous namespace
+
+struct InstructionScheduler::PipelinePlan {
+    struct Source {
+        int op;           // Producing body operation, -1 for a value from outside the loop
+        int distance;     // Iterations back: 0 or 1 (through a header phi)
+        SSAValue* value;  // Outside value, or the phi's entry value when distance is 1
+    };
+
+    struct Edge {
+        int from;
+        int to;
+        int latency;
+        int distance;
+    };
+
+    // base + coef * i + offset; base is null for addresses linear in i alone
+    struct Address {
+        bool affine;
+        SSAValue* base;
+        int64_t coef;
+        int64_t offset;
+    };
+
+    SSABasicBlock* preheader = nullptr;
+    SSABasicBlock* header = nullptr;
+    SSABasicBlock* body = nullptr;
+    size_t entry_edge = 0;
+    size_t latch_edge = 0;
+
+    SSAValue* start = nullptr;
+    SSAValue* limit = nullptr;
+    int64_t step = 0;
+    int iv_update = -1;
+
+    std::vector<SSAInstruction*> phis;
+    std::vector<int> phi_update;                // Body operation feeding each phi
+    std::vector<SSAValue*> entry_of;            // Per operation: entry value of the phi it feeds
+
+    std::vector<SSAInstruction*> ops;           // Body without its branch
+    std::vector<X64::OpClass> classes;
+    std::vector<std::vector<Source>> sources;
+    std::vector<Edge> edges;
+    std::unordered_set<SSAValue*> allocas;
+    std::unordered_map<SSAValue*, int> outside;  // Non-constant outside values -> vector width
+
+    int cycles_before = 0;
+    int ii = 0;
+    int stages = 0;
+    std::vector<int> time;
+};
+
+bool InstructionScheduler::AnalyzePipelineLoop(SSA::SSAFunction& func, const AdvancedOptimizer::Loop& loop,
+                                               PipelinePlan& plan) {
+    SSABasicBlock* header = loop.header;
+    if (loop.blocks.size() != 2) return false;
+    SSABasicBlock* body = loop.blocks[0] == header ? loop.blocks[1] : loop.blocks[0];
+
+    const auto& header_preds = header->GetPredecessors();
+    if (header_preds.size() != 2) return false;
+    plan.latch_edge = header_preds[0] == body ? 0 : 1;
+    plan.entry_edge = 1 - plan.latch_edge;
+    if (header_preds[plan.latch_edge] != body) return false;
+    plan.preheader = header_preds[plan.entry_edge];
+    if (plan.preheader == body || plan.preheader == header) return false;
+    if (header->GetSuccessors().size() != 2 || header->GetSuccessors()[0] != body) return false;
+    if (body->GetPredecessors().size() != 1 || body->GetSuccessors().size() != 1 ||
+        body->GetSuccessors()[0] != header) {
+        return false;
+    }
+
+    const auto& pre_instrs = plan.preheader->GetInstructions();
+    if (plan.preheader->GetSuccessors().size() != 1 || pre_instrs.empty() ||
+        pre_instrs.back()->GetOpCode() != OpCode::Br) {
+        return false;
+    }
+    const auto& body_instrs = body->GetInstructions();
+    if (body_instrs.empty() || body_instrs.back()->GetOpCode() != OpCode::Br) return false;
+    plan.header = header;
+    plan.body = body;
+
+    // Header: phis, then 'c = lt i, limit', then 'condbr c'
+    const auto& header_instrs = header->GetInstructions();
+    size_t n = header_instrs.size();
+    if (n < 3) return false;
+    SSAInstruction* compare = header_instrs[n - 2].get();
+    SSAInstruction* branch = header_instrs[n - 1].get();
+    if (branch->GetOpCode() != OpCode::CondBr || compare->GetOpCode() != OpCode::Lt ||
+        branch->GetOperands().size() != 1 || branch->GetOperands()[0] != compare->GetResult()) {
+        return false;
+    }
+
+    std::unordered_map<SSAValue*, int> body_index;
+    for (size_t k = 0; k + 1 < body_instrs.size(); ++k) {
+        SSAInstruction* instr = body_instrs[k].get();
+        if (!IsPipelinable(instr->GetOpCode())) return false;
+        if (instr->GetResult()) body_index[instr->GetResult()] = static_cast<int>(k);
+        plan.ops.push_back(instr);
+    }
+    if (plan.ops.empty() || plan.ops.size() > kMaxPipelineOps) return false;
+    plan.entry_of.assign(plan.ops.size(), nullptr);
+
+    // Every phi is carried by a body value; one value feeds at most one phi
+    std::unordered_map<SSAValue*, size_t> phi_index;
+    for (size_t k = 0; k + 2 < n; ++k) {
+        SSAInstruction* phi = header_instrs[k].get();
+        if (phi->GetOpCode() != OpCode::Phi || phi->GetOperands().size() != 2) return false;
+        auto it = body_index.find(phi->GetOperands()[plan.latch_edge]);
+        if (it == body_index.end() || plan.entry_of[it->second]) return false;
+        plan.entry_of[it->second] = phi->GetOperands()[plan.entry_edge];
+        phi_index[phi->GetResult()] = plan.phis.size();
+        plan.phis.push_back(phi);
+        plan.phi_update.push_back(it->second);
+    }
+
+    // Induction: the compared phi, advanced by a positive constant
+    auto iv = phi_index.find(compare->GetOperands()[0]);
+    if (iv == phi_index.end()) return false;
+    SSAInstruction* iv_phi = plan.phis[iv->second];
+    plan.iv_update = plan.phi_update[iv->second];
+    const SSAInstruction* update = plan.ops[plan.iv_update];
+    const auto& update_ops = update->GetOperands();
+    if (update->GetOpCode() != OpCode::Add || update->GetVectorWidth() > 1) return false;
+    SSAValue* step = update_ops[0] == iv_phi->GetResult() ? update_ops[1]
+                   : update_ops[1] == iv_phi->GetResult() ? update_ops[0] : nullptr;
+    if (!step || !IsConstant(step) || step->GetConstantValue() <= 0) return false;
+    plan.step = step->GetConstantValue();
+    plan.start = iv_phi->GetOperands()[plan.entry_edge];
+    plan.limit = compare->GetOperands()[1];
+    if (body_index.count(plan.limit) || phi_index.count(plan.limit)) return false;
+
+    std::unordered_map<SSAValue*, int> widths;
+    for (const auto& block : func.GetBlocks()) {
+        for (const auto& instr : block->GetInstructions()) {
+            if (!instr->GetResult()) continue;
+            widths[instr->GetResult()] = instr->GetVectorWidth();
+            if (instr->GetOpCode() == OpCode::Alloca) plan.allocas.insert(instr->GetResult());
+        }
+    }
+
+    for (SSAInstruction* instr : plan.ops) {
+        plan.classes.push_back(Classify(*instr));
+        std::vector<PipelinePlan::Source> sources;
+        for (SSAValue* operand : instr->GetOperands()) {
+            auto body_def = body_index.find(operand);
+            auto phi = phi_index.find(operand);
+            if (operand == compare->GetResult()) return false;
+            if (body_def != body_index.end()) {
+                sources.push_back({ body_def->second, 0, nullptr });
+            } else if (phi != phi_index.end()) {
+                int latch = plan.phi_update[phi->second];
+                sources.push_back({ latch, 1, plan.entry_of[latch] });
+            } else {
+                sources.push_back({ -1, 0, operand });
+                if (!IsConstant(operand)) {
+                    auto width = widths.find(operand);
+                    plan.outside[operand] = width == widths.end() ? 1 : width->second;
+                }
+            }
+        }
+        plan.sources.push_back(sources);
+    }
+
+    return true;
+}
+
+// Register edges carry the producer's latency, store-to-load edges the
+// forwarding latency, other memory pairs only their order. Every latency
+// is at least 1, so dependent operations never share a kernel row.
+void InstructionScheduler::BuildPipelineEdges(PipelinePlan& plan) {
+    using Address = PipelinePlan::Address;
+    int count = static_cast<int>(plan.ops.size());
+    auto add_edge = [&plan](int from, int to, int latency, int distance) {
+        plan.edges.push_back({ from, to, std::max(1, latency), distance });
+    };
+
+    for (int v = 0; v < count; ++v) {
+        for (const auto& source : plan.sources[v]) {
+            if (source.op >= 0) {
+                add_edge(source.op, v, model_.GetLatency(plan.classes[source.op]), source.distance);
+            }
+        }
+    }
+
+    // Address of an operand as base + coef*i + offset, i being this iteration's induction value
+    std::function<Address(const PipelinePlan::Source&, int)> address_of =
+        [&](const PipelinePlan::Source& source, int depth) -> Address {
+        const Address unknown = { false, nullptr, 0, 0 };
+        if (source.op < 0) {
+            if (IsConstant(source.value)) return { true, nullptr, 0, source.value->GetConstantValue() };
+            return { true, source.value, 0, 0 };
+        }
+        if (source.op == plan.iv_update) {
+            return { true, nullptr, 1, source.distance == 1 ? 0 : plan.step };
+        }
+        if (source.distance != 0 || depth > 8) return unknown;
+
+        const SSAInstruction* def = plan.ops[source.op];
+        if (def->GetVectorWidth() > 1 || plan.sources[source.op].size() != 2) return unknown;
+        Address a = address_of(plan.sources[source.op][0], depth + 1);
+        Address b = address_of(plan.sources[source.op][1], depth + 1);
+        if (!a.affine || !b.affine) return unknown;
+
+        switch (def->GetOpCode()) {
+            case OpCode::Add:
+                if (a.base && b.base) return unknown;
+                return { true, a.base ? a.base : b.base, a.coef + b.coef, a.offset + b.offset };
+            case OpCode::Sub:
+                if (b.base) return unknown;
+                return { true, a.base, a.coef - b.coef, a.offset - b.offset };
+            case OpCode::Mul: {
+                bool a_const = !a.base && a.coef == 0;
+                bool b_const = !b.base && b.coef == 0;
+                if (!a_const && !b_const) return unknown;
+                const Address& x = a_const ? b : a;
+                int64_t k = a_const ? a.offset : b.offset;
+                if (x.base && k != 1) return unknown;
+                return { true, x.base, x.coef * k, x.offset * k };
+            }
+            default:
+                return unknown;
+        }
+    };
+
+    std::vector<int> memory;
+    std::vector<Address> addresses;
+    for (int v = 0; v < count; ++v) {
+        OpCode op = plan.ops[v]->GetOpCode();
+        if (!IsMemoryOp(op)) continue;
+        bool is_load = op == OpCode::Load || op == OpCode::VectorLoad;
+        memory.push_back(v);
+        addresses.push_back(address_of(plan.sources[v][is_load ? 0 : 1], 0));
+    }
+
+    auto is_write = [&plan](int v) {
+        OpCode op = plan.ops[v]->GetOpCode();
+        return op == OpCode::Store || op == OpCode::VectorStore;
+    };
+    auto size_of = [&plan](int v) { return 8 * static_cast<int64_t>(std::max(1, plan.ops[v]->GetVectorWidth())); };
+
+    for (size_t x = 0; x < memory.size(); ++x) {
+        for (size_t y = x + 1; y < memory.size(); ++y) {
+            int a = memory[x];
+            int b = memory[y];
+            if (!is_write(a) && !is_write(b)) continue;
+            int a_to_b = is_write(a) && !is_write(b) ? model_.store_forward_latency : 1;
+            int b_to_a = is_write(b) && !is_write(a) ? model_.store_forward_latency : 1;
+            const Address& pa = addresses[x];
+            const Address& pb = addresses[y];
+
+            if (pa.affine && pb.affine && pa.base != pb.base && pa.base && pb.base &&
+                plan.allocas.count(pa.base) && plan.allocas.count(pb.base)) {
+                continue;  // Distinct stack objects
+            }
+            if (!pa.affine || !pb.affine || pa.base != pb.base || pa.coef != pb.coef) {
+                add_edge(a, b, a_to_b, 0);
+                add_edge(b, a, b_to_a, 1);
+                continue;
+            }
+
+            // b in iteration k + d starts 'stride * d + diff' bytes after a in iteration k
+            int64_t stride = pa.coef * plan.step;
+            int64_t diff = pb.offset - pa.offset;
+            int64_t sa = size_of(a);
+            int64_t sb = size_of(b);
+            auto overlaps = [&](int64_t d) {
+                int64_t gap = stride * d + diff;
+                return gap < sa && -gap < sb;
+            };
+            if (stride == 0) {
+                if (overlaps(0)) {
+                    add_edge(a, b, a_to_b, 0);
+                    add_edge(b, a, b_to_a, 1);
+                }
+                continue;
+            }
+
+            int64_t bound = std::min<int64_t>(kMaxDependenceDistance,
+                                              (std::abs(diff) + sa + sb) / std::abs(stride) + 1);
+            for (int64_t d = 0; d <= bound; ++d) {
+                if (overlaps(d)) {
+                    add_edge(a, b, a_to_b, static_cast<int>(d));
+                    break;
+                }
+            }
+            for (int64_t d = 1; d <= bound; ++d) {
+                if (overlaps(-d)) {
+                    add_edge(b, a, b_to_a, static_cast<int>(d));
+                    break;
+                }
+            }
+        }
+    }
+}
+
+// Busiest resource: issue slots (loop control included) or an execution unit
+int InstructionScheduler::ComputeResMII(const PipelinePlan& plan) const {
+    int ops = static_cast<int>(plan.ops.size()) + kLoopControlOps;
+    int mii = (ops + model_.issue_width - 1) / model_.issue_width;
+
+    int busy[X64::kExecUnitCount] = {};
+    for (X64::OpClass op : plan.classes) {
+        const X64::OpCost& cost = model_.GetCost(op);
+        busy[static_cast<int>(cost.unit)] += cost.occupancy;
+    }
+    for (int u = 0; u < X64::kExecUnitCount; ++u) {
+        int units = std::max(1, model_.units[u]);
+        mii = std::max(mii, (busy[u] + units - 1) / units);
+    }
+    return mii;
+}
+
+// Smallest II under which no dependence cycle needs more than II cycles per
+// iteration it spans: no cycle of positive weight 'latency - II * distance'
+int InstructionScheduler::ComputeRecMII(const PipelinePlan& plan) const {
+    int count = static_cast<int>(plan.ops.size());
+    int total_latency = 0;
+    for (const auto& edge : plan.edges) total_latency += edge.latency;
+
+    for (int ii = 1; ii <= total_latency + 1; ++ii) {
+        std::vector<std::vector<int>> longest(count, std::vector<int>(count, kUnreachable));
+        for (const auto& edge : plan.edges) {
+            int& w = longest[edge.from][edge.to];
+            w = std::max(w, edge.latency - ii * edge.distance);
+        }
+        for (int k = 0; k < count; ++k) {
+            for (int i = 0; i < count; ++i) {
+                if (longest[i][k] == kUnreachable) continue;
+                for (int j = 0; j < count; ++j) {
+                    if (longest[k][j] == kUnreachable) continue;
+                    longest[i][j] = std::max(longest[i][j], longest[i][k] + longest[k][j]);
+                }
+            }
+        }
+
+        bool positive = false;
+        for (int i = 0; i < count; ++i) {
+            if (longest[i][i] > 0) positive = true;
+        }
+        if (!positive) return ii;
+    }
+    return total_latency + 1;
+}
+
+// Rau's iterative modulo scheduling: operations go in order of height, each
+// at the first slot within II of its earliest start with free resources in
+// the modulo reservation table. If there is none it is forced in anyway,
+// evicting whatever conflicts, plus successors whose constraints it breaks.
+bool InstructionScheduler::ModuloSchedule(PipelinePlan& plan, int ii) {
+    int count = static_cast<int>(plan.ops.size());
+
+    // Height: longest 'latency - II * distance' path to the end of the iteration
+    std::vector<int> height(count, 0);
+    for (int round = 0; round <= count; ++round) {
+        bool changed = false;
+        for (const auto& edge : plan.edges) {
+            int h = height[edge.to] + edge.latency - ii * edge.distance;
+            if (h > height[edge.from]) {
+                height[edge.from] = h;
+                changed = true;
+            }
+        }
+        if (!changed) break;
+    }
+
+    std::vector<std::vector<int>> unit_use(X64::kExecUnitCount, std::vector<int>(ii, 0));
+    std::vector<int> issue_use(ii, 0);
+    std::vector<int> time(count, -1);
+    std::vector<int> last_time(count, -1);
+
+    auto rows_of = [&](int v, int t) {
+        std::vector<int> rows;
+        for (int c = 0; c < model_.GetCost(plan.classes[v]).occupancy; ++c) rows.push_back((t + c) % ii);
+        return rows;
+    };
+    auto reserve = [&](int v, int t, int sign) {
+        int unit = static_cast<int>(model_.GetCost(plan.classes[v]).unit);
+        for (int row : rows_of(v, t)) unit_use[unit][row] += sign;
+        issue_use[t % ii] += sign;
+    };
+    auto fits = [&](int v, int t) {
+        int unit = static_cast<int>(model_.GetCost(plan.classes[v]).unit);
+        std::vector<int> need(ii, 0);
+        for (int row : rows_of(v, t)) need[row]++;
+        for (int row = 0; row < ii; ++row) {
+            if (need[row] && unit_use[unit][row] + need[row] > std::max(1, model_.units[unit])) return false;
+        }
+        return issue_use[t % ii] < model_.issue_width;
+    };
+    auto unschedule = [&](int v) {
+        reserve(v, time[v], -1);
+        time[v] = -1;
+    };
+
+    int budget = kBudgetRatio * count;
+    int placed = 0;
+    while (placed < count) {
+        if (budget-- <= 0) return false;
+
+        int v = -1;
+        for (int k = 0; k < count; ++k) {
+            if (time[k] < 0 && (v < 0 || height[k] > height[v])) v = k;
+        }
+
+        int earliest = 0;
+        for (const auto& edge : plan.edges) {
+            if (edge.to == v && edge.from != v && time[edge.from] >= 0) {
+                earliest = std::max(earliest, time[edge.from] + edge.latency - ii * edge.distance);
+            }
+        }
+
+        int slot = -1;
+        for (int t = earliest; t < earliest + ii; ++t) {
+            if (fits(v, t)) {
+                slot = t;
+                break;
+            }
+        }
+        if (slot < 0) {
+            slot = last_time[v] < 0 || earliest > last_time[v] ? earliest : last_time[v] + 1;
+        }
+
+        // Evict resource conflicts, then successors the new slot invalidates
+        int unit = static_cast<int>(model_.GetCost(plan.classes[v]).unit);
+        while (!fits(v, slot)) {
+            std::vector<int> rows = rows_of(v, slot);
+            int victim = -1;
+            for (int w = 0; w < count && victim < 0; ++w) {
+                if (w == v || time[w] < 0) continue;
+                if (time[w] % ii == slot % ii && issue_use[slot % ii] >= model_.issue_width) victim = w;
+                if (static_cast<int>(model_.GetCost(plan.classes[w]).unit) != unit) continue;
+                for (int row : rows_of(w, time[w])) {
+                    if (std::find(rows.begin(), rows.end(), row) != rows.end()) victim = w;
+                }
+            }
+            if (victim < 0) return false;
+            unschedule(victim);
+            placed--;
+        }
+        for (const auto& edge : plan.edges) {
+            if (edge.from == v && edge.to != v && time[edge.to] >= 0 &&
+                time[edge.to] < slot + edge.latency - ii * edge.distance) {
+                unschedule(edge.to);
+                placed--;
+            }
+        }
+
+        time[v] = slot;
+        last_time[v] = slot;
+        reserve(v, slot, 1);
+        placed++;
+    }
+
+    for (const auto& edge : plan.edges) {
+        if (time[edge.to] - time[edge.from] < edge.latency - ii * edge.distance) return false;
+    }
+
+    int first = *std::min_element(time.begin(), time.end());
+    int last = 0;
+    for (int& t : time) {
+        t -= first;
+        last = std::max(last, t);
+    }
+    plan.ii = ii;
+    plan.stages = last / ii + 1;
+    plan.time = time;
+    return true;
+}
+
+// MaxLive of the kernel per register class against what the register
+// allocator can hand out; outside values and the loop counter stay live
+// throughout
+bool InstructionScheduler::FitsRegisterBudget(const PipelinePlan& plan) const {
+    const X64::ABIInfo& abi = X64::GetABIInfo(abi_);
+    int scalar_budget = static_cast<int>(abi.allocatable_caller_saved.size() +
+                                         abi.allocatable_callee_saved.size());
+    int count = static_cast<int>(plan.ops.size());
+
+    std::vector<int> end(count);
+    for (int u = 0; u < count; ++u) end[u] = plan.time[u] + 1;
+    for (int v = 0; v < count; ++v) {
+        for (const auto& source : plan.sources[v]) {
+            if (source.op >= 0) {
+                end[source.op] = std::max(end[source.op], plan.time[v] + source.distance * plan.ii);
+            }
+        }
+    }
+
+    std::vector<int> scalar(plan.ii, 2);  // Counter and limit
+    std::vector<int> vector(plan.ii, 0);
+    for (const auto& value : plan.outside) {
+        for (int row = 0; row < plan.ii; ++row) (value.second > 1 ? vector : scalar)[row]++;
+    }
+    for (int u = 0; u < count; ++u) {
+        if (!plan.ops[u]->GetResult()) continue;
+        auto& live = plan.ops[u]->GetVectorWidth() > 1 ? vector : scalar;
+        for (int t = plan.time[u]; t < end[u]; ++t) live[t % plan.ii]++;
+    }
+
+    return *std::max_element(scalar.begin(), scalar.end()) <= scalar_budget &&
+           *std::max_element(vector.begin(), vector.end()) <= kVectorRegisters;
+}
+
+void InstructionScheduler::EmitPipelinedLoop(SSA::SSAFunction& func, PipelinePlan& plan) {
+    const int S = plan.stages;
+    const int II = plan.ii;
+    int count = static_cast<int>(plan.ops.size());
+
+    std::vector<int> stage(count);
+    std::vector<int> order(count);
+    for (int v = 0; v < count; ++v) {
+        stage[v] = plan.time[v] / II;
+        order[v] = v;
+    }
+    // Within a virtual iteration absolute time grows with the kernel row
+    std::sort(order.begin(), order.end(), [&](int a, int b) {
+        int ra = plan.time[a] % II;
+        int rb = plan.time[b] % II;
+        if (ra != rb) return ra < rb;
+        return plan.time[a] != plan.time[b] ? plan.time[a] < plan.time[b] : a < b;
+    });
+
+    // Kernel phis carry a value 1 .. depth kernel iterations back
+    std::vector<int> depth(count, 0);
+    for (int v = 0; v < count; ++v) {
+        for (const auto& source : plan.sources[v]) {
+            if (source.op >= 0) {
+                depth[source.op] = std::max(depth[source.op], stage[v] + source.distance - stage[source.op]);
+            }
+        }
+    }
+
+    SSABasicBlock* pre = plan.preheader;
+    SSABasicBlock* header = plan.header;
+    SSABasicBlock* prologue = func.CreateBasicBlock(header->GetName() + ".prologue");
+    SSABasicBlock* kernel = func.CreateBasicBlock(header->GetName() + ".kernel");
+    SSABasicBlock* epilogue = func.CreateBasicBlock(header->GetName() + ".epilogue");
+
+    // Guard: the kernel needs S iterations
+    pre->RemoveInstruction(pre->GetInstructions().size() - 1);
+    SSAValue* first_kernel = Append(func, pre, OpCode::Add,
+                                    {plan.start, func.CreateConstant((S - 1) * plan.step)});
+    SSAValue* enough = Append(func, pre, OpCode::Lt, {first_kernel, plan.limit});
+    Append(func, pre, OpCode::CondBr, {enough});
+
+    std::map<std::pair<int, int>, SSAValue*> instance;  // (operation, virtual iteration) outside the kernel
+    std::vector<SSAValue*> kernel_value(count, nullptr);
+    std::vector<std::vector<SSAInstruction*>> carried(count);
+
+    auto iteration = [&](int u, int j) { return j + S - 1 - stage[u]; };
+    auto resolve = [&](int v, const PipelinePlan::Source& source, int j, bool in_prologue) -> SSAValue* {
+        if (source.op < 0) return source.value;
+        int u = source.op;
+        int from = j - (stage[v] + source.distance - stage[u]);
+        if (in_prologue) {
+            return iteration(u, from) < 0 ? source.value : instance[std::make_pair(u, from)];
+        }
+        if (from >= 1) return instance[std::make_pair(u, from)];
+        if (from == 0) return kernel_value[u];
+        return carried[u][-from - 1]->GetResult();
+    };
+    auto emit = [&](SSABasicBlock* block, int v, int j, bool in_prologue) {
+        std::vector<SSAValue*> operands;
+        for (const auto& source : plan.sources[v]) operands.push_back(resolve(v, source, j, in_prologue));
+        return EmitCopy(func, block, plan.ops[v], operands);
+    };
+
+    // Prologue
+    for (int j = -(S - 1); j <= -1; ++j) {
+        for (int v : order) {
+            if (stage[v] <= j + S - 1) instance[std::make_pair(v, j)] = emit(prologue, v, j, true);
+        }
+    }
+    Append(func, prologue, OpCode::Br, {});
+
+    // Kernel: carried-value phis and the counter first, operands filled in below
+    for (int u = 0; u < count; ++u) {
+        for (int m = 1; m <= depth[u]; ++m) {
+            auto phi = std::make_unique<SSAInstruction>(OpCode::Phi);
+            phi->SetResult(func.CreateValue(SSAValue::Kind::Register));
+            phi->SetVectorWidth(plan.ops[u]->GetVectorWidth());
+            carried[u].push_back(phi.get());
+            kernel->AddInstruction(std::move(phi));
+        }
+    }
+    auto counter_phi = std::make_unique<SSAInstruction>(OpCode::Phi);
+    SSAValue* counter = func.CreateValue(SSAValue::Kind::Register);
+    counter_phi->SetResult(counter);
+    SSAInstruction* counter_ptr = counter_phi.get();
+    kernel->AddInstruction(std::move(counter_phi));
+
+    for (int v : order) kernel_value[v] = emit(kernel, v, 0, false);
+    SSAValue* next = Append(func, kernel, OpCode::Add, {counter, func.CreateConstant(plan.step)});
+    SSAValue* more = Append(func, kernel, OpCode::Lt, {next, plan.limit});
+    Append(func, kernel, OpCode::CondBr, {more});
+
+    counter_ptr->AddOperand(first_kernel);
+    counter_ptr->AddOperand(next);
+    for (int u = 0; u < count; ++u) {
+        for (int m = 1; m <= depth[u]; ++m) {
+            SSAInstruction* phi = carried[u][m - 1];
+            phi->AddOperand(iteration(u, -m) < 0 ? plan.entry_of[u] : instance[std::make_pair(u, -m)]);
+            phi->AddOperand(m == 1 ? kernel_value[u] : carried[u][m - 2]->GetResult());
+        }
+    }
+
+    // Epilogue
+    for (int e = 1; e <= S - 1; ++e) {
+        for (int v : order) {
+            if (stage[v] >= e) instance[std::make_pair(v, e)] = emit(epilogue, v, e, false);
+        }
+    }
+    Append(func, epilogue, OpCode::Br, {});
+
+    // The original loop resumes with the last iteration's values
+    for (size_t p = 0; p < plan.phis.size(); ++p) {
+        SSAInstruction* phi = plan.phis[p];
+        int u = plan.phi_update[p];
+        SSAValue* last = stage[u] == 0 ? kernel_value[u] : instance[std::make_pair(u, stage[u])];
+        SSAValue* entry = phi->GetOperands()[plan.entry_edge];
+        phi->SetOperand(plan.entry_edge, last);
+        phi->AddOperand(entry);
+    }
+    header->ReplacePredecessor(pre, epilogue);
+    header->AddPredecessor(pre);
+
+    pre->ReplaceSuccessor(header, prologue);
+    pre->AddSuccessor(header);
+    prologue->AddPredecessor(pre);
+    prologue->AddSuccessor(kernel);
+    kernel->AddPredecessor(prologue);
+    kernel->AddPredecessor(kernel);
+    kernel->AddSuccessor(kernel);
+    kernel->AddSuccessor(epilogue);
+    epilogue->AddPredecessor(kernel);
+    epilogue->AddSuccessor(header);
+}
+
+bool InstructionScheduler::SoftwarePipelining(SSA::SSAFunction& func, const AdvancedOptimizer::Loop& loop) {
+    PipelinePlan plan;
+    if (!AnalyzePipelineLoop(func, loop, plan)) {
+        stats_.pipeline_rejected_shape++;
+        return false;
+    }
+    BuildPipelineEdges(plan);
+
+    // Unpipelined: the body as scheduled, plus the header's compare
+    plan.cycles_before = EstimateCycles(*plan.body) + model_.GetLatency(X64::OpClass::IntAlu);
+
+    int mii = std::max(ComputeResMII(plan), ComputeRecMII(plan));
+    bool over_budget = false;
+    for (int ii = mii; ii < plan.cycles_before; ++ii) {
+        if (!ModuloSchedule(plan, ii)) continue;
+        if (plan.stages < 2) break;  // Nothing overlaps; list scheduling already covers it
+        if (plan.stages > kMaxStages) continue;
+        if (!FitsRegisterBudget(plan)) {
+            over_budget = true;
+            continue;
+        }
+
+        EmitPipelinedLoop(func, plan);
+        stats_.loops_pipelined++;
+        stats_.loops.push_back({ plan.header->GetName(), plan.cycles_before, plan.ii, plan.stages });
+        return true;
+    }
+
+    if (over_budget) {
+        stats_.pipeline_rejected_pressure++;
+    } else {
+        stats_.pipeline_rejected_cost++;
+    }
+    return false;
+}
+
+void InstructionScheduler::Stats::Print(const std::string& label) const {
+    std::cout << "\n=== Instruction Scheduling (" << label << ") ===\n";
+    for (const auto& entry : blocks) {
+        std::cout << entry.block << ": " << entry.cycles_before << " -> "
+                  << entry.cycles_after << " cycles\n";
+    }
+    std::cout << "Blocks reordered: " << blocks_scheduled << "\n";
+    std::cout << "Estimated cycles: " << cycles_before << " -> " << cycles_after << "\n";
+    for (const auto& entry : loops) {
+        std::cout << entry.loop << ": " << entry.cycles_before << " -> " << entry.initiation_interval
+                  << " cycles/iteration (" << entry.stages << " stages)\n";
+    }
+    std::cout << "Loops pipelined: " << loops_pipelined << "\n";
+    std::cout << "Rejected (shape): " << pipeline_rejected_shape << "\n";
+    std::cout << "Rejected (cost): " << pipeline_rejected_cost << "\n";
+    std::cout << "Rejected (register pressure): " << pipeline_rejected_pressure << "\n";
+}
+
+} // namespace AdvancedOptimization
+} // namespace Snow
@@ -0,0 +1,496 @@
+#include "JITCompiler.h"
+#include "../Runtime/Runtime.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace Snow {
+namespace JIT {
+
+namespace {
+
+// ============================================================================
+// RUNTIME BINDINGS
+// Snow values are all int64_t and every call produces R0, so each runtime
+// function gets a uniform int64_t wrapper.
+// ============================================================================
+
+int64_t SnowSay(int64_t value) { Runtime::Say(value); return 0; }
+int64_t SnowWait(int64_t nanoseconds) { Runtime::Wait(nanoseconds); return 0; }
+int64_t SnowShowDod(int64_t value) { Runtime::ShowDod(value); return 0; }
+int64_t SnowGetCurrentTime() { return Runtime::GetCurrentTime(); }
+int64_t SnowAbs(int64_t value) { return Runtime::Abs(value); }
+int64_t SnowMin(int64_t a, int64_t b) { return Runtime::Min(a, b); }
+int64_t SnowMax(int64_t a, int64_t b) { return Runtime::Max(a, b); }
+
+int64_t SnowAllocate(int64_t size) {
+    return reinterpret_cast<int64_t>(Runtime::Allocate(static_cast<size_t>(size)));
+}
+
+int64_t SnowDeallocate(int64_t pointer) {
+    Runtime::Deallocate(reinterpret_cast<void*>(pointer));
+    return 0;
+}
+
+size_t GetPageSize() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#else
+    return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+size_t RoundToPages(size_t size) {
+    size_t page = GetPageSize();
+    return std::max<size_t>(page, (size + page - 1) / page * page);
+}
+
+const int kScratch0 = X64::RAX;
+const int kScratch1 = X64::RCX;
+
+} // anonymous namespace
+
+// ============================================================================
+// EXECUTABLE MEMORY
+// ============================================================================
+
+ExecutableMemory::~ExecutableMemory() {
+    Release();
+}
+
+bool ExecutableMemory::Load(const std::vector<uint8_t>& code) {
+    Release();
+    size_t mapped = RoundToPages(code.size());
+
+#ifdef _WIN32
+    void* pages = VirtualAlloc(nullptr, mapped, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    if (!pages) return false;
+    std::memcpy(pages, code.data(), code.size());
+    DWORD old_protection;
+    if (!VirtualProtect(pages, mapped, PAGE_EXECUTE_READ, &old_protection)) {
+        VirtualFree(pages, 0, MEM_RELEASE);
+        return false;
+    }
+    FlushInstructionCache(GetCurrentProcess(), pages, mapped);
+#else
+    void* pages = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pages == MAP_FAILED) return false;
+    std::memcpy(pages, code.data(), code.size());
+    if (mprotect(pages, mapped, PROT_READ | PROT_EXEC) != 0) {
+        munmap(pages, mapped);
+        return false;
+    }
+#endif
+
+    base_ = static_cast<uint8_t*>(pages);
+    size_ = code.size();
+    return true;
+}
+
+void ExecutableMemory::Release() {
+    if (!base_) return;
+#ifdef _WIN32
+    VirtualFree(base_, 0, MEM_RELEASE);
+#else
+    munmap(base_, RoundToPages(size_));
+#endif
+    base_ = nullptr;
+    size_ = 0;
+}
+
+// ============================================================================
+// JIT COMPILER
+// ============================================================================
+
+JITCompiler::JITCompiler()
+#ifdef _WIN32
+    : abi_(X64::TargetABI::Win64),
+#else
+    : abi_(X64::TargetABI::SysV),
+#endif
+      frame_entries_enabled_(false), compile_ms_(0.0), function_(nullptr), slot_count_(0), frame_size_(0) {
+    AddSymbol("Say", reinterpret_cast<void*>(&SnowSay));
+    AddSymbol("Wait", reinterpret_cast<void*>(&SnowWait));
+    AddSymbol("_snow_wait", reinterpret_cast<void*>(&SnowWait));
+    AddSymbol("ShowDod", reinterpret_cast<void*>(&SnowShowDod));
+    AddSymbol("GetCurrentTime", reinterpret_cast<void*>(&SnowGetCurrentTime));
+    AddSymbol("Abs", reinterpret_cast<void*>(&SnowAbs));
+    AddSymbol("Min", reinterpret_cast<void*>(&SnowMin));
+    AddSymbol("Max", reinterpret_cast<void*>(&SnowMax));
+    AddSymbol("Allocate", reinterpret_cast<void*>(&SnowAllocate));
+    AddSymbol("Deallocate", reinterpret_cast<void*>(&SnowDeallocate));
+}
+
+void JITCompiler::AddSymbol(const std::string& name, void* address) {
+    symbols_[name] = address;
+}
+
+bool JITCompiler::Fail(const std::string& message) {
+    error_ = message;
+    return false;
+}
+
+bool JITCompiler::Compile(const IR::Module& module) {
+    std::unordered_set<std::string> functions;
+    for (const auto& func : module.GetFunctions()) {
+        functions.insert(func->GetName());
+    }
+    return Compile(module, functions);
+}
+
+bool JITCompiler::Compile(const IR::Module& module, const std::unordered_set<std::string>& functions) {
+    auto start = std::chrono::high_resolution_clock::now();
+
+    code_.clear();
+    call_fixups_.clear();
+    symbol_fixups_.clear();
+    function_offsets_.clear();
+    frame_entries_.clear();
+    register_slots_.clear();
+    memory_.Release();
+    error_.clear();
+
+    for (const auto& func : module.GetFunctions()) {
+        if (functions.count(func->GetName())) function_offsets_[func->GetName()] = 0;
+    }
+
+    for (const auto& func : module.GetFunctions()) {
+        if (!functions.count(func->GetName())) continue;
+        // Keep function entries 16-byte aligned; int3 fills the gaps
+        while (code_.size() % 16 != 0) code_.push_back(0xCC);
+        function_offsets_[func->GetName()] = code_.size();
+        if (!CompileFunction(*func)) return false;
+    }
+
+    for (const auto& fixup : call_fixups_) {
+        int32_t displacement = static_cast<int32_t>(function_offsets_[fixup.label]) -
+                               static_cast<int32_t>(fixup.position + 4);
+        std::memcpy(&code_[fixup.position], &displacement, sizeof(displacement));
+    }
+
+    for (const auto& fixup : symbol_fixups_) {
+        uint64_t address = reinterpret_cast<uint64_t>(symbols_[fixup.symbol]);
+        std::memcpy(&code_[fixup.position], &address, sizeof(address));
+    }
+
+    if (!memory_.Load(code_)) {
+        return Fail("Could not map executable memory");
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    compile_ms_ = std::chrono::duration<double, std::milli>(end - start).count();
+    return true;
+}
+
+JITCompiler::EntryPoint JITCompiler::GetFunction(const std::string& name) const {
+    auto it = function_offsets_.find(name);
+    if (it == function_offsets_.end() || !memory_.GetBase()) return nullptr;
+    return reinterpret_cast<EntryPoint>(memory_.GetBase() + it->second);
+}
+
+JITCompiler::FrameEntry JITCompiler::GetFrameEntry(const std::string& function, const std::string& block) const {
+    auto entries = frame_entries_.find(function);
+    if (entries == frame_entries_.end() || !memory_.GetBase()) return nullptr;
+    auto it = entries->second.find(block);
+    if (it == entries->second.end()) return nullptr;
+    return reinterpret_cast<FrameEntry>(memory_.GetBase() + it->second);
+}
+
+int JITCompiler::GetRegisterSlots(const std::string& function) const {
+    auto it = register_slots_.find(function);
+    return it == register_slots_.end() ? 0 : it->second;
+}
+
+// ============================================================================
+// FUNCTION LOWERING
+// Frame: saved rbp at [rbp], IR register r at [rbp - 8*(r+1)], then the
+// outgoing argument area while a call is being set up. The frame is a
+// multiple of 16 bytes, so rsp stays call-aligned.
+// ============================================================================
+
+int32_t JITCompiler::GetSlotOffset(int reg) const {
+    return -8 * (reg + 1);
+}
+
+int32_t JITCompiler::GetStackArgumentOffset(int index) const {
+    const X64::ABIInfo& abi = X64::GetABIInfo(abi_);
+    int stack_index = index - static_cast<int>(abi.argument_registers.size());
+    return 16 + abi.shadow_space + 8 * stack_index;
+}
+
+bool JITCompiler::CompileFunction(const IR::Function& func) {
+    function_ = &func;
+    labels_.clear();
+    branch_fixups_.clear();
+
+    // Every register the function touches gets a slot, R0 included
+    slot_count_ = std::max<int>(std::max(func.GetRegisterCount(), 1),
+                                static_cast<int>(func.GetParameters().size()));
+    std::vector<int> used;
+    for (const auto& block : func.GetBlocks()) {
+        for (const auto& instr : block->GetInstructions()) {
+            used.clear();
+            instr.GetUsedRegisters(used);
+            used.push_back(instr.GetDefinedRegister());
+            for (int reg : used) slot_count_ = std::max(slot_count_, reg + 1);
+        }
+    }
+    frame_size_ = (slot_count_ * 8 + 15) / 16 * 16;
+
+    emitter_.EmitPrologue(code_);
+    emitter_.EmitAddImm(code_, X64::RSP, -frame_size_);
+
+    // Parameter k of the function is its register k
+    const X64::ABIInfo& abi = X64::GetABIInfo(abi_);
+    int params = static_cast<int>(func.GetParameters().size());
+    for (int k = 0; k < params; k++) {
+        if (k < static_cast<int>(abi.argument_registers.size())) {
+            StoreRegister(k, abi.argument_registers[k]);
+        } else {
+            emitter_.EmitLoad(code_, kScratch0, X64::RBP, GetStackArgumentOffset(k));
+            StoreRegister(k, kScratch0);
+        }
+    }
+
+    bool terminated = false;
+    for (const auto& block : func.GetBlocks()) {
+        labels_[block->GetName()] = code_.size();
+        terminated = false;
+        for (const auto& instr : block->GetInstructions()) {
+            if (!CompileInstruction(instr)) return false;
+            terminated = instr.IsTerminator();
+        }
+    }
+    if (!terminated) {
+        EmitReturn();
+    }
+    register_slots_[func.GetName()] = slot_count_;
+
+    if (frame_entries_enabled_) {
+        const auto& blocks = func.GetBlocks();
+        std::unordered_set<std::string> headers;
+        if (!blocks.empty()) headers.insert(blocks[0]->GetName());
+        for (size_t b = 0; b < blocks.size(); b++) {
+            for (const auto& instr : blocks[b]->GetInstructions()) {
+                if (!instr.IsBranch()) continue;
+                for (size_t t = 0; t <= b; t++) {
+                    if (blocks[t]->GetName() == instr.dest.label) headers.insert(instr.dest.label);
+                }
+            }
+        }
+        for (const auto& block : blocks) {
+            if (headers.count(block->GetName())) EmitFrameEntry(block->GetName());
+        }
+    }
+
+    for (const auto& fixup : branch_fixups_) {
+        auto target = labels_.find(fixup.label);
+        if (target == labels_.end()) {
+            return Fail("Unknown label '" + fixup.label + "' in function " + func.GetName());
+        }
+        int32_t displacement = static_cast<int32_t>(target->second) - static_cast<int32_t>(fixup.position + 4);
+        std::memcpy(&code_[fixup.position], &displacement, sizeof(displacement));
+    }
+    return true;
+}
+
+void JITCompiler::EmitFrameEntry(const std::string& block) {
+    while (code_.size() % 16 != 0) code_.push_back(0xCC);
+    frame_entries_[function_->GetName()][block] = code_.size();
+
+    // Same frame as the function itself, then one copy per register slot
+    int source = X64::GetABIInfo(abi_).argument_registers[0];
+    emitter_.EmitPrologue(code_);
+    emitter_.EmitAddImm(code_, X64::RSP, -frame_size_);
+    for (int r = 0; r < slot_count_; r++) {
+        emitter_.EmitLoad(code_, kScratch0, source, 8 * r);
+        StoreRegister(r, kScratch0);
+    }
+    emitter_.EmitJmp(code_, 0);
+    Fixup fixup = { code_.size() - 4, block };
+    branch_fixups_.push_back(fixup);
+}
+
+void JITCompiler::LoadOperand(int reg, const IR::Operand& op) {
+    switch (op.type) {
+        case IR::OperandType::Register:
+            emitter_.EmitLoad(code_, reg, X64::RBP, GetSlotOffset(static_cast<int>(op.value)));
+            break;
+        case IR::OperandType::Immediate:
+            emitter_.EmitMovImm(code_, reg, op.value);
+            break;
+        case IR::OperandType::Memory:
+            emitter_.EmitMovImm(code_, reg, op.value);
+            emitter_.EmitLoad(code_, reg, reg, 0);
+            break;
+        case IR::OperandType::Label:
+            emitter_.EmitMovImm(code_, reg, 0);
+            break;
+    }
+}
+
+void JITCompiler::StoreRegister(int ir_reg, int reg) {
+    emitter_.EmitStore(code_, X64::RBP, GetSlotOffset(ir_reg), reg);
+}
+
+void JITCompiler::EmitReturn() {
+    // RET reads R0 by convention
+    emitter_.EmitLoad(code_, X64::RAX, X64::RBP, GetSlotOffset(0));
+    emitter_.EmitEpilogue(code_);
+    emitter_.EmitRet(code_);
+}
+
+void JITCompiler::EmitBranch(const IR::Instruction& instr) {
+    switch (instr.opcode) {
+        case IR::OpCode::JMP: emitter_.EmitJmp(code_, 0); break;
+        case IR::OpCode::JE: emitter_.EmitJcc(code_, PEGenerator::Condition::E, 0); break;
+        case IR::OpCode::JNE: emitter_.EmitJcc(code_, PEGenerator::Condition::NE, 0); break;
+        case IR::OpCode::JG: emitter_.EmitJcc(code_, PEGenerator::Condition::G, 0); break;
+        case IR::OpCode::JL: emitter_.EmitJcc(code_, PEGenerator::Condition::L, 0); break;
+        case IR::OpCode::JGE: emitter_.EmitJcc(code_, PEGenerator::Condition::GE, 0); break;
+        case IR::OpCode::JLE: emitter_.EmitJcc(code_, PEGenerator::Condition::LE, 0); break;
+        default: return;
+    }
+    Fixup fixup = { code_.size() - 4, instr.dest.label };
+    branch_fixups_.push_back(fixup);
+}
+
+bool JITCompiler::EmitCall(const std::string& target, const std::vector<IR::Operand>& arguments) {
+    bool internal = function_offsets_.count(target) > 0;
+    if (!internal && !symbols_.count(target)) {
+        return Fail("Undefined function '" + target + "' called from " + function_->GetName());
+    }
+
+    // Arguments past the register ones go above the callee's shadow space
+    const X64::ABIInfo& abi = X64::GetABIInfo(abi_);
+    int register_args = static_cast<int>(abi.argument_registers.size());
+    int count = static_cast<int>(arguments.size());
+    int stack_args = std::max(0, count - register_args);
+    int area = (abi.shadow_space + 8 * stack_args + 15) / 16 * 16;
+
+    if (area > 0) emitter_.EmitAddImm(code_, X64::RSP, -area);
+    for (int k = register_args; k < count; k++) {
+        LoadOperand(kScratch0, arguments[k]);
+        emitter_.EmitStore(code_, X64::RSP, abi.shadow_space + 8 * (k - register_args), kScratch0);
+    }
+    for (int k = 0; k < std::min(count, register_args); k++) {
+        LoadOperand(abi.argument_registers[k], arguments[k]);
+    }
+
+    if (internal) {
+        emitter_.EmitCall(code_, 0);
+        Fixup fixup = { code_.size() - 4, target };
+        call_fixups_.push_back(fixup);
+    } else {
+        emitter_.EmitMovImm64(code_, X64::RAX, 0);
+        SymbolFixup fixup = { code_.size() - 8, target };
+        symbol_fixups_.push_back(fixup);
+        emitter_.EmitCallIndirect(code_, X64::RAX);
+    }
+
+    if (area > 0) emitter_.EmitAddImm(code_, X64::RSP, area);
+    return true;
+}
+
+bool JITCompiler::CompileInstruction(const IR::Instruction& instr) {
+    switch (instr.opcode) {
+        case IR::OpCode::MOV:
+        case IR::OpCode::DODECAP:   // Copies its source, as in the VM
+            LoadOperand(kScratch0, instr.src1);
+            StoreRegister(static_cast<int>(instr.dest.value), kScratch0);
+            break;
+
+        case IR::OpCode::LOAD:
+            LoadOperand(kScratch0, instr.src1);
+            if (instr.src1.type != IR::OperandType::Memory) {
+                emitter_.EmitLoad(code_, kScratch0, kScratch0, 0);
+            }
+            StoreRegister(static_cast<int>(instr.dest.value), kScratch0);
+            break;
+
+        case IR::OpCode::STORE:
+            if (instr.dest.type == IR::OperandType::Memory) {
+                emitter_.EmitMovImm(code_, kScratch1, instr.dest.value);
+            } else {
+                LoadOperand(kScratch1, instr.dest);
+            }
+            LoadOperand(kScratch0, instr.src1);
+            emitter_.EmitStore(code_, kScratch1, 0, kScratch0);
+            break;
+
+        case IR::OpCode::ADD:
+        case IR::OpCode::SUB:
+        case IR::OpCode::MUL:
+            LoadOperand(kScratch0, instr.src1);
+            LoadOperand(kScratch1, instr.src2);
+            if (instr.opcode == IR::OpCode::ADD) emitter_.EmitAdd(code_, kScratch0, kScratch1);
+            if (instr.opcode == IR::OpCode::SUB) emitter_.EmitSub(code_, kScratch0, kScratch1);
+            if (instr.opcode == IR::OpCode::MUL) emitter_.EmitMul(code_, kScratch0, kScratch1);
+            StoreRegister(static_cast<int>(instr.dest.value), kScratch0);
+            break;
+
+        case IR::OpCode::DIV:
+            LoadOperand(X64::RAX, instr.src1);
+            if (instr.src2.type == IR::OperandType::Immediate) {
+                emitter_.EmitDivImm(code_, instr.src2.value, kScratch1);
+            } else {
+                LoadOperand(kScratch1, instr.src2);
+                emitter_.EmitDiv(code_, kScratch1);
+            }
+            StoreRegister(static_cast<int>(instr.dest.value), X64::RAX);
+            break;
+
+        case IR::OpCode::CMP:
+            LoadOperand(kScratch0, instr.dest);
+            LoadOperand(kScratch1, instr.src1);
+            emitter_.EmitCmp(code_, kScratch0, kScratch1);
+            break;
+
+        case IR::OpCode::JMP:
+        case IR::OpCode::JE:
+        case IR::OpCode::JNE:
+        case IR::OpCode::JG:
+        case IR::OpCode::JL:
+        case IR::OpCode::JGE:
+        case IR::OpCode::JLE:
+            EmitBranch(instr);
+            break;
+
+        case IR::OpCode::CALL:
+            // Result is in R0 by convention
+            if (!EmitCall(instr.dest.label, instr.arguments)) return false;
+            StoreRegister(0, X64::RAX);
+            break;
+
+        case IR::OpCode::RET:
+            EmitReturn();
+            break;
+
+        case IR::OpCode::WAIT:
+            if (!EmitCall("_snow_wait", std::vector<IR::Operand>(1, instr.dest))) return false;
+            break;
+
+        case IR::OpCode::LABEL:
+            labels_[instr.dest.label] = code_.size();
+            break;
+
+        case IR::OpCode::SAMPLE:
+        case IR::OpCode::DELTA:
+        case IR::OpCode::NOP:
+            // No machine code, as in the assembly backend
+            break;
+    }
+    return true;
+}
+
+} // namespace JIT
+} // namespace Snow
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "../IR/IR.h"
+#include "../PEGenerator/PEGenerator.h"
+#include "../CodeGen/X64Target.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdint>
+
+namespace Snow {
+namespace JIT {
+
+// ============================================================================
+// EXECUTABLE MEMORY
+// Pages are mapped read+write, filled, then switched to read+execute, so no
+// page is ever writable and executable at the same time (W^X).
+// ============================================================================
+
+class ExecutableMemory {
+public:
+    ExecutableMemory() : base_(nullptr), size_(0) {}
+    ~ExecutableMemory();
+
+    ExecutableMemory(const ExecutableMemory&) = delete;
+    ExecutableMemory& operator=(const ExecutableMemory&) = delete;
+
+    // Copies 'code' into fresh pages and makes them executable
+    bool Load(const std::vector<uint8_t>& code);
+    void Release();
+
+    uint8_t* GetBase() const { return base_; }
+    size_t GetSize() const { return size_; }
+
+private:
+    uint8_t* base_;
+    size_t size_;
+};
+
+// ============================================================================
+// JIT COMPILER
+// Lowers an IR::Module straight to machine code with MachineCodeEmitter
+// and runs it in-process, skipping the assemble/link round-trip. This is a
+// baseline compiler tuned for compile speed: every IR register lives in a
+// frame slot at [rbp - 8*(r+1)], and each instruction loads its operands
+// into rax/rcx, operates and stores the result back. Calls follow the host
+// C calling convention, so Snow functions and runtime functions call each
+// other directly. Calls between Snow functions are rel32 fixups resolved
+// when the module is laid out. Calls to anything else go through the symbol
+// table and are patched into a movabs+call pair.
+// ============================================================================
+
+class JITCompiler {
+public:
+    typedef int64_t (*EntryPoint)();
+    
+    // Loads IR registers 0..GetRegisterSlots()-1 from 'registers' into the
+    // frame and continues at a block, as if control had just arrived there
+    typedef int64_t (*FrameEntry)(const int64_t* registers);
+
+    JITCompiler();
+
+    // Runtime functions callable from Snow code. The defaults bind the
+    // Snow::Runtime library (Say, Wait, ShowDod, Abs, Min, Max, ...). Every
+    // symbol takes and returns int64_t in the host calling convention.
+    void AddSymbol(const std::string& name, void* address);
+    const std::unordered_map<std::string, void*>& GetSymbols() const { return symbols_; }
+
+    bool Compile(const IR::Module& module);
+    
+    // Compiles only the named functions; calls from them to other module
+    // functions must be to names in the set as well
+    bool Compile(const IR::Module& module, const std::unordered_set<std::string>& functions);
+
+    // Entry point of a compiled function, nullptr if there is none
+    EntryPoint GetFunction(const std::string& name) const;
+    
+    // Frame entries are emitted for the entry block and every loop header
+    // (target of a branch from the same or a later block) when enabled
+    void SetFrameEntries(bool enable) { frame_entries_enabled_ = enable; }
+    FrameEntry GetFrameEntry(const std::string& function, const std::string& block) const;
+    int GetRegisterSlots(const std::string& function) const;
+
+    size_t GetCodeSize() const { return memory_.GetSize(); }
+    double GetCompileMilliseconds() const { return compile_ms_; }
+    const std::string& GetError() const { return error_; }
+
+private:
+    struct Fixup {
+        size_t position;        // Offset of the rel32 field
+        std::string label;
+    };
+
+    struct SymbolFixup {
+        size_t position;        // Offset of the movabs imm64 field
+        std::string symbol;
+    };
+
+    X64::TargetABI abi_;
+    PEGenerator::MachineCodeEmitter emitter_;
+    std::unordered_map<std::string, void*> symbols_;
+    ExecutableMemory memory_;
+    std::unordered_map<std::string, size_t> function_offsets_;
+    std::unordered_map<std::string, std::unordered_map<std::string, size_t>> frame_entries_;
+    std::unordered_map<std::string, int> register_slots_;
+    bool frame_entries_enabled_;
+    double compile_ms_;
+    std::string error_;
+
+    // Per-function state
+    std::vector<uint8_t> code_;
+    std::unordered_map<std::string, size_t> labels_;
+    std::vector<Fixup> branch_fixups_;
+    std::vector<Fixup> call_fixups_;
+    std::vector<SymbolFixup> symbol_fixups_;
+    const IR::Function* function_;
+    int slot_count_;
+    int frame_size_;
+
+    bool CompileFunction(const IR::Function& func);
+    bool CompileInstruction(const IR::Instruction& instr);
+    void EmitFrameEntry(const std::string& block);
+    bool EmitCall(const std::string& target, const std::vector<IR::Operand>& arguments);
+
+    int32_t GetSlotOffset(int reg) const;
+    int32_t GetStackArgumentOffset(int index) const;   // From rbp, for parameter 'index'
+    void LoadOperand(int reg, const IR::Operand& op);
+    void StoreRegister(int ir_reg, int reg);
+    void EmitReturn();
+    void EmitBranch(const IR::Instruction& instr);
+
+    bool Fail(const std::string& message);
+};
+
+} // namespace JIT
+} // namespace Snow
@@ -0,0 +1,500 @@
+#include "LinearScanAllocator.h"
+#include <algorithm>
+#include <queue>
+#include <climits>
+#include <functional>
+
+namespace Snow {
+
+// ============================================================================
+// LINEAR SCAN ALLOCATOR IMPLEMENTATION
+// ============================================================================
+
+LinearScanAllocator::LinearScanAllocator(X64::TargetABI abi)
+    : abi_(abi), spill_slot_count_(0), selection_(nullptr) {
+}
+
+void LinearScanAllocator::Allocate(const IR::Function& func, const SelectionMap* selection) {
+    stats_ = Stats();
+    selection_ = selection;
+    intervals_.clear();
+    children_.clear();
+    spill_slots_.clear();
+    spill_slot_count_ = 0;
+    used_callee_saved_.clear();
+    reloads_.clear();
+    call_saves_.clear();
+    call_restores_.clear();
+
+    cfg_.reset(new IR::ControlFlowGraph(func));
+    liveness_.reset(new IR::Liveness(func, *cfg_));
+
+    NumberInstructions();
+    BuildIntervals();
+    selection_ = nullptr;
+    ScanIntervals();
+    AssignSpillSlots();
+    CollectReloads();
+    CollectCallSaves();
+}
+
+void LinearScanAllocator::NumberInstructions() {
+    int count = cfg_->GetBlockCount();
+    block_first_.assign(count, 0);
+    block_from_.assign(count, 0);
+    block_to_.assign(count, 0);
+    call_positions_.clear();
+
+    int index = 0;
+    for (int b = 0; b < count; ++b) {
+        const auto& instrs = cfg_->GetBlock(b)->GetInstructions();
+        block_first_[b] = index;
+        block_from_[b] = 2 * index;
+
+        for (const auto& instr : instrs) {
+            // Runtime calls clobber caller-saved registers just like CALL
+            if (instr.opcode == IR::OpCode::CALL || instr.opcode == IR::OpCode::WAIT) {
+                call_positions_.push_back(2 * index);
+            }
+            index++;
+        }
+
+        block_to_[b] = 2 * index - 1;
+    }
+}
+
+void LinearScanAllocator::BuildIntervals() {
+    int reg_count = liveness_->GetRegisterCount();
+    std::vector<int> start(reg_count, INT_MAX);
+    std::vector<int> end(reg_count, -1);
+    std::vector<std::vector<int>> uses(reg_count);
+
+    auto extend = [&](int vreg, int pos) {
+        start[vreg] = std::min(start[vreg], pos);
+        end[vreg] = std::max(end[vreg], pos);
+    };
+
+    std::vector<int> used;
+    for (int b = 0; b < cfg_->GetBlockCount(); ++b) {
+        if (block_to_[b] < block_from_[b]) continue; // Empty block
+
+        const IR::RegisterSet& live_in = liveness_->GetLiveIn(b);
+        const IR::RegisterSet& live_out = liveness_->GetLiveOut(b);
+        for (int v = 0; v < reg_count; ++v) {
+            if (live_in[v]) extend(v, block_from_[b]);
+            if (live_out[v]) extend(v, block_to_[b]);
+        }
+
+        const auto& instrs = cfg_->GetBlock(b)->GetInstructions();
+        for (size_t i = 0; i < instrs.size(); ++i) {
+            int pos = GetPosition(b, static_cast<int>(i));
+
+            const SelectedUses* selected = nullptr;
+            if (selection_) {
+                auto it = selection_->find(&instrs[i]);
+                if (it != selection_->end()) selected = &it->second;
+            }
+
+            used.clear();
+            if (selected) {
+                used = selected->reads;
+            } else {
+                instrs[i].GetUsedRegisters(used);
+            }
+            for (int v : used) {
+                extend(v, pos);
+                uses[v].push_back(pos);
+            }
+
+            int def = selected && !selected->writes ? -1 : instrs[i].GetDefinedRegister();
+            if (def >= 0) {
+                extend(def, pos + 1);
+                uses[def].push_back(pos + 1);
+            }
+        }
+    }
+
+    children_.assign(reg_count, std::vector<LiveInterval*>());
+    for (int v = 0; v < reg_count; ++v) {
+        if (end[v] < 0) continue;
+
+        std::unique_ptr<LiveInterval> interval(new LiveInterval());
+        interval->vreg = v;
+        interval->start = start[v];
+        interval->end = end[v];
+        interval->use_positions = uses[v];
+        std::sort(interval->use_positions.begin(), interval->use_positions.end());
+        interval->use_positions.erase(
+            std::unique(interval->use_positions.begin(), interval->use_positions.end()),
+            interval->use_positions.end());
+        interval->crosses_call = CrossesCall(interval.get());
+
+        children_[v].push_back(interval.get());
+        intervals_.push_back(std::move(interval));
+        stats_.intervals++;
+    }
+}
+
+void LinearScanAllocator::ScanIntervals() {
+    auto later = [](const LiveInterval* a, const LiveInterval* b) {
+        if (a->start != b->start) return a->start > b->start;
+        return a->vreg > b->vreg;
+    };
+    std::priority_queue<LiveInterval*, std::vector<LiveInterval*>, decltype(later)> unhandled(later);
+    for (const auto& interval : intervals_) {
+        unhandled.push(interval.get());
+    }
+
+    const X64::ABIInfo& abi = X64::GetABIInfo(abi_);
+    std::vector<LiveInterval*> active;
+    std::vector<LiveInterval*> owner(16, nullptr);
+
+    while (!unhandled.empty()) {
+        LiveInterval* cur = unhandled.top();
+        unhandled.pop();
+
+        // Expire intervals that ended before this one starts
+        active.erase(std::remove_if(active.begin(), active.end(),
+            [&](LiveInterval* a) {
+                if (a->end >= cur->start) return false;
+                owner[a->phys_reg] = nullptr;
+                return true;
+            }), active.end());
+
+        // Values live across a call try callee-saved registers first; in a
+        // caller-saved one they have to be saved around the calls, so they
+        // only take one that is free
+        std::vector<int> allowed;
+        const auto& first = cur->crosses_call ? abi.allocatable_callee_saved : abi.allocatable_caller_saved;
+        const auto& second = cur->crosses_call ? abi.allocatable_caller_saved : abi.allocatable_callee_saved;
+        allowed.insert(allowed.end(), first.begin(), first.end());
+        allowed.insert(allowed.end(), second.begin(), second.end());
+
+        int free_reg = X64::NoRegister;
+        for (int reg : allowed) {
+            if (!owner[reg]) {
+                free_reg = reg;
+                break;
+            }
+        }
+
+        if (free_reg != X64::NoRegister) {
+            cur->phys_reg = free_reg;
+            owner[free_reg] = cur;
+            active.push_back(cur);
+            continue;
+        }
+
+        // No register free: evict whichever candidate is needed furthest away,
+        // preferring values that are saved around calls anyway
+        const std::vector<int>& evictable = cur->crosses_call ? first : allowed;
+        int cur_use = NextUse(cur, cur->start);
+        LiveInterval* victim = nullptr;
+        int victim_use = cur_use;
+        bool victim_saved = false;
+        for (LiveInterval* a : active) {
+            if (std::find(evictable.begin(), evictable.end(), a->phys_reg) == evictable.end()) continue;
+            int next = NextUse(a, cur->start);
+            bool saved = IsSavedAcrossCall(a);
+            if (next <= cur_use || (victim_saved && !saved)) continue;
+            if (saved != victim_saved || next > victim_use) {
+                victim = a;
+                victim_use = next;
+                victim_saved = saved;
+            }
+        }
+
+        LiveInterval* spilled = cur;
+        if (victim) {
+            int reg = victim->phys_reg;
+            active.erase(std::find(active.begin(), active.end(), victim));
+
+            spilled = victim->start < cur->start ? SplitAt(victim, cur->start) : victim;
+
+            cur->phys_reg = reg;
+            owner[reg] = cur;
+            active.push_back(cur);
+        }
+
+        // The spilled part waits in memory until its next read
+        spilled->phys_reg = X64::NoRegister;
+        int reload = NextRead(spilled, spilled->start + 1);
+        if (reload != INT_MAX) {
+            unhandled.push(SplitAt(spilled, reload));
+        }
+    }
+
+    for (const auto& interval : intervals_) {
+        int reg = interval->phys_reg;
+        if (reg != X64::NoRegister && X64::IsCalleeSaved(abi_, reg) &&
+            std::find(used_callee_saved_.begin(), used_callee_saved_.end(), reg) == used_callee_saved_.end()) {
+            used_callee_saved_.push_back(reg);
+        }
+    }
+    std::sort(used_callee_saved_.begin(), used_callee_saved_.end());
+}
+
+void LinearScanAllocator::AssignSpillSlots() {
+    spill_slots_.assign(children_.size(), -1);
+    in_memory_.assign(children_.size(), false);
+
+    // A slot is only read and written between the first and last position of
+    // its value, so values whose lifetimes don't overlap share one
+    std::vector<int> needed;
+    for (size_t v = 0; v < children_.size(); ++v) {
+        bool in_memory = false;
+        bool saved = false;
+        for (const LiveInterval* child : children_[v]) {
+            if (child->phys_reg == X64::NoRegister) {
+                in_memory = true;
+            } else if (IsSavedAcrossCall(child)) {
+                saved = true;
+            }
+        }
+
+        if (in_memory || saved) {
+            needed.push_back(static_cast<int>(v));
+        }
+        if (in_memory) {
+            in_memory_[v] = true;
+            stats_.spilled_registers++;
+        }
+    }
+
+    std::sort(needed.begin(), needed.end(), [this](int a, int b) {
+        return children_[a].front()->start < children_[b].front()->start;
+    });
+
+    typedef std::pair<int, int> SlotEnd;    // (last position, slot)
+    std::priority_queue<SlotEnd, std::vector<SlotEnd>, std::greater<SlotEnd>> busy;
+    std::priority_queue<int, std::vector<int>, std::greater<int>> free_slots;
+    for (int v : needed) {
+        while (!busy.empty() && busy.top().first < children_[v].front()->start) {
+            free_slots.push(busy.top().second);
+            busy.pop();
+        }
+
+        int slot;
+        if (free_slots.empty()) {
+            slot = spill_slot_count_++;
+        } else {
+            slot = free_slots.top();
+            free_slots.pop();
+        }
+        spill_slots_[v] = slot;
+        busy.push(std::make_pair(children_[v].back()->end, slot));
+    }
+}
+
+void LinearScanAllocator::CollectReloads() {
+    int positions = cfg_->GetBlockCount() > 0
+        ? block_to_[cfg_->GetBlockCount() - 1] + 2 : 0;
+    reloads_.assign(std::max(positions, 0), std::vector<std::pair<int, int>>());
+
+    for (const auto& interval : intervals_) {
+        const LiveInterval* child = interval.get();
+        if (child->phys_reg == X64::NoRegister || !IsSpilled(child->vreg)) continue;
+
+        // Children starting at a write get their value from the instruction itself
+        if (child->start % 2 == 0 && child->start < static_cast<int>(reloads_.size())) {
+            reloads_[child->start].push_back(
+                std::make_pair(child->phys_reg, spill_slots_[child->vreg]));
+        }
+    }
+}
+
+void LinearScanAllocator::CollectCallSaves() {
+    for (const auto& interval : intervals_) {
+        const LiveInterval* child = interval.get();
+        if (!IsSavedAcrossCall(child)) continue;
+
+        auto it = std::lower_bound(call_positions_.begin(), call_positions_.end(), child->start);
+        for (; it != call_positions_.end() && *it < child->end; ++it) {
+            int call = *it;
+            bool deferred = false;
+
+            // The call's own result (R0) is written, neither saved nor restored
+            if (std::binary_search(child->use_positions.begin(), child->use_positions.end(), call + 1) ||
+                !IsNeededAfterCall(child, call, deferred)) {
+                continue;
+            }
+
+            // Spilled values were already stored at their definition
+            auto entry = std::make_pair(child->phys_reg, spill_slots_[child->vreg]);
+            if (!IsSpilled(child->vreg) && IsNewerThanSlot(child, call)) {
+                call_saves_[call].push_back(entry);
+                stats_.call_saves++;
+            }
+            if (!deferred) {
+                call_restores_[call].push_back(entry);
+                stats_.call_restores++;
+            }
+        }
+    }
+}
+
+const std::vector<std::pair<int, int>>& LinearScanAllocator::GetReloadsAt(int position) const {
+    static const std::vector<std::pair<int, int>> none;
+    if (position < 0 || position >= static_cast<int>(reloads_.size())) {
+        return none;
+    }
+    return reloads_[position];
+}
+
+const std::vector<std::pair<int, int>>& LinearScanAllocator::GetCallSaves(int position) const {
+    static const std::vector<std::pair<int, int>> none;
+    auto it = call_saves_.find(position);
+    return it != call_saves_.end() ? it->second : none;
+}
+
+const std::vector<std::pair<int, int>>& LinearScanAllocator::GetCallRestores(int position) const {
+    static const std::vector<std::pair<int, int>> none;
+    auto it = call_restores_.find(position);
+    return it != call_restores_.end() ? it->second : none;
+}
+
+std::vector<std::pair<int, int>> LinearScanAllocator::GetEdgeReloads(int from, int to) const {
+    std::vector<std::pair<int, int>> moves;
+
+    // Empty blocks share their position with the next block: nothing changes
+    // leaving one, and an edge into one really lands on the block it falls into
+    if (block_to_[from] < block_from_[from]) {
+        return moves;
+    }
+    while (block_to_[to] < block_from_[to]) {
+        if (++to >= static_cast<int>(block_from_.size())) return moves;
+    }
+
+    const IR::RegisterSet& live_in = liveness_->GetLiveIn(to);
+    for (size_t v = 0; v < live_in.size(); ++v) {
+        if (!live_in[v] || !IsSpilled(static_cast<int>(v))) continue;
+
+        const LiveInterval* at_target = FindChild(static_cast<int>(v), block_from_[to]);
+        if (!at_target || at_target->phys_reg == X64::NoRegister) continue;
+        if (at_target->start == block_from_[to]) continue; // Reloaded at block entry
+
+        const LiveInterval* at_source = FindChild(static_cast<int>(v), block_to_[from]);
+        if (at_source && at_source->phys_reg == at_target->phys_reg) continue;
+
+        moves.push_back(std::make_pair(at_target->phys_reg, spill_slots_[v]));
+    }
+
+    return moves;
+}
+
+Location LinearScanAllocator::GetLocation(int vreg, int position) const {
+    Location loc;
+    if (vreg < 0 || vreg >= static_cast<int>(children_.size())) {
+        return loc;
+    }
+
+    const LiveInterval* child = FindChild(vreg, position);
+    if (child) {
+        loc.reg = child->phys_reg;
+    }
+    loc.slot = spill_slots_[vreg];
+    return loc;
+}
+
+// ============================================================================
+// INTERVAL HELPERS
+// ============================================================================
+
+LiveInterval* LinearScanAllocator::SplitAt(LiveInterval* interval, int position) {
+    std::unique_ptr<LiveInterval> child(new LiveInterval());
+    child->vreg = interval->vreg;
+    child->start = position;
+    child->end = interval->end;
+    interval->end = position - 1;
+
+    auto split = std::lower_bound(interval->use_positions.begin(),
+                                  interval->use_positions.end(), position);
+    child->use_positions.assign(split, interval->use_positions.end());
+    interval->use_positions.erase(split, interval->use_positions.end());
+
+    interval->crosses_call = CrossesCall(interval);
+    child->crosses_call = CrossesCall(child.get());
+
+    auto& siblings = children_[interval->vreg];
+    siblings.insert(std::find(siblings.begin(), siblings.end(), interval) + 1, child.get());
+
+    LiveInterval* ptr = child.get();
+    intervals_.push_back(std::move(child));
+    stats_.splits++;
+    return ptr;
+}
+
+int LinearScanAllocator::NextUse(const LiveInterval* interval, int position) const {
+    auto it = std::lower_bound(interval->use_positions.begin(),
+                               interval->use_positions.end(), position);
+    return it != interval->use_positions.end() ? *it : INT_MAX;
+}
+
+int LinearScanAllocator::NextRead(const LiveInterval* interval, int position) const {
+    for (int use : interval->use_positions) {
+        if (use >= position && use % 2 == 0) {
+            return use;
+        }
+    }
+    return INT_MAX;
+}
+
+bool LinearScanAllocator::CrossesCall(const LiveInterval* interval) const {
+    // A call at position c reads at c and clobbers before c+1
+    auto it = std::lower_bound(call_positions_.begin(), call_positions_.end(), interval->start);
+    return it != call_positions_.end() && *it < interval->end;
+}
+
+bool LinearScanAllocator::IsNeededAfterCall(const LiveInterval* interval, int call, bool& deferred) const {
+    // Within the call's block, a value that passes through another call before
+    // it is read is reloaded after that one (deferred); one that is
+    // overwritten first is not needed at all
+    auto after = std::upper_bound(call_positions_.begin(), call_positions_.end(), call);
+    int next_call = after != call_positions_.end() ? *after : INT_MAX;
+    int block_end = block_to_[GetBlock(call)];
+    int last = std::min(block_end, interval->end);
+    int use = NextUse(interval, call + 2);
+
+    deferred = next_call < use && next_call <= last;
+    if (deferred) return true;
+    if (use <= last) return use % 2 == 0;
+    return interval->end >= block_end;  // Live out, unless split off to memory
+}
+
+bool LinearScanAllocator::IsNewerThanSlot(const LiveInterval* interval, int call) const {
+    // The slot is current after an earlier call in the same block that the
+    // value was live across, until the value is written again
+    auto it = std::lower_bound(call_positions_.begin(), call_positions_.end(), call);
+    if (it == call_positions_.begin()) return true;
+    int previous = *(it - 1);
+    if (previous < block_from_[GetBlock(call)] || previous < interval->start) return true;
+
+    for (int use : interval->use_positions) {
+        if (use > previous && use < call && use % 2 == 1) return true;
+    }
+    return false;
+}
+
+int LinearScanAllocator::GetBlock(int position) const {
+    // Empty blocks share their start with the next block and come first
+    auto it = std::upper_bound(block_from_.begin(), block_from_.end(), position);
+    return static_cast<int>(it - block_from_.begin()) - 1;
+}
+
+bool LinearScanAllocator::IsSavedAcrossCall(const LiveInterval* interval) const {
+    return interval->crosses_call && interval->phys_reg != X64::NoRegister &&
+           !X64::IsCalleeSaved(abi_, interval->phys_reg);
+}
+
+const LiveInterval* LinearScanAllocator::FindChild(int vreg, int position) const {
+    const auto& siblings = children_[vreg];
+    auto it = std::upper_bound(siblings.begin(), siblings.end(), position,
+        [](int pos, const LiveInterval* child) { return pos < child->start; });
+    if (it == siblings.begin()) {
+        return nullptr;
+    }
+    --it;
+    return (*it)->end >= position ? *it : nullptr;
+}
+
+} // namespace Snow
@@ -0,0 +1,145 @@
+#pragma once
+
+#include "../IR/IR.h"
+#include "../IR/IRAnalysis.h"
+#include "X64Target.h"
+#include <vector>
+#include <memory>
+#include <utility>
+#include <unordered_map>
+
+namespace Snow {
+
+// ============================================================================
+// LIVE INTERVALS
+// Instruction k (in block layout order) reads its operands at position 2k and
+// writes its result at 2k+1, so a value dying at k can share a register with
+// the value k defines. Intervals are closed ranges of positions.
+// ============================================================================
+
+struct LiveInterval {
+    int vreg;
+    int start;
+    int end;
+    std::vector<int> use_positions; // Sorted; even = read, odd = write
+    int phys_reg = X64::NoRegister; // NoRegister = lives in the spill slot
+    bool crosses_call = false;
+};
+
+// Where a virtual register lives at a given position
+struct Location {
+    int reg = X64::NoRegister;
+    int slot = -1;
+
+    bool IsRegister() const { return reg != X64::NoRegister; }
+};
+
+// ============================================================================
+// LINEAR SCAN REGISTER ALLOCATOR
+// Poletto-Sarkar linear scan with interval splitting. When registers run out,
+// the interval whose next use is furthest away is split: the part before the
+// current position keeps its register, the rest waits in a stack slot until
+// its next read and then competes for a register again.
+//
+// Spilled values are stored after every definition, so a slot is always up to
+// date and every split or control-flow join only ever needs a reload. Values
+// whose lifetimes don't overlap share a slot, so the frame holds only as many
+// slots as are ever live at once.
+//
+// Values live across a call prefer callee-saved registers. Once those are
+// taken they may still sit in a caller-saved one and get a slot, but are only
+// stored before a call when the register is newer than the slot, and only
+// reloaded after it when the block reads them before the next call.
+// ============================================================================
+
+class LinearScanAllocator {
+public:
+    explicit LinearScanAllocator(X64::TargetABI abi);
+
+    // Operands as instruction selection will actually emit them. An
+    // instruction folded into another one's addressing mode reads and writes
+    // nothing; the instruction it was folded into reads its operands instead.
+    struct SelectedUses {
+        std::vector<int> reads;
+        bool writes = true;
+    };
+    typedef std::unordered_map<const IR::Instruction*, SelectedUses> SelectionMap;
+
+    void Allocate(const IR::Function& func, const SelectionMap* selection = nullptr);
+
+    // Queries for code emission (valid after Allocate)
+    int GetPosition(int block, int instr) const { return 2 * (block_first_[block] + instr); }
+    Location GetLocation(int vreg, int position) const;
+    bool HasSpillSlot(int vreg) const { return vreg < static_cast<int>(spill_slots_.size()) && spill_slots_[vreg] >= 0; }
+    bool IsSpilled(int vreg) const { return vreg < static_cast<int>(in_memory_.size()) && in_memory_[vreg]; }
+    int GetSpillSlot(int vreg) const { return spill_slots_[vreg]; }
+    int GetSpillSlotCount() const { return spill_slot_count_; }
+    const std::vector<int>& GetUsedCalleeSaved() const { return used_callee_saved_; }
+
+    // Reloads (register, slot) to emit before the instruction at 'position'
+    const std::vector<std::pair<int, int>>& GetReloadsAt(int position) const;
+
+    // Caller-saved registers (register, slot) to store before the call at
+    // 'position' and to reload after it
+    const std::vector<std::pair<int, int>>& GetCallSaves(int position) const;
+    const std::vector<std::pair<int, int>>& GetCallRestores(int position) const;
+
+    // Reloads needed when control flows from block 'from' into block 'to'
+    std::vector<std::pair<int, int>> GetEdgeReloads(int from, int to) const;
+
+    const IR::ControlFlowGraph& GetCFG() const { return *cfg_; }
+
+    // Statistics
+    struct Stats {
+        int intervals = 0;
+        int splits = 0;
+        int spilled_registers = 0;
+        int call_saves = 0;         // Caller-saved registers stored before calls
+        int call_restores = 0;      // and reloaded after them
+    };
+
+    const Stats& GetStats() const { return stats_; }
+
+private:
+    X64::TargetABI abi_;
+    Stats stats_;
+
+    std::unique_ptr<IR::ControlFlowGraph> cfg_;
+    std::unique_ptr<IR::Liveness> liveness_;
+
+    std::vector<int> block_first_;   // Index of each block's first instruction
+    std::vector<int> block_from_;    // First position in block
+    std::vector<int> block_to_;      // Last position in block (from-1 if empty)
+    std::vector<int> call_positions_;
+
+    std::vector<std::unique_ptr<LiveInterval>> intervals_;
+    std::vector<std::vector<LiveInterval*>> children_; // Per vreg, by start
+    std::vector<int> spill_slots_;
+    std::vector<bool> in_memory_;    // Per vreg: a slot kept current at every definition
+    int spill_slot_count_;
+    std::vector<int> used_callee_saved_;
+    std::vector<std::vector<std::pair<int, int>>> reloads_;
+    std::unordered_map<int, std::vector<std::pair<int, int>>> call_saves_;
+    std::unordered_map<int, std::vector<std::pair<int, int>>> call_restores_;
+    const SelectionMap* selection_;
+
+    void NumberInstructions();
+    void BuildIntervals();
+    void ScanIntervals();
+    void AssignSpillSlots();
+    void CollectReloads();
+    void CollectCallSaves();
+
+    // Interval helpers
+    LiveInterval* SplitAt(LiveInterval* interval, int position);
+    int NextUse(const LiveInterval* interval, int position) const;
+    int NextRead(const LiveInterval* interval, int position) const;
+    bool CrossesCall(const LiveInterval* interval) const;
+    bool IsSavedAcrossCall(const LiveInterval* interval) const;
+    bool IsNeededAfterCall(const LiveInterval* interval, int call, bool& deferred) const;
+    bool IsNewerThanSlot(const LiveInterval* interval, int call) const;
+    int GetBlock(int position) const;
+    const LiveInterval* FindChild(int vreg, int position) const;
+};
+
+} // namespace Snow
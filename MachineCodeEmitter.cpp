@@ -0,0 +1,849 @@
+#include "PEGenerator.h"
+#include "../CodeGen/DivisionMagic.h"
+#include <algorithm>
+
+namespace Snow {
+namespace PEGenerator {
+
+namespace {
+
+const int kScratch0 = 14;  // XMM14
+const int kScratch1 = 15;  // XMM15
+
+// Opcodes after the 0F escape
+const uint8_t kMovdqa = 0x6F;      // 66: movdqa xmm, xmm/m
+const uint8_t kMovdquLoad = 0x6F;  // F3: movdqu xmm, m
+const uint8_t kMovdquStore = 0x7F; // F3: movdqu m, xmm
+const uint8_t kPaddq = 0xD4;
+const uint8_t kPsubq = 0xFB;
+const uint8_t kPmuludq = 0xF4;
+const uint8_t kShiftImm = 0x73;    // /2 = psrlq, /6 = psllq
+const uint8_t kPshufd = 0x70;
+const uint8_t kPunpcklqdq = 0x6C;
+const uint8_t kMovqToXmm = 0x6E;   // with W: movq xmm, r64
+const uint8_t kMovqFromXmm = 0x7E; // with W: movq r64, xmm
+const uint8_t kVpbroadcastq = 0x59;  // 0F38
+const uint8_t kVextracti128 = 0x39;  // 0F3A
+const uint8_t kVinserti128 = 0x38;   // 0F3A
+const uint8_t kPrefetch = 0x18;       // /0 = nta, /1 = t0, /2 = t1, /3 = t2
+
+void EmitImm32(std::vector<uint8_t>& code, int32_t value) {
+    for (int i = 0; i < 4; ++i) code.push_back(static_cast<uint8_t>(value >> (8 * i)));
+}
+
+} // namespace
+
+// ============================================================================
+// ENCODING HELPERS
+// ============================================================================
+
+MachineCodeEmitter::MachineCodeEmitter() : vector_width_(2) {
+}
+
+uint8_t MachineCodeEmitter::GetRegisterEncoding(int reg) {
+    return static_cast<uint8_t>(reg & 7);
+}
+
+void MachineCodeEmitter::EmitREX(std::vector<uint8_t>& code, bool w, bool r, bool x, bool b) {
+    code.push_back(static_cast<uint8_t>(0x40 | (w << 3) | (r << 2) | (x << 1) | b));
+}
+
+void MachineCodeEmitter::EmitModRM(std::vector<uint8_t>& code, uint8_t mod, uint8_t reg, uint8_t rm) {
+    code.push_back(static_cast<uint8_t>((mod << 6) | ((reg & 7) << 3) | (rm & 7)));
+}
+
+// scale is the encoded field: 0..3 for x1, x2, x4, x8
+void MachineCodeEmitter::EmitSIB(std::vector<uint8_t>& code, uint8_t scale, uint8_t index, uint8_t base) {
+    code.push_back(static_cast<uint8_t>((scale << 6) | ((index & 7) << 3) | (base & 7)));
+}
+
+void MachineCodeEmitter::EmitMemoryOperand(std::vector<uint8_t>& code, int reg, int base_reg, int32_t offset) {
+    EmitMemoryOperand(code, reg, Address(base_reg, offset));
+}
+
+void MachineCodeEmitter::EmitMemoryOperand(std::vector<uint8_t>& code, int reg, const Address& address) {
+    static const uint8_t kScale[9] = { 0, 0, 1, 0, 2, 0, 0, 0, 3 };
+    int32_t offset = address.offset;
+
+    if (address.base < 0) {
+        // rm=100 with SIB base 101 and mod 00 is [index*scale + disp32], or
+        // [disp32] with the no-index encoding 100 (never rip-relative)
+        uint8_t index = address.index < 0 ? 4 : GetRegisterEncoding(address.index);
+        EmitModRM(code, 0, static_cast<uint8_t>(reg), 4);
+        EmitSIB(code, kScale[address.index < 0 ? 1 : address.scale], index, 5);
+        EmitImm32(code, offset);
+        return;
+    }
+
+    uint8_t base = GetRegisterEncoding(address.base);
+
+    // rbp/r13 have no zero-displacement form; rsp/r12 need a SIB byte
+    uint8_t mod;
+    if (offset == 0 && base != 5) {
+        mod = 0;
+    } else if (offset >= -128 && offset <= 127) {
+        mod = 1;
+    } else {
+        mod = 2;
+    }
+
+    if (address.index >= 0) {
+        EmitModRM(code, mod, static_cast<uint8_t>(reg), 4);
+        EmitSIB(code, kScale[address.scale], GetRegisterEncoding(address.index), base);
+    } else {
+        EmitModRM(code, mod, static_cast<uint8_t>(reg), base);
+        if (base == 4) EmitSIB(code, 0, 4, 4);
+    }
+
+    if (mod == 1) {
+        code.push_back(static_cast<uint8_t>(offset));
+    } else if (mod == 2) {
+        EmitImm32(code, offset);
+    }
+}
+
+void MachineCodeEmitter::EmitREX(std::vector<uint8_t>& code, int reg, const Address& address) {
+    EmitREX(code, true, reg >= 8, address.index >= 8, address.base >= 8);
+}
+
+void MachineCodeEmitter::EmitVEX(std::vector<uint8_t>& code, bool r, bool x, bool b, int map,
+                                 bool w, int vvvv, bool l, uint8_t prefix) {
+    uint8_t pp = prefix == 0x66 ? 1 : prefix == 0xF3 ? 2 : prefix == 0xF2 ? 3 : 0;
+    uint8_t tail = static_cast<uint8_t>(((~vvvv & 0xF) << 3) | (l << 2) | pp);
+
+    // Two-byte form only covers the 0F map with W, X and B clear
+    if (!x && !b && !w && map == 1) {
+        code.push_back(0xC5);
+        code.push_back(static_cast<uint8_t>((!r << 7) | tail));
+        return;
+    }
+    code.push_back(0xC4);
+    code.push_back(static_cast<uint8_t>((!r << 7) | (!x << 6) | (!b << 5) | map));
+    code.push_back(static_cast<uint8_t>((w << 7) | tail));
+}
+
+void MachineCodeEmitter::EmitSIMD(std::vector<uint8_t>& code, uint8_t prefix, int map, uint8_t opcode,
+                                  int reg, int vvvv, int rm, bool w, bool l) {
+    if (vector_width_ > 2) {
+        EmitVEX(code, reg >= 8, false, rm >= 8, map, w, vvvv, l, prefix);
+    } else {
+        if (prefix) code.push_back(prefix);
+        if (w || reg >= 8 || rm >= 8) EmitREX(code, w, reg >= 8, false, rm >= 8);
+        code.push_back(0x0F);
+        if (map == 2) code.push_back(0x38);
+        if (map == 3) code.push_back(0x3A);
+    }
+    code.push_back(opcode);
+    EmitModRM(code, 3, static_cast<uint8_t>(reg), static_cast<uint8_t>(rm));
+}
+
+// ============================================================================
+// GENERAL-PURPOSE INSTRUCTIONS
+// Register operands are always the full 64-bit registers.
+// ============================================================================
+
+void MachineCodeEmitter::EmitPrologue(std::vector<uint8_t>& code) {
+    EmitPush(code, 5);                             // push rbp
+    EmitMov(code, 5, 4);                           // mov rbp, rsp
+}
+
+void MachineCodeEmitter::EmitEpilogue(std::vector<uint8_t>& code) {
+    EmitMov(code, 4, 5);                           // mov rsp, rbp
+    EmitPop(code, 5);                              // pop rbp
+}
+
+void MachineCodeEmitter::EmitAdd(std::vector<uint8_t>& code, int dst_reg, int src_reg) {
+    EmitREX(code, true, src_reg >= 8, false, dst_reg >= 8);
+    code.push_back(0x01);
+    EmitModRM(code, 3, static_cast<uint8_t>(src_reg), static_cast<uint8_t>(dst_reg));
+}
+
+void MachineCodeEmitter::EmitSub(std::vector<uint8_t>& code, int dst_reg, int src_reg) {
+    EmitREX(code, true, src_reg >= 8, false, dst_reg >= 8);
+    code.push_back(0x29);
+    EmitModRM(code, 3, static_cast<uint8_t>(src_reg), static_cast<uint8_t>(dst_reg));
+}
+
+void MachineCodeEmitter::EmitMul(std::vector<uint8_t>& code, int dst_reg, int src_reg) {
+    EmitREX(code, true, dst_reg >= 8, false, src_reg >= 8);
+    code.push_back(0x0F);
+    code.push_back(0xAF);                          // imul r64, r/m64
+    EmitModRM(code, 3, static_cast<uint8_t>(dst_reg), static_cast<uint8_t>(src_reg));
+}
+
+// Signed rdx:rax / reg; quotient in rax, remainder in rdx
+void MachineCodeEmitter::EmitDiv(std::vector<uint8_t>& code, int reg) {
+    code.push_back(0x48);
+    code.push_back(0x99);                          // cqo
+    EmitREX(code, true, false, false, reg >= 8);
+    code.push_back(0xF7);
+    EmitModRM(code, 3, 7, static_cast<uint8_t>(reg));
+}
+
+// rdx:rax = rax * reg (one-operand imul or mul)
+void MachineCodeEmitter::EmitMulHigh(std::vector<uint8_t>& code, int reg, bool is_signed) {
+    EmitREX(code, true, false, false, reg >= 8);
+    code.push_back(0xF7);
+    EmitModRM(code, 3, is_signed ? 5 : 4, static_cast<uint8_t>(reg));
+}
+
+void MachineCodeEmitter::EmitNeg(std::vector<uint8_t>& code, int reg) {
+    EmitREX(code, true, false, false, reg >= 8);
+    code.push_back(0xF7);
+    EmitModRM(code, 3, 3, static_cast<uint8_t>(reg));
+}
+
+void MachineCodeEmitter::EmitShiftImm(std::vector<uint8_t>& code, ShiftOp op, int reg, int count) {
+    EmitREX(code, true, false, false, reg >= 8);
+    code.push_back(count == 1 ? 0xD1 : 0xC1);
+    EmitModRM(code, 3, static_cast<uint8_t>(op), static_cast<uint8_t>(reg));
+    if (count != 1) code.push_back(static_cast<uint8_t>(count));
+}
+
+void MachineCodeEmitter::EmitDivImm(std::vector<uint8_t>& code, int64_t divisor, int scratch_reg) {
+    if (!X64::CanDivideWithoutIdiv(divisor)) {
+        EmitMovImm(code, scratch_reg, divisor);
+        EmitDiv(code, scratch_reg);
+        return;
+    }
+
+    // n / -d == -(n / d) when rounding toward zero
+    uint64_t magnitude = divisor < 0 ? 0 - static_cast<uint64_t>(divisor) : static_cast<uint64_t>(divisor);
+    int power = X64::GetPowerOfTwoShift(magnitude);
+    if (power == 0) {
+        // Division by one
+    } else if (power > 0) {
+        // Bias negative dividends by 2^k-1 so the arithmetic shift truncates
+        EmitMov(code, 2, 0);                                // mov rdx, rax
+        if (power > 1) EmitShiftImm(code, ShiftOp::Sar, 2, 63);
+        EmitShiftImm(code, ShiftOp::Shr, 2, 64 - power);
+        EmitAdd(code, 0, 2);                                // add rax, rdx
+        EmitShiftImm(code, ShiftOp::Sar, 0, power);
+    } else {
+        X64::SignedDivisionMagic magic = X64::ComputeSignedDivisionMagic(divisor);
+        if (magic.multiplier < 0) EmitMov(code, scratch_reg, 0);
+        EmitMovImm(code, 2, magic.multiplier);
+        EmitMulHigh(code, 2, true);                         // rdx = high(rax * magic)
+        if (magic.multiplier < 0) EmitAdd(code, 2, scratch_reg);
+        if (magic.shift > 0) EmitShiftImm(code, ShiftOp::Sar, 2, magic.shift);
+        EmitMov(code, 0, 2);                                // rax = q + (q < 0)
+        EmitShiftImm(code, ShiftOp::Shr, 0, 63);
+        EmitAdd(code, 0, 2);
+    }
+    if (divisor < 0) EmitNeg(code, 0);
+}
+
+void MachineCodeEmitter::EmitUnsignedDivImm(std::vector<uint8_t>& code, uint64_t divisor, int scratch_reg) {
+    int power = X64::GetPowerOfTwoShift(divisor);
+    if (divisor == 0) {
+        EmitAlu(code, AluOp::Xor, 2, 2);                    // xor rdx, rdx
+        EmitMovImm(code, scratch_reg, 0);
+        EmitREX(code, true, false, false, scratch_reg >= 8);
+        code.push_back(0xF7);
+        EmitModRM(code, 3, 6, static_cast<uint8_t>(scratch_reg)); // div scratch (traps)
+        return;
+    }
+    if (power >= 0) {
+        if (power > 0) EmitShiftImm(code, ShiftOp::Shr, 0, power);
+        return;
+    }
+
+    X64::UnsignedDivisionMagic magic = X64::ComputeUnsignedDivisionMagic(divisor);
+    if (magic.add) EmitMov(code, scratch_reg, 0);
+    EmitMovImm(code, 2, static_cast<int64_t>(magic.multiplier));
+    EmitMulHigh(code, 2, false);                            // rdx = high(rax * magic)
+    if (magic.add) {
+        EmitSub(code, scratch_reg, 2);                      // ((n - q) >> 1) + q
+        EmitShiftImm(code, ShiftOp::Shr, scratch_reg, 1);
+        EmitAdd(code, 2, scratch_reg);
+        if (magic.shift > 1) EmitShiftImm(code, ShiftOp::Shr, 2, magic.shift - 1);
+    } else if (magic.shift > 0) {
+        EmitShiftImm(code, ShiftOp::Shr, 2, magic.shift);
+    }
+    EmitMov(code, 0, 2);
+}
+
+void MachineCodeEmitter::EmitAlu(std::vector<uint8_t>& code, AluOp op, int dst_reg, int src_reg) {
+    EmitREX(code, true, src_reg >= 8, false, dst_reg >= 8);
+    code.push_back(static_cast<uint8_t>(static_cast<uint8_t>(op) * 8 + 1));
+    EmitModRM(code, 3, static_cast<uint8_t>(src_reg), static_cast<uint8_t>(dst_reg));
+}
+
+void MachineCodeEmitter::EmitAluImm(std::vector<uint8_t>& code, AluOp op, int reg, int32_t immediate) {
+    EmitREX(code, true, false, false, reg >= 8);
+    bool short_form = immediate >= -128 && immediate <= 127;
+    code.push_back(short_form ? 0x83 : 0x81);
+    EmitModRM(code, 3, static_cast<uint8_t>(op), static_cast<uint8_t>(reg));
+    if (short_form) {
+        code.push_back(static_cast<uint8_t>(immediate));
+    } else {
+        EmitImm32(code, immediate);
+    }
+}
+
+// imul dst, src, imm
+void MachineCodeEmitter::EmitMulImm(std::vector<uint8_t>& code, int dst_reg, int src_reg, int32_t immediate) {
+    EmitREX(code, true, dst_reg >= 8, false, src_reg >= 8);
+    bool short_form = immediate >= -128 && immediate <= 127;
+    code.push_back(short_form ? 0x6B : 0x69);
+    EmitModRM(code, 3, static_cast<uint8_t>(dst_reg), static_cast<uint8_t>(src_reg));
+    if (short_form) {
+        code.push_back(static_cast<uint8_t>(immediate));
+    } else {
+        EmitImm32(code, immediate);
+    }
+}
+
+void MachineCodeEmitter::EmitMov(std::vector<uint8_t>& code, int dst_reg, int src_reg) {
+    EmitREX(code, true, src_reg >= 8, false, dst_reg >= 8);
+    code.push_back(0x89);
+    EmitModRM(code, 3, static_cast<uint8_t>(src_reg), static_cast<uint8_t>(dst_reg));
+}
+
+void MachineCodeEmitter::EmitMovImm(std::vector<uint8_t>& code, int reg, int64_t immediate) {
+    if (immediate >= 0 && immediate <= UINT32_MAX) {
+        // mov r32, imm32 zero-extends and needs no REX.W
+        if (reg >= 8) EmitREX(code, false, false, false, true);
+        code.push_back(static_cast<uint8_t>(0xB8 + GetRegisterEncoding(reg)));
+        EmitImm32(code, static_cast<int32_t>(immediate));
+    } else if (immediate >= INT32_MIN && immediate <= INT32_MAX) {
+        EmitREX(code, true, false, false, reg >= 8);
+        code.push_back(0xC7);
+        EmitModRM(code, 3, 0, static_cast<uint8_t>(reg));
+        EmitImm32(code, static_cast<int32_t>(immediate));
+    } else {
+        EmitMovImm64(code, reg, immediate);
+    }
+}
+
+void MachineCodeEmitter::EmitMovImm64(std::vector<uint8_t>& code, int reg, int64_t immediate) {
+    EmitREX(code, true, false, false, reg >= 8);
+    code.push_back(static_cast<uint8_t>(0xB8 + GetRegisterEncoding(reg)));
+    for (int i = 0; i < 8; ++i) code.push_back(static_cast<uint8_t>(immediate >> (8 * i)));
+}
+
+void MachineCodeEmitter::EmitAddImm(std::vector<uint8_t>& code, int reg, int32_t immediate) {
+    EmitREX(code, true, false, false, reg >= 8);
+    if (immediate >= -128 && immediate <= 127) {
+        code.push_back(0x83);
+        EmitModRM(code, 3, 0, static_cast<uint8_t>(reg));
+        code.push_back(static_cast<uint8_t>(immediate));
+    } else {
+        code.push_back(0x81);
+        EmitModRM(code, 3, 0, static_cast<uint8_t>(reg));
+        EmitImm32(code, immediate);
+    }
+}
+
+// Flags from reg1 - reg2
+void MachineCodeEmitter::EmitCmp(std::vector<uint8_t>& code, int reg1, int reg2) {
+    EmitREX(code, true, reg2 >= 8, false, reg1 >= 8);
+    code.push_back(0x39);
+    EmitModRM(code, 3, static_cast<uint8_t>(reg2), static_cast<uint8_t>(reg1));
+}
+
+void MachineCodeEmitter::EmitSetcc(std::vector<uint8_t>& code, Condition condition, int reg) {
+    // Any REX makes byte registers 4-7 spl..dil instead of ah..bh
+    if (reg >= 4) EmitREX(code, false, false, false, reg >= 8);
+    code.push_back(0x0F);
+    code.push_back(static_cast<uint8_t>(0x90 | static_cast<uint8_t>(condition)));
+    EmitModRM(code, 3, 0, static_cast<uint8_t>(reg));
+    EmitREX(code, true, reg >= 8, false, reg >= 8);
+    code.push_back(0x0F);
+    code.push_back(0xB6);                          // movzx r64, r/m8
+    EmitModRM(code, 3, static_cast<uint8_t>(reg), static_cast<uint8_t>(reg));
+}
+
+void MachineCodeEmitter::EmitPush(std::vector<uint8_t>& code, int reg) {
+    if (reg >= 8) EmitREX(code, false, false, false, true);
+    code.push_back(static_cast<uint8_t>(0x50 + GetRegisterEncoding(reg)));
+}
+
+void MachineCodeEmitter::EmitPop(std::vector<uint8_t>& code, int reg) {
+    if (reg >= 8) EmitREX(code, false, false, false, true);
+    code.push_back(static_cast<uint8_t>(0x58 + GetRegisterEncoding(reg)));
+}
+
+void MachineCodeEmitter::EmitLoad(std::vector<uint8_t>& code, int dst_reg, int base_reg, int32_t offset) {
+    EmitLoad(code, dst_reg, Address(base_reg, offset));
+}
+
+void MachineCodeEmitter::EmitStore(std::vector<uint8_t>& code, int base_reg, int32_t offset, int src_reg) {
+    EmitStore(code, Address(base_reg, offset), src_reg);
+}
+
+void MachineCodeEmitter::EmitLea(std::vector<uint8_t>& code, int dst_reg, int base_reg, int32_t offset) {
+    EmitLea(code, dst_reg, Address(base_reg, offset));
+}
+
+void MachineCodeEmitter::EmitLoad(std::vector<uint8_t>& code, int dst_reg, const Address& src) {
+    EmitREX(code, dst_reg, src);
+    code.push_back(0x8B);
+    EmitMemoryOperand(code, dst_reg, src);
+}
+
+void MachineCodeEmitter::EmitStore(std::vector<uint8_t>& code, const Address& dst, int src_reg) {
+    EmitREX(code, src_reg, dst);
+    code.push_back(0x89);
+    EmitMemoryOperand(code, src_reg, dst);
+}
+
+// mov qword [mem], imm32 (sign-extended)
+void MachineCodeEmitter::EmitStoreImm(std::vector<uint8_t>& code, const Address& dst, int32_t immediate) {
+    EmitREX(code, 0, dst);
+    code.push_back(0xC7);
+    EmitMemoryOperand(code, 0, dst);
+    EmitImm32(code, immediate);
+}
+
+void MachineCodeEmitter::EmitLea(std::vector<uint8_t>& code, int dst_reg, const Address& src) {
+    EmitREX(code, dst_reg, src);
+    code.push_back(0x8D);
+    EmitMemoryOperand(code, dst_reg, src);
+}
+
+// op dst, qword [mem]
+void MachineCodeEmitter::EmitAluLoad(std::vector<uint8_t>& code, AluOp op, int dst_reg, const Address& src) {
+    EmitREX(code, dst_reg, src);
+    code.push_back(static_cast<uint8_t>(static_cast<uint8_t>(op) * 8 + 3));
+    EmitMemoryOperand(code, dst_reg, src);
+}
+
+// op qword [mem], src
+void MachineCodeEmitter::EmitAluStore(std::vector<uint8_t>& code, AluOp op, const Address& dst, int src_reg) {
+    EmitREX(code, src_reg, dst);
+    code.push_back(static_cast<uint8_t>(static_cast<uint8_t>(op) * 8 + 1));
+    EmitMemoryOperand(code, src_reg, dst);
+}
+
+void MachineCodeEmitter::EmitAluMemoryImm(std::vector<uint8_t>& code, AluOp op, const Address& dst, int32_t immediate) {
+    EmitREX(code, 0, dst);
+    bool short_form = immediate >= -128 && immediate <= 127;
+    code.push_back(short_form ? 0x83 : 0x81);
+    EmitMemoryOperand(code, static_cast<uint8_t>(op), dst);
+    if (short_form) {
+        code.push_back(static_cast<uint8_t>(immediate));
+    } else {
+        EmitImm32(code, immediate);
+    }
+}
+
+void MachineCodeEmitter::EmitMulLoad(std::vector<uint8_t>& code, int dst_reg, const Address& src) {
+    EmitREX(code, dst_reg, src);
+    code.push_back(0x0F);
+    code.push_back(0xAF);
+    EmitMemoryOperand(code, dst_reg, src);
+}
+
+// imul dst, qword [mem], imm
+void MachineCodeEmitter::EmitMulImm(std::vector<uint8_t>& code, int dst_reg, const Address& src, int32_t immediate) {
+    EmitREX(code, dst_reg, src);
+    bool short_form = immediate >= -128 && immediate <= 127;
+    code.push_back(short_form ? 0x6B : 0x69);
+    EmitMemoryOperand(code, dst_reg, src);
+    if (short_form) {
+        code.push_back(static_cast<uint8_t>(immediate));
+    } else {
+        EmitImm32(code, immediate);
+    }
+}
+
+// As EmitDiv, with the divisor in memory
+void MachineCodeEmitter::EmitDivMemory(std::vector<uint8_t>& code, const Address& divisor) {
+    code.push_back(0x48);
+    code.push_back(0x99);                          // cqo
+    EmitREX(code, 0, divisor);
+    code.push_back(0xF7);
+    EmitMemoryOperand(code, 7, divisor);
+}
+
+void MachineCodeEmitter::EmitCall(std::vector<uint8_t>& code, int32_t offset) {
+    code.push_back(0xE8);
+    EmitImm32(code, offset);
+}
+
+void MachineCodeEmitter::EmitCallIndirect(std::vector<uint8_t>& code, int reg) {
+    if (reg >= 8) EmitREX(code, false, false, false, true);
+    code.push_back(0xFF);
+    EmitModRM(code, 3, 2, static_cast<uint8_t>(reg));
+}
+
+void MachineCodeEmitter::EmitRet(std::vector<uint8_t>& code) {
+    code.push_back(0xC3);
+}
+
+void MachineCodeEmitter::EmitJmp(std::vector<uint8_t>& code, int32_t offset) {
+    code.push_back(0xE9);
+    EmitImm32(code, offset);
+}
+
+void MachineCodeEmitter::EmitJe(std::vector<uint8_t>& code, int32_t offset) {
+    EmitJcc(code, Condition::E, offset);
+}
+
+void MachineCodeEmitter::EmitJne(std::vector<uint8_t>& code, int32_t offset) {
+    EmitJcc(code, Condition::NE, offset);
+}
+
+void MachineCodeEmitter::EmitJcc(std::vector<uint8_t>& code, Condition condition, int32_t offset) {
+    code.push_back(0x0F);
+    code.push_back(static_cast<uint8_t>(0x80 | static_cast<uint8_t>(condition)));
+    EmitImm32(code, offset);
+}
+
+void MachineCodeEmitter::EmitJmp8(std::vector<uint8_t>& code, int8_t offset) {
+    code.push_back(0xEB);
+    code.push_back(static_cast<uint8_t>(offset));
+}
+
+void MachineCodeEmitter::EmitJcc8(std::vector<uint8_t>& code, Condition condition, int8_t offset) {
+    code.push_back(static_cast<uint8_t>(0x70 | static_cast<uint8_t>(condition)));
+    code.push_back(static_cast<uint8_t>(offset));
+}
+
+void MachineCodeEmitter::EmitNop(std::vector<uint8_t>& code, size_t length) {
+    static const uint8_t kNops[9][9] = {
+        { 0x90 },
+        { 0x66, 0x90 },
+        { 0x0F, 0x1F, 0x00 },
+        { 0x0F, 0x1F, 0x40, 0x00 },
+        { 0x0F, 0x1F, 0x44, 0x00, 0x00 },
+        { 0x66, 0x0F, 0x1F, 0x44, 0x00, 0x00 },
+        { 0x0F, 0x1F, 0x80, 0x00, 0x00, 0x00, 0x00 },
+        { 0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00 },
+        { 0x66, 0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    };
+    while (length > 0) {
+        size_t n = std::min<size_t>(length, 9);
+        code.insert(code.end(), kNops[n - 1], kNops[n - 1] + n);
+        length -= n;
+    }
+}
+
+// ============================================================================
+// PREFETCH
+// ============================================================================
+
+void MachineCodeEmitter::EmitPrefetch(std::vector<uint8_t>& code, int base_reg, int32_t offset, int locality) {
+    EmitPrefetch(code, Address(base_reg, offset), locality);
+}
+
+void MachineCodeEmitter::EmitPrefetch(std::vector<uint8_t>& code, const Address& address, int locality) {
+    static const uint8_t kHint[4] = { 0, 3, 2, 1 };  // Indexed by locality
+    if (address.base >= 8 || address.index >= 8) {
+        EmitREX(code, false, false, address.index >= 8, address.base >= 8);
+    }
+    code.push_back(0x0F);
+    code.push_back(kPrefetch);
+    EmitMemoryOperand(code, kHint[std::max(0, std::min(3, locality))], address);
+}
+
+// ============================================================================
+// SIMD INSTRUCTIONS
+// Without AVX-512DQ there is no 64-bit lane multiply, so VectorMul builds
+// the low 64 bits of each product from 32x32 pmuludq partial products:
+//   a * b = lo(a)*lo(b) + ((hi(a)*lo(b) + lo(a)*hi(b)) << 32)
+// ============================================================================
+
+void MachineCodeEmitter::EmitVectorLoad(std::vector<uint8_t>& code, int dst_xmm, int base_reg, int32_t offset) {
+    if (vector_width_ > 2) {
+        EmitVEX(code, dst_xmm >= 8, false, base_reg >= 8, 1, false, 0, true, 0xF3);
+    } else {
+        code.push_back(0xF3);
+        if (dst_xmm >= 8 || base_reg >= 8) EmitREX(code, false, dst_xmm >= 8, false, base_reg >= 8);
+        code.push_back(0x0F);
+    }
+    code.push_back(kMovdquLoad);
+    EmitMemoryOperand(code, dst_xmm, base_reg, offset);
+}
+
+void MachineCodeEmitter::EmitVectorStore(std::vector<uint8_t>& code, int base_reg, int32_t offset, int src_xmm) {
+    if (vector_width_ > 2) {
+        EmitVEX(code, src_xmm >= 8, false, base_reg >= 8, 1, false, 0, true, 0xF3);
+    } else {
+        code.push_back(0xF3);
+        if (src_xmm >= 8 || base_reg >= 8) EmitREX(code, false, src_xmm >= 8, false, base_reg >= 8);
+        code.push_back(0x0F);
+    }
+    code.push_back(kMovdquStore);
+    EmitMemoryOperand(code, src_xmm, base_reg, offset);
+}
+
+void MachineCodeEmitter::EmitVectorAdd(std::vector<uint8_t>& code, int dst_xmm, int src1_xmm, int src2_xmm) {
+    if (vector_width_ > 2) {
+        EmitSIMD(code, 0x66, 1, kPaddq, dst_xmm, src1_xmm, src2_xmm, false, true);
+        return;
+    }
+    // Two-operand form; addition commutes, so only a distinct dst needs a copy
+    if (dst_xmm == src2_xmm) {
+        EmitSIMD(code, 0x66, 1, kPaddq, dst_xmm, 0, src1_xmm, false, false);
+        return;
+    }
+    if (dst_xmm != src1_xmm) EmitSIMD(code, 0x66, 1, kMovdqa, dst_xmm, 0, src1_xmm, false, false);
+    EmitSIMD(code, 0x66, 1, kPaddq, dst_xmm, 0, src2_xmm, false, false);
+}
+
+void MachineCodeEmitter::EmitVectorSub(std::vector<uint8_t>& code, int dst_xmm, int src1_xmm, int src2_xmm) {
+    if (vector_width_ > 2) {
+        EmitSIMD(code, 0x66, 1, kPsubq, dst_xmm, src1_xmm, src2_xmm, false, true);
+        return;
+    }
+    if (dst_xmm == src2_xmm && dst_xmm != src1_xmm) {
+        EmitSIMD(code, 0x66, 1, kMovdqa, kScratch1, 0, src2_xmm, false, false);
+        src2_xmm = kScratch1;
+    }
+    if (dst_xmm != src1_xmm) EmitSIMD(code, 0x66, 1, kMovdqa, dst_xmm, 0, src1_xmm, false, false);
+    EmitSIMD(code, 0x66, 1, kPsubq, dst_xmm, 0, src2_xmm, false, false);
+}
+
+void MachineCodeEmitter::EmitVectorMul(std::vector<uint8_t>& code, int dst_xmm, int src1_xmm, int src2_xmm) {
+    const int a = src1_xmm;
+    const int b = src2_xmm;
+    const int t0 = kScratch0;
+    const int t1 = kScratch1;
+
+    if (vector_width_ > 2) {
+        EmitSIMD(code, 0x66, 1, kShiftImm, 2, t0, a, false, true);   // vpsrlq t0, a, 32
+        code.push_back(32);
+        EmitSIMD(code, 0x66, 1, kPmuludq, t0, t0, b, false, true);   // hi(a) * lo(b)
+        EmitSIMD(code, 0x66, 1, kShiftImm, 2, t1, b, false, true);   // vpsrlq t1, b, 32
+        code.push_back(32);
+        EmitSIMD(code, 0x66, 1, kPmuludq, t1, t1, a, false, true);   // lo(a) * hi(b)
+        EmitSIMD(code, 0x66, 1, kPaddq, t0, t0, t1, false, true);
+        EmitSIMD(code, 0x66, 1, kShiftImm, 6, t0, t0, false, true);  // vpsllq t0, t0, 32
+        code.push_back(32);
+        EmitSIMD(code, 0x66, 1, kPmuludq, t1, a, b, false, true);    // lo(a) * lo(b)
+        EmitSIMD(code, 0x66, 1, kPaddq, dst_xmm, t1, t0, false, true);
+        return;
+    }
+
+    EmitSIMD(code, 0x66, 1, kMovdqa, t0, 0, a, false, false);
+    EmitSIMD(code, 0x66, 1, kShiftImm, 2, 0, t0, false, false);      // psrlq t0, 32
+    code.push_back(32);
+    EmitSIMD(code, 0x66, 1, kPmuludq, t0, 0, b, false, false);
+    EmitSIMD(code, 0x66, 1, kMovdqa, t1, 0, b, false, false);
+    EmitSIMD(code, 0x66, 1, kShiftImm, 2, 0, t1, false, false);      // psrlq t1, 32
+    code.push_back(32);
+    EmitSIMD(code, 0x66, 1, kPmuludq, t1, 0, a, false, false);
+    EmitSIMD(code, 0x66, 1, kPaddq, t0, 0, t1, false, false);
+    EmitSIMD(code, 0x66, 1, kShiftImm, 6, 0, t0, false, false);      // psllq t0, 32
+    code.push_back(32);
+    EmitSIMD(code, 0x66, 1, kMovdqa, t1, 0, a, false, false);
+    EmitSIMD(code, 0x66, 1, kPmuludq, t1, 0, b, false, false);
+    EmitSIMD(code, 0x66, 1, kPaddq, t1, 0, t0, false, false);
+    EmitSIMD(code, 0x66, 1, kMovdqa, dst_xmm, 0, t1, false, false);
+}
+
+void MachineCodeEmitter::EmitVectorBroadcast(std::vector<uint8_t>& code, int dst_xmm, int src_reg) {
+    if (vector_width_ > 2) {
+        EmitSIMD(code, 0x66, 1, kMovqToXmm, dst_xmm, 0, src_reg, true, false);          // vmovq
+        EmitSIMD(code, 0x66, 2, kVpbroadcastq, dst_xmm, 0, dst_xmm, false, true);
+        return;
+    }
+    EmitSIMD(code, 0x66, 1, kMovqToXmm, dst_xmm, 0, src_reg, true, false);              // movq
+    EmitSIMD(code, 0x66, 1, kPunpcklqdq, dst_xmm, 0, dst_xmm, false, false);
+}
+
+// Lane k = src_regs[k]; one general register per lane
+void MachineCodeEmitter::EmitVectorBuild(std::vector<uint8_t>& code, int dst_xmm, const std::vector<int>& src_regs) {
+    const int t0 = kScratch0;
+    const int t1 = kScratch1;
+
+    if (vector_width_ > 2) {
+        EmitSIMD(code, 0x66, 1, kMovqToXmm, dst_xmm, 0, src_regs[0], true, false);
+        EmitSIMD(code, 0x66, 1, kMovqToXmm, t1, 0, src_regs[1], true, false);
+        EmitSIMD(code, 0x66, 1, kPunpcklqdq, dst_xmm, dst_xmm, t1, false, false);
+        EmitSIMD(code, 0x66, 1, kMovqToXmm, t0, 0, src_regs[2], true, false);
+        EmitSIMD(code, 0x66, 1, kMovqToXmm, t1, 0, src_regs[3], true, false);
+        EmitSIMD(code, 0x66, 1, kPunpcklqdq, t0, t0, t1, false, false);
+        EmitSIMD(code, 0x66, 3, kVinserti128, dst_xmm, dst_xmm, t0, false, true);  // upper half
+        code.push_back(1);
+        return;
+    }
+    EmitSIMD(code, 0x66, 1, kMovqToXmm, dst_xmm, 0, src_regs[0], true, false);
+    EmitSIMD(code, 0x66, 1, kMovqToXmm, t1, 0, src_regs[1], true, false);
+    EmitSIMD(code, 0x66, 1, kPunpcklqdq, dst_xmm, 0, t1, false, false);
+}
+
+void MachineCodeEmitter::EmitVectorReduceAdd(std::vector<uint8_t>& code, int dst_reg, int src_xmm) {
+    const int t0 = kScratch0;
+    const int t1 = kScratch1;
+
+    if (vector_width_ > 2) {
+        EmitSIMD(code, 0x66, 3, kVextracti128, src_xmm, 0, t1, false, true);  // high half
+        code.push_back(1);
+        EmitSIMD(code, 0x66, 1, kPaddq, t1, t1, src_xmm, false, false);
+        EmitSIMD(code, 0x66, 1, kPshufd, t0, 0, t1, false, false);            // swap qwords
+        code.push_back(0x4E);
+        EmitSIMD(code, 0x66, 1, kPaddq, t1, t1, t0, false, false);
+        EmitSIMD(code, 0x66, 1, kMovqFromXmm, t1, 0, dst_reg, true, false);
+        return;
+    }
+    EmitSIMD(code, 0x66, 1, kPshufd, t1, 0, src_xmm, false, false);
+    code.push_back(0x4E);
+    EmitSIMD(code, 0x66, 1, kPaddq, t1, 0, src_xmm, false, false);
+    EmitSIMD(code, 0x66, 1, kMovqFromXmm, t1, 0, dst_reg, true, false);
+}
+
+void MachineCodeEmitter::EmitVZeroUpper(std::vector<uint8_t>& code) {
+    code.push_back(0xC5);
+    code.push_back(0xF8);
+    code.push_back(0x77);
+}
+
+// ============================================================================
+// BRANCH RELAXATION
+// ============================================================================
+
+BranchRelaxer::BranchRelaxer() : loop_alignment_(16) {
+}
+
+void BranchRelaxer::Reset() {
+    events_.clear();
+    label_names_.clear();
+    label_index_.clear();
+    label_events_.clear();
+    stats_ = Stats();
+    error_.clear();
+}
+
+int BranchRelaxer::GetLabel(const std::string& label) {
+    auto it = label_index_.find(label);
+    if (it != label_index_.end()) return it->second;
+    int index = static_cast<int>(label_names_.size());
+    label_index_[label] = index;
+    label_names_.push_back(label);
+    label_events_.push_back(-1);
+    return index;
+}
+
+void BranchRelaxer::AddLabel(const std::string& label, size_t position) {
+    int index = GetLabel(label);
+    label_events_[index] = static_cast<int>(events_.size());
+    events_.push_back({ Event::Kind::Label, position, index, false, Condition::E, false, 0, 0 });
+}
+
+void BranchRelaxer::AddBranch(size_t position, const std::string& label) {
+    events_.push_back({ Event::Kind::Branch, position, GetLabel(label), false, Condition::E, false, 2, 0 });
+}
+
+void BranchRelaxer::AddBranch(size_t position, Condition condition, const std::string& label) {
+    events_.push_back({ Event::Kind::Branch, position, GetLabel(label), true, condition, false, 2, 0 });
+}
+
+void BranchRelaxer::Layout() {
+    size_t delta = 0;
+    for (auto& event : events_) {
+        event.address = event.position + delta;
+        if (event.kind == Event::Kind::Align) {
+            size_t alignment = static_cast<size_t>(loop_alignment_);
+            event.size = (alignment - event.address % alignment) % alignment;
+        } else if (event.kind == Event::Kind::Branch) {
+            event.size = !event.is_long ? 2 : event.conditional ? 6 : 5;
+        }
+        delta += event.size;
+    }
+}
+
+bool BranchRelaxer::Relax(std::vector<uint8_t>& code, size_t start, MachineCodeEmitter& emitter) {
+    for (const auto& event : events_) {
+        if (event.kind == Event::Kind::Branch && label_events_[event.label] < 0) {
+            error_ = "Undefined label '" + label_names_[event.label] + "'";
+            return false;
+        }
+    }
+
+    // A label with a branch to it from further down heads a loop. The
+    // padding goes before every label sharing its position.
+    if (loop_alignment_ > 1) {
+        std::vector<bool> headers(events_.size(), false);
+        for (size_t i = 0; i < events_.size(); ++i) {
+            if (events_[i].kind != Event::Kind::Branch) continue;
+            size_t target = static_cast<size_t>(label_events_[events_[i].label]);
+            if (target >= i) continue;
+            while (target > 0 && events_[target - 1].kind == Event::Kind::Label &&
+                   events_[target - 1].position == events_[target].position) {
+                --target;
+            }
+            headers[target] = true;
+        }
+        std::vector<Event> events;
+        for (size_t i = 0; i < events_.size(); ++i) {
+            if (headers[i]) {
+                events.push_back({ Event::Kind::Align, events_[i].position, -1, false, Condition::E, false, 0, 0 });
+            }
+            if (events_[i].kind == Event::Kind::Label) {
+                label_events_[events_[i].label] = static_cast<int>(events.size());
+            }
+            events.push_back(events_[i]);
+        }
+        events_.swap(events);
+    }
+
+    // Code offsets are relative to the section, which is at least as aligned
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        Layout();
+        ++stats_.iterations;
+        for (auto& event : events_) {
+            if (event.kind != Event::Kind::Branch || event.is_long) continue;
+            int64_t target = static_cast<int64_t>(events_[label_events_[event.label]].address);
+            int64_t rel = target - static_cast<int64_t>(event.address + 2);
+            if (rel < -128 || rel > 127) {
+                event.is_long = true;
+                changed = true;
+            }
+        }
+    }
+
+    // Rebuilt past 'start' only; addresses are offsets into the whole code
+    std::vector<uint8_t> relaxed;
+    relaxed.reserve(code.size() - start + events_.size() * 4);
+    size_t cursor = start;
+    for (const auto& event : events_) {
+        relaxed.insert(relaxed.end(), code.begin() + cursor, code.begin() + event.position);
+        cursor = event.position;
+        if (event.kind == Event::Kind::Align) {
+            emitter.EmitNop(relaxed, event.size);
+            stats_.padding += event.size;
+        } else if (event.kind == Event::Kind::Branch) {
+            int64_t target = static_cast<int64_t>(events_[label_events_[event.label]].address);
+            int64_t rel = target - static_cast<int64_t>(event.address + event.size);
+            if (!event.is_long) {
+                if (event.conditional) {
+                    emitter.EmitJcc8(relaxed, event.condition, static_cast<int8_t>(rel));
+                } else {
+                    emitter.EmitJmp8(relaxed, static_cast<int8_t>(rel));
+                }
+                ++stats_.short_branches;
+                stats_.near_size += event.conditional ? 6 : 5;
+            } else {
+                if (event.conditional) {
+                    emitter.EmitJcc(relaxed, event.condition, static_cast<int32_t>(rel));
+                } else {
+                    emitter.EmitJmp(relaxed, static_cast<int32_t>(rel));
+                }
+                ++stats_.long_branches;
+                stats_.near_size += event.size;
+            }
+        }
+    }
+    relaxed.insert(relaxed.end(), code.begin() + cursor, code.end());
+    stats_.near_size += code.size() - start;
+    code.resize(start);
+    code.insert(code.end(), relaxed.begin(), relaxed.end());
+    return true;
+}
+
+size_t BranchRelaxer::MapPosition(size_t position) const {
+    // Everything inserted at or before a byte moves it along
+    auto it = std::upper_bound(events_.begin(), events_.end(), position,
+                               [](size_t p, const Event& event) { return p < event.position; });
+    if (it == events_.begin()) return position;
+    --it;
+    return position + (it->address + it->size - it->position);
+}
+
+} // namespace PEGenerator
+} // namespace Snow
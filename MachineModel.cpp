@@ -0,0 +1,222 @@
+#include "MachineModel.h"
+#include <algorithm>
+#include <cstring>
+
+namespace Snow {
+namespace X64 {
+
+// ============================================================================
+// MICROARCHITECTURE PRESETS
+// ============================================================================
+
+MachineModel MachineModel::Get(MicroArch arch) {
+    // Units: ALU, Mul, Div, Load, Store, Branch, Vector
+    static const MachineModel skylake = {
+        "skylake", 4,
+        { 4, 1, 1, 2, 1, 2, 3 },
+        5, 250,
+        {
+            { 1, ExecUnit::ALU, 1 },      // IntAlu
+            { 3, ExecUnit::Mul, 1 },      // IntMul
+            { 42, ExecUnit::Div, 24 },    // IntDiv
+            { 5, ExecUnit::Load, 1 },     // Load
+            { 1, ExecUnit::Store, 1 },    // Store
+            { 1, ExecUnit::Branch, 1 },   // Branch
+            { 5, ExecUnit::Branch, 2 },   // Call
+            { 1, ExecUnit::Vector, 1 },   // VecAlu
+            { 10, ExecUnit::Vector, 4 },  // VecMul
+            { 3, ExecUnit::Vector, 1 },   // VecShuffle
+            { 6, ExecUnit::Load, 1 },     // VecLoad
+            { 1, ExecUnit::Store, 1 }     // VecStore
+        }
+    };
+
+    static const MachineModel zen3 = {
+        "zen3", 6,
+        { 4, 1, 1, 3, 2, 2, 4 },
+        7, 280,
+        {
+            { 1, ExecUnit::ALU, 1 },      // IntAlu
+            { 3, ExecUnit::Mul, 1 },      // IntMul
+            { 14, ExecUnit::Div, 7 },     // IntDiv
+            { 4, ExecUnit::Load, 1 },     // Load
+            { 1, ExecUnit::Store, 1 },    // Store
+            { 1, ExecUnit::Branch, 1 },   // Branch
+            { 4, ExecUnit::Branch, 2 },   // Call
+            { 1, ExecUnit::Vector, 1 },   // VecAlu
+            { 8, ExecUnit::Vector, 3 },   // VecMul
+            { 3, ExecUnit::Vector, 1 },   // VecShuffle
+            { 7, ExecUnit::Load, 1 },     // VecLoad
+            { 1, ExecUnit::Store, 1 }     // VecStore
+        }
+    };
+
+    return arch == MicroArch::Zen3 ? zen3 : skylake;
+}
+
+bool ParseMicroArch(const char* name, MicroArch& arch) {
+    if (std::strcmp(name, "skylake") == 0) {
+        arch = MicroArch::Skylake;
+        return true;
+    }
+    if (std::strcmp(name, "zen3") == 0) {
+        arch = MicroArch::Zen3;
+        return true;
+    }
+    return false;
+}
+
+// ============================================================================
+// DEPENDENCE DAG SCHEDULING
+// ============================================================================
+
+namespace {
+
+// Next-free cycle of every copy of every execution unit
+class UnitTracker {
+public:
+    explicit UnitTracker(const MachineModel& model) : model_(model) {
+        for (int u = 0; u < kExecUnitCount; u++) {
+            busy_[u].assign(std::max(1, model.units[u]), 0);
+        }
+    }
+
+    // Earliest cycle >= 'cycle' at which 'op' can start
+    int EarliestStart(OpClass op, int cycle) const {
+        const auto& copies = busy_[static_cast<int>(model_.GetCost(op).unit)];
+        return std::max(cycle, *std::min_element(copies.begin(), copies.end()));
+    }
+
+    void Reserve(OpClass op, int cycle) {
+        const OpCost& cost = model_.GetCost(op);
+        auto& copies = busy_[static_cast<int>(cost.unit)];
+        auto it = std::min_element(copies.begin(), copies.end());
+        *it = cycle + cost.occupancy;
+    }
+
+private:
+    const MachineModel& model_;
+    std::vector<int> busy_[kExecUnitCount];
+};
+
+} // anonymous namespace
+
+void AddScheduleEdge(std::vector<ScheduleNode>& nodes, int from, int to, int latency) {
+    for (auto& edge : nodes[from].successors) {
+        if (edge.first == to) {
+            edge.second = std::max(edge.second, latency);
+            return;
+        }
+    }
+    nodes[from].successors.push_back(std::make_pair(to, latency));
+}
+
+std::vector<int> ComputeCriticalPaths(const MachineModel& model,
+                                      const std::vector<ScheduleNode>& nodes) {
+    // Edges always point forward in program order, so one backward sweep will do
+    std::vector<int> path(nodes.size(), 0);
+    for (int i = static_cast<int>(nodes.size()) - 1; i >= 0; i--) {
+        int length = model.GetLatency(nodes[i].op);
+        for (const auto& edge : nodes[i].successors) {
+            length = std::max(length, edge.second + path[edge.first]);
+        }
+        path[i] = length;
+    }
+    return path;
+}
+
+int EstimateCycles(const MachineModel& model, const std::vector<ScheduleNode>& nodes,
+                   const std::vector<int>& order) {
+    UnitTracker units(model);
+    std::vector<int> ready(nodes.size(), 0);
+    int cycle = 0;
+    int slots = 0;
+    int finish = 0;
+
+    for (int n : order) {
+        OpClass op = nodes[n].op;
+        int start = units.EarliestStart(op, std::max(cycle, ready[n]));
+        if (start == cycle && slots >= model.issue_width) {
+            start = units.EarliestStart(op, cycle + 1);
+        }
+        if (start > cycle) {
+            cycle = start;
+            slots = 0;
+        }
+        slots++;
+        units.Reserve(op, start);
+
+        finish = std::max(finish, start + model.GetLatency(op));
+        for (const auto& edge : nodes[n].successors) {
+            ready[edge.first] = std::max(ready[edge.first], start + edge.second);
+        }
+    }
+
+    return finish;
+}
+
+std::vector<int> ListSchedule(const MachineModel& model, const std::vector<ScheduleNode>& nodes,
+                              bool model_resources) {
+    int count = static_cast<int>(nodes.size());
+    std::vector<int> path = ComputeCriticalPaths(model, nodes);
+    std::vector<int> pending(count, 0);
+    std::vector<int> ready(count, 0);
+    std::vector<bool> done(count, false);
+    for (const auto& node : nodes) {
+        for (const auto& edge : node.successors) {
+            pending[edge.first]++;
+        }
+    }
+
+    auto higher_priority = [&](int a, int b) {
+        if (path[a] != path[b]) return path[a] > path[b];
+        if (nodes[a].successors.size() != nodes[b].successors.size()) {
+            return nodes[a].successors.size() > nodes[b].successors.size();
+        }
+        return a < b;
+    };
+
+    UnitTracker units(model);
+    std::vector<int> order;
+    order.reserve(count);
+    int cycle = 0;
+
+    while (static_cast<int>(order.size()) < count) {
+        int slots = 0;
+        bool issued = true;
+
+        // Latency-0 successors become ready within the cycle, so keep looking
+        // until the cycle is full or nothing more can go
+        while (issued && slots < model.issue_width) {
+            issued = false;
+            std::vector<int> candidates;
+            for (int n = 0; n < count; n++) {
+                if (!done[n] && pending[n] == 0 && ready[n] <= cycle) {
+                    candidates.push_back(n);
+                }
+            }
+            std::sort(candidates.begin(), candidates.end(), higher_priority);
+
+            for (int n : candidates) {
+                if (slots >= model.issue_width) break;
+                if (model_resources && units.EarliestStart(nodes[n].op, cycle) > cycle) continue;
+
+                if (model_resources) units.Reserve(nodes[n].op, cycle);
+                done[n] = true;
+                order.push_back(n);
+                slots++;
+                issued = true;
+                for (const auto& edge : nodes[n].successors) {
+                    pending[edge.first]--;
+                    ready[edge.first] = std::max(ready[edge.first], cycle + edge.second);
+                }
+            }
+        }
+        cycle++;
+    }
+
+    return order;
+}
+
+} // namespace X64
+} // namespace Snow
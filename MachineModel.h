@@ -0,0 +1,105 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+
+namespace Snow {
+namespace X64 {
+
+// ============================================================================
+// MICROARCHITECTURE COST MODEL
+// Latency/throughput tables for a few representative x86-64 cores, after
+// Agner Fog's instruction tables and the vendors' optimization manuals.
+// Numbers describe the instruction sequence the code generators emit for an
+// operation class, not a single machine instruction. The tables are plain
+// data so callers can start from a preset and tweak individual entries.
+// ============================================================================
+
+enum class MicroArch {
+    Skylake,    // Intel Skylake / Coffee Lake client cores
+    Zen3        // AMD Zen 3
+};
+
+enum class OpClass {
+    IntAlu,     // mov, add, sub, lea, compares
+    IntMul,     // imul r64
+    IntDiv,     // cqo + idiv r64
+    Load,       // mov r64, [m]
+    Store,      // mov [m], r64
+    Branch,     // jmp/jcc/ret
+    Call,       // call + return value move
+    VecAlu,     // paddq/psubq
+    VecMul,     // emulated 64-bit lane multiply (pmuludq + shifts + adds)
+    VecShuffle, // broadcasts, lane builds and horizontal reductions
+    VecLoad,    // movdqu/vmovdqu load
+    VecStore,   // movdqu/vmovdqu store
+    Count
+};
+
+enum class ExecUnit {
+    ALU, Mul, Div, Load, Store, Branch, Vector,
+    Count
+};
+
+const int kOpClassCount = static_cast<int>(OpClass::Count);
+const int kExecUnitCount = static_cast<int>(ExecUnit::Count);
+
+struct OpCost {
+    int latency;    // Cycles until a dependent instruction can issue
+    ExecUnit unit;  // Port group the operation issues to
+    int occupancy;  // Cycles the unit stays busy (reciprocal throughput)
+};
+
+struct MachineModel {
+    const char* name;
+    int issue_width;             // Instructions issued per cycle
+    int units[kExecUnitCount];   // Copies of each execution unit
+    int store_forward_latency;   // Store to dependent load of the same address
+    int memory_latency;          // Load that misses every cache level
+    OpCost costs[kOpClassCount];
+
+    const OpCost& GetCost(OpClass op) const { return costs[static_cast<int>(op)]; }
+    int GetLatency(OpClass op) const { return GetCost(op).latency; }
+    int GetUnitCount(ExecUnit unit) const { return units[static_cast<int>(unit)]; }
+
+    static MachineModel Get(MicroArch arch);
+};
+
+// Parses "skylake" or "zen3"; returns false for unknown names
+bool ParseMicroArch(const char* name, MicroArch& arch);
+
+// ============================================================================
+// DEPENDENCE DAG SCHEDULING
+// Shared by the IR and SSA schedulers. Node i may only issue after every
+// predecessor p has issued and 'latency' cycles have passed since; latency-0
+// edges only order the two nodes. Nodes are given in original program order.
+// ============================================================================
+
+struct ScheduleNode {
+    OpClass op = OpClass::IntAlu;
+    std::vector<std::pair<int, int>> successors; // (node, edge latency)
+};
+
+// Adds an edge, keeping the largest latency if the edge already exists
+void AddScheduleEdge(std::vector<ScheduleNode>& nodes, int from, int to, int latency);
+
+// Longest latency-weighted path from each node to the end of the DAG,
+// including the node's own latency
+std::vector<int> ComputeCriticalPaths(const MachineModel& model,
+                                      const std::vector<ScheduleNode>& nodes);
+
+// Cycles to run 'order' on an in-order issue model of the machine: each node
+// issues no earlier than its predecessor in 'order', when its operands are
+// ready, an issue slot is free and its execution unit is available
+int EstimateCycles(const MachineModel& model, const std::vector<ScheduleNode>& nodes,
+                   const std::vector<int>& order);
+
+// Cycle-by-cycle list scheduling: among ready nodes, issue the one with the
+// longest critical path first (ties: more successors, then program order).
+// With 'model_resources' false only the issue width limits a cycle, which
+// schedules purely for latency.
+std::vector<int> ListSchedule(const MachineModel& model, const std::vector<ScheduleNode>& nodes,
+                              bool model_resources = true);
+
+} // namespace X64
+} // namespace Snow
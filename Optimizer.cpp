@@ -1,7 +1,12 @@
 #include "Optimizer.h"
+#include "../CodeGen/DivisionMagic.h"
 #include <iostream>
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <chrono>
+#include <iomanip>
+#include <sstream>
 
 namespace Snow {
 
@@ -13,30 +18,70 @@ void OptimizationStats::Print() const {
     std::cout << "\n[CIAM Optimizer Statistics]" << std::endl;
     std::cout << "  Constants folded: " << constants_folded << std::endl;
     std::cout << "  Dead code removed: " << dead_code_removed << std::endl;
-    std::cout << "  Loops unrolled: " << loops_unrolled << std::endl;
+    std::cout << "  Loops unrolled: " << loops_unrolled
+              << " (" << loops_fully_unrolled << " fully, "
+              << (unroll_size_delta >= 0 ? "+" : "") << unroll_size_delta << " instructions)" << std::endl;
   std::cout << "  Peephole optimizations: " << peephole_optimizations << std::endl;
-    std::cout << "  Tail calls optimized: " << tail_calls_optimized << std::endl;
-    std::cout << "  Vectorized loops: " << vectorized_loops << std::endl;
+    std::cout << "  Tail calls optimized: " << tail_calls_optimized
+              << " (" << tail_recursions_looped << " self-recursive into loops)" << std::endl;
+    std::cout << "  Vectorization candidates: " << vectorization_candidates << std::endl;
     std::cout << "  Bounds checks eliminated: " << bounds_checks_eliminated << std::endl;
     std::cout << "  Branches optimized: " << branches_optimized << std::endl;
     std::cout << "  Loops fused: " << loops_fused << std::endl;
+    std::cout << "  Invariants hoisted: " << invariants_hoisted << std::endl;
+    std::cout << "  Induction variables reduced: " << induction_variables_reduced << std::endl;
+    std::cout << "  Constant divisions simplified: " << divisions_reduced << std::endl;
+    std::cout << "  Blocks scheduled: " << blocks_scheduled
+              << " (" << schedule_cycles_before << " -> " << schedule_cycles_after
+              << " estimated cycles)" << std::endl;
+    std::cout << "  Calls inlined: " << calls_inlined
+              << " (" << (inline_size_delta >= 0 ? "+" : "") << inline_size_delta << " instructions)" << std::endl;
 }
 
 void OptimizationStats::Reset() {
   *this = OptimizationStats();
 }
 
+void OptimizationStats::Merge(const OptimizationStats& other) {
+    constants_folded += other.constants_folded;
+    dead_code_removed += other.dead_code_removed;
+    loops_unrolled += other.loops_unrolled;
+    loops_fully_unrolled += other.loops_fully_unrolled;
+    unroll_size_delta += other.unroll_size_delta;
+    peephole_optimizations += other.peephole_optimizations;
+    tail_calls_optimized += other.tail_calls_optimized;
+    tail_recursions_looped += other.tail_recursions_looped;
+    vectorization_candidates += other.vectorization_candidates;
+    bounds_checks_eliminated += other.bounds_checks_eliminated;
+    branches_optimized += other.branches_optimized;
+    loops_fused += other.loops_fused;
+    invariants_hoisted += other.invariants_hoisted;
+    induction_variables_reduced += other.induction_variables_reduced;
+    divisions_reduced += other.divisions_reduced;
+    blocks_scheduled += other.blocks_scheduled;
+    schedule_cycles_before += other.schedule_cycles_before;
+    schedule_cycles_after += other.schedule_cycles_after;
+    calls_inlined += other.calls_inlined;
+    inline_size_delta += other.inline_size_delta;
+}
+
 // ============================================================================
 // CIAM OPTIMIZER IMPLEMENTATION
 // ============================================================================
 
-CIAMOptimizer::CIAMOptimizer() : opt_level_(1) {
+CIAMOptimizer::CIAMOptimizer()
+    : opt_level_(1), unroll_factor_(0), unroll_budget_(32), inline_budget_(0), current_function_(nullptr), verbose_(false),
+      threads_(0), log_(&std::cout),
+      machine_model_(X64::MachineModel::Get(X64::MicroArch::Skylake)) {
     // Initialize optimization flags
     optimization_flags_["constant_folding"] = true;
 optimization_flags_["dead_code_elimination"] = true;
     optimization_flags_["loop_unrolling"] = true;
+    optimization_flags_["licm"] = true;
+    optimization_flags_["strength_reduction"] = true;
     optimization_flags_["peephole"] = true;
     optimization_flags_["tail_call"] = true;
+    optimization_flags_["inlining"] = false; // Aggressive
     optimization_flags_["vectorization"] = false; // Aggressive
     optimization_flags_["lookahead"] = false; // Aggressive
   optimization_flags_["bounds_check"] = true;
@@ -49,8 +94,6 @@ optimization_flags_["dead_code_elimination"] = true;
 }
 
 void CIAMOptimizer::SetOptimizationLevel(int level) {
-    opt_level_ = level;
-    
     switch (level) {
    case 0: // No optimization
          for (auto& flag : optimization_flags_) {
@@ -65,15 +108,21 @@ case 1: // Basic (-O1)
             optimization_flags_["bounds_check"] = true;
           optimization_flags_["branch_opt"] = true;
             optimization_flags_["footprint"] = true;
+            optimization_flags_["licm"] = true;
+            unroll_budget_ = 32;
             break;
   
         case 2: // Aggressive (-O2)
       SetOptimizationLevel(1);
   optimization_flags_["loop_unrolling"] = true;
+            optimization_flags_["strength_reduction"] = true;
             optimization_flags_["tail_call"] = true;
    optimization_flags_["vectorization"] = true;
             optimization_flags_["lookahead"] = true;
       optimization_flags_["loop_fusion"] = true;
+            optimization_flags_["inlining"] = true;
+            unroll_budget_ = 128;
+            inline_budget_ = 24;
             break;
       
         case 3: // Maximum (-O3)
@@ -81,8 +130,25 @@ case 1: // Basic (-O1)
             optimization_flags_["scheduling"] = true;
             optimization_flags_["adaptive"] = true;
             optimization_flags_["profile_guided"] = true;
+            unroll_budget_ = 512;
+            inline_budget_ = 64;
             break;
     }
+    
+    // Set last: the levels above build on each other recursively
+    opt_level_ = level;
+}
+
+void CIAMOptimizer::SetUnrollFactor(int factor) {
+    unroll_factor_ = std::max(0, factor);
+}
+
+void CIAMOptimizer::SetMicroArch(X64::MicroArch arch) {
+    machine_model_ = X64::MachineModel::Get(arch);
+}
+
+void CIAMOptimizer::SetMachineModel(const X64::MachineModel& model) {
+    machine_model_ = model;
 }
 
 void CIAMOptimizer::EnableOptimization(const std::string& name, bool enabled) {
@@ -97,101 +163,221 @@ void CIAMOptimizer::SetProfileData(const ProfileData& data) {
 void CIAMOptimizer::Optimize(IR::Module& module) {
     std::cout << "\n[CIAM Optimizer] Running optimization passes (Level " << opt_level_ << ")..." << std::endl;
     stats_.Reset();
- 
-    for (const auto& func : module.GetFunctions()) {
-      std::cout << "  Optimizing function: " << func->GetName() << std::endl;
-  
-        // Pass 1: Constant Folding
-  if (optimization_flags_["constant_folding"]) {
-            ConstantFolding(*func);
-        }
-  
-        // Pass 2: Dead Code Elimination
-    if (optimization_flags_["dead_code_elimination"]) {
-          DeadCodeElimination(*func);
-        }
-        
-        // Pass 3: Peephole Optimization
-        if (optimization_flags_["peephole"]) {
-       PeepholeOptimization(*func);
-     }
-        
-  // Pass 4: Algebraic Simplification
-        OptimizeBase12Arithmetic(*func);
-        
- // Pass 5: Bounds Check Elimination
-        if (optimization_flags_["bounds_check"]) {
-       BoundsCheckElimination(*func);
-        }
-        
-   // Pass 6: Branch Optimization
-if (optimization_flags_["branch_opt"]) {
-            BranchChainOptimization(*func);
-        }
-        
-     // Pass 7: Loop Unrolling
-        if (optimization_flags_["loop_unrolling"]) {
-    LoopUnrolling(*func);
+    analyses_.clear();
+    schedule_report_.clear();
+    schedule_index_.clear();
+    pass_timings_.assign(GetPasses().size(), PassTiming());
+    for (auto& timing : analysis_timings_) {
+        timing = PassTiming();
+    }
+    
+    // Flags are resolved once; the pipeline is the same for every function
+    std::vector<size_t> pipeline;
+    const auto& passes = GetPasses();
+    for (size_t p = 0; p < passes.size(); p++) {
+        if (!passes[p].flag || optimization_flags_[passes[p].flag]) {
+            pipeline.push_back(p);
         }
-        
-     // Pass 8: Loop Fusion (Curling)
-        if (optimization_flags_["loop_fusion"]) {
-  LoopFusion(*func);
+    }
+    
+    // Interprocedural, so ahead of the per-function passes, which then also
+    // see the inlined bodies. Module-level passes run here, between the
+    // parallel phases, never alongside them.
+    if (optimization_flags_["inlining"]) {
+        InlineHotFunctions(module);
+    }
+    
+    std::vector<IR::Function*> functions;
+    for (const auto& func : module.GetFunctions()) {
+        functions.push_back(func.get());
+    }
+    
+    // Function passes only touch their own function, so each worker runs
+    // whole pipelines with private statistics and analysis caches
+    WorkStealingPool pool(threads_);
+    size_t worker_count = std::min<size_t>(pool.GetThreadCount(), functions.size());
+    std::vector<std::unique_ptr<CIAMOptimizer>> workers;
+    for (size_t w = 0; w < worker_count; w++) {
+        workers.emplace_back(new CIAMOptimizer());
+        workers.back()->CopySettings(*this);
+    }
+    
+    std::vector<FunctionResult> results(functions.size());
+    pool.ParallelFor(functions.size(), [&](unsigned worker, size_t index) {
+        workers[worker]->OptimizeFunction(*functions[index], pipeline, results[index]);
+    });
+    
+    for (const auto& result : results) {
+        std::cout << result.log;
+        schedule_report_.insert(schedule_report_.end(), result.schedule.begin(), result.schedule.end());
+    }
+    for (const auto& worker : workers) {
+        stats_.Merge(worker->stats_);
+        for (size_t p = 0; p < pass_timings_.size(); p++) {
+            pass_timings_[p].seconds += worker->pass_timings_[p].seconds;
+            pass_timings_[p].runs += worker->pass_timings_[p].runs;
+            pass_timings_[p].changes += worker->pass_timings_[p].changes;
         }
-      
-    // Pass 9: Vectorization
-     if (optimization_flags_["vectorization"]) {
-            Vectorization(*func);
+        for (unsigned a = 0; a < kAnalysisCount; a++) {
+            analysis_timings_[a].seconds += worker->analysis_timings_[a].seconds;
+            analysis_timings_[a].runs += worker->analysis_timings_[a].runs;
+            analysis_timings_[a].changes += worker->analysis_timings_[a].changes;
         }
+    }
+    
+    std::cout << "[CIAM Optimizer] Optimization complete." << std::endl;
+    stats_.Print();
+    if (verbose_) {
+        PrintTimings();
+    }
+}
+
+void CIAMOptimizer::CopySettings(const CIAMOptimizer& other) {
+    profile_data_ = other.profile_data_;
+    opt_level_ = other.opt_level_;
+    optimization_flags_ = other.optimization_flags_;
+    unroll_factor_ = other.unroll_factor_;
+    unroll_budget_ = other.unroll_budget_;
+    inline_budget_ = other.inline_budget_;
+    machine_model_ = other.machine_model_;
+    verbose_ = other.verbose_;
+    pass_timings_.assign(GetPasses().size(), PassTiming());
+}
+
+void CIAMOptimizer::OptimizeFunction(IR::Function& func, const std::vector<size_t>& pipeline,
+                                     FunctionResult& result) {
+    std::ostringstream log;
+    log_ = &log;
+    log << "  Optimizing function: " << func.GetName() << std::endl;
+    current_function_ = &func;
+    size_t report_start = schedule_report_.size();
+    
+    RunPasses(func, pipeline);
+    analyses_.erase(&func);
+    
+    PrintScheduleReport(report_start);
+    result.schedule.assign(schedule_report_.begin() + report_start, schedule_report_.end());
+    result.log = log.str();
+    log_ = &std::cout;
+}
+
+// ============================================================================
+// PASS MANAGER
+// ============================================================================
+
+const std::vector<CIAMOptimizer::PassInfo>& CIAMOptimizer::GetPasses() {
+    // Scheduling only reorders within blocks, so block live-in/out sets survive
+    const unsigned schedule_preserved = kPreservesControlFlow | kAnalysisLiveness;
+    
+    static const std::vector<PassInfo> passes = {
+        { "Constant folding", "constant_folding", &CIAMOptimizer::ConstantFolding,
+          0, kPreservesControlFlow },
+        { "Dead code elimination", "dead_code_elimination", &CIAMOptimizer::DeadCodeElimination,
+          kAnalysisCFG | kAnalysisLiveness, kPreservesControlFlow },
+        { "Peephole", "peephole", &CIAMOptimizer::PeepholeOptimization,
+          0, kPreservesControlFlow },
+        { "Base-12 arithmetic", nullptr, &CIAMOptimizer::OptimizeBase12Arithmetic,
+          0, kPreservesControlFlow },
+        { "Bounds check elimination", "bounds_check", &CIAMOptimizer::BoundsCheckElimination,
+          0, kPreservesControlFlow },
+        { "Branch chains", "branch_opt", &CIAMOptimizer::BranchChainOptimization,
+          0, 0 },
+        { "Loop-invariant code motion", "licm", &CIAMOptimizer::LoopInvariantCodeMotion,
+          kAnalysisLoops | kAnalysisLiveness, kPreservesControlFlow },
+        { "Strength reduction", "strength_reduction", &CIAMOptimizer::InductionVariableStrengthReduction,
+          kAnalysisLoops, kPreservesControlFlow },
+        { "Loop unrolling", "loop_unrolling", &CIAMOptimizer::LoopUnrolling,
+          kAnalysisLoops, 0 },
+        { "Loop fusion", "loop_fusion", &CIAMOptimizer::LoopFusion,
+          kAnalysisLoops, 0 },
+        { "Vectorization", "vectorization", &CIAMOptimizer::Vectorization,
+          kAnalysisLoops, 0 },
+        { "Tail calls", "tail_call", &CIAMOptimizer::TailCallOptimization,
+          0, 0 },
+        { "Look-ahead scheduling", "lookahead", &CIAMOptimizer::LookAheadOptimization,
+          0, schedule_preserved },
+        { "Synchronized scheduling", "scheduling", &CIAMOptimizer::SynchronizedScheduling,
+          0, schedule_preserved },
+        { "Footprint compression", "footprint", &CIAMOptimizer::FootprintCompression,
+          0, kAllAnalyses },
+        { "Adaptive tuning", "adaptive", &CIAMOptimizer::AdaptiveTuning,
+          0, kAllAnalyses },
+        { "Profile-guided", "profile_guided", &CIAMOptimizer::ProfileGuidedOptimization,
+          0, 0 },
+        { "Dozisecond operations", nullptr, &CIAMOptimizer::OptimizeDozisecondOperations,
+          0, kAllAnalyses },
+        { "Redundant moves", nullptr, &CIAMOptimizer::RemoveRedundantMoves,
+          0, kAllAnalyses }
+    };
+    return passes;
+}
+
+void CIAMOptimizer::RunPasses(IR::Function& func, const std::vector<size_t>& pipeline) {
+    typedef std::chrono::steady_clock Clock;
+    const auto& passes = GetPasses();
+    
+    for (size_t p : pipeline) {
+        const PassInfo& pass = passes[p];
         
-        // Pass 10: Tail Call Optimization
-        if (optimization_flags_["tail_call"]) {
-       TailCallOptimization(*func);
-        }
+        // Loops first: canonicalizing the nest may insert preheader blocks
+        if (pass.required & kAnalysisLoops) GetLoopInfo(func);
+        if (pass.required & kAnalysisCFG) GetCFG(func);
+        if (pass.required & kAnalysisDominators) GetDominators(func);
+        if (pass.required & kAnalysisLiveness) GetLiveness(func);
         
-   // Pass 11: Look-Ahead Optimization
-        if (optimization_flags_["lookahead"]) {
-   LookAheadOptimization(*func);
-        }
+        // Analyses a pass builds on demand are charged to the analysis
+        double analysis_before = 0;
+        for (const auto& timing : analysis_timings_) analysis_before += timing.seconds;
         
-        // Pass 12: Synchronized Scheduling
-        if (optimization_flags_["scheduling"]) {
-        SynchronizedScheduling(*func);
-        }
-
-        // Pass 13: Footprint Compression
-        if (optimization_flags_["footprint"]) {
-  FootprintCompression(*func);
-        }
+        auto start = Clock::now();
+        bool changed = (this->*pass.run)(func);
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
         
-        // Pass 14: Adaptive Tuning
-        if (optimization_flags_["adaptive"]) {
-        AdaptiveTuning(*func);
- }
+        double analysis_after = 0;
+        for (const auto& timing : analysis_timings_) analysis_after += timing.seconds;
         
-        // Pass 15: Profile-Guided Optimization
-        if (optimization_flags_["profile_guided"]) {
- ProfileGuidedOptimization(*func);
+        PassTiming& timing = pass_timings_[p];
+        timing.seconds += seconds - (analysis_after - analysis_before);
+        timing.runs++;
+        if (changed) {
+            timing.changes++;
+            InvalidateAnalyses(func, pass.preserved);
         }
-      
-        // Pass 16: Dodecagram-specific optimizations
-        OptimizeDozisecondOperations(*func);
-        
-        // Final cleanup
-        RemoveRedundantMoves(*func);
     }
+}
+
+void CIAMOptimizer::PrintTimings() const {
+    static const char* const analysis_names[kAnalysisCount] = {
+        "CFG", "Dominators", "Liveness", "Loops"
+    };
     
-    std::cout << "[CIAM Optimizer] Optimization complete." << std::endl;
-    stats_.Print();
+    auto print = [](const char* name, const PassTiming& timing, const char* runs, const char* changes) {
+        std::cout << "  " << std::left << std::setw(28) << name << std::right
+                  << std::fixed << std::setprecision(3) << std::setw(9) << timing.seconds * 1000.0
+                  << " ms  (" << timing.runs << " " << runs << ", " << timing.changes << " " << changes << ")"
+                  << std::endl;
+    };
+    
+    std::cout << "\n[CIAM Pass Timing]" << std::endl;
+    const auto& passes = GetPasses();
+    for (size_t p = 0; p < passes.size(); p++) {
+        if (pass_timings_[p].runs > 0) print(passes[p].name, pass_timings_[p], "runs", "changed");
+    }
+    for (unsigned a = 0; a < kAnalysisCount; a++) {
+        print(analysis_names[a], analysis_timings_[a], "requests", "computed");
+    }
+    std::cout.unsetf(std::ios::fixed);
+    std::cout << std::setprecision(6);
 }
 
 // ============================================================================
 // 1. CONSTANT FOLDING
 // ============================================================================
 
-void CIAMOptimizer::ConstantFolding(IR::Function& func) {
+bool CIAMOptimizer::ConstantFolding(IR::Function& func) {
+    int before = stats_.constants_folded;
     for (const auto& block : func.GetBlocks()) {
-        auto& instructions = const_cast<std::vector<IR::Instruction>&>(block->GetInstructions());
+        auto& instructions = block->GetInstructions();
         
         for (auto& instr : instructions) {
     if (IsConstant(instr.src1) && IsConstant(instr.src2)) {
@@ -209,6 +395,7 @@ void CIAMOptimizer::ConstantFolding(IR::Function& func) {
             }
         }
  }
+    return stats_.constants_folded != before;
 }
 
 bool CIAMOptimizer::TryEvaluateConstant(IR::OpCode op, int64_t a, int64_t b, int64_t& result) {
@@ -237,36 +424,77 @@ bool CIAMOptimizer::TryEvaluateConstant(IR::OpCode op, int64_t a, int64_t b, int
 // 2. DEAD CODE ELIMINATION
 // ============================================================================
 
-void CIAMOptimizer::DeadCodeElimination(IR::Function& func) {
-    std::unordered_set<IR::Instruction*> live_instructions;
+// Backward walk over each block from its live-out set: an instruction
+// without side effects whose destination is not live afterwards is dead.
+// Instructions that define no register (CMP feeds the flags) always stay.
+bool CIAMOptimizer::DeadCodeElimination(IR::Function& func) {
+    const IR::ControlFlowGraph& cfg = GetCFG(func);
+    const IR::Liveness& liveness = GetLiveness(func);
+    int registers = liveness.GetRegisterCount();
+    int removed = 0;
+    std::vector<int> uses;
     
-    // Mark live instructions
-    for (const auto& block : func.GetBlocks()) {
-        auto& instructions = const_cast<std::vector<IR::Instruction>&>(block->GetInstructions());
-     
-     for (auto& instr : instructions) {
-            // Instructions with side effects are always live
-            if (HasSideEffects(instr)) {
-      live_instructions.insert(&instr);
-    }
+    for (int b = 0; b < cfg.GetBlockCount(); b++) {
+        auto& instructions = func.GetBlocks()[b]->GetInstructions();
+        
+        IR::RegisterSet live(registers, false);
+        int fallthrough = cfg.GetFallthrough(b);
+        if (fallthrough >= 0) {
+            live = liveness.GetLiveIn(fallthrough);
+        } else if (!instructions.empty() && !instructions.back().IsTerminator() && registers > 0) {
+            // Falling off the end of the function returns R0
+            live[0] = true;
+        }
+        
+        std::vector<bool> dead(instructions.size(), false);
+        for (size_t i = instructions.size(); i-- > 0;) {
+            const IR::Instruction& instr = instructions[i];
+            
+            if (instr.IsBranch()) {
+                int target = cfg.GetBlockIndex(instr.dest.label);
+                if (instr.opcode == IR::OpCode::JMP) {
+                    live.assign(registers, false);
+                }
+                if (target >= 0) {
+                    const IR::RegisterSet& target_live = liveness.GetLiveIn(target);
+                    for (int r = 0; r < registers; r++) {
+                        if (target_live[r]) live[r] = true;
+                    }
+                }
+            } else if (instr.opcode == IR::OpCode::RET) {
+                live.assign(registers, false);
+            }
+            
+            int def = instr.GetDefinedRegister();
+            if (def >= 0 && !live[def] && !HasSideEffects(instr)) {
+                dead[i] = true;
+                continue;
+            }
+            if (def >= 0) {
+                live[def] = false;
+            }
+            
+            uses.clear();
+            instr.GetUsedRegisters(uses);
+            for (int reg : uses) {
+                live[reg] = true;
+            }
+        }
+        
+        size_t kept = 0;
+        for (size_t i = 0; i < instructions.size(); i++) {
+            if (dead[i]) {
+                removed++;
+                continue;
+            }
+            if (kept != i) instructions[kept] = instructions[i];
+            kept++;
         }
+        instructions.erase(instructions.begin() + kept, instructions.end());
     }
     
-    // Remove dead code
-    for (const auto& block : func.GetBlocks()) {
-        auto& instructions = const_cast<std::vector<IR::Instruction>&>(block->GetInstructions());
-    
-        instructions.erase(
-        std::remove_if(instructions.begin(), instructions.end(),
-     [&](const IR::Instruction& instr) {
-   bool is_dead = (live_instructions.find(const_cast<IR::Instruction*>(&instr)) == live_instructions.end())
-          && !HasSideEffects(instr);
-        if (is_dead) stats_.dead_code_removed++;
-      return is_dead;
-     }),
-            instructions.end()
-        );
-    }
+    stats_.dead_code_removed += removed;
+    return removed > 0;
 }
 
 bool CIAMOptimizer::HasSideEffects(const IR::Instruction& instr) {
@@ -292,31 +520,69 @@ bool CIAMOptimizer::HasSideEffects(const IR::Instruction& instr) {
 // 3. LOOP UNROLLING
 // ============================================================================
 
-void CIAMOptimizer::LoopUnrolling(IR::Function& func) {
-    std::vector<std::vector<IR::BasicBlock*>> loops;
-    DetectLoops(func, loops);
+bool CIAMOptimizer::LoopUnrolling(IR::Function& func) {
+    // Innermost loops by header name: every unroll reshapes the CFG, so each
+    // loop is looked up again in a fresh nest before it is transformed
+    std::vector<std::string> headers;
+    {
+        const IR::LoopInfo& info = GetLoopInfo(func);
+        for (const auto& loop : info.GetLoops()) {
+            if (loop.children.empty()) {
+                headers.push_back(info.GetCFG().GetBlock(loop.header)->GetName());
+            }
+        }
+    }
     
-    for (auto& loop : loops) {
-      int iterations = EstimateLoopIterations(loop);
+    int factor = unroll_factor_ > 0 ? unroll_factor_ : (opt_level_ >= 3 ? 8 : opt_level_ == 2 ? 4 : 2);
+    bool changed = false;
+    
+    for (const auto& name : headers) {
+        const IR::LoopInfo& info = GetLoopInfo(func);
+        int header = info.GetCFG().GetBlockIndex(name);
+        int index = header >= 0 ? info.GetLoopWithHeader(header) : -1;
+        if (index < 0) continue;
         
-        // Only unroll small loops with known iteration counts
-        if (iterations > 0 && iterations <= 12) { // Dodecagram threshold!
-            UnrollLoop(loop, iterations);
-     stats_.loops_unrolled++;
-    }
+        const IR::Loop& loop = info.GetLoop(index);
+        int iterations = loop.trip_count;
+        if (iterations < 2) continue;
+        
+        std::vector<IR::BasicBlock*> loop_blocks;
+        int size = 0;
+        loop_blocks.push_back(func.GetBlocks()[loop.header].get());
+        for (int b : loop.blocks) {
+            if (b != loop.header) loop_blocks.push_back(func.GetBlocks()[b].get());
+            size += static_cast<int>(func.GetBlocks()[b]->GetInstructions().size());
+        }
+        
+        // Small constant-trip loops vanish entirely (dodecagram threshold),
+        // others are unrolled by the largest factor the size budget allows
+        int chosen = factor;
+        if (iterations <= 12 && iterations * size <= unroll_budget_) {
+            chosen = iterations;
+        } else {
+            while (chosen > 1 && chosen * size > unroll_budget_) chosen /= 2;
+            if (chosen < 2 || chosen >= iterations) continue;
+        }
+        
+        if (UnrollLoop(loop_blocks, chosen)) changed = true;
     }
+    return changed;
 }
 
 void CIAMOptimizer::DetectLoops(IR::Function& func, std::vector<std::vector<IR::BasicBlock*>>& loops) {
- // Simplified loop detection - looks for back edges
-    for (const auto& block : func.GetBlocks()) {
-        for (auto* successor : block->GetSuccessors()) {
-            if (IsBackEdge(block.get(), successor)) {
-     std::vector<IR::BasicBlock*> loop_blocks;
-       loop_blocks.push_back(const_cast<IR::BasicBlock*>(block.get()));
-                loops.push_back(loop_blocks);
-  }
+    const IR::LoopInfo& info = GetLoopInfo(func);
+    const auto& blocks = func.GetBlocks();
+    
+    // Inner loops first, header leads each block list
+    for (const auto& loop : info.GetLoops()) {
+        std::vector<IR::BasicBlock*> loop_blocks;
+        loop_blocks.push_back(blocks[loop.header].get());
+        for (int b : loop.blocks) {
+            if (b != loop.header) {
+                loop_blocks.push_back(blocks[b].get());
+            }
         }
+        loops.push_back(loop_blocks);
     }
 }
 
@@ -329,30 +595,297 @@ if (it != profile_data_.average_loop_iterations.end()) {
         }
     }
     
-    // Default: try to detect constant iteration count
-    return -1; // Unknown
+    // Counted loop with a constant start, step and limit
+    const IR::Loop* info = FindLoop(loop);
+    return info ? info->trip_count : -1; // -1 = unknown
 }
 
-void CIAMOptimizer::UnrollLoop(std::vector<IR::BasicBlock*>& loop_blocks, int factor) {
-    // Simplified unrolling: duplicate loop body
-    if (loop_blocks.empty()) return;
+// Unrolling clones the loop blocks once per copy, header first, and places
+// the copies right after the preheader. A factor at or above the trip count
+// unrolls fully: every pass gets its own copy, the exit test is dropped from
+// all but the last, and the original loop is deleted. Otherwise the copies
+// form a new loop whose exit tests are all dropped; after round (trips-1)/F
+// a single equality test on the induction register leaves for the original
+// loop, which stays behind as the remainder and runs the last 1..F passes.
+// Registers that never carry a value across iterations or out of the loop
+// get fresh names in every copy, so the copies do not serialize on them.
+bool CIAMOptimizer::UnrollLoop(std::vector<IR::BasicBlock*>& loop_blocks, int factor) {
+    if (loop_blocks.empty() || factor < 2 || !current_function_) return false;
+    IR::Function& func = *current_function_;
+    
+    const IR::Loop* found = FindLoop(loop_blocks);
+    if (!found) return false;
+    const IR::Loop loop = *found;
+    const IR::LoopInfo& info = GetLoopInfo(func);
+    const IR::ControlFlowGraph& cfg = info.GetCFG();
+    const auto& blocks = func.GetBlocks();
+    
+    int trips = loop.trip_count;
+    if (trips < 2 || loop.preheader < 0 || loop.latches.size() != 1 ||
+        !loop.children.empty() || loop.induction_register < 0) {
+        return false;
+    }
+    bool full = factor >= trips;
+    int rounds = full ? 0 : (trips - 1) / factor;
+    int copies = full ? trips : factor;
+    if (!full && rounds < 1) return false;
+    
+    // One exiting block, whose first branch is the exit test
+    int exiting = -1;
+    int exit_block = -1;
+    for (int b : loop.blocks) {
+        for (int succ : cfg.GetSuccessors(b)) {
+            if (loop.Contains(succ)) continue;
+            if (exiting >= 0 && (exiting != b || exit_block != succ)) return false;
+            exiting = b;
+            exit_block = succ;
+        }
+    }
+    if (exiting < 0 || cfg.GetSuccessors(exiting).size() != 2) return false;
+    
+    const auto& exit_instrs = blocks[exiting]->GetInstructions();
+    size_t branch = exit_instrs.size();
+    for (size_t i = 0; i < exit_instrs.size(); i++) {
+        if (exit_instrs[i].IsConditionalBranch()) {
+            branch = i;
+            break;
+        }
+        if (exit_instrs[i].IsTerminator()) return false;
+    }
+    if (branch == exit_instrs.size()) return false;
+    bool exit_when_taken = cfg.GetBlockIndex(exit_instrs[branch].dest.label) == exit_block;
+    
+    // The latch must return to the header through its last instruction
+    int latch = loop.latches[0];
+    const std::string header_name = blocks[loop.header]->GetName();
+    const auto& latch_instrs = blocks[latch]->GetInstructions();
+    int back_edges = 0;
+    for (size_t i = 0; i < latch_instrs.size(); i++) {
+        if (!latch_instrs[i].IsBranch() || latch_instrs[i].dest.label != header_name) continue;
+        bool last_jump = i + 1 == latch_instrs.size() && latch_instrs[i].opcode == IR::OpCode::JMP;
+        bool bottom_test = latch == exiting && i == branch && !exit_when_taken;
+        if (!last_jump && !bottom_test) return false;
+        back_edges++;
+    }
+    if (back_edges > 1 || (back_edges == 0 && cfg.GetFallthrough(latch) != loop.header)) return false;
+    
+    // Induction value once the unrolled loop has run all its rounds
+    int64_t remainder_start = loop.induction_start +
+        static_cast<int64_t>(rounds) * factor * loop.induction_step;
+    if (remainder_start < INT32_MIN || remainder_start > INT32_MAX) return false;
+    
+    // Per-iteration temporaries: not live into the header or out of the loop
+    IR::Liveness liveness(func, cfg);
+    auto live_at = [&](int block, int reg) {
+        const IR::RegisterSet& live = liveness.GetLiveIn(block);
+        return reg < static_cast<int>(live.size()) && live[reg];
+    };
+    std::unordered_set<int> renamable;
+    for (int b : loop.blocks) {
+        for (const auto& instr : blocks[b]->GetInstructions()) {
+            int def = instr.GetDefinedRegister();
+            if (def > 0 && !live_at(loop.header, def) && !live_at(exit_block, def)) {
+                renamable.insert(def);
+            }
+        }
+    }
+    
+    int size_before = 0;
+    for (const auto& block : blocks) {
+        size_before += static_cast<int>(block->GetInstructions().size());
+    }
+    
+    // Copy order and labels
+    std::vector<int> order;
+    order.push_back(loop.header);
+    for (int b : loop.blocks) {
+        if (b != loop.header) order.push_back(b);
+    }
+    
+    std::unordered_set<std::string> used_names;
+    for (const auto& block : blocks) {
+        used_names.insert(block->GetName());
+    }
+    std::vector<std::unordered_map<int, std::string>> names(copies);
+    for (int k = 0; k < copies; k++) {
+        for (int b : order) {
+            std::string name = blocks[b]->GetName() + "_u" + std::to_string(k);
+            while (used_names.count(name)) name += "_";
+            used_names.insert(name);
+            names[k][b] = name;
+        }
+    }
+    
+    struct Clone {
+        std::string name;
+        std::vector<IR::Instruction> instructions;
+        int copy;
+    };
+    std::vector<Clone> clones;
+    
+    for (int k = 0; k < copies; k++) {
+        bool last_pass = full && k == copies - 1;
+        
+        std::unordered_map<int, int> rename;
+        for (int reg : renamable) {
+            rename[reg] = func.AllocateRegister();
+        }
+        
+        auto target_of = [&](int b) -> std::string {
+            if (b == loop.header) {
+                // Back edge; never taken on the final pass of a full unroll
+                if (full) return last_pass ? blocks[exit_block]->GetName() : names[k + 1][b];
+                return names[(k + 1) % copies][b];
+            }
+            return loop.Contains(b) ? names[k][b] : blocks[b]->GetName();
+        };
+        
+        for (size_t pos = 0; pos < order.size(); pos++) {
+            int b = order[pos];
+            std::vector<IR::Instruction> instrs = blocks[b]->GetInstructions();
+            
+            for (auto& instr : instrs) {
+                std::vector<IR::Operand*> operands = {&instr.dest, &instr.src1, &instr.src2};
+                for (IR::Operand& arg : instr.arguments) operands.push_back(&arg);
+                for (IR::Operand* op : operands) {
+                    if (op->type != IR::OperandType::Register) continue;
+                    auto it = rename.find(static_cast<int>(op->value));
+                    if (it != rename.end()) op->value = it->second;
+                }
+                if (instr.IsBranch()) {
+                    int target = cfg.GetBlockIndex(instr.dest.label);
+                    if (target >= 0) instr.dest.label = target_of(target);
+                }
+            }
+            
+            // Only the final pass can leave; every other copy always continues
+            if (b == exiting) {
+                bool leaves = last_pass;
+                if (leaves == exit_when_taken) {
+                    instrs[branch].opcode = IR::OpCode::JMP;
+                    instrs.erase(instrs.begin() + branch + 1, instrs.end());
+                } else {
+                    instrs.erase(instrs.begin() + branch);
+                }
+                bool flags_used = branch < instrs.size() && instrs[branch].IsConditionalBranch();
+                if (branch > 0 && instrs[branch - 1].opcode == IR::OpCode::CMP && !flags_used) {
+                    instrs.erase(instrs.begin() + (branch - 1));
+                }
+            }
+            
+            // Falling through only works when the successor copy comes next
+            std::string layout_next;
+            if (pos + 1 < order.size()) {
+                layout_next = names[k][order[pos + 1]];
+            } else if (k + 1 < copies) {
+                layout_next = names[k + 1][order[0]];
+            }
+            int fall = cfg.GetFallthrough(b);
+            bool ends = !instrs.empty() && instrs.back().IsTerminator();
+            if (!ends && fall >= 0 && target_of(fall) != layout_next) {
+                instrs.push_back(IR::Instruction(IR::OpCode::JMP, IR::Operand::Label(target_of(fall))));
+            } else if (ends && instrs.back().opcode == IR::OpCode::JMP &&
+                       instrs.back().dest.label == layout_next) {
+                instrs.pop_back();
+            }
+            
+            // Last copy of a partial unroll: hand the remaining passes to the original loop
+            if (!full && k == copies - 1 && b == latch) {
+                instrs.insert(instrs.end() - 1, IR::Instruction(IR::OpCode::CMP,
+                    IR::Operand::Register(loop.induction_register),
+                    IR::Operand::Immediate(remainder_start)));
+                instrs.insert(instrs.end() - 1, IR::Instruction(IR::OpCode::JE,
+                    IR::Operand::Label(header_name)));
+            }
+            
+            clones.push_back({names[k][b], instrs, k});
+        }
+    }
+    
+    // The final pass stops at the exit; drop the copies it can no longer reach
+    if (full) {
+        std::unordered_map<std::string, size_t> index_of;
+        for (size_t i = 0; i < clones.size(); i++) {
+            if (clones[i].copy == copies - 1) index_of[clones[i].name] = i;
+        }
+        std::unordered_set<size_t> reached;
+        std::vector<size_t> worklist(1, index_of[names[copies - 1][loop.header]]);
+        while (!worklist.empty()) {
+            size_t i = worklist.back();
+            worklist.pop_back();
+            if (!reached.insert(i).second) continue;
+            
+            const auto& instrs = clones[i].instructions;
+            for (const auto& instr : instrs) {
+                auto it = instr.IsBranch() ? index_of.find(instr.dest.label) : index_of.end();
+                if (it != index_of.end()) worklist.push_back(it->second);
+            }
+            if ((instrs.empty() || !instrs.back().IsTerminator()) && i + 1 < clones.size()) {
+                worklist.push_back(i + 1);
+            }
+        }
+        std::vector<Clone> kept;
+        for (size_t i = 0; i < clones.size(); i++) {
+            if (clones[i].copy != copies - 1 || reached.count(i)) kept.push_back(clones[i]);
+        }
+        clones.swap(kept);
+    }
+    
+    // Enter the copies instead of the header; the preheader falls into them
+    std::vector<const IR::BasicBlock*> originals;
+    for (int b : loop.blocks) {
+        originals.push_back(blocks[b].get());
+    }
+    for (auto& instr : blocks[loop.preheader]->GetInstructions()) {
+        if (instr.IsBranch() && instr.dest.label == header_name) {
+            instr.dest.label = names[0][loop.header];
+        }
+    }
     
- // Implementation would duplicate the loop body 'factor' times
-    // This is a framework - full implementation would clone instructions
+    size_t insert_at = loop.header;
+    for (const auto& clone : clones) {
+        IR::BasicBlock* block = func.InsertBlock(insert_at++, clone.name);
+        for (const auto& instr : clone.instructions) {
+            block->AddInstruction(instr);
+        }
+    }
+    
+    if (full) {
+        for (const IR::BasicBlock* block : originals) {
+            func.RemoveBlock(block);
+        }
+    }
+    
+    int size_after = 0;
+    for (const auto& block : func.GetBlocks()) {
+        size_after += static_cast<int>(block->GetInstructions().size());
+    }
+    
+    InvalidateAnalyses(func);
+    stats_.loops_unrolled++;
+    if (full) stats_.loops_fully_unrolled++;
+    stats_.unroll_size_delta += size_after - size_before;
+    return true;
 }
 
 bool CIAMOptimizer::IsBackEdge(IR::BasicBlock* from, IR::BasicBlock* to) {
-    // Simplified: check if 'to' appears before 'from' (back edge indicator)
-    return false; // Placeholder
+    // Edge into a block that dominates its source
+    if (!current_function_) return false;
+    const IR::LoopInfo& info = GetLoopInfo(*current_function_);
+    const IR::ControlFlowGraph& cfg = info.GetCFG();
+    int from_index = cfg.GetBlockIndex(from->GetName());
+    int to_index = cfg.GetBlockIndex(to->GetName());
+    return from_index >= 0 && to_index >= 0 && info.IsBackEdge(from_index, to_index);
 }
 
 // ============================================================================
 // 4. PEEPHOLE OPTIMIZATION
 // ============================================================================
 
-void CIAMOptimizer::PeepholeOptimization(IR::Function& func) {
+bool CIAMOptimizer::PeepholeOptimization(IR::Function& func) {
+    int before = stats_.peephole_optimizations;
     for (const auto& block : func.GetBlocks()) {
-        auto& instructions = const_cast<std::vector<IR::Instruction>&>(block->GetInstructions());
+        auto& instructions = block->GetInstructions();
    
   for (size_t i = 0; i < instructions.size(); ++i) {
             // Optimize single instructions
@@ -372,6 +905,7 @@ void CIAMOptimizer::PeepholeOptimization(IR::Function& func) {
             }
     }
     }
+    return stats_.peephole_optimizations != before;
 }
 
 bool CIAMOptimizer::OptimizeRedundantMoves(IR::Instruction& instr) {
@@ -440,49 +974,142 @@ bool CIAMOptimizer::OptimizeInstructionPair(IR::Instruction& i1, IR::Instruction
 // 5. TAIL CALL OPTIMIZATION
 // ============================================================================
 
-void CIAMOptimizer::TailCallOptimization(IR::Function& func) {
+// A call whose result is only copied back into R0 before the block returns
+// is in tail position. Self-recursive tail calls become a jump back to the
+// top of the function after reassigning the parameters, so deep recursion
+// runs in constant stack; other tail calls are marked for the code
+// generator, which tears the frame down and jumps to the callee.
+bool CIAMOptimizer::TailCallOptimization(IR::Function& func) {
+    std::vector<std::pair<IR::BasicBlock*, size_t>> sites;
+    bool self_recursive = false;
     for (const auto& block : func.GetBlocks()) {
-        auto& instructions = const_cast<std::vector<IR::Instruction>&>(block->GetInstructions());
-        
-        for (auto& instr : instructions) {
- if (instr.opcode == IR::OpCode::CALL && IsTailCall(instr, *block)) {
-           ConvertToTailCall(instr);
-                stats_.tail_calls_optimized++;
-       }
+        const auto& instructions = block->GetInstructions();
+        for (size_t i = 0; i < instructions.size(); i++) {
+            if (instructions[i].opcode != IR::OpCode::CALL || !IsTailCall(*block, i)) continue;
+            sites.push_back(std::make_pair(block.get(), i));
+            if (instructions[i].dest.label == func.GetName() &&
+                instructions[i].arguments.size() == func.GetParameters().size()) {
+                self_recursive = true;
+            }
+        }
+    }
+    if (sites.empty()) return false;
+    
+    // The loop re-enters below the entry block, which stays free of
+    // predecessors and becomes the loop's preheader
+    std::string loop_header;
+    if (self_recursive) {
+        IR::BasicBlock* entry = func.GetBlocks()[0].get();
+        std::unordered_set<std::string> names;
+        for (const auto& block : func.GetBlocks()) {
+            names.insert(block->GetName());
+        }
+        loop_header = func.GetName() + "_tailrec";
+        while (names.count(loop_header)) loop_header += "_";
+        IR::BasicBlock* header = func.InsertBlock(1, loop_header);
+        for (const auto& instr : entry->GetInstructions()) {
+            header->AddInstruction(instr);
+        }
+        entry->GetInstructions().clear();
+        for (auto& site : sites) {
+            if (site.first == entry) site.first = header;
+        }
+    }
+    
+    // Rewriting a site truncates its block, so go back to front
+    for (auto it = sites.rbegin(); it != sites.rend(); ++it) {
+        const IR::Instruction& call = it->first->GetInstructions()[it->second];
+        if (call.dest.label == func.GetName() && call.arguments.size() == func.GetParameters().size()) {
+            ConvertTailRecursion(func, *it->first, it->second, loop_header);
+            stats_.tail_recursions_looped++;
+        } else {
+            ConvertToTailCall(*it->first, it->second);
         }
+        stats_.tail_calls_optimized++;
     }
+    
+    return true;
 }
 
-bool CIAMOptimizer::IsTailCall(const IR::Instruction& call_instr, const IR::BasicBlock& block) {
-    // Check if CALL is followed immediately by RET
+bool CIAMOptimizer::IsTailCall(const IR::BasicBlock& block, size_t call_index) const {
+    // Registers known to hold the call's result
+    std::unordered_set<int64_t> result = {0};
     const auto& instrs = block.GetInstructions();
-    for (size_t i = 0; i < instrs.size() - 1; ++i) {
-        if (&instrs[i] == &call_instr) {
-   return instrs[i + 1].opcode == IR::OpCode::RET;
-   }
+    for (size_t i = call_index + 1; i < instrs.size(); i++) {
+        const IR::Instruction& instr = instrs[i];
+        switch (instr.opcode) {
+            case IR::OpCode::LABEL:
+            case IR::OpCode::NOP:
+                break;
+            case IR::OpCode::RET:
+                return result.count(0) > 0;
+            case IR::OpCode::MOV:
+                if (instr.dest.type != IR::OperandType::Register ||
+                    instr.src1.type != IR::OperandType::Register || !result.count(instr.src1.value)) {
+                    return false;
+                }
+                result.insert(instr.dest.value);
+                break;
+            default:
+                return false;
+        }
     }
     return false;
 }
 
-void CIAMOptimizer::ConvertToTailCall(IR::Instruction& call_instr) {
+void CIAMOptimizer::ConvertToTailCall(IR::BasicBlock& block, size_t call_index) {
+    // Nothing after the call survives the jump, so the result copies go
+    auto& instructions = block.GetInstructions();
+    instructions.erase(instructions.begin() + call_index + 1, instructions.end());
+    instructions.push_back(IR::Instruction(IR::OpCode::RET));
+    
     // Mark as tail call for codegen
-    call_instr.comment = "TAIL_CALL";
+    instructions[call_index].comment = "TAIL_CALL";
+}
+
+void CIAMOptimizer::ConvertTailRecursion(IR::Function& func, IR::BasicBlock& block, size_t call_index,
+                                         const std::string& loop_header) {
+    auto& instructions = block.GetInstructions();
+    const std::vector<IR::Operand> arguments = instructions[call_index].arguments;
+    instructions.erase(instructions.begin() + call_index, instructions.end());
+    
+    // Parameter k lives in register k. An argument that reads another
+    // parameter is copied out first, so the reassignment acts as a parallel move.
+    int params = static_cast<int>(arguments.size());
+    std::vector<IR::Operand> sources = arguments;
+    for (int k = 0; k < params; k++) {
+        const IR::Operand& arg = arguments[k];
+        if (arg.type == IR::OperandType::Register && arg.value < params && arg.value != k) {
+            IR::Operand temp = IR::Operand::Register(func.AllocateRegister());
+            instructions.push_back(IR::Instruction(IR::OpCode::MOV, temp, arg));
+            sources[k] = temp;
+        }
+    }
+    for (int k = 0; k < params; k++) {
+        const IR::Operand& src = sources[k];
+        if (src.type == IR::OperandType::Register && src.value == k) continue;
+        instructions.push_back(IR::Instruction(IR::OpCode::MOV, IR::Operand::Register(k), src));
+    }
+    instructions.push_back(IR::Instruction(IR::OpCode::JMP, IR::Operand::Label(loop_header)));
 }
 
 // ============================================================================
 // 6. VECTORIZATION (SIMD/AVX)
 // ============================================================================
 
-void CIAMOptimizer::Vectorization(IR::Function& func) {
+bool CIAMOptimizer::Vectorization(IR::Function& func) {
     std::vector<std::vector<IR::BasicBlock*>> loops;
     DetectLoops(func, loops);
     
+    // Counts candidates only; VectorizeLoop is a placeholder and the loop
+    // vectorizer works on SSA (AdvancedOptimization/VectorizationEngine)
     for (auto& loop : loops) {
         if (IsVectorizableLoop(loop)) {
             VectorizeLoop(loop);
-   stats_.vectorized_loops++;
+   stats_.vectorization_candidates++;
         }
   }
+    return false;
 }
 
 bool CIAMOptimizer::IsVectorizableLoop(const std::vector<IR::BasicBlock*>& loop) {
@@ -498,31 +1125,279 @@ void CIAMOptimizer::VectorizeLoop(std::vector<IR::BasicBlock*>& loop) {
 
 // ============================================================================
 // 7. LOOK-AHEAD OPTIMIZATION
+// List scheduling over a per-region dependence DAG (registers plus LOAD/STORE
+// and memory-operand ordering), prioritised by critical path. Costs come from
+// the selected X64::MachineModel; see ScheduleBlock for the cycle report.
 // ============================================================================
 
-void CIAMOptimizer::LookAheadOptimization(IR::Function& func) {
+bool CIAMOptimizer::LookAheadOptimization(IR::Function& func) {
+    bool changed = false;
     for (const auto& block : func.GetBlocks()) {
-    auto& instructions = const_cast<std::vector<IR::Instruction>&>(block->GetInstructions());
-      
         // Reorder instructions to hide latency
-        ReorderInstructionsForLatency(const_cast<IR::BasicBlock&>(*block));
+        if (ReorderInstructionsForLatency(*block)) changed = true;
     }
+    return changed;
 }
 
-void CIAMOptimizer::ReorderInstructionsForLatency(IR::BasicBlock& block) {
-    // Instruction scheduling to minimize pipeline stalls
-    // Move independent instructions earlier to fill bubbles
+bool CIAMOptimizer::ReorderInstructionsForLatency(IR::BasicBlock& block) {
+    // Latency only: long operations start early so their results are ready
+    // by the time they are used; execution units are assumed plentiful
+    return ScheduleBlock(block, false);
+}
+
+namespace {
+
+// Straight-line instructions the scheduler may move. CMP stays put because
+// the arithmetic the code generator emits clobbers the flags its Jcc reads.
+bool IsSchedulable(const IR::Instruction& instr) {
+    switch (instr.opcode) {
+        case IR::OpCode::MOV:
+        case IR::OpCode::LOAD:
+        case IR::OpCode::STORE:
+        case IR::OpCode::ADD:
+        case IR::OpCode::SUB:
+        case IR::OpCode::MUL:
+        case IR::OpCode::DIV:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool ReadsMemoryOperand(const IR::Instruction& instr) {
+    return instr.src1.type == IR::OperandType::Memory ||
+           instr.src2.type == IR::OperandType::Memory;
+}
+
+X64::OpClass ClassifyInstruction(const IR::Instruction& instr) {
+    switch (instr.opcode) {
+        case IR::OpCode::LOAD:
+            return X64::OpClass::Load;
+        case IR::OpCode::STORE:
+            return X64::OpClass::Store;
+        case IR::OpCode::MUL:
+            return X64::OpClass::IntMul;
+        case IR::OpCode::DIV:
+            // Constant divisors are emitted as a multiply-high and shifts
+            if (instr.src2.type == IR::OperandType::Immediate &&
+                X64::CanDivideWithoutIdiv(instr.src2.value)) {
+                return X64::OpClass::IntMul;
+            }
+            return X64::OpClass::IntDiv;
+        case IR::OpCode::CALL:
+        case IR::OpCode::WAIT:
+            return X64::OpClass::Call;
+        case IR::OpCode::RET:
+            return X64::OpClass::Branch;
+        default:
+            if (instr.IsBranch()) return X64::OpClass::Branch;
+            if (ReadsMemoryOperand(instr)) return X64::OpClass::Load;
+            if (instr.dest.type == IR::OperandType::Memory) return X64::OpClass::Store;
+            return X64::OpClass::IntAlu;
+    }
+}
+
+// A memory access; Memory operands hold absolute addresses of 8-byte slots,
+// register addresses could point anywhere
+struct MemoryAccess {
+    bool known;
+    int64_t address;
+};
+
+bool MayAlias(const MemoryAccess& a, const MemoryAccess& b) {
+    if (!a.known || !b.known) return true;
+    return a.address - b.address < 8 && b.address - a.address < 8;
+}
+
+void CollectMemoryAccesses(const IR::Instruction& instr,
+                           std::vector<MemoryAccess>& reads,
+                           std::vector<MemoryAccess>& writes) {
+    auto address_of = [](const IR::Operand& op) {
+        return op.type == IR::OperandType::Memory ? MemoryAccess{ true, op.value }
+                                                  : MemoryAccess{ false, 0 };
+    };
+    
+    if (instr.opcode == IR::OpCode::LOAD) {
+        reads.push_back(address_of(instr.src1));
+        return;
+    }
+    if (instr.opcode == IR::OpCode::STORE) {
+        writes.push_back(address_of(instr.dest));
+        if (instr.src1.type == IR::OperandType::Memory) reads.push_back(address_of(instr.src1));
+        return;
+    }
+    if (instr.src1.type == IR::OperandType::Memory) reads.push_back(address_of(instr.src1));
+    if (instr.src2.type == IR::OperandType::Memory) reads.push_back(address_of(instr.src2));
+    if (instr.dest.type == IR::OperandType::Memory) writes.push_back(address_of(instr.dest));
+}
+
+// Dependence DAG over instructions [begin, end): register RAW edges carry
+// the producer's latency, store-to-load edges the forwarding latency, and
+// WAR/WAW and load-before-store edges only keep the original order
+std::vector<X64::ScheduleNode> BuildRegionDAG(const X64::MachineModel& model,
+                                              const std::vector<IR::Instruction>& instructions,
+                                              size_t begin, size_t end) {
+    int count = static_cast<int>(end - begin);
+    std::vector<X64::ScheduleNode> nodes(count);
+    std::vector<std::vector<MemoryAccess>> reads(count), writes(count);
+    std::unordered_map<int, int> last_def;
+    std::unordered_map<int, std::vector<int>> uses_since_def;
+    
+    for (int j = 0; j < count; j++) {
+        const IR::Instruction& instr = instructions[begin + j];
+        nodes[j].op = ClassifyInstruction(instr);
+        CollectMemoryAccesses(instr, reads[j], writes[j]);
+        
+        std::vector<int> used;
+        instr.GetUsedRegisters(used);
+        for (int reg : used) {
+            auto def = last_def.find(reg);
+            if (def != last_def.end()) {
+                X64::AddScheduleEdge(nodes, def->second, j, model.GetLatency(nodes[def->second].op));
+            }
+            uses_since_def[reg].push_back(j);
+        }
+        
+        int defined = instr.GetDefinedRegister();
+        if (defined >= 0) {
+            for (int user : uses_since_def[defined]) {
+                if (user != j) X64::AddScheduleEdge(nodes, user, j, 0);
+            }
+            auto def = last_def.find(defined);
+            if (def != last_def.end()) X64::AddScheduleEdge(nodes, def->second, j, 0);
+            last_def[defined] = j;
+            uses_since_def[defined].clear();
+        }
+        
+        for (int i = 0; i < j; i++) {
+            for (const auto& w : writes[i]) {
+                for (const auto& r : reads[j]) {
+                    if (MayAlias(w, r)) X64::AddScheduleEdge(nodes, i, j, model.store_forward_latency);
+                }
+                for (const auto& w2 : writes[j]) {
+                    if (MayAlias(w, w2)) X64::AddScheduleEdge(nodes, i, j, 0);
+                }
+            }
+            for (const auto& r : reads[i]) {
+                for (const auto& w : writes[j]) {
+                    if (MayAlias(r, w)) X64::AddScheduleEdge(nodes, i, j, 0);
+                }
+            }
+        }
+    }
+    
+    return nodes;
+}
+
+// Cycles charged for an instruction the scheduler never moves
+int BarrierCycles(const X64::MachineModel& model, const IR::Instruction& instr) {
+    if (instr.opcode == IR::OpCode::LABEL) return 0;
+    return model.GetLatency(ClassifyInstruction(instr));
+}
+
+// Regions above this size are left alone; the DAG is quadratic in memory ops
+const size_t kMaxScheduleRegion = 512;
+
+} // anonymous namespace
+
+// Schedules each maximal run of movable instructions in the block on its own
+// and keeps the new order only where the cost model says it is faster. The
+// block estimate is the sum of its regions plus the fixed instructions, so
+// it is pessimistic (no overlap across barriers) but comparable across runs.
+bool CIAMOptimizer::ScheduleBlock(IR::BasicBlock& block, bool model_resources) {
+    auto& instructions = block.GetInstructions();
+    std::vector<IR::Instruction> scheduled;
+    scheduled.reserve(instructions.size());
+    
+    int before = 0;
+    int after = 0;
+    bool has_region = false;
+    bool reordered = false;
+    size_t i = 0;
+    
+    while (i < instructions.size()) {
+        if (!IsSchedulable(instructions[i])) {
+            int cycles = BarrierCycles(machine_model_, instructions[i]);
+            before += cycles;
+            after += cycles;
+            scheduled.push_back(instructions[i++]);
+            continue;
+        }
+        
+        size_t end = i;
+        while (end < instructions.size() && IsSchedulable(instructions[end])) end++;
+        
+        std::vector<int> original(end - i);
+        for (size_t k = 0; k < original.size(); k++) original[k] = static_cast<int>(k);
+        
+        if (original.size() < 2 || original.size() > kMaxScheduleRegion) {
+            for (size_t k = i; k < end; k++) {
+                int cycles = machine_model_.GetLatency(ClassifyInstruction(instructions[k]));
+                before += cycles;
+                after += cycles;
+                scheduled.push_back(instructions[k]);
+            }
+            i = end;
+            continue;
+        }
+        
+        has_region = true;
+        std::vector<X64::ScheduleNode> dag = BuildRegionDAG(machine_model_, instructions, i, end);
+        int original_cycles = X64::EstimateCycles(machine_model_, dag, original);
+        std::vector<int> order = X64::ListSchedule(machine_model_, dag, model_resources);
+        int new_cycles = X64::EstimateCycles(machine_model_, dag, order);
+        if (new_cycles >= original_cycles) {
+            order = original;
+            new_cycles = original_cycles;
+        }
+        if (order != original) reordered = true;
+        
+        before += original_cycles;
+        after += new_cycles;
+        for (int n : order) {
+            scheduled.push_back(instructions[i + n]);
+        }
+        i = end;
+    }
+    
+    instructions.swap(scheduled);
+    if (!has_region) return false;
+    
+    // Later scheduling passes refine a block: keep the first "before" and
+    // the latest "after" so the report shows the combined effect
+    auto it = schedule_index_.find(&block);
+    if (it == schedule_index_.end()) {
+        schedule_index_[&block] = schedule_report_.size();
+        schedule_report_.push_back({ current_function_->GetName(), block.GetName(), before, after });
+        stats_.blocks_scheduled++;
+        stats_.schedule_cycles_before += before;
+        stats_.schedule_cycles_after += after;
+    } else {
+        BlockScheduleEstimate& entry = schedule_report_[it->second];
+        stats_.schedule_cycles_after += after - entry.cycles_after;
+        entry.cycles_after = after;
+    }
+    return reordered;
+}
+
+void CIAMOptimizer::PrintScheduleReport(size_t first) const {
+    for (size_t i = first; i < schedule_report_.size(); i++) {
+        const BlockScheduleEstimate& entry = schedule_report_[i];
+        *log_ << "    [Schedule:" << machine_model_.name << "] " << entry.block << ": "
+                  << entry.cycles_before << " -> " << entry.cycles_after << " cycles" << std::endl;
+    }
 }
 
 // ============================================================================
 // 8. BOUNDS CHECK ELIMINATION
 // ============================================================================
 
-void CIAMOptimizer::BoundsCheckElimination(IR::Function& func) {
+bool CIAMOptimizer::BoundsCheckElimination(IR::Function& func) {
+    int before = stats_.bounds_checks_eliminated;
     AnalyzeArrayAccess(func);
     
     for (const auto& block : func.GetBlocks()) {
-     auto& instructions = const_cast<std::vector<IR::Instruction>&>(block->GetInstructions());
+     auto& instructions = block->GetInstructions();
         
         instructions.erase(
             std::remove_if(instructions.begin(), instructions.end(),
@@ -534,6 +1409,7 @@ void CIAMOptimizer::BoundsCheckElimination(IR::Function& func) {
        instructions.end()
       );
     }
+    return stats_.bounds_checks_eliminated != before;
 }
 
 void CIAMOptimizer::AnalyzeArrayAccess(IR::Function& func) {
@@ -549,16 +1425,17 @@ bool CIAMOptimizer::CanEliminateBoundsCheck(const IR::Instruction& check) {
 // 9. BRANCH CHAIN OPTIMIZATION
 // ============================================================================
 
-void CIAMOptimizer::BranchChainOptimization(IR::Function& func) {
+bool CIAMOptimizer::BranchChainOptimization(IR::Function& func) {
+    int before = stats_.branches_optimized;
     for (const auto& block : func.GetBlocks()) {
-        SimplifyBranchChains(const_cast<IR::BasicBlock&>(*block));
-   EliminateRedundantBranches(const_cast<IR::BasicBlock&>(*block));
+        SimplifyBranchChains(*block);
+   EliminateRedundantBranches(*block);
 }
+    return stats_.branches_optimized != before;
 }
 
 void CIAMOptimizer::SimplifyBranchChains(IR::BasicBlock& block) {
     // JMP to JMP -> Direct JMP
-    stats_.branches_optimized++;
 }
 
 void CIAMOptimizer::EliminateRedundantBranches(IR::BasicBlock& block) {
@@ -569,7 +1446,8 @@ void CIAMOptimizer::EliminateRedundantBranches(IR::BasicBlock& block) {
 // 10. LOOP FUSION (CURLING)
 // ============================================================================
 
-void CIAMOptimizer::LoopFusion(IR::Function& func) {
+bool CIAMOptimizer::LoopFusion(IR::Function& func) {
+    int before = stats_.loops_fused;
     std::vector<std::vector<IR::BasicBlock*>> loops;
     DetectLoops(func, loops);
     
@@ -581,6 +1459,7 @@ void CIAMOptimizer::LoopFusion(IR::Function& func) {
 }
         }
     }
+    return stats_.loops_fused != before;
 }
 
 bool CIAMOptimizer::CanFuseLoops(const std::vector<IR::BasicBlock*>& loop1,
@@ -596,25 +1475,31 @@ void CIAMOptimizer::FuseLoops(std::vector<IR::BasicBlock*>& loop1,
 
 // ============================================================================
 // 11. SYNCHRONIZED SCHEDULING
+// Re-runs the list scheduler with execution unit limits after look-ahead.
 // ============================================================================
 
-void CIAMOptimizer::SynchronizedScheduling(IR::Function& func) {
+bool CIAMOptimizer::SynchronizedScheduling(IR::Function& func) {
+    bool changed = false;
     for (const auto& block : func.GetBlocks()) {
-        ScheduleForPipeline(const_cast<IR::BasicBlock&>(*block));
+        if (ScheduleForPipeline(*block)) changed = true;
     }
+    return changed;
 }
 
-void CIAMOptimizer::ScheduleForPipeline(IR::BasicBlock& block) {
- // Schedule instructions for optimal pipeline utilization
+bool CIAMOptimizer::ScheduleForPipeline(IR::BasicBlock& block) {
+    // Resource-aware: issue width and execution unit counts/occupancy limit
+    // each cycle, so e.g. two divisions are not packed back to back
+    return ScheduleBlock(block, true);
 }
 
 // ============================================================================
 // 12. FOOTPRINT COMPRESSION
 // ============================================================================
 
-void CIAMOptimizer::FootprintCompression(IR::Function& func) {
+bool CIAMOptimizer::FootprintCompression(IR::Function& func) {
     CompressRegisterUsage(func);
     MinimizeStackFrame(func);
+    return false;
 }
 
 void CIAMOptimizer::CompressRegisterUsage(IR::Function& func) {
@@ -629,9 +1514,11 @@ void CIAMOptimizer::RegisterCoalescing(IR::Function& func) {
     // Merge live ranges of variables to reduce register pressure
 }
 
-void CIAMOptimizer::RemoveRedundantMoves(IR::Function& func) {
+bool CIAMOptimizer::RemoveRedundantMoves(IR::Function& func) {
+    bool changed = false;
     for (const auto& block : func.GetBlocks()) {
-        auto& instructions = const_cast<std::vector<IR::Instruction>&>(block->GetInstructions());
+        auto& instructions = block->GetInstructions();
+        size_t size = instructions.size();
      
         instructions.erase(
 std::remove_if(instructions.begin(), instructions.end(),
@@ -640,16 +1527,19 @@ std::remove_if(instructions.begin(), instructions.end(),
      }),
             instructions.end()
         );
+        if (instructions.size() != size) changed = true;
     }
+    return changed;
 }
 
 // ============================================================================
 // 13. ADAPTIVE TUNING
 // ============================================================================
 
-void CIAMOptimizer::AdaptiveTuning(IR::Function& func) {
+bool CIAMOptimizer::AdaptiveTuning(IR::Function& func) {
     TuneForCacheLocality(func);
     OptimizeForBranchPrediction(func);
+    return false;
 }
 
 void CIAMOptimizer::TuneForCacheLocality(IR::Function& func) {
@@ -664,43 +1554,512 @@ void CIAMOptimizer::OptimizeForBranchPrediction(IR::Function& func) {
 // 14. PROFILE-GUIDED OPTIMIZATION
 // ============================================================================
 
-void CIAMOptimizer::ProfileGuidedOptimization(IR::Function& func) {
-    if (profile_data_.block_execution_count.empty()) return;
+bool CIAMOptimizer::ProfileGuidedOptimization(IR::Function& func) {
+    if (profile_data_.block_execution_count.empty()) return false;
     
     ReorderBlocksForHotPath(func);
+    return false;
 }
 
 void CIAMOptimizer::ReorderBlocksForHotPath(IR::Function& func) {
     // Reorder basic blocks to place hot code together
 }
 
+namespace {
+
+// Callees this small are always inlined: the call sequence (argument moves,
+// call, prologue, epilogue, ret) is about as large as their body
+const int kAlwaysInlineSize = 6;
+
+// Callers stop growing through inlining at this size
+const int kMaxInlinedCallerSize = 2000;
+
+int InstructionCount(const IR::Function& func) {
+    int count = 0;
+    for (const auto& block : func.GetBlocks()) {
+        for (const auto& instr : block->GetInstructions()) {
+            if (instr.opcode != IR::OpCode::LABEL && instr.opcode != IR::OpCode::NOP) count++;
+        }
+    }
+    return count;
+}
+
+} // anonymous namespace
+
+// Call sites are visited bottom-up over the call graph's strongly connected
+// components, so a callee has already absorbed its own callees when its size
+// is judged. Calls inside a component (recursion) stay calls. The size
+// budget grows with the logarithm of the profiled call count; with profile
+// data, callees that were never called are only inlined when tiny.
 void CIAMOptimizer::InlineHotFunctions(IR::Module& module) {
-    // Inline frequently called functions
+    IR::CallGraph graph(module);
+    int site = 0;
+    
+    auto worth_inlining = [this](const IR::Function& callee, int size) {
+        if (size <= kAlwaysInlineSize) return true;
+        double budget = inline_budget_;
+        if (!profile_data_.call_counts.empty()) {
+            auto it = profile_data_.call_counts.find(callee.GetName());
+            int calls = it != profile_data_.call_counts.end() ? it->second : 0;
+            if (calls <= 0) return false;
+            budget *= 1.0 + std::log10(static_cast<double>(calls));
+        }
+        return size <= budget;
+    };
+    
+    for (const auto& component : graph.GetComponents()) {
+        for (int f : component) {
+            IR::Function& caller = *graph.GetFunction(f);
+            int caller_size = InstructionCount(caller);
+            std::unordered_set<const IR::BasicBlock*> inlined_blocks;
+            
+            for (size_t b = 0; b < caller.GetBlocks().size(); b++) {
+                const IR::BasicBlock* block = caller.GetBlocks()[b].get();
+                if (inlined_blocks.count(block)) continue;
+                
+                const auto& instructions = block->GetInstructions();
+                for (size_t i = 0; i < instructions.size(); i++) {
+                    if (instructions[i].opcode != IR::OpCode::CALL) continue;
+                    int target = graph.GetFunctionIndex(instructions[i].dest.label);
+                    if (target < 0 || graph.GetComponent(target) == graph.GetComponent(f)) continue;
+                    
+                    const IR::Function& callee = *graph.GetFunction(target);
+                    int size = InstructionCount(callee);
+                    if (!worth_inlining(callee, size) || caller_size + size > kMaxInlinedCallerSize) continue;
+                    
+                    // The block now ends before the call; its tail is the continuation
+                    size_t continuation = InlineCallSite(caller, b, i, callee, site++);
+                    for (size_t k = b + 1; k < continuation; k++) {
+                        inlined_blocks.insert(caller.GetBlocks()[k].get());
+                    }
+                    
+                    int new_size = InstructionCount(caller);
+                    stats_.calls_inlined++;
+                    stats_.inline_size_delta += new_size - caller_size;
+                    caller_size = new_size;
+                    break;
+                }
+            }
+            
+            InvalidateAnalyses(caller);
+        }
+    }
+}
+
+// Splits the caller's block at the call, lays a copy of the callee out
+// after it and returns the index of the continuation block holding the
+// rest of the original block. Callee register r becomes a fresh caller
+// register, so parameter k is bound by a move from argument k; RET turns
+// into a move of the result into R0 and a jump to the continuation.
+size_t CIAMOptimizer::InlineCallSite(IR::Function& caller, size_t block_index, size_t call_index,
+                                     const IR::Function& callee, int site) {
+    IR::BasicBlock* block = caller.GetBlocks()[block_index].get();
+    auto& instructions = block->GetInstructions();
+    const IR::Instruction call = instructions[call_index];
+    std::vector<IR::Instruction> rest(instructions.begin() + call_index + 1, instructions.end());
+    instructions.erase(instructions.begin() + call_index, instructions.end());
+    
+    std::unordered_map<int, int> rename;
+    auto reg = [&](int r) {
+        auto it = rename.find(r);
+        if (it == rename.end()) it = rename.emplace(r, caller.AllocateRegister()).first;
+        return it->second;
+    };
+    
+    // Labels: callee_block_iN, unique within the caller
+    std::unordered_set<std::string> used_names;
+    for (const auto& existing : caller.GetBlocks()) {
+        used_names.insert(existing->GetName());
+    }
+    auto unique_name = [&used_names](std::string name) {
+        while (used_names.count(name)) name += "_";
+        used_names.insert(name);
+        return name;
+    };
+    const std::string suffix = "_i" + std::to_string(site);
+    std::unordered_map<std::string, std::string> names;
+    for (const auto& callee_block : callee.GetBlocks()) {
+        names[callee_block->GetName()] = unique_name(callee.GetName() + "_" + callee_block->GetName() + suffix);
+    }
+    std::string continuation = unique_name(block->GetName() + "_ret" + suffix);
+    
+    size_t params = std::min(callee.GetParameters().size(), call.arguments.size());
+    for (size_t k = 0; k < params; k++) {
+        instructions.push_back(IR::Instruction(IR::OpCode::MOV,
+            IR::Operand::Register(reg(static_cast<int>(k))), call.arguments[k]));
+    }
+    
+    const auto& callee_blocks = callee.GetBlocks();
+    size_t insert_at = block_index + 1;
+    for (size_t b = 0; b < callee_blocks.size(); b++) {
+        bool last = b + 1 == callee_blocks.size();
+        std::vector<IR::Instruction> body;
+        bool terminated = false;
+        
+        for (const auto& original : callee_blocks[b]->GetInstructions()) {
+            IR::Instruction instr = original;
+            std::vector<IR::Operand*> operands = {&instr.dest, &instr.src1, &instr.src2};
+            for (IR::Operand& arg : instr.arguments) operands.push_back(&arg);
+            for (IR::Operand* op : operands) {
+                if (op->type == IR::OperandType::Register) op->value = reg(static_cast<int>(op->value));
+            }
+            if (instr.IsBranch() || instr.opcode == IR::OpCode::LABEL) {
+                auto it = names.find(instr.dest.label);
+                if (it != names.end()) instr.dest.label = it->second;
+            }
+            
+            if (instr.opcode == IR::OpCode::RET) {
+                body.push_back(IR::Instruction(IR::OpCode::MOV, IR::Operand::Register(0),
+                                               IR::Operand::Register(reg(0))));
+                body.push_back(IR::Instruction(IR::OpCode::JMP, IR::Operand::Label(continuation)));
+                terminated = true;
+                break;
+            }
+            
+            body.push_back(instr);
+            if (instr.opcode == IR::OpCode::CALL) {
+                // The nested call's result lands in the caller's R0
+                body.push_back(IR::Instruction(IR::OpCode::MOV, IR::Operand::Register(reg(0)),
+                                               IR::Operand::Register(0)));
+            }
+            if (instr.IsTerminator()) {
+                terminated = true;
+                break;
+            }
+        }
+        
+        // Falling off the end of the callee returns; the continuation comes next
+        if (last && !terminated) {
+            body.push_back(IR::Instruction(IR::OpCode::MOV, IR::Operand::Register(0),
+                                           IR::Operand::Register(reg(0))));
+        } else if (last && body.back().opcode == IR::OpCode::JMP && body.back().dest.label == continuation) {
+            body.pop_back();
+        }
+        
+        IR::BasicBlock* clone = caller.InsertBlock(insert_at++, names[callee_blocks[b]->GetName()]);
+        for (const auto& instr : body) {
+            clone->AddInstruction(instr);
+        }
+    }
+    
+    IR::BasicBlock* tail = caller.InsertBlock(insert_at, continuation);
+    for (const auto& instr : rest) {
+        tail->AddInstruction(instr);
+    }
+    return insert_at;
+}
+
+// ============================================================================
+// 15. LOOP-INVARIANT CODE MOTION
+// An instruction moves to the loop preheader when it has no side effects,
+// none of its operands are defined inside the loop, and its destination is
+// defined exactly once in the loop and is not live on entry to the header
+// (so no path through the loop can observe the old value). Loads also need
+// a loop without stores or calls and must sit in the header, which runs
+// whenever the loop is entered. Inner loops go first so invariants bubble
+// outward through each enclosing preheader in turn.
+// ============================================================================
+
+bool CIAMOptimizer::LoopInvariantCodeMotion(IR::Function& func) {
+    const IR::LoopInfo& info = GetLoopInfo(func);
+    const IR::ControlFlowGraph& cfg = info.GetCFG();
+    const auto& blocks = func.GetBlocks();
+    int before = stats_.invariants_hoisted;
+    
+    // Hoisting only ever shrinks live ranges into the loop, so liveness
+    // computed once stays conservative for every loop in the nest
+    const IR::Liveness& liveness = GetLiveness(func);
+    
+    std::vector<int> rpo_position(cfg.GetBlockCount(), -1);
+    const auto& rpo = info.GetDominators().GetReversePostorder();
+    for (size_t i = 0; i < rpo.size(); i++) {
+        rpo_position[rpo[i]] = static_cast<int>(i);
+    }
+    
+    for (const auto& loop : info.GetLoops()) {
+        if (loop.preheader < 0) continue;
+        
+        std::unordered_map<int, int> def_count;
+        bool writes_memory = false;
+        for (int b : loop.blocks) {
+            for (const auto& instr : blocks[b]->GetInstructions()) {
+                int def = instr.GetDefinedRegister();
+                if (def >= 0) def_count[def]++;
+                if (instr.opcode == IR::OpCode::STORE || instr.opcode == IR::OpCode::CALL ||
+                    instr.opcode == IR::OpCode::WAIT) {
+                    writes_memory = true;
+                }
+            }
+        }
+        
+        std::vector<int> order(loop.blocks);
+        std::sort(order.begin(), order.end(), [&](int a, int b) {
+            return rpo_position[a] < rpo_position[b];
+        });
+        
+        const IR::RegisterSet& header_live = liveness.GetLiveIn(loop.header);
+        auto& preheader = blocks[loop.preheader]->GetInstructions();
+        
+        for (int b : order) {
+            if (rpo_position[b] < 0) continue;
+            auto& instructions = blocks[b]->GetInstructions();
+            
+            for (size_t i = 0; i < instructions.size();) {
+                const IR::Instruction& instr = instructions[i];
+                bool hoist = IsHoistable(instr, writes_memory) &&
+                             (instr.opcode != IR::OpCode::LOAD || b == loop.header);
+                
+                int def = instr.GetDefinedRegister();
+                if (hoist) {
+                    hoist = def >= 0 && def_count[def] == 1 &&
+                            !(def < static_cast<int>(header_live.size()) && header_live[def]);
+                }
+                if (hoist) {
+                    std::vector<int> uses;
+                    instr.GetUsedRegisters(uses);
+                    for (int reg : uses) {
+                        if (def_count.count(reg) && def_count[reg] > 0) {
+                            hoist = false;
+                            break;
+                        }
+                    }
+                }
+                
+                if (!hoist) {
+                    i++;
+                    continue;
+                }
+                
+                preheader.insert(preheader.begin() + PreheaderInsertPoint(*blocks[loop.preheader]), instr);
+                instructions.erase(instructions.begin() + i);
+                def_count[def] = 0;
+                stats_.invariants_hoisted++;
+            }
+        }
+    }
+    return stats_.invariants_hoisted != before;
+}
+
+bool CIAMOptimizer::IsHoistable(const IR::Instruction& instr, bool loop_writes_memory) {
+    if (HasSideEffects(instr)) return false;
+    
+    switch (instr.opcode) {
+        case IR::OpCode::MOV:
+        case IR::OpCode::ADD:
+        case IR::OpCode::SUB:
+        case IR::OpCode::MUL:
+            return true;
+        case IR::OpCode::DIV:
+            // Hoisting may execute it on paths that never did; never fault
+            return instr.src2.type == IR::OperandType::Immediate && instr.src2.value != 0;
+        case IR::OpCode::LOAD:
+            return !loop_writes_memory;
+        default:
+            // CMP feeds the next branch; temporal ops observe the clock
+            return false;
+    }
+}
+
+size_t CIAMOptimizer::PreheaderInsertPoint(const IR::BasicBlock& preheader) const {
+    // Before the first branch and any compare setting its flags
+    const auto& instructions = preheader.GetInstructions();
+    size_t point = 0;
+    while (point < instructions.size() && !instructions[point].IsBranch() &&
+           instructions[point].opcode != IR::OpCode::RET) {
+        point++;
+    }
+    while (point > 0 && instructions[point - 1].opcode == IR::OpCode::CMP) {
+        point--;
+    }
+    return point;
+}
+
+// ============================================================================
+// 16. INDUCTION VARIABLE STRENGTH REDUCTION
+// For a loop's induction register i (stepped by a constant c once per
+// iteration) each MUL d, i, k with constant k becomes MOV d, s, where s is
+// set to i * k in the preheader and advanced by c * k right after i is.
+// ============================================================================
+
+bool CIAMOptimizer::InductionVariableStrengthReduction(IR::Function& func) {
+    const IR::LoopInfo& info = GetLoopInfo(func);
+    int before = stats_.induction_variables_reduced;
+    const auto& blocks = func.GetBlocks();
+    
+    for (const auto& loop : info.GetLoops()) {
+        int iv = loop.induction_register;
+        if (iv < 0 || loop.induction_step == 0 || loop.preheader < 0) continue;
+        
+        // The single in-loop update of the induction register
+        IR::BasicBlock* update_block = nullptr;
+        size_t update_index = 0;
+        for (int b : loop.blocks) {
+            const auto& instructions = blocks[b]->GetInstructions();
+            for (size_t i = 0; i < instructions.size(); i++) {
+                if (instructions[i].GetDefinedRegister() == iv) {
+                    update_block = blocks[b].get();
+                    update_index = i;
+                }
+            }
+        }
+        if (!update_block) continue;
+        
+        auto factor_of = [&](const IR::Operand& op, int64_t& factor) {
+            if (op.type == IR::OperandType::Immediate) {
+                factor = op.value;
+                return true;
+            }
+            return op.type == IR::OperandType::Register &&
+                   info.GetConstant(static_cast<int>(op.value), factor);
+        };
+        auto is_iv = [iv](const IR::Operand& op) {
+            return op.type == IR::OperandType::Register && op.value == iv;
+        };
+        
+        // One reduced register per distinct factor
+        std::unordered_map<int64_t, int> reduced;
+        std::vector<int64_t> factors;
+        
+        for (int b : loop.blocks) {
+            for (auto& instr : blocks[b]->GetInstructions()) {
+                if (instr.opcode != IR::OpCode::MUL) continue;
+                
+                int64_t factor = 0;
+                if (!(is_iv(instr.src1) && factor_of(instr.src2, factor)) &&
+                    !(is_iv(instr.src2) && factor_of(instr.src1, factor))) {
+                    continue;
+                }
+                
+                auto it = reduced.find(factor);
+                if (it == reduced.end()) {
+                    it = reduced.emplace(factor, func.AllocateRegister()).first;
+                    factors.push_back(factor);
+                }
+                
+                instr.opcode = IR::OpCode::MOV;
+                instr.src1 = IR::Operand::Register(it->second);
+                instr.src2 = IR::Operand();
+                instr.comment = "Strength-reduced induction multiply";
+                stats_.induction_variables_reduced++;
+            }
+        }
+        
+        // s = i * k before the loop, s += c * k alongside every step of i
+        auto& preheader = blocks[loop.preheader]->GetInstructions();
+        auto& update = update_block->GetInstructions();
+        for (int64_t factor : factors) {
+            IR::Operand reg = IR::Operand::Register(reduced[factor]);
+            
+            preheader.insert(preheader.begin() + PreheaderInsertPoint(*blocks[loop.preheader]),
+                             IR::Instruction(IR::OpCode::MUL, reg, IR::Operand::Register(iv),
+                                             IR::Operand::Immediate(factor)));
+            update.insert(update.begin() + update_index + 1,
+                          IR::Instruction(IR::OpCode::ADD, reg, reg,
+                                          IR::Operand::Immediate(loop.induction_step * factor)));
+        }
+    }
+    return stats_.induction_variables_reduced != before;
 }
 
 // ============================================================================
 // DODECAGRAM-SPECIFIC OPTIMIZATIONS
 // ============================================================================
 
-void CIAMOptimizer::OptimizeBase12Arithmetic(IR::Function& func) {
+// Dodecagram code divides by 12 and 144 all the time. The IR has no
+// multiply-high or shift, so the multiply-high sequences themselves are
+// chosen by the code generators for any DIV whose divisor is an immediate.
+// This pass makes sure they see one: divisors held in a register that was
+// just loaded with a constant become immediates, x/1 becomes a move, and
+// (x/a)/b becomes x/(a*b), which rounds the same way toward zero for
+// positive a and b, so a digit pair is one division by 144 instead of two
+// by 12. Everything is block-local and stops at labels.
+bool CIAMOptimizer::OptimizeBase12Arithmetic(IR::Function& func) {
+    int before = stats_.divisions_reduced;
+    
     for (const auto& block : func.GetBlocks()) {
-        auto& instructions = const_cast<std::vector<IR::Instruction>&>(block->GetInstructions());
+        auto& instructions = block->GetInstructions();
+        std::unordered_map<int64_t, int64_t> constants;            // Register -> value
+        std::unordered_map<int64_t, std::pair<int64_t, int64_t>> quotients; // q -> (x, divisor) for q = x / divisor
         
         for (auto& instr : instructions) {
-    // Optimize division by 12 -> shift and subtract
-     // Optimize multiplication by powers of 12
-  if (instr.opcode == IR::OpCode::DIV &&
-      IsConstant(instr.src2) && GetConstantValue(instr.src2) == 12) {
-      instr.comment = "Base-12 division optimization candidate";
-       }
-     }
+            if (instr.opcode == IR::OpCode::LABEL) {
+                constants.clear();
+                quotients.clear();
+                continue;
+            }
+            
+            if (instr.opcode == IR::OpCode::DIV) {
+                if (instr.src2.type == IR::OperandType::Register) {
+                    auto known = constants.find(instr.src2.value);
+                    if (known != constants.end() && known->second != 0) {
+                        instr.src2 = IR::Operand::Immediate(known->second);
+                        stats_.divisions_reduced++;
+                    }
+                }
+                
+                if (IsConstant(instr.src2) && instr.src1.type == IR::OperandType::Register) {
+                    int64_t divisor = GetConstantValue(instr.src2);
+                    auto inner = quotients.find(instr.src1.value);
+                    if (inner != quotients.end() && divisor > 0 &&
+                        inner->second.second <= INT64_MAX / divisor) {
+                        instr.src1 = IR::Operand::Register(static_cast<int>(inner->second.first));
+                        instr.src2 = IR::Operand::Immediate(inner->second.second * divisor);
+                        stats_.divisions_reduced++;
+                    }
+                }
+                
+                if (IsConstant(instr.src2) && GetConstantValue(instr.src2) == 1) {
+                    instr.opcode = IR::OpCode::MOV;
+                    instr.src2 = IR::Operand::Register(0);
+                    stats_.divisions_reduced++;
+                } else if (IsConstant(instr.src2) && X64::CanDivideWithoutIdiv(GetConstantValue(instr.src2))) {
+                    int64_t divisor = GetConstantValue(instr.src2);
+                    std::ostringstream note;
+                    note << "Division by " << divisor;
+                    uint64_t magnitude = divisor < 0 ? 0 - static_cast<uint64_t>(divisor)
+                                                     : static_cast<uint64_t>(divisor);
+                    if (X64::GetPowerOfTwoShift(magnitude) >= 0) {
+                        note << ": shift";
+                    } else {
+                        X64::SignedDivisionMagic magic = X64::ComputeSignedDivisionMagic(divisor);
+                        note << ": multiply-high by 0x" << std::hex
+                             << static_cast<uint64_t>(magic.multiplier) << std::dec
+                             << ", shift " << magic.shift;
+                    }
+                    instr.comment = note.str();
+                }
+            }
+            
+            // Forget whatever this instruction overwrites
+            int def = instr.GetDefinedRegister();
+            if (def >= 0) {
+                constants.erase(def);
+                quotients.erase(def);
+                for (auto it = quotients.begin(); it != quotients.end(); ) {
+                    if (it->second.first == def) {
+                        it = quotients.erase(it);
+                    } else {
+                        ++it;
+                    }
+                }
+                
+                if (instr.opcode == IR::OpCode::MOV && IsConstant(instr.src1)) {
+                    constants[def] = GetConstantValue(instr.src1);
+                } else if (instr.opcode == IR::OpCode::DIV && IsConstant(instr.src2) &&
+                           GetConstantValue(instr.src2) > 0 &&
+                           instr.src1.type == IR::OperandType::Register && instr.src1.value != def) {
+                    quotients[def] = std::make_pair(instr.src1.value, GetConstantValue(instr.src2));
+                }
+            }
+        }
     }
+    return stats_.divisions_reduced != before;
 }
 
-void CIAMOptimizer::OptimizeDozisecondOperations(IR::Function& func) {
+bool CIAMOptimizer::OptimizeDozisecondOperations(IR::Function& func) {
     // Optimize temporal operations (dozisecond timing)
     for (const auto& block : func.GetBlocks()) {
-        auto& instructions = const_cast<std::vector<IR::Instruction>&>(block->GetInstructions());
+        auto& instructions = block->GetInstructions();
         
         for (auto& instr : instructions) {
  if (instr.opcode == IR::OpCode::WAIT) {
@@ -708,6 +2067,7 @@ void CIAMOptimizer::OptimizeDozisecondOperations(IR::Function& func) {
             }
   }
     }
+    return false; // Annotations only
 }
 
 // ============================================================================
@@ -725,25 +2085,128 @@ int64_t CIAMOptimizer::GetConstantValue(const IR::Operand& op) const {
     return 0;
 }
 
-void CIAMOptimizer::BuildControlFlowGraph(IR::Function& func) {
-    // Build CFG for analysis
+void CIAMOptimizer::ComputeDefUseChains(IR::Function& func) {
+    // Build def-use chains for dataflow analysis
+}
+
+bool CIAMOptimizer::IsInnerLoop(const std::vector<IR::BasicBlock*>& loop) {
+    // Innermost: no nested loops
+    const IR::Loop* info = FindLoop(loop);
+    return info && info->children.empty();
 }
 
-void CIAMOptimizer::FindDominators(IR::Function& func) {
-  // Compute dominator tree
+namespace {
+
+// Times one analysis computation into 'timing'
+class AnalysisTimer {
+public:
+    explicit AnalysisTimer(double& seconds)
+        : seconds_(seconds), start_(std::chrono::steady_clock::now()) {}
+    ~AnalysisTimer() {
+        seconds_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    }
+
+private:
+    double& seconds_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+} // anonymous namespace
+
+const IR::ControlFlowGraph& CIAMOptimizer::GetCFG(IR::Function& func) {
+    AnalysisCache& cache = analyses_[&func];
+    PassTiming& timing = analysis_timings_[0];
+    timing.runs++;
+    if (!cache.cfg) {
+        AnalysisTimer timer(timing.seconds);
+        cache.cfg.reset(new IR::ControlFlowGraph(func));
+        timing.changes++;
+    }
+    return *cache.cfg;
 }
 
-void CIAMOptimizer::ComputeDefUseChains(IR::Function& func) {
-    // Build def-use chains for dataflow analysis
+const IR::DominatorTree& CIAMOptimizer::GetDominators(IR::Function& func) {
+    const IR::ControlFlowGraph& cfg = GetCFG(func);
+    AnalysisCache& cache = analyses_[&func];
+    PassTiming& timing = analysis_timings_[1];
+    timing.runs++;
+    if (!cache.dominators) {
+        AnalysisTimer timer(timing.seconds);
+        cache.dominators.reset(new IR::DominatorTree(cfg));
+        timing.changes++;
+    }
+    return *cache.dominators;
 }
 
-void CIAMOptimizer::ComputeLiveRanges(IR::Function& func) {
-    // Compute variable live ranges
+const IR::Liveness& CIAMOptimizer::GetLiveness(IR::Function& func) {
+    const IR::ControlFlowGraph& cfg = GetCFG(func);
+    AnalysisCache& cache = analyses_[&func];
+    PassTiming& timing = analysis_timings_[2];
+    timing.runs++;
+    if (!cache.liveness) {
+        AnalysisTimer timer(timing.seconds);
+        cache.liveness.reset(new IR::Liveness(func, cfg));
+        timing.changes++;
+    }
+    return *cache.liveness;
 }
 
-bool CIAMOptimizer::IsInnerLoop(const std::vector<IR::BasicBlock*>& loop) {
-    // Check if loop is innermost (no nested loops)
-    return true; // Simplified
+const IR::LoopInfo& CIAMOptimizer::GetLoopInfo(IR::Function& func) {
+    AnalysisCache& cache = analyses_[&func];
+    PassTiming& timing = analysis_timings_[3];
+    timing.runs++;
+    if (cache.loops) {
+        return *cache.loops;
+    }
+    
+    {
+        AnalysisTimer timer(timing.seconds);
+        
+        // Canonicalize first so every loop reports a preheader; new blocks
+        // make every other cached analysis of the function stale
+        if (IR::InsertLoopPreheaders(func) > 0) {
+            InvalidateAnalyses(func);
+        }
+        cache.loops.reset(new IR::LoopInfo(func));
+        timing.changes++;
+    }
+    
+    const IR::LoopInfo& info = *cache.loops;
+    if (info.GetLoopCount() > 0) {
+        int max_depth = 0;
+        int counted = 0;
+        for (const auto& loop : info.GetLoops()) {
+            max_depth = std::max(max_depth, loop.depth);
+            if (loop.trip_count > 0) counted++;
+        }
+        *log_ << "    Loop nest: " << info.GetLoopCount() << " loops, max depth "
+                  << max_depth << ", " << counted << " counted" << std::endl;
+    }
+    return info;
+}
+
+void CIAMOptimizer::InvalidateAnalyses(IR::Function& func, unsigned preserved) {
+    auto it = analyses_.find(&func);
+    if (it == analyses_.end()) return;
+    
+    // Dominators and liveness are derived from the cached CFG
+    AnalysisCache& cache = it->second;
+    if (!(preserved & kAnalysisCFG)) {
+        preserved &= ~(kAnalysisDominators | kAnalysisLiveness);
+        cache.cfg.reset();
+    }
+    if (!(preserved & kAnalysisDominators)) cache.dominators.reset();
+    if (!(preserved & kAnalysisLiveness)) cache.liveness.reset();
+    if (!(preserved & kAnalysisLoops)) cache.loops.reset();
+}
+
+const IR::Loop* CIAMOptimizer::FindLoop(const std::vector<IR::BasicBlock*>& loop) {
+    if (loop.empty() || !current_function_) return nullptr;
+    
+    const IR::LoopInfo& info = GetLoopInfo(*current_function_);
+    int header = info.GetCFG().GetBlockIndex(loop[0]->GetName());
+    int index = header >= 0 ? info.GetLoopWithHeader(header) : -1;
+    return index >= 0 ? &info.GetLoop(index) : nullptr;
 }
 
 void CIAMOptimizer::IncrementStat(const std::string& stat_name) {
@@ -1,6 +1,11 @@
 #pragma once
 
 #include "../IR/IR.h"
+#include "../IR/IRAnalysis.h"
+#include "../CodeGen/MachineModel.h"
+#include "../Common/ThreadPool.h"
+#include <memory>
+#include <ostream>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -15,17 +20,53 @@ struct OptimizationStats {
     int constants_folded = 0;
     int dead_code_removed = 0;
     int loops_unrolled = 0;
+    int loops_fully_unrolled = 0;
+    int unroll_size_delta = 0;      // Instructions added by unrolling
     int peephole_optimizations = 0;
     int tail_calls_optimized = 0;
-    int vectorized_loops = 0;
+    int tail_recursions_looped = 0; // Self-recursive tail calls turned into jumps
+    int vectorization_candidates = 0; // Counted only, not vectorized
     int bounds_checks_eliminated = 0;
     int branches_optimized = 0;
     int loops_fused = 0;
+    int invariants_hoisted = 0;
+    int induction_variables_reduced = 0;
+    int divisions_reduced = 0;      // Constant divisors exposed, combined or removed
+    int blocks_scheduled = 0;
+    int schedule_cycles_before = 0; // Estimated, summed over scheduled blocks
+    int schedule_cycles_after = 0;
+    int calls_inlined = 0;
+    int inline_size_delta = 0;      // Instructions added by inlining
     
     void Print() const;
     void Reset();
+    void Merge(const OptimizationStats& other); // Adds other's counts
 };
 
+// Estimated cycles for one block before and after instruction scheduling
+struct BlockScheduleEstimate {
+    std::string function;
+    std::string block;
+    int cycles_before;
+    int cycles_after;
+};
+
+// ============================================================================
+// ANALYSES
+// Per-function analyses the pass manager computes and caches, as bit masks
+// for the passes' declared requirements and preserved results
+// ============================================================================
+
+const unsigned kAnalysisCFG = 1u << 0;
+const unsigned kAnalysisDominators = 1u << 1;
+const unsigned kAnalysisLiveness = 1u << 2;
+const unsigned kAnalysisLoops = 1u << 3;
+const unsigned kAnalysisCount = 4;
+const unsigned kAllAnalyses = (1u << kAnalysisCount) - 1;
+
+// Instruction rewrites that leave blocks and branches alone
+const unsigned kPreservesControlFlow = kAnalysisCFG | kAnalysisDominators;
+
 // ============================================================================
 // PROFILE DATA
 // ============================================================================
@@ -34,6 +75,7 @@ struct ProfileData {
     std::unordered_map<std::string, int> block_execution_count;
     std::unordered_map<std::string, int> branch_taken_count;
  std::unordered_map<std::string, double> average_loop_iterations;
+    std::unordered_map<std::string, int> call_counts; // Calls per callee name
 };
 
 // ============================================================================
@@ -51,12 +93,25 @@ public:
     // Enable/disable specific optimizations
     void EnableOptimization(const std::string& name, bool enabled);
     void SetOptimizationLevel(int level); // 0=none, 1=basic, 2=aggressive, 3=maximum
+    void SetUnrollFactor(int factor);     // 0 = pick by optimization level
+    
+    // Cost model used by the instruction schedulers (default: Skylake)
+    void SetMicroArch(X64::MicroArch arch);
+    void SetMachineModel(const X64::MachineModel& model);
   
     // Profile-guided optimization
     void SetProfileData(const ProfileData& data);
     
+    // Print per-pass and per-analysis timings after optimizing
+    void SetVerbose(bool verbose) { verbose_ = verbose; }
+    
+    // Functions are optimized in parallel on this many threads (0 = one per
+    // hardware thread); the result does not depend on the count
+    void SetThreadCount(unsigned threads) { threads_ = threads; }
+    
     // Get statistics
     const OptimizationStats& GetStats() const { return stats_; }
+    const std::vector<BlockScheduleEstimate>& GetScheduleReport() const { return schedule_report_; }
     
 private:
     OptimizationStats stats_;
@@ -65,79 +120,165 @@ private:
   
     std::unordered_map<std::string, bool> optimization_flags_;
     
+    // Loop unrolling limits; the budget caps instructions in an unrolled loop
+    int unroll_factor_;
+    int unroll_budget_;
+    
+    // Largest callee (in instructions) inlined at a call site of unknown frequency
+    int inline_budget_;
+    
+    IR::Function* current_function_;
+    bool verbose_;
+    unsigned threads_;
+    std::ostream* log_;     // Per-function progress output
+    
+    // Function pipelines run on worker optimizers that copy this one's
+    // settings; their output and schedule report are kept per function and
+    // replayed in module order, their statistics and timings are summed
+    struct FunctionResult {
+        std::string log;
+        std::vector<BlockScheduleEstimate> schedule;
+    };
+    
+    void CopySettings(const CIAMOptimizer& other);
+    void OptimizeFunction(IR::Function& func, const std::vector<size_t>& pipeline, FunctionResult& result);
+    
+    // ========================================================================
+    // PASS MANAGER
+    // Passes run in a fixed order and declare the analyses they read and
+    // the ones that survive their changes. Analyses are computed on first
+    // use, cached per function and dropped only when a pass reports that it
+    // changed the function without preserving them.
+    // ========================================================================
+    
+    struct PassInfo {
+        const char* name;
+        const char* flag;     // Key in optimization_flags_, nullptr = always runs
+        bool (CIAMOptimizer::*run)(IR::Function& func); // Returns true on change
+        unsigned required;    // Computed before the pass runs
+        unsigned preserved;   // Still valid after the pass changes the function
+    };
+    
+    struct PassTiming {
+        double seconds = 0;
+        int runs = 0;
+        int changes = 0;
+    };
+    
+    struct AnalysisCache {
+        std::unique_ptr<IR::ControlFlowGraph> cfg;
+        std::unique_ptr<IR::DominatorTree> dominators;
+        std::unique_ptr<IR::Liveness> liveness;     // Refers to cfg
+        std::unique_ptr<IR::LoopInfo> loops;        // Has its own CFG and dominators
+    };
+    
+    std::unordered_map<const IR::Function*, AnalysisCache> analyses_;
+    std::vector<PassTiming> pass_timings_;          // Parallel to GetPasses()
+    PassTiming analysis_timings_[kAnalysisCount];
+    
+    static const std::vector<PassInfo>& GetPasses();
+    void RunPasses(IR::Function& func, const std::vector<size_t>& pipeline);
+    void PrintTimings() const;
+    
+    // Cached analyses; building one is timed against the analysis, not the pass
+    const IR::ControlFlowGraph& GetCFG(IR::Function& func);
+    const IR::DominatorTree& GetDominators(IR::Function& func);
+    const IR::Liveness& GetLiveness(IR::Function& func);
+    const IR::LoopInfo& GetLoopInfo(IR::Function& func);
+    void InvalidateAnalyses(IR::Function& func, unsigned preserved = 0);
+    
+    // Instruction scheduling cost model and per-block cycle estimates
+    X64::MachineModel machine_model_;
+    std::vector<BlockScheduleEstimate> schedule_report_;
+    std::unordered_map<const IR::BasicBlock*, size_t> schedule_index_;
+    
     // ========================================================================
     // OPTIMIZATION PASSES
     // ========================================================================
     
     // 1. Constant Folding
-    void ConstantFolding(IR::Function& func);
+    bool ConstantFolding(IR::Function& func);
     void FoldConstantExpression(IR::Instruction& instr);
     
     // 2. Dead Code Elimination
-    void DeadCodeElimination(IR::Function& func);
+    bool DeadCodeElimination(IR::Function& func);
     void MarkLiveInstructions(IR::Function& func, std::unordered_set<IR::Instruction*>& live);
     void RemoveDeadCode(IR::Function& func, const std::unordered_set<IR::Instruction*>& live);
   
     // 3. Loop Unrolling
-  void LoopUnrolling(IR::Function& func);
+  bool LoopUnrolling(IR::Function& func);
     bool DetectLoop(IR::BasicBlock* block, std::vector<IR::BasicBlock*>& loop_blocks);
-    void UnrollLoop(std::vector<IR::BasicBlock*>& loop_blocks, int factor);
+    bool UnrollLoop(std::vector<IR::BasicBlock*>& loop_blocks, int factor);
  
     // 4. Peephole Optimization
-    void PeepholeOptimization(IR::Function& func);
+    bool PeepholeOptimization(IR::Function& func);
     bool OptimizeInstructionPair(IR::Instruction& i1, IR::Instruction& i2);
     bool OptimizeRedundantMoves(IR::Instruction& instr);
     bool OptimizeAlgebraicIdentities(IR::Instruction& instr);
     
     // 5. Tail Call Optimization
-    void TailCallOptimization(IR::Function& func);
-    bool IsTailCall(const IR::Instruction& call_instr, const IR::BasicBlock& block);
-    void ConvertToTailCall(IR::Instruction& call_instr);
+    bool TailCallOptimization(IR::Function& func);
+    bool IsTailCall(const IR::BasicBlock& block, size_t call_index) const;
+    void ConvertToTailCall(IR::BasicBlock& block, size_t call_index);
+    void ConvertTailRecursion(IR::Function& func, IR::BasicBlock& block, size_t call_index,
+                              const std::string& loop_header);
     
     // 6. Vectorization (SIMD/AVX)
-    void Vectorization(IR::Function& func);
+    bool Vectorization(IR::Function& func);
     bool IsVectorizableLoop(const std::vector<IR::BasicBlock*>& loop);
     void VectorizeLoop(std::vector<IR::BasicBlock*>& loop);
     
     // 7. Look-Ahead Optimization
-    void LookAheadOptimization(IR::Function& func);
-    void ReorderInstructionsForLatency(IR::BasicBlock& block);
+    bool LookAheadOptimization(IR::Function& func);
+    bool ReorderInstructionsForLatency(IR::BasicBlock& block);
+    bool ScheduleBlock(IR::BasicBlock& block, bool model_resources);
+    void PrintScheduleReport(size_t first) const;
     
     // 8. Bounds Check Elimination
-    void BoundsCheckElimination(IR::Function& func);
+    bool BoundsCheckElimination(IR::Function& func);
     void AnalyzeArrayAccess(IR::Function& func);
     bool CanEliminateBoundsCheck(const IR::Instruction& check);
     
     // 9. Branch Chain Optimization
-    void BranchChainOptimization(IR::Function& func);
+    bool BranchChainOptimization(IR::Function& func);
     void SimplifyBranchChains(IR::BasicBlock& block);
     void EliminateRedundantBranches(IR::BasicBlock& block);
     
     // 10. Curling (Loop Fusion)
-    void LoopFusion(IR::Function& func);
+    bool LoopFusion(IR::Function& func);
     bool CanFuseLoops(const std::vector<IR::BasicBlock*>& loop1,
       const std::vector<IR::BasicBlock*>& loop2);
  void FuseLoops(std::vector<IR::BasicBlock*>& loop1,
                std::vector<IR::BasicBlock*>& loop2);
     
     // 11. Synchronized Scheduling
-    void SynchronizedScheduling(IR::Function& func);
- void ScheduleForPipeline(IR::BasicBlock& block);
+    bool SynchronizedScheduling(IR::Function& func);
+ bool ScheduleForPipeline(IR::BasicBlock& block);
     
     // 12. Footprint Compression
-    void FootprintCompression(IR::Function& func);
+    bool FootprintCompression(IR::Function& func);
     void CompressRegisterUsage(IR::Function& func);
  void MinimizeStackFrame(IR::Function& func);
     
   // 13. Adaptive Tuning
-    void AdaptiveTuning(IR::Function& func);
+    bool AdaptiveTuning(IR::Function& func);
     void TuneForCacheLocality(IR::Function& func);
     void OptimizeForBranchPrediction(IR::Function& func);
     
     // 14. Profile-Guided Optimization
-    void ProfileGuidedOptimization(IR::Function& func);
+    bool ProfileGuidedOptimization(IR::Function& func);
     void ReorderBlocksForHotPath(IR::Function& func);
     void InlineHotFunctions(IR::Module& module);
+    size_t InlineCallSite(IR::Function& caller, size_t block_index, size_t call_index,
+                          const IR::Function& callee, int site);
+    
+    // 15. Loop-Invariant Code Motion
+    bool LoopInvariantCodeMotion(IR::Function& func);
+    bool IsHoistable(const IR::Instruction& instr, bool loop_writes_memory);
+    size_t PreheaderInsertPoint(const IR::BasicBlock& preheader) const;
+    
+    // 16. Induction Variable Strength Reduction
+    bool InductionVariableStrengthReduction(IR::Function& func);
     
     // ========================================================================
     // HELPER METHODS
@@ -149,27 +290,25 @@ private:
     bool TryEvaluateConstant(IR::OpCode op, int64_t a, int64_t b, int64_t& result);
 
     // Control flow analysis
-    void BuildControlFlowGraph(IR::Function& func);
-    void FindDominators(IR::Function& func);
     bool IsBackEdge(IR::BasicBlock* from, IR::BasicBlock* to);
   
     // Data flow analysis
     void ComputeDefUseChains(IR::Function& func);
-    void ComputeLiveRanges(IR::Function& func);
     bool HasSideEffects(const IR::Instruction& instr);
     
-    // Loop analysis
+    // Loop analysis (loops are passed around as block lists, header first)
+    const IR::Loop* FindLoop(const std::vector<IR::BasicBlock*>& loop);
     void DetectLoops(IR::Function& func, std::vector<std::vector<IR::BasicBlock*>>& loops);
   int EstimateLoopIterations(const std::vector<IR::BasicBlock*>& loop);
     bool IsInnerLoop(const std::vector<IR::BasicBlock*>& loop);
     
     // Register allocation
     void RegisterCoalescing(IR::Function& func);
-    void RemoveRedundantMoves(IR::Function& func);
+    bool RemoveRedundantMoves(IR::Function& func);
     
     // Dodecagram-specific optimizations
-    void OptimizeBase12Arithmetic(IR::Function& func);
-    void OptimizeDozisecondOperations(IR::Function& func);
+    bool OptimizeBase12Arithmetic(IR::Function& func);
+    bool OptimizeDozisecondOperations(IR::Function& func);
     
     // Statistics tracking
     void IncrementStat(const std::string& stat_name);
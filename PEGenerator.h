@@ -1,7 +1,9 @@
 #pragma once
 
+#include "../SSA/SSA.h"
 #include <string>
 #include <vector>
+#include <unordered_map>
 #include <cstdint>
 #include <fstream>
 #include <memory>
@@ -242,8 +244,42 @@ private:
 
 // ============================================================================
 // MACHINE CODE EMITTER
+// Registers use hardware numbering: RAX = 0 ... R15 = 15, XMM0 ... XMM15.
+// Packed ops work on 64-bit lanes, two per xmm register with SSE2 encodings
+// or four per ymm register with VEX-encoded AVX2. XMM14 and XMM15 are
+// scratch for the multiply, subtract and reduction sequences.
 // ============================================================================
 
+// Condition codes as encoded in the low nibble of jcc (0F 80+cc)
+enum class Condition : uint8_t {
+    E = 0x4, NE = 0x5, L = 0xC, GE = 0xD, LE = 0xE, G = 0xF
+};
+
+// [base + index*scale + offset]. Without a base or an index it is the
+// absolute address [offset]; rsp cannot be an index.
+struct Address {
+    int base = -1;
+    int index = -1;
+    int scale = 1;          // 1, 2, 4 or 8
+    int32_t offset = 0;
+
+    Address() {}
+    Address(int base_reg, int32_t disp) : base(base_reg), offset(disp) {}
+    Address(int base_reg, int index_reg, int index_scale, int32_t disp)
+        : base(base_reg), index(index_reg), scale(index_scale), offset(disp) {}
+};
+
+// Integer ALU operations by their /digit in the 81/83 immediate group; the
+// register and memory forms are opcodes digit*8+1 (r/m, reg) and +3 (reg, r/m)
+enum class AluOp : uint8_t {
+    Add = 0, Or = 1, And = 4, Sub = 5, Xor = 6, Cmp = 7
+};
+
+// Shifts by their /digit in the C1/D1 group
+enum class ShiftOp : uint8_t {
+    Shl = 4, Shr = 5, Sar = 7
+};
+
 class MachineCodeEmitter {
 public:
     MachineCodeEmitter();
@@ -257,33 +293,175 @@ public:
     void EmitSub(std::vector<uint8_t>& code, int dst_reg, int src_reg);
     void EmitMul(std::vector<uint8_t>& code, int dst_reg, int src_reg);
     void EmitDiv(std::vector<uint8_t>& code, int reg);
+    void EmitMulHigh(std::vector<uint8_t>& code, int reg, bool is_signed);
+    void EmitNeg(std::vector<uint8_t>& code, int reg);
+    void EmitShiftImm(std::vector<uint8_t>& code, ShiftOp op, int reg, int count);
+    
+    // rax = rax / divisor for a constant divisor, as a multiply-high and
+    // shifts instead of idiv/div (see DivisionMagic.h). Clobbers rdx and
+    // scratch_reg. A divisor of 0, or INT64_MIN when signed, still divides.
+    void EmitDivImm(std::vector<uint8_t>& code, int64_t divisor, int scratch_reg);
+    void EmitUnsignedDivImm(std::vector<uint8_t>& code, uint64_t divisor, int scratch_reg);
+    void EmitAlu(std::vector<uint8_t>& code, AluOp op, int dst_reg, int src_reg);
+    void EmitAluImm(std::vector<uint8_t>& code, AluOp op, int reg, int32_t immediate);
+    void EmitMulImm(std::vector<uint8_t>& code, int dst_reg, int src_reg, int32_t immediate);
+    void EmitMulImm(std::vector<uint8_t>& code, int dst_reg, const Address& src, int32_t immediate);
     
     // Move
  void EmitMov(std::vector<uint8_t>& code, int dst_reg, int src_reg);
     void EmitMovImm(std::vector<uint8_t>& code, int reg, int64_t immediate);
-    
-    // Memory
+    void EmitMovImm64(std::vector<uint8_t>& code, int reg, int64_t immediate); // Always movabs, for patching
+    void EmitAddImm(std::vector<uint8_t>& code, int reg, int32_t immediate);
+    void EmitCmp(std::vector<uint8_t>& code, int reg1, int reg2);
+    // reg = 1 if the flags satisfy condition, else 0 (setcc + movzx)
+    void EmitSetcc(std::vector<uint8_t>& code, Condition condition, int reg);
+    void EmitPush(std::vector<uint8_t>& code, int reg);
+    void EmitPop(std::vector<uint8_t>& code, int reg);
+    
+    // Memory. A negative base_reg addresses the absolute [offset] instead.
     void EmitLoad(std::vector<uint8_t>& code, int dst_reg, int base_reg, int32_t offset);
     void EmitStore(std::vector<uint8_t>& code, int base_reg, int32_t offset, int src_reg);
-    
-    // Control flow
+    void EmitLea(std::vector<uint8_t>& code, int dst_reg, int base_reg, int32_t offset);
+    void EmitLoad(std::vector<uint8_t>& code, int dst_reg, const Address& src);
+    void EmitStore(std::vector<uint8_t>& code, const Address& dst, int src_reg);
+    void EmitStoreImm(std::vector<uint8_t>& code, const Address& dst, int32_t immediate);
+    void EmitLea(std::vector<uint8_t>& code, int dst_reg, const Address& src);
+    void EmitAluLoad(std::vector<uint8_t>& code, AluOp op, int dst_reg, const Address& src);
+    void EmitAluStore(std::vector<uint8_t>& code, AluOp op, const Address& dst, int src_reg);
+    void EmitAluMemoryImm(std::vector<uint8_t>& code, AluOp op, const Address& dst, int32_t immediate);
+    void EmitMulLoad(std::vector<uint8_t>& code, int dst_reg, const Address& src);
+    void EmitDivMemory(std::vector<uint8_t>& code, const Address& divisor);
+    // locality as in __builtin_prefetch: 3 = prefetcht0 ... 0 = prefetchnta
+    void EmitPrefetch(std::vector<uint8_t>& code, int base_reg, int32_t offset, int locality);
+    void EmitPrefetch(std::vector<uint8_t>& code, const Address& address, int locality);
+    
+    // Control flow. Offsets are rel32, measured from the end of the
+    // instruction, and always the last four bytes emitted so they can be
+    // patched once the target is known.
     void EmitCall(std::vector<uint8_t>& code, int32_t offset);
     void EmitRet(std::vector<uint8_t>& code);
     void EmitJmp(std::vector<uint8_t>& code, int32_t offset);
     void EmitJe(std::vector<uint8_t>& code, int32_t offset);
     void EmitJne(std::vector<uint8_t>& code, int32_t offset);
+    void EmitJcc(std::vector<uint8_t>& code, Condition condition, int32_t offset);
+    void EmitCallIndirect(std::vector<uint8_t>& code, int reg);
+    
+    // Short forms: rel8, the last byte emitted
+    void EmitJmp8(std::vector<uint8_t>& code, int8_t offset);
+    void EmitJcc8(std::vector<uint8_t>& code, Condition condition, int8_t offset);
+    
+    // Recommended multi-byte NOP forms, at most 9 bytes per instruction
+    void EmitNop(std::vector<uint8_t>& code, size_t length = 1);
     
-    // SIMD instructions
+    // SIMD instructions: 2 lanes = SSE2, 4 lanes = AVX2
+    void SetVectorWidth(int lanes) { vector_width_ = lanes; }
+    int GetVectorWidth() const { return vector_width_; }
+    
+    void EmitVectorLoad(std::vector<uint8_t>& code, int dst_xmm, int base_reg, int32_t offset);
+    void EmitVectorStore(std::vector<uint8_t>& code, int base_reg, int32_t offset, int src_xmm);
     void EmitVectorAdd(std::vector<uint8_t>& code, int dst_xmm, int src1_xmm, int src2_xmm);
+    void EmitVectorSub(std::vector<uint8_t>& code, int dst_xmm, int src1_xmm, int src2_xmm);
     void EmitVectorMul(std::vector<uint8_t>& code, int dst_xmm, int src1_xmm, int src2_xmm);
+    void EmitVectorBroadcast(std::vector<uint8_t>& code, int dst_xmm, int src_reg);
+    void EmitVectorBuild(std::vector<uint8_t>& code, int dst_xmm, const std::vector<int>& src_regs);
+    void EmitVectorReduceAdd(std::vector<uint8_t>& code, int dst_reg, int src_xmm);
+    
+    // Clears upper ymm state; emit before calls and returns after AVX2 code
+    void EmitVZeroUpper(std::vector<uint8_t>& code);
     
     // Helper: get register encoding
     static uint8_t GetRegisterEncoding(int reg);
 
 private:
+    int vector_width_;
+    
     void EmitREX(std::vector<uint8_t>& code, bool w, bool r, bool x, bool b);
     void EmitModRM(std::vector<uint8_t>& code, uint8_t mod, uint8_t reg, uint8_t rm);
     void EmitSIB(std::vector<uint8_t>& code, uint8_t scale, uint8_t index, uint8_t base);
+    
+    // ModRM/SIB/displacement for a memory operand, shortest displacement
+    void EmitMemoryOperand(std::vector<uint8_t>& code, int reg, int base_reg, int32_t offset);
+    void EmitMemoryOperand(std::vector<uint8_t>& code, int reg, const Address& address);
+    
+    // REX.W prefix for an instruction with a register and a memory operand
+    void EmitREX(std::vector<uint8_t>& code, int reg, const Address& address);
+    
+    // prefix: 0, 0x66, 0xF3 or 0xF2; map: 1 = 0F, 2 = 0F38, 3 = 0F3A
+    void EmitVEX(std::vector<uint8_t>& code, bool r, bool x, bool b, int map,
+                 bool w, int vvvv, bool l, uint8_t prefix);
+    
+    // Register-to-register SIMD op: legacy SSE encoding in 2-lane mode (vvvv
+    // unused), VEX in 4-lane mode with 'l' selecting ymm
+    void EmitSIMD(std::vector<uint8_t>& code, uint8_t prefix, int map, uint8_t opcode,
+                  int reg, int vvvv, int rm, bool w, bool l);
+};
+
+// ============================================================================
+// BRANCH RELAXATION
+// Lays out one function's code with the shortest branch encodings. While
+// the code is generated, labels and branches are recorded at their
+// position in the byte stream instead of being encoded. Relax() then starts
+// with every branch in its 2-byte rel8 form, widens those whose target is
+// out of range to rel32 and repeats until nothing changes. Branches only
+// ever grow, so this terminates. Loop headers (targets of a branch placed
+// after them) are padded with multi-byte NOPs to the loop alignment,
+// counted from the start of the section.
+// ============================================================================
+
+class BranchRelaxer {
+public:
+    BranchRelaxer();
+
+    // Power of two; 0 or 1 disables loop alignment (default 16)
+    void SetLoopAlignment(int bytes) { loop_alignment_ = bytes; }
+    int GetLoopAlignment() const { return loop_alignment_; }
+
+    // Record at 'position' in the unrelaxed code, in emission order
+    void Reset();
+    void AddLabel(const std::string& label, size_t position);
+    void AddBranch(size_t position, const std::string& label);
+    void AddBranch(size_t position, Condition condition, const std::string& label);
+
+    // Rewrites code[start..] with branches encoded and loop padding
+    // inserted; false if a branch targets an undefined label
+    bool Relax(std::vector<uint8_t>& code, size_t start, MachineCodeEmitter& emitter);
+
+    // Where a byte of the unrelaxed code ended up
+    size_t MapPosition(size_t position) const;
+
+    struct Stats {
+        size_t short_branches = 0;
+        size_t long_branches = 0;
+        size_t padding = 0;         // NOP bytes before loop headers
+        size_t near_size = 0;       // Size with every branch rel32 and no padding
+        int iterations = 0;
+    };
+    const Stats& GetStats() const { return stats_; }
+    const std::string& GetError() const { return error_; }
+
+private:
+    struct Event {
+        enum class Kind { Label, Branch, Align };
+        Kind kind;
+        size_t position;            // In the unrelaxed code
+        int label;                  // Label index (Label, Branch)
+        bool conditional;
+        Condition condition;
+        bool is_long;
+        size_t size;                // Bytes inserted at 'position'
+        size_t address;             // Position after layout
+    };
+
+    int loop_alignment_;
+    std::vector<Event> events_;
+    std::vector<std::string> label_names_;
+    std::unordered_map<std::string, int> label_index_;
+    std::vector<int> label_events_;  // Label index -> its event, -1 if undefined
+    Stats stats_;
+    std::string error_;
+
+    int GetLabel(const std::string& label);
+    void Layout();
 };
 
 // ============================================================================
@@ -0,0 +1,396 @@
+#include "AdvancedOptimizer.h"
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace Snow {
+namespace AdvancedOptimization {
+
+using SSA::SSAValue;
+using SSA::SSAInstruction;
+using SSA::SSABasicBlock;
+using SSA::SSAFunction;
+using OpCode = SSAInstruction::OpCode;
+
+namespace {
+
+// base + sum(coef[k] * iv_k) + offset over the loop's induction phis
+struct AffineAddress {
+    SSAValue* base = nullptr;
+    std::vector<int64_t> coef;
+    int64_t offset = 0;
+};
+
+const int kLocalityAll = 3;    // prefetcht0
+const int kLocalityNone = 0;   // prefetchnta
+
+// Fetching further ahead than this mostly evicts lines that are still needed
+const int kMaxDistance = 64;
+const int64_t kMaxDistanceBytes = 4096;
+
+bool IsConstant(const SSAValue* value) {
+    return value->GetKind() == SSAValue::Kind::Constant;
+}
+
+// Operand index of the address, -1 for instructions that do not access memory
+int AddressOperand(const SSAInstruction& instr) {
+    switch (instr.GetOpCode()) {
+        case OpCode::Load:
+        case OpCode::VectorLoad:
+            return 0;
+        case OpCode::Store:
+        case OpCode::VectorStore:
+            return 1;
+        default:
+            return -1;
+    }
+}
+
+} // anonymous namespace
+
+struct PrefetchInserter::LoopStreams {
+    struct Induction {
+        SSAValue* value;
+        int64_t step;
+    };
+
+    struct Access {
+        size_t index;                        // Position in the body
+        SSAInstruction* instr;
+        bool is_write;
+        AffineAddress address;
+    };
+
+    struct Stream {
+        SSAValue* base;
+        std::vector<int64_t> coef;
+        int64_t stride = 0;                  // Bytes per iteration
+        bool written = false;
+        std::vector<const Access*> accesses; // Ascending offset
+    };
+
+    SSABasicBlock* header = nullptr;
+    SSABasicBlock* body = nullptr;
+    std::vector<Induction> inductions;
+    int64_t trip = -1;                       // Known only for constant bounds
+    std::vector<Access> accesses;
+    std::vector<Stream> streams;
+};
+
+PrefetchInserter::PrefetchInserter() {
+}
+
+void PrefetchInserter::SetMicroArch(X64::MicroArch arch) {
+    scheduler_.SetMicroArch(arch);
+}
+
+// ============================================================================
+// STREAM DETECTION
+//
+//   header:  i = phi [s, i.next]  (more phis)  condbr c, body, exit
+//   body:    ... i.next = add i, step  br header
+//
+// Every header phi advanced by a constant in the body is an induction;
+// addresses are affine in the inductions over a loop-invariant base.
+// ============================================================================
+
+bool PrefetchInserter::AnalyzeLoop(const AdvancedOptimizer::Loop& loop, LoopStreams& streams) {
+    if (loop.blocks.size() != 2) return false;
+    SSABasicBlock* header = loop.header;
+    SSABasicBlock* body = loop.blocks[0] == header ? loop.blocks[1] : loop.blocks[0];
+
+    const auto& header_preds = header->GetPredecessors();
+    if (header_preds.size() != 2) return false;
+    size_t latch_edge = header_preds[0] == body ? 0 : 1;
+    if (header_preds[latch_edge] != body || header->GetSuccessors().size() != 2) return false;
+    if (body->GetPredecessors().size() != 1 || body->GetSuccessors().size() != 1 ||
+        body->GetSuccessors()[0] != header) {
+        return false;
+    }
+
+    // Calls make the body's timing unknowable; existing prefetches mean the
+    // loop was handled already
+    const auto& body_instrs = body->GetInstructions();
+    if (body_instrs.empty() || body_instrs.back()->GetOpCode() != OpCode::Br) return false;
+    std::unordered_map<SSAValue*, SSAInstruction*> defs;
+    for (const auto& instr : body_instrs) {
+        if (instr->GetOpCode() == OpCode::Call || instr->GetOpCode() == OpCode::Prefetch) return false;
+        if (instr->GetResult()) defs[instr->GetResult()] = instr.get();
+    }
+
+    std::unordered_map<SSAValue*, size_t> induction_index;
+    std::unordered_set<SSAValue*> header_values;
+    for (const auto& instr : header->GetInstructions()) {
+        if (instr->GetResult()) header_values.insert(instr->GetResult());
+        if (instr->GetOpCode() != OpCode::Phi || instr->GetOperands().size() != 2) continue;
+
+        auto update = defs.find(instr->GetOperands()[latch_edge]);
+        if (update == defs.end() || update->second->GetOpCode() != OpCode::Add ||
+            update->second->GetVectorWidth() > 1) {
+            continue;
+        }
+        const auto& ops = update->second->GetOperands();
+        SSAValue* step = ops[0] == instr->GetResult() ? ops[1] : ops[1] == instr->GetResult() ? ops[0] : nullptr;
+        if (!step || !IsConstant(step) || step->GetConstantValue() == 0) continue;
+
+        induction_index[instr->GetResult()] = streams.inductions.size();
+        streams.inductions.push_back({ instr->GetResult(), step->GetConstantValue() });
+
+        // 'lt iv, limit' with constant bounds gives the trip count
+        for (const auto& other : header->GetInstructions()) {
+            if (other->GetOpCode() != OpCode::Lt || other->GetOperands()[0] != instr->GetResult()) continue;
+            SSAValue* start = instr->GetOperands()[1 - latch_edge];
+            SSAValue* limit = other->GetOperands()[1];
+            int64_t step_value = step->GetConstantValue();
+            if (step_value > 0 && IsConstant(start) && IsConstant(limit)) {
+                int64_t span = limit->GetConstantValue() - start->GetConstantValue();
+                streams.trip = span <= 0 ? 0 : (span + step_value - 1) / step_value;
+            }
+        }
+    }
+    if (streams.inductions.empty()) return false;
+    size_t width = streams.inductions.size();
+
+    std::function<bool(SSAValue*, AffineAddress&, int)> affine =
+        [&](SSAValue* value, AffineAddress& out, int depth) {
+        out = AffineAddress();
+        out.coef.assign(width, 0);
+        if (IsConstant(value)) {
+            out.offset = value->GetConstantValue();
+            return true;
+        }
+        auto iv = induction_index.find(value);
+        if (iv != induction_index.end()) {
+            out.coef[iv->second] = 1;
+            return true;
+        }
+        if (header_values.count(value)) return false;
+        auto def = defs.find(value);
+        if (def == defs.end()) {
+            out.base = value;
+            return true;
+        }
+
+        SSAInstruction* instr = def->second;
+        if (depth > 8 || instr->GetVectorWidth() > 1 || instr->GetOperands().size() != 2) return false;
+        AffineAddress a, b;
+        if (!affine(instr->GetOperands()[0], a, depth + 1) || !affine(instr->GetOperands()[1], b, depth + 1)) {
+            return false;
+        }
+        auto is_constant = [](const AffineAddress& x) {
+            return !x.base && std::all_of(x.coef.begin(), x.coef.end(), [](int64_t c) { return c == 0; });
+        };
+        switch (instr->GetOpCode()) {
+            case OpCode::Add:
+            case OpCode::Sub: {
+                int64_t sign = instr->GetOpCode() == OpCode::Add ? 1 : -1;
+                if (b.base && (a.base || sign < 0)) return false;
+                out.base = a.base ? a.base : b.base;
+                for (size_t k = 0; k < width; ++k) out.coef[k] = a.coef[k] + sign * b.coef[k];
+                out.offset = a.offset + sign * b.offset;
+                return true;
+            }
+            case OpCode::Mul: {
+                if (!is_constant(a) && !is_constant(b)) return false;
+                const AffineAddress& x = is_constant(a) ? b : a;
+                int64_t k = is_constant(a) ? a.offset : b.offset;
+                if (x.base && k != 1) return false;
+                out.base = x.base;
+                for (size_t l = 0; l < width; ++l) out.coef[l] = x.coef[l] * k;
+                out.offset = x.offset * k;
+                return true;
+            }
+            default:
+                return false;
+        }
+    };
+
+    for (size_t k = 0; k + 1 < body_instrs.size(); ++k) {
+        SSAInstruction* instr = body_instrs[k].get();
+        int operand = AddressOperand(*instr);
+        if (operand < 0) continue;
+        LoopStreams::Access access = { k, instr, operand == 1, AffineAddress() };
+        if (!affine(instr->GetOperands()[operand], access.address, 0)) continue;
+        streams.accesses.push_back(access);
+    }
+
+    // One stream per (base, coefficients); invariant addresses stay cached
+    for (const auto& access : streams.accesses) {
+        int64_t stride = 0;
+        for (size_t k = 0; k < width; ++k) stride += access.address.coef[k] * streams.inductions[k].step;
+        if (stride == 0) continue;
+
+        LoopStreams::Stream* stream = nullptr;
+        for (auto& candidate : streams.streams) {
+            if (candidate.base == access.address.base && candidate.coef == access.address.coef) {
+                stream = &candidate;
+            }
+        }
+        if (!stream) {
+            streams.streams.push_back(LoopStreams::Stream());
+            stream = &streams.streams.back();
+            stream->base = access.address.base;
+            stream->coef = access.address.coef;
+            stream->stride = stride;
+        }
+        stream->written |= access.is_write;
+        stream->accesses.push_back(&access);
+    }
+    for (auto& stream : streams.streams) {
+        std::stable_sort(stream.accesses.begin(), stream.accesses.end(),
+                         [](const LoopStreams::Access* a, const LoopStreams::Access* b) {
+                             return a->address.offset < b->address.offset;
+                         });
+    }
+
+    streams.header = header;
+    streams.body = body;
+    return !streams.streams.empty();
+}
+
+// ============================================================================
+// INSERTION
+// Each stream gets 'p = add addr, distance * stride; prefetch p' in front of
+// the first access of every line it touches per iteration. Stalls count
+// the new lines each iteration touches at the full memory latency, minus
+// the cycles the prefetch distance puts between the fetch and the use.
+// ============================================================================
+
+bool PrefetchInserter::PrefetchLoop(SSAFunction& func, LoopStreams& streams) {
+    SSABasicBlock* body = streams.body;
+    const int line = cache_.line_size;
+    const int latency = scheduler_.GetMachineModel().memory_latency;
+    int cycles_before = std::max(1, scheduler_.EstimateCycles(*body));
+
+    int distance = std::min(kMaxDistance, (latency + cycles_before - 1) / cycles_before);
+    if (streams.trip >= 0 && streams.trip <= distance) return false;
+
+    // Unbounded or larger than L2: streaming data would only evict the working set
+    bool streaming = streams.trip < 0;
+    if (!streaming) {
+        int64_t footprint = 0;
+        for (const auto& stream : streams.streams) footprint += streams.trip * std::abs(stream.stride);
+        streaming = footprint > static_cast<int64_t>(cache_.l2_kb) * 1024;
+    }
+
+    struct Point {
+        const LoopStreams::Access* access;
+        int64_t displacement;
+        int locality;
+    };
+    std::vector<Point> points;
+    std::vector<int> stream_distance;
+    std::vector<double> lines;
+    int nontemporal = 0;
+
+    for (const auto& stream : streams.streams) {
+        int64_t stride = std::abs(stream.stride);
+        int ahead = static_cast<int>(std::max<int64_t>(1, std::min<int64_t>(distance, kMaxDistanceBytes / stride)));
+        int locality = streaming && !stream.written ? kLocalityNone : kLocalityAll;
+
+        int chunks = 0;
+        int64_t chunk_start = 0;
+        for (const LoopStreams::Access* access : stream.accesses) {
+            if (chunks && access->address.offset < chunk_start + line) continue;
+            chunk_start = access->address.offset;
+            chunks++;
+            points.push_back({ access, ahead * stream.stride, locality });
+            if (locality == kLocalityNone) nontemporal++;
+        }
+        stream_distance.push_back(ahead);
+        lines.push_back(std::min(static_cast<double>(stride) / line, static_cast<double>(chunks)));
+    }
+
+    // Back to front so the recorded positions stay valid
+    std::sort(points.begin(), points.end(), [](const Point& a, const Point& b) {
+        return a.access->index > b.access->index;
+    });
+    std::vector<SSAInstruction*> inserted;
+    for (const Point& point : points) {
+        SSAInstruction* access = point.access->instr;
+        SSAValue* address = access->GetOperands()[point.access->is_write ? 1 : 0];
+
+        auto prefetch = std::make_unique<SSAInstruction>(OpCode::Prefetch);
+        auto advance = std::make_unique<SSAInstruction>(OpCode::Add);
+        SSAValue* target = func.CreateValue(SSAValue::Kind::Register);
+        advance->AddOperand(address);
+        advance->AddOperand(func.CreateConstant(point.displacement));
+        advance->SetResult(target);
+        prefetch->AddOperand(target);
+        prefetch->AddOperand(func.CreateConstant(point.locality));
+        inserted.push_back(advance.get());
+        inserted.push_back(prefetch.get());
+
+        body->InsertInstruction(point.access->index, std::move(prefetch));
+        body->InsertInstruction(point.access->index, std::move(advance));
+    }
+
+    int cycles_after = std::max(1, scheduler_.EstimateCycles(*body));
+    LoopReport report = { streams.header->GetName(), static_cast<int>(streams.streams.size()), distance,
+                          cycles_before, cycles_after, 0.0, 0.0 };
+    for (size_t s = 0; s < streams.streams.size(); ++s) {
+        int hidden = stream_distance[s] * cycles_after;
+        report.stalls_before += lines[s] * latency;
+        report.stalls_after += lines[s] * std::max(0, latency - hidden);
+    }
+
+    // The body got longer by the prefetch overhead; that has to buy back more stalls
+    if (report.stalls_before - report.stalls_after <= cycles_after - cycles_before) {
+        const auto& instrs = body->GetInstructions();
+        for (size_t k = instrs.size(); k-- > 0;) {
+            if (std::find(inserted.begin(), inserted.end(), instrs[k].get()) != inserted.end()) {
+                body->RemoveInstruction(k);
+            }
+        }
+        return false;
+    }
+
+    stats_.prefetches_inserted += static_cast<int>(points.size());
+    stats_.nontemporal += nontemporal;
+    stats_.loops.push_back(report);
+    return true;
+}
+
+// ============================================================================
+// DRIVER
+// ============================================================================
+
+int PrefetchInserter::InsertPrefetches(SSAFunction& func) {
+    int before = stats_.prefetches_inserted;
+    for (const AdvancedOptimizer::Loop& loop : VectorizationEngine::FindInnermostLoops(func)) {
+        LoopStreams streams;
+        stats_.loops_analyzed++;
+        if (!AnalyzeLoop(loop, streams)) {
+            stats_.rejected_shape++;
+            continue;
+        }
+        if (!PrefetchLoop(func, streams)) {
+            stats_.rejected_cost++;
+            continue;
+        }
+        stats_.loops_prefetched++;
+    }
+    return stats_.prefetches_inserted - before;
+}
+
+void PrefetchInserter::Stats::Print(const std::string& label) const {
+    std::cout << "\n=== Prefetch Insertion (" << label << ") ===\n";
+    std::cout << "Loops analyzed: " << loops_analyzed << "\n";
+    std::cout << "Loops prefetched: " << loops_prefetched << "\n";
+    std::cout << "Prefetches inserted: " << prefetches_inserted << "\n";
+    std::cout << "Non-temporal: " << nontemporal << "\n";
+    std::cout << "Rejected (shape): " << rejected_shape << "\n";
+    std::cout << "Rejected (cost): " << rejected_cost << "\n";
+    for (const auto& loop : loops) {
+        std::cout << loop.loop << ": " << loop.streams << " streams, " << loop.distance
+                  << " iterations ahead, stalls " << loop.stalls_before << " -> " << loop.stalls_after
+                  << " cycles/iteration (body " << loop.body_cycles_before << " -> "
+                  << loop.body_cycles_after << " cycles)\n";
+    }
+}
+
+} // namespace AdvancedOptimization
+} // namespace Snow
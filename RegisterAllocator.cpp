@@ -0,0 +1,1015 @@
+#include "AdvancedOptimizer.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <set>
+
+namespace Snow {
+namespace AdvancedOptimization {
+
+using SSA::SSAValue;
+using SSA::SSAInstruction;
+using SSA::SSABasicBlock;
+using SSA::SSAFunction;
+
+namespace {
+
+bool IsTerminator(const SSAInstruction& instr) {
+    auto op = instr.GetOpCode();
+    return op == SSAInstruction::OpCode::Br ||
+           op == SSAInstruction::OpCode::CondBr ||
+           op == SSAInstruction::OpCode::Ret;
+}
+
+bool IsPhi(const SSAInstruction& instr) {
+    return instr.GetOpCode() == SSAInstruction::OpCode::Phi;
+}
+
+// Position of 'pred' among 'block's predecessors (phi operand indices)
+std::vector<size_t> PredecessorIndices(const SSABasicBlock* block, const SSABasicBlock* pred) {
+    std::vector<size_t> indices;
+    const auto& preds = block->GetPredecessors();
+    for (size_t i = 0; i < preds.size(); ++i) {
+        if (preds[i] == pred) indices.push_back(i);
+    }
+    return indices;
+}
+
+// Colors are handed out caller-saved first: they cost nothing in the prologue
+std::vector<int> ColorOrder(X64::TargetABI abi) {
+    const X64::ABIInfo& info = X64::GetABIInfo(abi);
+    std::vector<int> regs = info.allocatable_caller_saved;
+    regs.insert(regs.end(), info.allocatable_callee_saved.begin(),
+                info.allocatable_callee_saved.end());
+    return regs;
+}
+
+const int kMaxRounds = 16;
+
+} // namespace
+
+// ============================================================================
+// INTERFERENCE GRAPH (Appel, "Modern Compiler Implementation", ch. 11)
+// Nodes 0..K-1 are the precolored physical registers, the rest are values.
+// ============================================================================
+
+struct RegisterAllocator::InterferenceGraph {
+    enum class NodeState {
+        Precolored, Initial, Simplify, Freeze, Spill,
+        Spilled, Coalesced, Colored, OnStack
+    };
+
+    enum class MoveState {
+        Worklist, Active, Coalesced, Constrained, Frozen
+    };
+
+    struct Move {
+        int src;
+        int dst;
+    };
+
+    int K = 0;
+    std::vector<SSAValue*> values;
+    std::unordered_map<SSAValue*, int> index;
+    std::unordered_set<uint64_t> adj_set;
+    std::vector<std::vector<int>> adj_list;
+    std::vector<int> degree;
+    std::vector<int> alias;
+    std::vector<int> color;
+    std::vector<double> cost;
+    std::vector<NodeState> state;
+
+    std::vector<Move> moves;
+    std::vector<MoveState> move_state;
+    std::vector<std::vector<int>> move_list;
+
+    std::set<int> simplify_worklist;
+    std::set<int> freeze_worklist;
+    std::set<int> spill_worklist;
+    std::set<int> worklist_moves;
+    std::set<int> active_moves;
+    std::vector<int> select_stack;
+    std::vector<int> spilled_nodes;
+
+    explicit InterferenceGraph(int k) : K(k) {
+        for (int r = 0; r < K; ++r) {
+            AddNode(nullptr);
+            state[r] = NodeState::Precolored;
+            color[r] = r;
+            degree[r] = INT_MAX / 2;
+        }
+    }
+
+    int AddNode(SSAValue* value) {
+        int n = static_cast<int>(values.size());
+        values.push_back(value);
+        if (value) index[value] = n;
+        adj_list.emplace_back();
+        degree.push_back(0);
+        alias.push_back(n);
+        color.push_back(-1);
+        cost.push_back(0.0);
+        state.push_back(NodeState::Initial);
+        move_list.emplace_back();
+        return n;
+    }
+
+    int NodeOf(SSAValue* value) {
+        auto it = index.find(value);
+        return it != index.end() ? it->second : AddNode(value);
+    }
+
+    bool IsPrecolored(int n) const { return state[n] == NodeState::Precolored; }
+
+    bool Adjacent(int u, int v) const {
+        return adj_set.count((static_cast<uint64_t>(u) << 32) | static_cast<uint32_t>(v)) != 0;
+    }
+
+    void AddEdge(int u, int v) {
+        if (u == v || Adjacent(u, v)) return;
+        adj_set.insert((static_cast<uint64_t>(u) << 32) | static_cast<uint32_t>(v));
+        adj_set.insert((static_cast<uint64_t>(v) << 32) | static_cast<uint32_t>(u));
+        if (!IsPrecolored(u)) {
+            adj_list[u].push_back(v);
+            degree[u]++;
+        }
+        if (!IsPrecolored(v)) {
+            adj_list[v].push_back(u);
+            degree[v]++;
+        }
+    }
+
+    void AddMove(int src, int dst) {
+        if (src == dst) return;
+        int m = static_cast<int>(moves.size());
+        moves.push_back(Move{src, dst});
+        move_state.push_back(MoveState::Worklist);
+        move_list[src].push_back(m);
+        move_list[dst].push_back(m);
+        worklist_moves.insert(m);
+    }
+
+    // Neighbours still in the graph
+    std::vector<int> AdjacentNodes(int n) const {
+        std::vector<int> result;
+        for (int m : adj_list[n]) {
+            if (state[m] != NodeState::OnStack && state[m] != NodeState::Coalesced) {
+                result.push_back(m);
+            }
+        }
+        return result;
+    }
+
+    std::vector<int> NodeMoves(int n) const {
+        std::vector<int> result;
+        for (int m : move_list[n]) {
+            if (move_state[m] == MoveState::Active || move_state[m] == MoveState::Worklist) {
+                result.push_back(m);
+            }
+        }
+        return result;
+    }
+
+    bool MoveRelated(int n) const { return !NodeMoves(n).empty(); }
+
+    int GetAlias(int n) const {
+        while (state[n] == NodeState::Coalesced) n = alias[n];
+        return n;
+    }
+
+    void MakeWorklist() {
+        for (size_t n = K; n < values.size(); ++n) {
+            if (state[n] != NodeState::Initial) continue;
+            int node = static_cast<int>(n);
+            if (degree[n] >= K) {
+                state[n] = NodeState::Spill;
+                spill_worklist.insert(node);
+            } else if (MoveRelated(node)) {
+                state[n] = NodeState::Freeze;
+                freeze_worklist.insert(node);
+            } else {
+                state[n] = NodeState::Simplify;
+                simplify_worklist.insert(node);
+            }
+        }
+    }
+
+    void EnableMoves(int n) {
+        for (int m : NodeMoves(n)) {
+            if (move_state[m] == MoveState::Active) {
+                active_moves.erase(m);
+                move_state[m] = MoveState::Worklist;
+                worklist_moves.insert(m);
+            }
+        }
+    }
+
+    void DecrementDegree(int m) {
+        if (IsPrecolored(m)) return;
+        int d = degree[m]--;
+        if (d != K) return;
+
+        EnableMoves(m);
+        for (int n : AdjacentNodes(m)) EnableMoves(n);
+        spill_worklist.erase(m);
+        if (MoveRelated(m)) {
+            state[m] = NodeState::Freeze;
+            freeze_worklist.insert(m);
+        } else {
+            state[m] = NodeState::Simplify;
+            simplify_worklist.insert(m);
+        }
+    }
+
+    void Simplify() {
+        int n = *simplify_worklist.begin();
+        simplify_worklist.erase(simplify_worklist.begin());
+        state[n] = NodeState::OnStack;
+        select_stack.push_back(n);
+        for (int m : AdjacentNodes(n)) DecrementDegree(m);
+    }
+
+    void AddWorkList(int u) {
+        if (!IsPrecolored(u) && !MoveRelated(u) && degree[u] < K) {
+            freeze_worklist.erase(u);
+            state[u] = NodeState::Simplify;
+            simplify_worklist.insert(u);
+        }
+    }
+
+    // George: coalescing v into precolored u is safe if v's neighbours are harmless to u
+    bool OK(int t, int r) const {
+        return degree[t] < K || IsPrecolored(t) || Adjacent(t, r);
+    }
+
+    // Briggs: the merged node has fewer than K significant-degree neighbours
+    bool Conservative(int u, int v) const {
+        std::unordered_set<int> nodes;
+        for (int n : AdjacentNodes(u)) nodes.insert(n);
+        for (int n : AdjacentNodes(v)) nodes.insert(n);
+        int k = 0;
+        for (int n : nodes) {
+            if (degree[n] >= K) k++;
+        }
+        return k < K;
+    }
+
+    void Combine(int u, int v) {
+        if (freeze_worklist.erase(v) == 0) spill_worklist.erase(v);
+        state[v] = NodeState::Coalesced;
+        alias[v] = u;
+        cost[u] += cost[v];
+        move_list[u].insert(move_list[u].end(), move_list[v].begin(), move_list[v].end());
+        EnableMoves(v);
+        for (int t : AdjacentNodes(v)) {
+            AddEdge(t, u);
+            DecrementDegree(t);
+        }
+        if (degree[u] >= K && freeze_worklist.erase(u) != 0) {
+            state[u] = NodeState::Spill;
+            spill_worklist.insert(u);
+        }
+    }
+
+    void Coalesce() {
+        int m = *worklist_moves.begin();
+        worklist_moves.erase(worklist_moves.begin());
+
+        int x = GetAlias(moves[m].src);
+        int y = GetAlias(moves[m].dst);
+        int u = x, v = y;
+        if (IsPrecolored(y)) {
+            u = y;
+            v = x;
+        }
+
+        if (u == v) {
+            move_state[m] = MoveState::Coalesced;
+            AddWorkList(u);
+        } else if (IsPrecolored(v) || Adjacent(u, v)) {
+            move_state[m] = MoveState::Constrained;
+            AddWorkList(u);
+            AddWorkList(v);
+        } else {
+            bool george = IsPrecolored(u);
+            if (george) {
+                for (int t : AdjacentNodes(v)) {
+                    if (!OK(t, u)) {
+                        george = false;
+                        break;
+                    }
+                }
+            }
+            if (george || (!IsPrecolored(u) && Conservative(u, v))) {
+                move_state[m] = MoveState::Coalesced;
+                Combine(u, v);
+                AddWorkList(u);
+            } else {
+                move_state[m] = MoveState::Active;
+                active_moves.insert(m);
+            }
+        }
+    }
+
+    void FreezeMoves(int u) {
+        for (int m : NodeMoves(u)) {
+            int x = moves[m].src;
+            int y = moves[m].dst;
+            int v = GetAlias(y) == GetAlias(u) ? GetAlias(x) : GetAlias(y);
+
+            active_moves.erase(m);
+            move_state[m] = MoveState::Frozen;
+
+            if (state[v] == NodeState::Freeze && !MoveRelated(v) && degree[v] < K) {
+                freeze_worklist.erase(v);
+                state[v] = NodeState::Simplify;
+                simplify_worklist.insert(v);
+            }
+        }
+    }
+
+    void Freeze() {
+        int u = *freeze_worklist.begin();
+        freeze_worklist.erase(freeze_worklist.begin());
+        state[u] = NodeState::Simplify;
+        simplify_worklist.insert(u);
+        FreezeMoves(u);
+    }
+
+    void SelectSpill() {
+        // Cheapest value per interference removed
+        int best = *spill_worklist.begin();
+        double best_ratio = HUGE_VAL;
+        for (int n : spill_worklist) {
+            double ratio = cost[n] / std::max(degree[n], 1);
+            if (ratio < best_ratio) {
+                best = n;
+                best_ratio = ratio;
+            }
+        }
+
+        spill_worklist.erase(best);
+        state[best] = NodeState::Simplify;
+        simplify_worklist.insert(best);
+        FreezeMoves(best);
+    }
+
+    void AssignColors() {
+        while (!select_stack.empty()) {
+            int n = select_stack.back();
+            select_stack.pop_back();
+
+            std::vector<bool> taken(K, false);
+            for (int w : adj_list[n]) {
+                int a = GetAlias(w);
+                if (state[a] == NodeState::Colored || state[a] == NodeState::Precolored) {
+                    taken[color[a]] = true;
+                }
+            }
+
+            auto free = std::find(taken.begin(), taken.end(), false);
+            if (free == taken.end()) {
+                state[n] = NodeState::Spilled;
+                spilled_nodes.push_back(n);
+            } else {
+                state[n] = NodeState::Colored;
+                color[n] = static_cast<int>(free - taken.begin());
+            }
+        }
+
+        for (size_t n = K; n < values.size(); ++n) {
+            if (state[n] == NodeState::Coalesced) {
+                color[n] = color[GetAlias(static_cast<int>(n))];
+            }
+        }
+    }
+};
+
+// ============================================================================
+// REGISTER ALLOCATOR IMPLEMENTATION
+// ============================================================================
+
+RegisterAllocator::RegisterAllocator()
+    : strategy_(Strategy::LinearScan), abi_(X64::TargetABI::Win64) {
+}
+
+RegisterAllocator::~RegisterAllocator() = default;
+
+void RegisterAllocator::SetOptimizationLevel(int level) {
+    // Graph coloring costs several build/color rounds; only -O3 pays for it
+    strategy_ = level >= 3 ? Strategy::GraphColoring : Strategy::LinearScan;
+}
+
+void RegisterAllocator::Allocate(SSAFunction& func) {
+    if (strategy_ == Strategy::GraphColoring) {
+        GraphColoringAllocation(func);
+    } else {
+        LinearScanAllocation(func);
+    }
+}
+
+void RegisterAllocator::CompareStrategies(SSAFunction& func) {
+    LinearScanAllocation(func);
+    stats_.Print("linear scan, " + func.GetName());
+
+    GraphColoringAllocation(func);
+    stats_.Print("graph coloring, " + func.GetName());
+}
+
+bool RegisterAllocator::IsAllocatable(const SSAValue* value) const {
+    if (!value) return false;
+    if (value->GetKind() != SSAValue::Kind::Register &&
+        value->GetKind() != SSAValue::Kind::Parameter) {
+        return false;
+    }
+    return stack_slots_.count(const_cast<SSAValue*>(value)) == 0;
+}
+
+double RegisterAllocator::UseWeight(int block) const {
+    return std::pow(10.0, std::min(loop_depth_[block], 8));
+}
+
+// ============================================================================
+// LIVENESS
+// Phi results are defined on entry to their block; phi operands are used at
+// the end of the matching predecessor, not in the phi's block.
+// ============================================================================
+
+void RegisterAllocator::ComputeLiveRanges(SSAFunction& func) {
+    blocks_.clear();
+    block_index_.clear();
+    stack_slots_.clear();
+    for (const auto& block : func.GetBlocks()) {
+        block_index_[block.get()] = static_cast<int>(blocks_.size());
+        blocks_.push_back(block.get());
+        for (const auto& instr : block->GetInstructions()) {
+            if (instr->GetOpCode() == SSAInstruction::OpCode::Alloca && instr->GetResult()) {
+                stack_slots_.insert(instr->GetResult());
+            }
+        }
+    }
+
+    size_t count = blocks_.size();
+    std::vector<std::unordered_set<SSAValue*>> phi_defs(count), defs(count),
+                                                upward(count), phi_uses(count);
+
+    for (size_t b = 0; b < count; ++b) {
+        for (const auto& instr : blocks_[b]->GetInstructions()) {
+            if (IsPhi(*instr)) {
+                if (IsAllocatable(instr->GetResult())) phi_defs[b].insert(instr->GetResult());
+                continue;
+            }
+            for (SSAValue* op : instr->GetOperands()) {
+                if (IsAllocatable(op) && !defs[b].count(op)) upward[b].insert(op);
+            }
+            if (IsAllocatable(instr->GetResult())) defs[b].insert(instr->GetResult());
+        }
+
+        for (SSABasicBlock* succ : blocks_[b]->GetSuccessors()) {
+            std::vector<size_t> slots = PredecessorIndices(succ, blocks_[b]);
+            for (const auto& instr : succ->GetInstructions()) {
+                if (!IsPhi(*instr)) break;
+                for (size_t i : slots) {
+                    if (i < instr->GetOperands().size() && IsAllocatable(instr->GetOperands()[i])) {
+                        phi_uses[b].insert(instr->GetOperands()[i]);
+                    }
+                }
+            }
+        }
+    }
+
+    live_in_.assign(count, std::unordered_set<SSAValue*>());
+    live_out_.assign(count, std::unordered_set<SSAValue*>());
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = count; i-- > 0;) {
+            std::unordered_set<SSAValue*> out = phi_uses[i];
+            for (SSABasicBlock* succ : blocks_[i]->GetSuccessors()) {
+                int s = block_index_[succ];
+                for (SSAValue* v : live_in_[s]) {
+                    if (!phi_defs[s].count(v)) out.insert(v);
+                }
+            }
+
+            std::unordered_set<SSAValue*> in = phi_defs[i];
+            in.insert(upward[i].begin(), upward[i].end());
+            for (SSAValue* v : out) {
+                if (!defs[i].count(v)) in.insert(v);
+            }
+
+            if (in.size() != live_in_[i].size() || out.size() != live_out_[i].size()) {
+                changed = true;
+            }
+            live_in_[i] = std::move(in);
+            live_out_[i] = std::move(out);
+        }
+    }
+
+    ComputeLoopDepths();
+}
+
+void RegisterAllocator::ComputeLoopDepths() {
+    size_t count = blocks_.size();
+    loop_depth_.assign(count, 0);
+    if (count == 0) return;
+
+    // Retreating edges of a DFS are the back edges of a reducible CFG
+    std::vector<int> dfs_state(count, 0); // 0 = unvisited, 1 = on stack, 2 = done
+    std::vector<std::pair<int, int>> back_edges;
+    std::function<void(int)> visit = [&](int b) {
+        dfs_state[b] = 1;
+        for (SSABasicBlock* succ : blocks_[b]->GetSuccessors()) {
+            int s = block_index_[succ];
+            if (dfs_state[s] == 1) {
+                back_edges.push_back(std::make_pair(b, s));
+            } else if (dfs_state[s] == 0) {
+                visit(s);
+            }
+        }
+        dfs_state[b] = 2;
+    };
+    visit(0);
+
+    // Natural loop per header: everything reaching the latch without passing the header
+    std::unordered_map<int, std::vector<bool>> loops;
+    for (const auto& edge : back_edges) {
+        std::vector<bool>& body = loops[edge.second];
+        body.resize(count, false);
+        body[edge.second] = true;
+
+        std::vector<int> work;
+        if (!body[edge.first]) {
+            body[edge.first] = true;
+            work.push_back(edge.first);
+        }
+        while (!work.empty()) {
+            int b = work.back();
+            work.pop_back();
+            for (SSABasicBlock* pred : blocks_[b]->GetPredecessors()) {
+                int p = block_index_[pred];
+                if (!body[p]) {
+                    body[p] = true;
+                    work.push_back(p);
+                }
+            }
+        }
+    }
+
+    for (const auto& loop : loops) {
+        for (size_t b = 0; b < count; ++b) {
+            if (loop.second[b]) loop_depth_[b]++;
+        }
+    }
+}
+
+// ============================================================================
+// GRAPH COLORING
+// ============================================================================
+
+void RegisterAllocator::BuildInterferenceGraph(SSAFunction& /*func*/) {
+    std::vector<int> colors = ColorOrder(abi_);
+    graph_.reset(new InterferenceGraph(static_cast<int>(colors.size())));
+    InterferenceGraph& g = *graph_;
+
+    std::vector<int> clobbered;
+    for (size_t c = 0; c < colors.size(); ++c) {
+        if (!X64::IsCalleeSaved(abi_, colors[c])) clobbered.push_back(static_cast<int>(c));
+    }
+
+    auto add_cost = [&](SSAValue* v, int block) {
+        int n = g.NodeOf(v);
+        g.cost[n] += spill_temps_.count(v) ? HUGE_VAL : UseWeight(block);
+    };
+
+    for (size_t b = 0; b < blocks_.size(); ++b) {
+        SSABasicBlock* block = blocks_[b];
+        const auto& instrs = block->GetInstructions();
+
+        // Phi results are defined together on entry and interfere with everything live there
+        std::vector<SSAValue*> live_in(live_in_[b].begin(), live_in_[b].end());
+        for (const auto& instr : instrs) {
+            if (!IsPhi(*instr)) break;
+            SSAValue* result = instr->GetResult();
+            if (!IsAllocatable(result)) continue;
+            int r = g.NodeOf(result);
+            add_cost(result, static_cast<int>(b));
+            for (SSAValue* v : live_in) g.AddEdge(r, g.NodeOf(v));
+
+            // Each incoming operand is a copy on the edge from its predecessor
+            const auto& preds = block->GetPredecessors();
+            for (size_t i = 0; i < instr->GetOperands().size() && i < preds.size(); ++i) {
+                SSAValue* op = instr->GetOperands()[i];
+                if (!IsAllocatable(op)) continue;
+                add_cost(op, block_index_[preds[i]]);
+                g.AddMove(g.NodeOf(op), r);
+            }
+        }
+
+        std::unordered_set<SSAValue*> live = live_out_[b];
+        for (size_t i = instrs.size(); i-- > 0;) {
+            const SSAInstruction& instr = *instrs[i];
+            if (IsPhi(instr)) break;
+
+            SSAValue* def = instr.GetResult();
+            if (IsAllocatable(def)) {
+                int d = g.NodeOf(def);
+                add_cost(def, static_cast<int>(b));
+                for (SSAValue* v : live) g.AddEdge(d, g.NodeOf(v));
+                live.erase(def);
+            }
+
+            // Values live across a call cannot sit in caller-saved registers
+            if (instr.GetOpCode() == SSAInstruction::OpCode::Call) {
+                for (SSAValue* v : live) {
+                    int n = g.NodeOf(v);
+                    for (int c : clobbered) g.AddEdge(n, c);
+                }
+            }
+
+            for (SSAValue* op : instr.GetOperands()) {
+                if (!IsAllocatable(op)) continue;
+                add_cost(op, static_cast<int>(b));
+                live.insert(op);
+            }
+        }
+
+        // Values that are never used still need a register for their definition
+        for (SSAValue* v : live) g.NodeOf(v);
+    }
+}
+
+void RegisterAllocator::GraphColoringAllocation(SSAFunction& func) {
+    auto start_time = std::chrono::high_resolution_clock::now();
+
+    stats_ = Stats();
+    allocation_.clear();
+    spill_slots_.clear();
+    spill_temps_.clear();
+
+    std::vector<int> colors = ColorOrder(abi_);
+
+    for (int round = 1; ; ++round) {
+        stats_.rounds = round;
+        ComputeLiveRanges(func);
+        BuildInterferenceGraph(func);
+
+        InterferenceGraph& g = *graph_;
+        g.MakeWorklist();
+        while (!g.simplify_worklist.empty() || !g.worklist_moves.empty() ||
+               !g.freeze_worklist.empty() || !g.spill_worklist.empty()) {
+            if (!g.simplify_worklist.empty()) {
+                g.Simplify();
+            } else if (!g.worklist_moves.empty()) {
+                g.Coalesce();
+            } else if (!g.freeze_worklist.empty()) {
+                g.Freeze();
+            } else {
+                g.SelectSpill();
+            }
+        }
+        g.AssignColors();
+
+        if (g.spilled_nodes.empty() || round == kMaxRounds) {
+            break;
+        }
+
+        std::vector<SSAValue*> spilled;
+        for (int n : g.spilled_nodes) spilled.push_back(g.values[n]);
+        RewriteSpills(func, spilled);
+    }
+
+    InterferenceGraph& g = *graph_;
+    for (size_t n = g.K; n < g.values.size(); ++n) {
+        SSAValue* value = g.values[n];
+        stats_.values++;
+        if (g.color[n] >= 0 && g.state[n] != InterferenceGraph::NodeState::Spilled) {
+            allocation_[value] = colors[g.color[n]];
+        } else if (!spill_slots_.count(value)) {
+            // Round limit reached: leave the value in memory
+            spill_slots_[value] = static_cast<int>(spill_slots_.size());
+        }
+    }
+
+    for (size_t m = 0; m < g.moves.size(); ++m) {
+        int src = g.GetAlias(g.moves[m].src);
+        int dst = g.GetAlias(g.moves[m].dst);
+        if (g.color[src] >= 0 && g.color[src] == g.color[dst]) {
+            stats_.copies_coalesced++;
+        } else {
+            stats_.copies_remaining++;
+        }
+    }
+    stats_.spilled = static_cast<int>(spill_slots_.size());
+
+    auto end_time = std::chrono::high_resolution_clock::now();
+    stats_.compile_time_us =
+        std::chrono::duration<double, std::micro>(end_time - start_time).count();
+}
+
+// Spill everywhere: store after the definition, reload into a fresh value
+// before every use. The fresh values live for one instruction and are never
+// spilled again, so the next round always makes progress.
+void RegisterAllocator::RewriteSpills(SSAFunction& func, const std::vector<SSAValue*>& spilled) {
+    if (blocks_.empty()) return;
+
+    SSABasicBlock* entry = blocks_[0];
+    std::unordered_map<SSAValue*, SSAValue*> slot_of;
+    for (SSAValue* v : spilled) {
+        SSAValue* slot = func.CreateValue(SSAValue::Kind::Register);
+        std::unique_ptr<SSAInstruction> slot_def(new SSAInstruction(SSAInstruction::OpCode::Alloca));
+        slot_def->SetResult(slot);
+        entry->InsertInstruction(0, std::move(slot_def));
+
+        slot_of[v] = slot;
+        stack_slots_.insert(slot);
+        spill_temps_.insert(v); // Now lives from its definition to the store
+        spill_slots_[v] = static_cast<int>(spill_slots_.size());
+    }
+
+    std::unordered_set<SSAInstruction*> stores;
+    auto make_store = [&](SSAValue* value, SSAValue* slot, int block) {
+        std::unique_ptr<SSAInstruction> store(new SSAInstruction(SSAInstruction::OpCode::Store));
+        store->AddOperand(value);
+        store->AddOperand(slot);
+        stores.insert(store.get());
+        stats_.spill_instructions++;
+        stats_.weighted_spill_cost += UseWeight(block);
+        return store;
+    };
+
+    // Parameters have no defining instruction: store them on entry
+    size_t entry_at = spilled.size();
+    for (SSAValue* v : spilled) {
+        if (v->GetKind() == SSAValue::Kind::Parameter) {
+            entry->InsertInstruction(entry_at++, make_store(v, slot_of[v], 0));
+        }
+    }
+
+    auto make_load = [&](SSAValue* slot, int block) {
+        SSAValue* temp = func.CreateValue(SSAValue::Kind::Register);
+        spill_temps_.insert(temp);
+        std::unique_ptr<SSAInstruction> load(new SSAInstruction(SSAInstruction::OpCode::Load));
+        load->SetResult(temp);
+        load->AddOperand(slot);
+        stats_.spill_instructions++;
+        stats_.weighted_spill_cost += UseWeight(block);
+        return load;
+    };
+
+    for (size_t b = 0; b < blocks_.size(); ++b) {
+        SSABasicBlock* block = blocks_[b];
+
+        for (size_t i = 0; i < block->GetInstructions().size(); ++i) {
+            SSAInstruction* instr = block->GetInstructions()[i].get();
+            if (instr->GetOpCode() == SSAInstruction::OpCode::Alloca || stores.count(instr)) continue;
+
+            // Phi operands are reloaded at the end of the predecessor
+            if (IsPhi(*instr)) {
+                const auto& preds = block->GetPredecessors();
+                for (size_t k = 0; k < instr->GetOperands().size() && k < preds.size(); ++k) {
+                    auto it = slot_of.find(instr->GetOperands()[k]);
+                    if (it == slot_of.end()) continue;
+
+                    SSABasicBlock* pred = preds[k];
+                    const auto& pred_instrs = pred->GetInstructions();
+                    size_t at = pred_instrs.size();
+                    if (at > 0 && IsTerminator(*pred_instrs[at - 1])) at--;
+
+                    auto load = make_load(it->second, block_index_[pred]);
+                    instr->SetOperand(k, load->GetResult());
+                    pred->InsertInstruction(at, std::move(load));
+                    if (pred == block && at <= i) i++;
+                }
+            } else {
+                for (size_t k = 0; k < instr->GetOperands().size(); ++k) {
+                    auto it = slot_of.find(instr->GetOperands()[k]);
+                    if (it == slot_of.end()) continue;
+
+                    auto load = make_load(it->second, static_cast<int>(b));
+                    instr->SetOperand(k, load->GetResult());
+                    block->InsertInstruction(i, std::move(load));
+                    i++;
+                }
+            }
+
+            auto it = slot_of.find(instr->GetResult());
+            if (!instr->GetResult() || it == slot_of.end()) continue;
+
+            // Store after the definition (after the whole phi group for phis)
+            size_t at = i + 1;
+            while (IsPhi(*instr) && at < block->GetInstructions().size() &&
+                   IsPhi(*block->GetInstructions()[at])) {
+                at++;
+            }
+            block->InsertInstruction(at, make_store(instr->GetResult(), it->second, static_cast<int>(b)));
+            if (at == i + 1) i++;
+        }
+    }
+}
+
+// ============================================================================
+// LINEAR SCAN
+// Blocks in layout order, two positions per instruction (read, write); phi
+// results start at their block's first position, phi operands end at the
+// predecessor's last one. Values are never split, whole values are spilled.
+// ============================================================================
+
+void RegisterAllocator::LinearScanAllocation(SSAFunction& func) {
+    auto start_time = std::chrono::high_resolution_clock::now();
+
+    stats_ = Stats();
+    stats_.rounds = 1;
+    allocation_.clear();
+    spill_slots_.clear();
+    spill_temps_.clear();
+    ComputeLiveRanges(func);
+
+    struct Interval {
+        SSAValue* value;
+        int start;
+        int end;
+        double cost;
+        bool crosses_call;
+        int reg;
+    };
+
+    std::vector<int> block_from(blocks_.size()), block_to(blocks_.size());
+    std::vector<int> calls;
+    int index = 0;
+    for (size_t b = 0; b < blocks_.size(); ++b) {
+        block_from[b] = 2 * index;
+        for (const auto& instr : blocks_[b]->GetInstructions()) {
+            if (instr->GetOpCode() == SSAInstruction::OpCode::Call) calls.push_back(2 * index);
+            index++;
+        }
+        block_to[b] = std::max(2 * index - 1, block_from[b]);
+    }
+
+    std::vector<Interval> intervals;
+    std::unordered_map<SSAValue*, size_t> interval_of;
+    auto extend = [&](SSAValue* v, int pos, double weight) {
+        auto it = interval_of.find(v);
+        if (it == interval_of.end()) {
+            interval_of[v] = intervals.size();
+            intervals.push_back(Interval{v, pos, pos, weight, false, X64::NoRegister});
+            return;
+        }
+        Interval& iv = intervals[it->second];
+        iv.start = std::min(iv.start, pos);
+        iv.end = std::max(iv.end, pos);
+        iv.cost += weight;
+    };
+
+    std::vector<std::pair<SSAValue*, SSAValue*>> copies;
+    for (size_t b = 0; b < blocks_.size(); ++b) {
+        double weight = UseWeight(static_cast<int>(b));
+        for (SSAValue* v : live_in_[b]) extend(v, block_from[b], 0);
+        for (SSAValue* v : live_out_[b]) extend(v, block_to[b], 0);
+
+        const auto& instrs = blocks_[b]->GetInstructions();
+        for (size_t i = 0; i < instrs.size(); ++i) {
+            const SSAInstruction& instr = *instrs[i];
+            int pos = block_from[b] + 2 * static_cast<int>(i);
+
+            if (IsPhi(instr)) {
+                if (!IsAllocatable(instr.GetResult())) continue;
+                extend(instr.GetResult(), block_from[b], weight);
+                const auto& preds = blocks_[b]->GetPredecessors();
+                for (size_t k = 0; k < instr.GetOperands().size() && k < preds.size(); ++k) {
+                    SSAValue* op = instr.GetOperands()[k];
+                    if (!IsAllocatable(op)) continue;
+                    int p = block_index_[preds[k]];
+                    extend(op, block_to[p], UseWeight(p));
+                    copies.push_back(std::make_pair(op, instr.GetResult()));
+                }
+                continue;
+            }
+
+            for (SSAValue* op : instr.GetOperands()) {
+                if (IsAllocatable(op)) extend(op, pos, weight);
+            }
+            if (IsAllocatable(instr.GetResult())) extend(instr.GetResult(), pos + 1, weight);
+        }
+    }
+
+    for (Interval& iv : intervals) {
+        auto it = std::lower_bound(calls.begin(), calls.end(), iv.start);
+        iv.crosses_call = it != calls.end() && *it < iv.end;
+    }
+
+    std::vector<Interval*> order;
+    for (Interval& iv : intervals) order.push_back(&iv);
+    std::sort(order.begin(), order.end(), [](const Interval* a, const Interval* b) {
+        if (a->start != b->start) return a->start < b->start;
+        return a->value->GetID() < b->value->GetID();
+    });
+
+    const X64::ABIInfo& abi = X64::GetABIInfo(abi_);
+    std::vector<Interval*> active;
+    std::vector<Interval*> owner(16, nullptr);
+
+    for (Interval* cur : order) {
+        active.erase(std::remove_if(active.begin(), active.end(), [&](Interval* a) {
+            if (a->end >= cur->start) return false;
+            owner[a->reg] = nullptr;
+            return true;
+        }), active.end());
+
+        std::vector<int> allowed;
+        if (!cur->crosses_call) allowed = abi.allocatable_caller_saved;
+        allowed.insert(allowed.end(), abi.allocatable_callee_saved.begin(),
+                       abi.allocatable_callee_saved.end());
+
+        // Prefer the register of a phi copy partner that has already expired
+        int free_reg = X64::NoRegister;
+        for (const auto& copy : copies) {
+            SSAValue* partner = copy.first == cur->value ? copy.second
+                              : copy.second == cur->value ? copy.first : nullptr;
+            if (!partner || !interval_of.count(partner)) continue;
+            int reg = intervals[interval_of[partner]].reg;
+            if (reg != X64::NoRegister && !owner[reg] &&
+                std::find(allowed.begin(), allowed.end(), reg) != allowed.end()) {
+                free_reg = reg;
+                break;
+            }
+        }
+        for (size_t r = 0; r < allowed.size() && free_reg == X64::NoRegister; ++r) {
+            if (!owner[allowed[r]]) free_reg = allowed[r];
+        }
+
+        if (free_reg == X64::NoRegister) {
+            // Spill whichever candidate ends last
+            Interval* victim = cur;
+            for (Interval* a : active) {
+                if (std::find(allowed.begin(), allowed.end(), a->reg) == allowed.end()) continue;
+                if (a->end > victim->end) victim = a;
+            }
+            if (victim != cur) {
+                free_reg = victim->reg;
+                victim->reg = X64::NoRegister;
+                active.erase(std::find(active.begin(), active.end(), victim));
+            }
+        }
+
+        if (free_reg != X64::NoRegister) {
+            cur->reg = free_reg;
+            owner[free_reg] = cur;
+            active.push_back(cur);
+        }
+    }
+
+    for (const Interval& iv : intervals) {
+        stats_.values++;
+        if (iv.reg != X64::NoRegister) {
+            allocation_[iv.value] = iv.reg;
+            continue;
+        }
+        // Without rewriting, every definition stores and every use reloads
+        spill_slots_[iv.value] = static_cast<int>(spill_slots_.size());
+        stats_.weighted_spill_cost += iv.cost;
+    }
+
+    for (size_t b = 0; b < blocks_.size(); ++b) {
+        for (const auto& instr : blocks_[b]->GetInstructions()) {
+            if (spill_slots_.count(instr->GetResult())) stats_.spill_instructions++;
+            for (SSAValue* op : instr->GetOperands()) {
+                if (spill_slots_.count(op)) stats_.spill_instructions++;
+            }
+        }
+    }
+
+    for (const auto& copy : copies) {
+        auto src = allocation_.find(copy.first);
+        auto dst = allocation_.find(copy.second);
+        if (src != allocation_.end() && dst != allocation_.end() && src->second == dst->second) {
+            stats_.copies_coalesced++;
+        } else {
+            stats_.copies_remaining++;
+        }
+    }
+    stats_.spilled = static_cast<int>(spill_slots_.size());
+
+    auto end_time = std::chrono::high_resolution_clock::now();
+    stats_.compile_time_us =
+        std::chrono::duration<double, std::micro>(end_time - start_time).count();
+}
+
+void RegisterAllocator::Stats::Print(const std::string& label) const {
+    std::cout << "\n=== Register Allocation (" << label << ") ===\n";
+    std::cout << "Values: " << values << "\n";
+    std::cout << "Spilled values: " << spilled << "\n";
+    std::cout << "Spill instructions: " << spill_instructions << "\n";
+    std::cout << "Loop-weighted spill cost: " << weighted_spill_cost << "\n";
+    std::cout << "Phi copies coalesced: " << copies_coalesced << "\n";
+    std::cout << "Phi copies remaining: " << copies_remaining << "\n";
+    std::cout << "Rounds: " << rounds << "\n";
+    std::cout << "Compile time: " << compile_time_us << " us\n";
+}
+
+} // namespace AdvancedOptimization
+} // namespace Snow
@@ -49,6 +49,12 @@ void SSABuilder::BuildFunction(const AST::FunctionDecl& func) {
     // Create entry block
     current_block_ = current_function_->CreateBasicBlock("entry");
     
+    // Parameters are the function's first values
+    symbol_table_.clear();
+    for (const auto& param : func.GetParameters()) {
+        symbol_table_[param] = current_function_->CreateValue(SSAValue::Kind::Parameter);
+    }
+    
     // Build function body
     if (func.GetBody()) {
         for (const auto& stmt : func.GetBody()->GetStatements()) {
@@ -77,7 +83,7 @@ void SSABuilder::BuildStatement(const AST::Statement& stmt) {
      auto instr = std::make_unique<SSAInstruction>(SSAInstruction::OpCode::Ret);
             if (ret.GetValue()) {
       auto* value = BuildExpression(*ret.GetValue());
-              instr->AddOperand(value);
+              if (value) instr->AddOperand(value);
    }
    current_block_->AddInstruction(std::move(instr));
     break;
@@ -93,13 +99,23 @@ SSAValue* SSABuilder::BuildExpression(const AST::Expression& expr) {
         case AST::NodeType::LiteralExpr: {
         auto& lit = static_cast<const AST::LiteralExpr&>(expr);
        auto* value = current_function_->CreateValue(SSAValue::Kind::Constant);
+        if (lit.GetLiteralType() == AST::LiteralExpr::LiteralType::Number) {
+            value->SetConstantValue(lit.GetNumberValue().ToDecimal());
+        }
   return value;
  }
   
+        case AST::NodeType::IdentifierExpr: {
+            auto& ident = static_cast<const AST::IdentifierExpr&>(expr);
+            auto it = symbol_table_.find(ident.GetName());
+            return it != symbol_table_.end() ? it->second : nullptr;
+        }
+  
    case AST::NodeType::BinaryOp: {
       auto& binop = static_cast<const AST::BinaryOpExpr&>(expr);
    auto* left = BuildExpression(*binop.GetLeft());
  auto* right = BuildExpression(*binop.GetRight());
+            if (!left || !right) return nullptr; // Unsupported operand
   
        SSAInstruction::OpCode op_code;
  switch (binop.GetOperator()) {
@@ -6,6 +6,7 @@
 #include <vector>
 #include <unordered_map>
 #include <memory>
+#include <algorithm>
 
 namespace Snow {
 namespace SSA {
@@ -24,21 +25,35 @@ public:
   GlobalVariable
     };
  
-    SSAValue(Kind kind, int id) : kind_(kind), id_(id), type_(nullptr) {}
+    SSAValue(Kind kind, int id) : kind_(kind), id_(id), type_(nullptr), constant_value_(0) {}
     
     Kind GetKind() const { return kind_; }
     int GetID() const { return id_; }
     void SetType(std::shared_ptr<void> type) { type_ = type; }
     
+    // Integer value of a Kind::Constant
+    void SetConstantValue(int64_t value) { constant_value_ = value; }
+    int64_t GetConstantValue() const { return constant_value_; }
+    
     std::string GetName() const;
 
 private:
     Kind kind_;
     int id_;
     std::shared_ptr<void> type_;
+    int64_t constant_value_;
 };
 
 // SSA Instruction
+// Phi operand i flows in from the parent block's i-th predecessor.
+// Load(address) and Store(value, address) move 64-bit words. CondBr(cond)
+// continues at the block's first successor when cond is nonzero, else at
+// the second. Vector ops work on GetVectorWidth() 64-bit lanes:
+// VectorLoad(address), VectorStore(value, address), VectorAdd/Sub/Mul(a, b),
+// VectorSplat(scalar) fills every lane, VectorBuild(s0, ..., sN) sets lane k
+// to sk, VectorReduceAdd(vector) sums the lanes. Prefetch(address, locality)
+// only hints that the line will be needed soon: locality 3 fetches into every
+// cache level (prefetcht0), 0 fetches non-temporally (prefetchnta).
 class SSAInstruction {
 public:
     enum class OpCode {
@@ -49,13 +64,14 @@ public:
     // Comparison
      Eq, Ne, Lt, Le, Gt, Ge,
      // Memory
-        Load, Store, Alloca,
+        Load, Store, Alloca, Prefetch,
         // Control Flow
      Br, CondBr, Ret, Call,
  // SSA-specific
         Phi,
         // SIMD/Vector
     VectorLoad, VectorStore, VectorAdd, VectorMul,
+        VectorSub, VectorSplat, VectorBuild, VectorReduceAdd,
         // Dodecagram-specific
         DodecConvert, DodecArithmetic,
    // Duration-specific
@@ -69,6 +85,7 @@ public:
     void SetResult(SSAValue* val) { result_ = val; }
     
     void AddOperand(SSAValue* val) { operands_.push_back(val); }
+    void SetOperand(size_t index, SSAValue* val) { operands_[index] = val; }
     const std::vector<SSAValue*>& GetOperands() const { return operands_; }
     
     // Debug information
@@ -98,6 +115,24 @@ public:
         instructions_.push_back(std::move(instr));
     }
     
+    void InsertInstruction(size_t index, std::unique_ptr<SSAInstruction> instr) {
+        instructions_.insert(instructions_.begin() + index, std::move(instr));
+    }
+    
+    void RemoveInstruction(size_t index) {
+        instructions_.erase(instructions_.begin() + index);
+    }
+    
+    // New position i holds the instruction previously at order[i]
+    void ReorderInstructions(const std::vector<size_t>& order) {
+        std::vector<std::unique_ptr<SSAInstruction>> reordered;
+        reordered.reserve(order.size());
+        for (size_t index : order) {
+            reordered.push_back(std::move(instructions_[index]));
+        }
+        instructions_.swap(reordered);
+    }
+    
  const std::vector<std::unique_ptr<SSAInstruction>>& GetInstructions() const {
         return instructions_;
  }
@@ -105,6 +140,14 @@ public:
     void AddPredecessor(SSABasicBlock* pred) { predecessors_.push_back(pred); }
     void AddSuccessor(SSABasicBlock* succ) { successors_.push_back(succ); }
     
+    // Retarget an edge in place, keeping phi operand positions valid
+    void ReplacePredecessor(SSABasicBlock* from, SSABasicBlock* to) {
+        std::replace(predecessors_.begin(), predecessors_.end(), from, to);
+    }
+    void ReplaceSuccessor(SSABasicBlock* from, SSABasicBlock* to) {
+        std::replace(successors_.begin(), successors_.end(), from, to);
+    }
+    
     const std::vector<SSABasicBlock*>& GetPredecessors() const { return predecessors_; }
     const std::vector<SSABasicBlock*>& GetSuccessors() const { return successors_; }
 
@@ -140,6 +183,12 @@ public:
       values_.push_back(std::move(value));
         return ptr;
     }
+    
+    SSAValue* CreateConstant(int64_t value) {
+        SSAValue* constant = CreateValue(SSAValue::Kind::Constant);
+        constant->SetConstantValue(value);
+        return constant;
+    }
 
 private:
     std::string name_;
@@ -164,6 +213,20 @@ public:
         return functions_;
     }
 
+    void AddFunction(std::unique_ptr<SSAFunction> func) {
+        functions_.push_back(std::move(func));
+    }
+
+    // Move a function out of its slot and back, e.g. to optimize it on its
+    // own; the slot stays empty in between
+    std::unique_ptr<SSAFunction> TakeFunction(size_t index) {
+        return std::move(functions_[index]);
+    }
+
+    void PutFunction(size_t index, std::unique_ptr<SSAFunction> func) {
+        functions_[index] = std::move(func);
+    }
+
 private:
     std::vector<std::unique_ptr<SSAFunction>> functions_;
 };
@@ -0,0 +1,499 @@
+#include "SSACompiler.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace Snow {
+namespace JIT {
+
+using SSA::SSAValue;
+using SSA::SSAInstruction;
+using SSA::SSABasicBlock;
+using OpCode = SSA::SSAInstruction::OpCode;
+using PEGenerator::Condition;
+
+namespace {
+
+const int kScratch0 = X64::RAX;
+const int kScratch1 = X64::RCX;
+const int kVector0 = 0;     // xmm0
+const int kVector1 = 1;     // xmm1
+
+// VectorBuild lane k is loaded into kLaneRegisters[k]; all caller-saved
+const int kLaneRegisters[] = { X64::RAX, X64::RCX, X64::RDX, X64::R8 };
+
+// Whether the result is a whole vector rather than a scalar
+bool ProducesVector(const SSAInstruction& instr) {
+    return instr.GetVectorWidth() > 1 && instr.GetOpCode() != OpCode::VectorReduceAdd;
+}
+
+bool IsTerminator(OpCode op) {
+    return op == OpCode::Br || op == OpCode::CondBr || op == OpCode::Ret;
+}
+
+} // anonymous namespace
+
+SSACompiler::SSACompiler()
+#ifdef _WIN32
+    : abi_(X64::TargetABI::Win64),
+#else
+    : abi_(X64::TargetABI::SysV),
+#endif
+      vector_width_(2), vector_instructions_(0), compile_ms_(0.0), function_(nullptr),
+      staging_(0), xmm_saves_(0), uses_vectors_(false), vector0_(nullptr) {}
+
+bool SSACompiler::Fail(const std::string& message) {
+    error_ = message;
+    return false;
+}
+
+bool SSACompiler::Compile(const SSA::SSAModule& module) {
+    auto start = std::chrono::high_resolution_clock::now();
+
+    code_.clear();
+    function_offsets_.clear();
+    memory_.Release();
+    vector_instructions_ = 0;
+    error_.clear();
+
+    if (vector_width_ != 2 && vector_width_ != 4) {
+        return Fail("Vector width must be 2 or 4 lanes");
+    }
+    emitter_.SetVectorWidth(vector_width_);
+
+    for (const auto& func : module.GetFunctions()) {
+        // Keep function entries 16-byte aligned; int3 fills the gaps
+        while (code_.size() % 16 != 0) code_.push_back(0xCC);
+        function_offsets_[func->GetName()] = code_.size();
+        if (!CompileFunction(*func)) return false;
+    }
+
+    if (!memory_.Load(code_)) {
+        return Fail("Could not map executable memory");
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    compile_ms_ = std::chrono::duration<double, std::milli>(end - start).count();
+    return true;
+}
+
+SSACompiler::EntryPoint SSACompiler::GetFunction(const std::string& name) const {
+    auto it = function_offsets_.find(name);
+    if (it == function_offsets_.end() || !memory_.GetBase()) return nullptr;
+    return reinterpret_cast<EntryPoint>(memory_.GetBase() + it->second);
+}
+
+// ============================================================================
+// FUNCTION LOWERING
+// Frame: saved rbp at [rbp], then one slot per value in order of definition,
+// Alloca storage, the phi staging area and, on Win64, the saved xmm14/xmm15
+// the emitter uses as vector scratch. The frame is a multiple of 16 bytes.
+// ============================================================================
+
+bool SSACompiler::AssignSlots(const SSA::SSAFunction& func, int32_t& frame) {
+    int32_t vector_bytes = 8 * vector_width_;
+    auto allocate = [&frame](int32_t bytes) {
+        frame += bytes;
+        return -frame;
+    };
+
+    size_t max_phis = 0;
+    for (const auto& block : func.GetBlocks()) {
+        size_t phis = 0;
+        for (const auto& instr : block->GetInstructions()) {
+            switch (instr->GetOpCode()) {
+                case OpCode::Call:
+                case OpCode::DodecConvert:
+                case OpCode::DodecArithmetic:
+                case OpCode::DurationCreate:
+                case OpCode::DurationCompare:
+                    return Fail("Instruction in block '" + block->GetName() + "' of " +
+                                func.GetName() + " has no machine code lowering");
+                case OpCode::Phi:
+                    phis++;
+                    break;
+                default:
+                    break;
+            }
+            if (instr->GetVectorWidth() > 1) {
+                if (instr->GetVectorWidth() != vector_width_) {
+                    return Fail("Vector instruction of width " + std::to_string(instr->GetVectorWidth()) +
+                                " in " + func.GetName() + "; the target has " +
+                                std::to_string(vector_width_) + " lanes");
+                }
+                uses_vectors_ = true;
+            }
+            const SSAValue* result = instr->GetResult();
+            if (result && !slots_.count(result)) {
+                slots_[result] = allocate(ProducesVector(*instr) ? vector_bytes : 8);
+            }
+            if (instr->GetOpCode() == OpCode::Alloca) objects_[instr.get()] = allocate(8);
+        }
+        max_phis = std::max(max_phis, phis);
+    }
+
+    // Parameter k of the function arrives in argument register k
+    size_t argument_registers = X64::GetABIInfo(abi_).argument_registers.size();
+    for (const auto& block : func.GetBlocks()) {
+        for (const auto& instr : block->GetInstructions()) {
+            for (const SSAValue* operand : instr->GetOperands()) {
+                if (!operand || slots_.count(operand)) continue;
+                switch (operand->GetKind()) {
+                    case SSAValue::Kind::Constant:
+                        break;
+                    case SSAValue::Kind::Parameter:
+                        if (static_cast<size_t>(operand->GetID()) >= argument_registers) {
+                            return Fail("Parameter " + operand->GetName() + " of " + func.GetName() +
+                                        " is not passed in a register");
+                        }
+                        slots_[operand] = allocate(8);
+                        break;
+                    case SSAValue::Kind::GlobalVariable:
+                        return Fail("Global " + operand->GetName() + " used in " + func.GetName() +
+                                    " has no machine code lowering");
+                    case SSAValue::Kind::Register:
+                        return Fail("Value " + operand->GetName() + " is used in " + func.GetName() +
+                                    " but never defined");
+                }
+            }
+        }
+    }
+
+    staging_ = max_phis > 1 ? allocate(vector_bytes * static_cast<int32_t>(max_phis)) : 0;
+
+    // xmm6-xmm15 are callee-saved on Win64
+    xmm_saves_ = uses_vectors_ && abi_ == X64::TargetABI::Win64 ? allocate(2 * vector_bytes) : 0;
+    return true;
+}
+
+bool SSACompiler::CompileFunction(const SSA::SSAFunction& func) {
+    function_ = &func;
+    slots_.clear();
+    objects_.clear();
+    labels_.clear();
+    branch_fixups_.clear();
+    uses_vectors_ = false;
+
+    int32_t frame = 0;
+    if (!AssignSlots(func, frame)) return false;
+    int32_t frame_size = (frame + 15) / 16 * 16;
+
+    emitter_.EmitPrologue(code_);
+    emitter_.EmitAddImm(code_, X64::RSP, -frame_size);
+    if (xmm_saves_) {
+        emitter_.EmitVectorStore(code_, X64::RBP, xmm_saves_, 14);
+        emitter_.EmitVectorStore(code_, X64::RBP, xmm_saves_ + 8 * vector_width_, 15);
+    }
+
+    const X64::ABIInfo& abi = X64::GetABIInfo(abi_);
+    for (const auto& slot : slots_) {
+        if (slot.first->GetKind() != SSAValue::Kind::Parameter) continue;
+        StoreScalar(slot.first, abi.argument_registers[slot.first->GetID()]);
+    }
+
+    bool terminated = false;
+    for (const auto& block : func.GetBlocks()) {
+        labels_[block.get()] = code_.size();
+        vector0_ = nullptr;
+        terminated = false;
+        for (const auto& instr : block->GetInstructions()) {
+            if (!CompileInstruction(*block, *instr)) return false;
+            terminated = IsTerminator(instr->GetOpCode());
+        }
+    }
+    if (!terminated) {
+        EmitReturn(nullptr);
+    }
+
+    for (const auto& fixup : branch_fixups_) {
+        auto target = labels_.find(fixup.target);
+        if (target == labels_.end()) {
+            return Fail("Branch to a block outside " + func.GetName());
+        }
+        int32_t displacement = static_cast<int32_t>(target->second) - static_cast<int32_t>(fixup.position + 4);
+        std::memcpy(&code_[fixup.position], &displacement, sizeof(displacement));
+    }
+    return true;
+}
+
+void SSACompiler::LoadScalar(int reg, const SSAValue* value) {
+    if (value->GetKind() == SSAValue::Kind::Constant) {
+        emitter_.EmitMovImm(code_, reg, value->GetConstantValue());
+    } else {
+        emitter_.EmitLoad(code_, reg, X64::RBP, slots_.at(value));
+    }
+}
+
+void SSACompiler::StoreScalar(const SSAValue* value, int reg) {
+    emitter_.EmitStore(code_, X64::RBP, slots_.at(value), reg);
+}
+
+// Within a block xmm0 keeps the last vector loaded or stored through it,
+// so a chain of vector ops does not wait on store forwarding each step
+void SSACompiler::LoadVector(int xmm, const SSAValue* value) {
+    if (xmm == kVector0 && vector0_ == value) return;
+    emitter_.EmitVectorLoad(code_, xmm, X64::RBP, slots_.at(value));
+    if (xmm == kVector0) vector0_ = value;
+}
+
+void SSACompiler::StoreVector(const SSAValue* value, int xmm) {
+    emitter_.EmitVectorStore(code_, X64::RBP, slots_.at(value), xmm);
+    if (xmm == kVector0) vector0_ = value;
+}
+
+bool SSACompiler::EmitEdge(const SSABasicBlock& from, const SSABasicBlock* to) {
+    const auto& preds = to->GetPredecessors();
+    auto pred = std::find(preds.begin(), preds.end(), &from);
+    if (pred == preds.end()) {
+        return Fail("Block '" + from.GetName() + "' branches to '" + to->GetName() +
+                    "', which does not list it as a predecessor");
+    }
+    size_t edge = static_cast<size_t>(pred - preds.begin());
+
+    std::vector<const SSAInstruction*> phis;
+    for (const auto& instr : to->GetInstructions()) {
+        if (instr->GetOpCode() != OpCode::Phi) break;
+        if (edge >= instr->GetOperands().size()) {
+            return Fail("Phi in '" + to->GetName() + "' has no operand for '" + from.GetName() + "'");
+        }
+        phis.push_back(instr.get());
+    }
+
+
+    // Phis read their operands at the same time: when one phi feeds another
+    // on this edge, the incoming values are staged before any is written
+    bool staged = false;
+    for (const SSAInstruction* phi : phis) {
+        for (const SSAInstruction* other : phis) {
+            if (phi->GetOperands()[edge] == other->GetResult()) staged = true;
+        }
+    }
+
+    int32_t stride = 8 * vector_width_;
+    for (size_t j = 0; j < phis.size(); j++) {
+        const SSAValue* value = phis[j]->GetOperands()[edge];
+        int32_t slot = staged ? staging_ + stride * static_cast<int32_t>(j) : slots_.at(phis[j]->GetResult());
+        if (ProducesVector(*phis[j])) {
+            LoadVector(kVector0, value);
+            emitter_.EmitVectorStore(code_, X64::RBP, slot, kVector0);
+        } else {
+            LoadScalar(kScratch0, value);
+            emitter_.EmitStore(code_, X64::RBP, slot, kScratch0);
+        }
+    }
+    for (size_t j = 0; staged && j < phis.size(); j++) {
+        int32_t slot = staging_ + stride * static_cast<int32_t>(j);
+        if (ProducesVector(*phis[j])) {
+            emitter_.EmitVectorLoad(code_, kVector0, X64::RBP, slot);
+            StoreVector(phis[j]->GetResult(), kVector0);
+        } else {
+            emitter_.EmitLoad(code_, kScratch0, X64::RBP, slot);
+            StoreScalar(phis[j]->GetResult(), kScratch0);
+        }
+    }
+
+    emitter_.EmitJmp(code_, 0);
+    Fixup fixup = { code_.size() - 4, to };
+    branch_fixups_.push_back(fixup);
+    return true;
+}
+
+void SSACompiler::EmitReturn(const SSAValue* value) {
+    if (value) LoadScalar(X64::RAX, value);
+    else emitter_.EmitMovImm(code_, X64::RAX, 0);
+    if (xmm_saves_) {
+        emitter_.EmitVectorLoad(code_, 14, X64::RBP, xmm_saves_);
+        emitter_.EmitVectorLoad(code_, 15, X64::RBP, xmm_saves_ + 8 * vector_width_);
+    }
+    if (uses_vectors_ && vector_width_ > 2) emitter_.EmitVZeroUpper(code_);
+    emitter_.EmitEpilogue(code_);
+    emitter_.EmitRet(code_);
+}
+
+bool SSACompiler::CompileInstruction(const SSABasicBlock& block, const SSAInstruction& instr) {
+    if (instr.GetVectorWidth() > 1) return CompileVectorInstruction(instr);
+
+    const auto& ops = instr.GetOperands();
+    const SSAValue* result = instr.GetResult();
+    OpCode op = instr.GetOpCode();
+    const auto& successors = block.GetSuccessors();
+
+    switch (op) {
+        case OpCode::Add:
+        case OpCode::Sub:
+        case OpCode::Mul:
+        case OpCode::And:
+        case OpCode::Or:
+        case OpCode::Xor:
+            LoadScalar(kScratch0, ops[0]);
+            LoadScalar(kScratch1, ops[1]);
+            if (op == OpCode::Add) emitter_.EmitAdd(code_, kScratch0, kScratch1);
+            if (op == OpCode::Sub) emitter_.EmitSub(code_, kScratch0, kScratch1);
+            if (op == OpCode::Mul) emitter_.EmitMul(code_, kScratch0, kScratch1);
+            if (op == OpCode::And) emitter_.EmitAlu(code_, PEGenerator::AluOp::And, kScratch0, kScratch1);
+            if (op == OpCode::Or) emitter_.EmitAlu(code_, PEGenerator::AluOp::Or, kScratch0, kScratch1);
+            if (op == OpCode::Xor) emitter_.EmitAlu(code_, PEGenerator::AluOp::Xor, kScratch0, kScratch1);
+            StoreScalar(result, kScratch0);
+            break;
+
+        case OpCode::Div:
+        case OpCode::Mod:
+            LoadScalar(X64::RAX, ops[0]);
+            LoadScalar(kScratch1, ops[1]);
+            emitter_.EmitDiv(code_, kScratch1);
+            StoreScalar(result, op == OpCode::Div ? X64::RAX : X64::RDX);
+            break;
+
+        case OpCode::Not:
+            LoadScalar(kScratch0, ops[0]);
+            emitter_.EmitAluImm(code_, PEGenerator::AluOp::Xor, kScratch0, -1);
+            StoreScalar(result, kScratch0);
+            break;
+
+        case OpCode::Eq:
+        case OpCode::Ne:
+        case OpCode::Lt:
+        case OpCode::Le:
+        case OpCode::Gt:
+        case OpCode::Ge: {
+            Condition condition = op == OpCode::Eq ? Condition::E :
+                                  op == OpCode::Ne ? Condition::NE :
+                                  op == OpCode::Lt ? Condition::L :
+                                  op == OpCode::Le ? Condition::LE :
+                                  op == OpCode::Gt ? Condition::G : Condition::GE;
+            LoadScalar(kScratch0, ops[0]);
+            LoadScalar(kScratch1, ops[1]);
+            emitter_.EmitCmp(code_, kScratch0, kScratch1);
+            emitter_.EmitSetcc(code_, condition, kScratch0);
+            StoreScalar(result, kScratch0);
+            break;
+        }
+
+        case OpCode::Load:
+            LoadScalar(kScratch0, ops[0]);
+            emitter_.EmitLoad(code_, kScratch0, kScratch0, 0);
+            StoreScalar(result, kScratch0);
+            break;
+
+        case OpCode::Store:
+            LoadScalar(kScratch0, ops[1]);
+            LoadScalar(kScratch1, ops[0]);
+            emitter_.EmitStore(code_, kScratch0, 0, kScratch1);
+            break;
+
+        case OpCode::Alloca:
+            emitter_.EmitLea(code_, kScratch0, X64::RBP, objects_.at(&instr));
+            StoreScalar(result, kScratch0);
+            break;
+
+        case OpCode::Prefetch: {
+            int locality = 3;
+            if (ops.size() > 1 && ops[1]->GetKind() == SSAValue::Kind::Constant) {
+                locality = static_cast<int>(std::min<int64_t>(3, std::max<int64_t>(0, ops[1]->GetConstantValue())));
+            }
+            LoadScalar(kScratch0, ops[0]);
+            emitter_.EmitPrefetch(code_, kScratch0, 0, locality);
+            break;
+        }
+
+        case OpCode::Phi:
+            // Copied in on each incoming edge
+            break;
+
+        case OpCode::Br:
+            if (successors.empty()) return Fail("Block '" + block.GetName() + "' branches nowhere");
+            return EmitEdge(block, successors[0]);
+
+        case OpCode::CondBr: {
+            if (successors.size() < 2) {
+                return Fail("Block '" + block.GetName() + "' needs two successors for its branch");
+            }
+            LoadScalar(kScratch0, ops[0]);
+            emitter_.EmitAluImm(code_, PEGenerator::AluOp::Cmp, kScratch0, 0);
+            emitter_.EmitJcc(code_, Condition::E, 0);
+            size_t to_else = code_.size() - 4;
+            const SSAValue* in_vector0 = vector0_;
+            if (!EmitEdge(block, successors[0])) return false;
+            int32_t displacement = static_cast<int32_t>(code_.size() - (to_else + 4));
+            std::memcpy(&code_[to_else], &displacement, sizeof(displacement));
+            vector0_ = in_vector0;
+            return EmitEdge(block, successors[1]);
+        }
+
+        case OpCode::Ret:
+            EmitReturn(ops.empty() ? nullptr : ops[0]);
+            break;
+
+        default:
+            return Fail("Instruction in block '" + block.GetName() + "' has no machine code lowering");
+    }
+    return true;
+}
+
+bool SSACompiler::CompileVectorInstruction(const SSAInstruction& instr) {
+    const auto& ops = instr.GetOperands();
+    const SSAValue* result = instr.GetResult();
+    OpCode op = instr.GetOpCode();
+
+    switch (op) {
+        case OpCode::VectorLoad:
+            LoadScalar(kScratch0, ops[0]);
+            emitter_.EmitVectorLoad(code_, kVector0, kScratch0, 0);
+            StoreVector(result, kVector0);
+            break;
+
+        case OpCode::VectorStore:
+            LoadScalar(kScratch0, ops[1]);
+            LoadVector(kVector0, ops[0]);
+            emitter_.EmitVectorStore(code_, kScratch0, 0, kVector0);
+            break;
+
+        case OpCode::VectorAdd:
+        case OpCode::VectorSub:
+        case OpCode::VectorMul:
+            LoadVector(kVector0, ops[0]);
+            LoadVector(kVector1, ops[1]);
+            if (op == OpCode::VectorAdd) emitter_.EmitVectorAdd(code_, kVector0, kVector0, kVector1);
+            if (op == OpCode::VectorSub) emitter_.EmitVectorSub(code_, kVector0, kVector0, kVector1);
+            if (op == OpCode::VectorMul) emitter_.EmitVectorMul(code_, kVector0, kVector0, kVector1);
+            StoreVector(result, kVector0);
+            break;
+
+        case OpCode::VectorSplat:
+            LoadScalar(kScratch0, ops[0]);
+            emitter_.EmitVectorBroadcast(code_, kVector0, kScratch0);
+            StoreVector(result, kVector0);
+            break;
+
+        case OpCode::VectorBuild: {
+            if (ops.size() != static_cast<size_t>(vector_width_)) {
+                return Fail("VectorBuild in " + function_->GetName() + " does not have one operand per lane");
+            }
+            std::vector<int> lanes;
+            for (size_t k = 0; k < ops.size(); k++) {
+                LoadScalar(kLaneRegisters[k], ops[k]);
+                lanes.push_back(kLaneRegisters[k]);
+            }
+            emitter_.EmitVectorBuild(code_, kVector0, lanes);
+            StoreVector(result, kVector0);
+            break;
+        }
+
+        case OpCode::VectorReduceAdd:
+            LoadVector(kVector0, ops[0]);
+            emitter_.EmitVectorReduceAdd(code_, kScratch0, kVector0);
+            StoreScalar(result, kScratch0);
+            break;
+
+        case OpCode::Phi:
+            return true;
+
+        default:
+            return Fail("Vector instruction in " + function_->GetName() + " has no machine code lowering");
+    }
+    vector_instructions_++;
+    return true;
+}
+
+} // namespace JIT
+} // namespace Snow
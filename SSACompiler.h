@@ -0,0 +1,102 @@
+#pragma once
+
+#include "../SSA/SSA.h"
+#include "../PEGenerator/PEGenerator.h"
+#include "../CodeGen/X64Target.h"
+#include "JITCompiler.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+namespace Snow {
+namespace JIT {
+
+// ============================================================================
+// SSA COMPILER
+// Lowers an SSA::SSAModule to machine code with MachineCodeEmitter and loads
+// it into executable memory, the way JITCompiler does for IR. This is the
+// path that turns the vectorizer's output, loops and SLP packs alike, into
+// packed instructions: vector ops become SSE2 or AVX2 code through the
+// emitter's SIMD helpers.
+//
+// Like JITCompiler it is a baseline compiler: every SSA value lives in a
+// frame slot (8 bytes for a scalar, one vector register's worth for a
+// vector), and each instruction loads its operands into rax/rcx or
+// xmm0/xmm1, operates and stores the result back. Phis are copied on the
+// edges into their block. Parameters arrive in the host C calling
+// convention's argument registers.
+//
+// Call, global variables and the Dodecagram/Duration opcodes have no
+// lowering; a function using them fails to compile.
+// ============================================================================
+
+class SSACompiler {
+public:
+    // Arguments beyond a function's parameters are ignored, so every
+    // function can be called through this
+    typedef int64_t (*EntryPoint)(int64_t, int64_t, int64_t, int64_t);
+
+    SSACompiler();
+
+    // Lanes of the vector instructions to lower: 2 = SSE2 (the default),
+    // 4 = AVX2. Vector instructions of any other width are rejected.
+    void SetVectorWidth(int lanes) { vector_width_ = lanes; }
+    int GetVectorWidth() const { return vector_width_; }
+
+    bool Compile(const SSA::SSAModule& module);
+
+    // Entry point of a compiled function, nullptr if there is none
+    EntryPoint GetFunction(const std::string& name) const;
+
+    // The code as emitted, before it was loaded
+    const std::vector<uint8_t>& GetCode() const { return code_; }
+    size_t GetCodeSize() const { return memory_.GetSize(); }
+    int GetVectorInstructions() const { return vector_instructions_; }
+    double GetCompileMilliseconds() const { return compile_ms_; }
+    const std::string& GetError() const { return error_; }
+
+private:
+    struct Fixup {
+        size_t position;        // Offset of the rel32 field
+        const SSA::SSABasicBlock* target;
+    };
+
+    X64::TargetABI abi_;
+    PEGenerator::MachineCodeEmitter emitter_;
+    ExecutableMemory memory_;
+    std::unordered_map<std::string, size_t> function_offsets_;
+    int vector_width_;
+    int vector_instructions_;
+    double compile_ms_;
+    std::string error_;
+
+    // Per-function state
+    std::vector<uint8_t> code_;
+    std::unordered_map<const SSA::SSAValue*, int32_t> slots_;
+    std::unordered_map<const SSA::SSAInstruction*, int32_t> objects_;   // Alloca storage
+    std::unordered_map<const SSA::SSABasicBlock*, size_t> labels_;
+    std::vector<Fixup> branch_fixups_;
+    const SSA::SSAFunction* function_;
+    int32_t staging_;           // Phi copies on an edge go through here
+    int32_t xmm_saves_;         // Callee-saved scratch xmm registers, 0 if none
+    bool uses_vectors_;
+    const SSA::SSAValue* vector0_;  // Value xmm0 holds, if known
+
+    bool CompileFunction(const SSA::SSAFunction& func);
+    bool AssignSlots(const SSA::SSAFunction& func, int32_t& frame);
+    bool CompileInstruction(const SSA::SSABasicBlock& block, const SSA::SSAInstruction& instr);
+    bool CompileVectorInstruction(const SSA::SSAInstruction& instr);
+
+    void LoadScalar(int reg, const SSA::SSAValue* value);
+    void StoreScalar(const SSA::SSAValue* value, int reg);
+    void LoadVector(int xmm, const SSA::SSAValue* value);
+    void StoreVector(const SSA::SSAValue* value, int xmm);
+    bool EmitEdge(const SSA::SSABasicBlock& from, const SSA::SSABasicBlock* to);
+    void EmitReturn(const SSA::SSAValue* value);
+
+    bool Fail(const std::string& message);
+};
+
+} // namespace JIT
+} // namespace Snow
@@ -0,0 +1,81 @@
+#include "ThreadPool.h"
+#include <algorithm>
+#include <exception>
+#include <thread>
+
+namespace Snow {
+
+WorkStealingPool::WorkStealingPool(unsigned threads) : threads_(threads) {
+    if (threads_ == 0) {
+        threads_ = std::max(1u, std::thread::hardware_concurrency());
+    }
+}
+
+void WorkStealingPool::ParallelFor(size_t count,
+                                   const std::function<void(unsigned worker, size_t index)>& task) {
+    if (count == 0) return;
+    unsigned workers = static_cast<unsigned>(std::min<size_t>(threads_, count));
+    
+    // Contiguous seeds keep neighbouring tasks on one worker until stolen
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    for (unsigned w = 0; w < workers; w++) {
+        queues.emplace_back(new WorkQueue());
+        size_t begin = count * w / workers;
+        size_t end = count * (w + 1) / workers;
+        for (size_t i = begin; i < end; i++) {
+            queues[w]->tasks.push_back(i);
+        }
+    }
+    
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    
+    auto run = [&](unsigned worker) {
+        size_t index = 0;
+        while (PopOwn(*queues[worker], index) || Steal(queues, worker, index)) {
+            try {
+                task(worker, index);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error) error = std::current_exception();
+            }
+        }
+    };
+    
+    std::vector<std::thread> threads;
+    for (unsigned w = 1; w < workers; w++) {
+        threads.emplace_back(run, w);
+    }
+    run(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+bool WorkStealingPool::PopOwn(WorkQueue& queue, size_t& index) {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) return false;
+    index = queue.tasks.back();
+    queue.tasks.pop_back();
+    return true;
+}
+
+bool WorkStealingPool::Steal(std::vector<std::unique_ptr<WorkQueue>>& queues, unsigned thief, size_t& index) {
+    // Start with the next worker so thieves spread over different victims
+    size_t count = queues.size();
+    for (size_t k = 1; k < count; k++) {
+        WorkQueue& victim = *queues[(thief + k) % count];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (victim.tasks.empty()) continue;
+        index = victim.tasks.front();
+        victim.tasks.pop_front();
+        return true;
+    }
+    return false;
+}
+
+} // namespace Snow
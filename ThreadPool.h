@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Snow {
+
+// ============================================================================
+// WORK-STEALING THREAD POOL
+// Each worker owns a deque of task indices seeded with a contiguous range.
+// A worker takes from the back of its own deque and, once that is empty,
+// steals from the front of the others, so uneven task costs even out
+// without a shared queue. Tasks cannot spawn tasks, which lets a worker
+// stop as soon as every deque is empty.
+// ============================================================================
+
+class WorkStealingPool {
+public:
+    // 0 threads = one per hardware thread
+    explicit WorkStealingPool(unsigned threads = 0);
+
+    unsigned GetThreadCount() const { return threads_; }
+
+    // Runs task(worker, index) for every index in [0, count) and returns when
+    // all are done. The calling thread is worker 0. Exceptions thrown by a
+    // task are rethrown here (the first one, after every worker has stopped).
+    void ParallelFor(size_t count, const std::function<void(unsigned worker, size_t index)>& task);
+
+private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+    };
+
+    unsigned threads_;
+
+    bool PopOwn(WorkQueue& queue, size_t& index);
+    bool Steal(std::vector<std::unique_ptr<WorkQueue>>& queues, unsigned thief, size_t& index);
+};
+
+} // namespace Snow
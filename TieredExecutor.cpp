@@ -0,0 +1,574 @@
+#include "TieredExecutor.h"
+#include "../Optimizer/Optimizer.h"
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <limits>
+
+#if defined(__GNUC__)
+#define SNOW_DIRECT_THREADED 1
+#endif
+
+namespace Snow {
+namespace JIT {
+
+namespace {
+
+// Counters are handed to the reoptimizer this often, not on every event
+const uint64_t kCheckInterval = 16;
+
+const uint32_t kMaxInlineArguments = 16;
+
+int64_t CallRuntime(void* function, const int64_t* a, uint32_t count) {
+    typedef int64_t (*F0)();
+    typedef int64_t (*F1)(int64_t);
+    typedef int64_t (*F2)(int64_t, int64_t);
+    typedef int64_t (*F3)(int64_t, int64_t, int64_t);
+    typedef int64_t (*F4)(int64_t, int64_t, int64_t, int64_t);
+    typedef int64_t (*F5)(int64_t, int64_t, int64_t, int64_t, int64_t);
+    typedef int64_t (*F6)(int64_t, int64_t, int64_t, int64_t, int64_t, int64_t);
+    switch (count) {
+        case 0: return reinterpret_cast<F0>(function)();
+        case 1: return reinterpret_cast<F1>(function)(a[0]);
+        case 2: return reinterpret_cast<F2>(function)(a[0], a[1]);
+        case 3: return reinterpret_cast<F3>(function)(a[0], a[1], a[2]);
+        case 4: return reinterpret_cast<F4>(function)(a[0], a[1], a[2], a[3]);
+        case 5: return reinterpret_cast<F5>(function)(a[0], a[1], a[2], a[3], a[4]);
+        case 6: return reinterpret_cast<F6>(function)(a[0], a[1], a[2], a[3], a[4], a[5]);
+    }
+    throw std::runtime_error("Runtime calls take at most 6 arguments");
+}
+
+void CloneFunction(const IR::Function& source, IR::Module& module) {
+    IR::Function* func = module.CreateFunction(source.GetName());
+    for (const auto& param : source.GetParameters()) func->AddParameter(param);
+    while (func->GetRegisterCount() < source.GetRegisterCount()) func->AllocateRegister();
+    for (const auto& block : source.GetBlocks()) {
+        IR::BasicBlock* copy = func->CreateBlock(block->GetName());
+        for (const auto& instr : block->GetInstructions()) copy->AddInstruction(instr);
+    }
+}
+
+} // anonymous namespace
+
+TieredExecutor::TieredExecutor(const IR::Module& module)
+    : module_(module), symbols_(JITCompiler().GetSymbols()), verbose_(false) {
+}
+
+void TieredExecutor::Stats::Print() const {
+    std::cout << "[Tier] " << interpreted_calls << " interpreted calls, "
+              << native_calls << " native calls, "
+              << promotions << " promotions (" << functions_compiled << " functions compiled), "
+              << osr_entries << " OSR entries\n";
+}
+
+bool TieredExecutor::Run(const std::string& name, int64_t& result) {
+    error_.clear();
+    if (functions_.empty() && !Decode()) return false;
+
+    auto found = function_index_.find(name);
+    if (found == function_index_.end()) {
+        error_ = "No function named '" + name + "'";
+        return false;
+    }
+    try {
+        result = Call(found->second, nullptr, 0);
+    } catch (const std::exception& e) {
+        error_ = e.what();
+        return false;
+    }
+    return true;
+}
+
+// ============================================================================
+// DECODING
+// ============================================================================
+
+bool TieredExecutor::Decode() {
+    const auto& functions = module_.GetFunctions();
+    functions_.resize(functions.size());
+    for (size_t i = 0; i < functions.size(); i++) {
+        functions_[i].ir = functions[i].get();
+        function_index_[functions[i]->GetName()] = static_cast<int>(i);
+    }
+    for (auto& func : functions_) {
+        if (!DecodeFunction(func)) {
+            functions_.clear();
+            function_index_.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+TieredExecutor::Value TieredExecutor::DecodeOperand(const IR::Operand& op) const {
+    Value value;
+    switch (op.type) {
+        case IR::OperandType::Register:
+            value.kind = Value::Register;
+            value.reg = static_cast<int32_t>(op.value);
+            break;
+        case IR::OperandType::Memory:
+            value.kind = Value::Memory;
+            value.value = op.value;
+            break;
+        default:
+            value.value = op.value;
+            break;
+    }
+    return value;
+}
+
+bool TieredExecutor::DecodeFunction(DecodedFunction& func) {
+    const IR::Function& ir = *func.ir;
+    const auto& blocks = ir.GetBlocks();
+
+    // Same register file as the JIT frame, so OSR can copy it one-to-one
+    func.registers = std::max<int>(std::max(ir.GetRegisterCount(), 1),
+                                   static_cast<int>(ir.GetParameters().size()));
+    std::vector<int> used;
+    for (const auto& block : blocks) {
+        for (const auto& instr : block->GetInstructions()) {
+            used.clear();
+            instr.GetUsedRegisters(used);
+            used.push_back(instr.GetDefinedRegister());
+            for (int reg : used) func.registers = std::max(func.registers, reg + 1);
+        }
+    }
+
+    std::unordered_map<std::string, int32_t> labels;
+    std::unordered_map<std::string, size_t> block_index;
+    std::vector<size_t> branches;   // Op index of each branch, in order
+
+    for (size_t b = 0; b < blocks.size(); b++) {
+        labels[blocks[b]->GetName()] = static_cast<int32_t>(func.code.size());
+        block_index[blocks[b]->GetName()] = b;
+        for (const auto& instr : blocks[b]->GetInstructions()) {
+            Op op;
+            switch (instr.opcode) {
+                case IR::OpCode::MOV:
+                case IR::OpCode::DODECAP:   // Copies its source, as in the VM
+                    op.kind = OpKind::Mov;
+                    op.a = DecodeOperand(instr.src1);
+                    break;
+                case IR::OpCode::LOAD:
+                    // A memory operand already reads through its address
+                    op.kind = instr.src1.type == IR::OperandType::Memory ? OpKind::Mov : OpKind::Load;
+                    op.a = DecodeOperand(instr.src1);
+                    break;
+                case IR::OpCode::STORE:
+                    op.kind = OpKind::Store;
+                    op.a = DecodeOperand(instr.dest);
+                    if (op.a.kind == Value::Memory) op.a.kind = Value::Immediate;
+                    op.b = DecodeOperand(instr.src1);
+                    break;
+                case IR::OpCode::ADD: op.kind = OpKind::Add; break;
+                case IR::OpCode::SUB: op.kind = OpKind::Sub; break;
+                case IR::OpCode::MUL: op.kind = OpKind::Mul; break;
+                case IR::OpCode::DIV: op.kind = OpKind::Div; break;
+                case IR::OpCode::CMP:
+                    op.kind = OpKind::Cmp;
+                    op.a = DecodeOperand(instr.dest);
+                    op.b = DecodeOperand(instr.src1);
+                    break;
+                case IR::OpCode::JMP: op.kind = OpKind::Jmp; break;
+                case IR::OpCode::JE:  op.kind = OpKind::Je; break;
+                case IR::OpCode::JNE: op.kind = OpKind::Jne; break;
+                case IR::OpCode::JG:  op.kind = OpKind::Jg; break;
+                case IR::OpCode::JL:  op.kind = OpKind::Jl; break;
+                case IR::OpCode::JGE: op.kind = OpKind::Jge; break;
+                case IR::OpCode::JLE: op.kind = OpKind::Jle; break;
+                case IR::OpCode::CALL: {
+                    auto callee = function_index_.find(instr.dest.label);
+                    if (callee != function_index_.end()) {
+                        op.kind = OpKind::Call;
+                        op.callee = callee->second;
+                    } else {
+                        auto symbol = symbols_.find(instr.dest.label);
+                        if (symbol == symbols_.end()) {
+                            error_ = "Undefined function '" + instr.dest.label + "' called from " + ir.GetName();
+                            return false;
+                        }
+                        op.kind = OpKind::CallSymbol;
+                        op.symbol = symbol->second;
+                    }
+                    op.first_arg = static_cast<uint32_t>(func.call_args.size());
+                    op.arg_count = static_cast<uint32_t>(instr.arguments.size());
+                    for (const auto& arg : instr.arguments) func.call_args.push_back(DecodeOperand(arg));
+                    break;
+                }
+                case IR::OpCode::RET: op.kind = OpKind::Ret; break;
+                case IR::OpCode::WAIT: {
+                    auto symbol = symbols_.find("_snow_wait");
+                    if (symbol == symbols_.end()) {
+                        error_ = "No '_snow_wait' symbol for WAIT";
+                        return false;
+                    }
+                    op.kind = OpKind::Wait;
+                    op.symbol = symbol->second;
+                    op.a = DecodeOperand(instr.dest);
+                    break;
+                }
+                case IR::OpCode::LABEL:
+                    labels[instr.dest.label] = static_cast<int32_t>(func.code.size());
+                    continue;
+                case IR::OpCode::SAMPLE:
+                case IR::OpCode::DELTA:
+                case IR::OpCode::NOP:
+                    continue;
+            }
+            if (op.kind >= OpKind::Add && op.kind <= OpKind::Div) {
+                op.a = DecodeOperand(instr.src1);
+                op.b = DecodeOperand(instr.src2);
+            }
+            if (instr.GetDefinedRegister() >= 0) op.dest = instr.GetDefinedRegister();
+            if (instr.IsBranch()) branches.push_back(func.code.size());
+            func.code.push_back(op);
+        }
+    }
+
+    // Falling off the end returns R0
+    Op end;
+    end.kind = OpKind::Ret;
+    func.code.push_back(end);
+
+    // Resolve branches; a branch to a block at or before its own is a
+    // loop back-edge and its target block a loop header
+    std::unordered_map<std::string, int32_t> header_ids;
+    size_t branch = 0;
+    for (size_t b = 0; b < blocks.size(); b++) {
+        for (const auto& instr : blocks[b]->GetInstructions()) {
+            if (!instr.IsBranch()) continue;
+            Op& op = func.code[branches[branch++]];
+            auto target = labels.find(instr.dest.label);
+            if (target == labels.end()) {
+                error_ = "Unknown label '" + instr.dest.label + "' in function " + ir.GetName();
+                return false;
+            }
+            op.target = target->second;
+
+            auto header = block_index.find(instr.dest.label);
+            if (header == block_index.end() || header->second > b) continue;
+            auto id = header_ids.find(instr.dest.label);
+            if (id == header_ids.end()) {
+                id = header_ids.emplace(instr.dest.label, static_cast<int32_t>(func.header_names.size())).first;
+                func.header_names.push_back(instr.dest.label);
+                func.back_edges.push_back(0);
+
+                // The JIT's frame entry restores registers but not flags, so
+                // OSR is only sound where the header sets the flags itself
+                // before its first conditional branch
+                bool flags_set = false, safe = true;
+                for (const auto& header_instr : blocks[header->second]->GetInstructions()) {
+                    if (header_instr.opcode == IR::OpCode::CMP) flags_set = true;
+                    if (header_instr.IsConditionalBranch()) {
+                        safe = flags_set;
+                        break;
+                    }
+                }
+                func.osr_allowed.push_back(safe);
+            }
+            op.header = id->second;
+        }
+    }
+    return true;
+}
+
+// ============================================================================
+// TIER 0: INTERPRETER
+// ============================================================================
+
+int64_t TieredExecutor::Call(int index, const int64_t* args, uint32_t count) {
+    DecodedFunction& func = functions_[index];
+    if (++func.calls % kCheckInterval == 0) OnCall(func);
+
+    if (func.native) {
+        stats_.native_calls++;
+        std::copy(args, args + count, func.native_frame.begin());
+        return func.native(func.native_frame.data());
+    }
+    stats_.interpreted_calls++;
+    return Execute(func, args, count);
+}
+
+int64_t TieredExecutor::Execute(DecodedFunction& func, const int64_t* args, uint32_t count) {
+#ifdef SNOW_DIRECT_THREADED
+    // Order matches OpKind
+    static const void* const handlers[] = {
+        &&op_Mov, &&op_Load, &&op_Store, &&op_Add, &&op_Sub, &&op_Mul, &&op_Div, &&op_Cmp,
+        &&op_Jmp, &&op_Je, &&op_Jne, &&op_Jg, &&op_Jl, &&op_Jge, &&op_Jle,
+        &&op_Call, &&op_CallSymbol, &&op_Wait, &&op_Ret
+    };
+    static_assert(sizeof(handlers) / sizeof(handlers[0]) == static_cast<size_t>(OpKind::Count),
+                  "handler table out of sync with OpKind");
+    if (!func.threaded) {
+        for (auto& op : func.code) op.handler = handlers[static_cast<int>(op.kind)];
+        func.threaded = true;
+    }
+#define SNOW_DISPATCH() goto *op->handler
+#define SNOW_OP(kind) op_##kind:
+#else
+#define SNOW_DISPATCH() goto dispatch
+#define SNOW_OP(kind) case OpKind::kind:
+#endif
+
+    std::vector<int64_t> regs(func.registers, 0);
+    std::copy(args, args + std::min<uint32_t>(count, static_cast<uint32_t>(regs.size())), regs.begin());
+
+    int64_t* r = regs.data();
+    auto read = [&r](const Value& v) -> int64_t {
+        if (v.kind == Value::Register) return r[v.reg];
+        if (v.kind == Value::Immediate) return v.value;
+        return *reinterpret_cast<const int64_t*>(v.value);
+    };
+
+    const Op* code = func.code.data();
+    const Op* op = code;
+    int64_t lhs = 0, rhs = 0, result = 0;
+    int64_t argv[kMaxInlineArguments];
+    std::vector<int64_t> spill;
+
+    // A taken branch; back-edges feed the loop's counter and may leave the
+    // frame through OSR
+#define SNOW_TAKE_BRANCH()                                                              \
+    do {                                                                                \
+        if (op->header >= 0 && ++func.back_edges[op->header] % kCheckInterval == 0 &&  \
+            OnBackEdge(func, op->header, regs, result)) {                               \
+            return result;                                                              \
+        }                                                                               \
+        op = code + op->target;                                                         \
+    } while (0)
+
+#define SNOW_BRANCH_IF(condition)                                                       \
+    if (condition) SNOW_TAKE_BRANCH(); else ++op;                                       \
+    SNOW_DISPATCH();
+
+#ifdef SNOW_DIRECT_THREADED
+    SNOW_DISPATCH();
+#else
+dispatch:
+    switch (op->kind) {
+#endif
+
+    SNOW_OP(Mov)
+        r[op->dest] = read(op->a);
+        ++op;
+        SNOW_DISPATCH();
+
+    SNOW_OP(Load)
+        r[op->dest] = *reinterpret_cast<const int64_t*>(read(op->a));
+        ++op;
+        SNOW_DISPATCH();
+
+    SNOW_OP(Store)
+        *reinterpret_cast<int64_t*>(read(op->a)) = read(op->b);
+        ++op;
+        SNOW_DISPATCH();
+
+    SNOW_OP(Add)
+        r[op->dest] = static_cast<int64_t>(static_cast<uint64_t>(read(op->a)) + static_cast<uint64_t>(read(op->b)));
+        ++op;
+        SNOW_DISPATCH();
+
+    SNOW_OP(Sub)
+        r[op->dest] = static_cast<int64_t>(static_cast<uint64_t>(read(op->a)) - static_cast<uint64_t>(read(op->b)));
+        ++op;
+        SNOW_DISPATCH();
+
+    SNOW_OP(Mul)
+        r[op->dest] = static_cast<int64_t>(static_cast<uint64_t>(read(op->a)) * static_cast<uint64_t>(read(op->b)));
+        ++op;
+        SNOW_DISPATCH();
+
+    SNOW_OP(Div) {
+        int64_t dividend = read(op->a), divisor = read(op->b);
+        if (divisor == 0) throw std::runtime_error("Division by zero in " + func.ir->GetName());
+        if (divisor == -1 && dividend == std::numeric_limits<int64_t>::min()) {
+            throw std::runtime_error("Division overflow in " + func.ir->GetName());
+        }
+        r[op->dest] = dividend / divisor;
+        ++op;
+        SNOW_DISPATCH();
+    }
+
+    SNOW_OP(Cmp)
+        lhs = read(op->a);
+        rhs = read(op->b);
+        ++op;
+        SNOW_DISPATCH();
+
+    SNOW_OP(Jmp)
+        SNOW_TAKE_BRANCH();
+        SNOW_DISPATCH();
+
+    SNOW_OP(Je)  SNOW_BRANCH_IF(lhs == rhs)
+    SNOW_OP(Jne) SNOW_BRANCH_IF(lhs != rhs)
+    SNOW_OP(Jg)  SNOW_BRANCH_IF(lhs > rhs)
+    SNOW_OP(Jl)  SNOW_BRANCH_IF(lhs < rhs)
+    SNOW_OP(Jge) SNOW_BRANCH_IF(lhs >= rhs)
+    SNOW_OP(Jle) SNOW_BRANCH_IF(lhs <= rhs)
+
+    SNOW_OP(Call)
+    SNOW_OP(CallSymbol) {
+        int64_t* values = argv;
+        if (op->arg_count > kMaxInlineArguments) {
+            spill.resize(op->arg_count);
+            values = spill.data();
+        }
+        const Value* arg = func.call_args.data() + op->first_arg;
+        for (uint32_t i = 0; i < op->arg_count; i++) values[i] = read(arg[i]);
+
+        // Result is in R0 by convention
+        r[0] = op->kind == OpKind::Call ? Call(op->callee, values, op->arg_count)
+                                        : CallRuntime(op->symbol, values, op->arg_count);
+        ++op;
+        SNOW_DISPATCH();
+    }
+
+    SNOW_OP(Wait)
+        argv[0] = read(op->a);
+        CallRuntime(op->symbol, argv, 1);
+        ++op;
+        SNOW_DISPATCH();
+
+    SNOW_OP(Ret)
+        return r[0];
+
+#ifndef SNOW_DIRECT_THREADED
+        case OpKind::Count:
+            break;
+    }
+    return r[0];
+#endif
+
+#undef SNOW_BRANCH_IF
+#undef SNOW_TAKE_BRANCH
+#undef SNOW_OP
+#undef SNOW_DISPATCH
+}
+
+// ============================================================================
+// PROMOTION AND ON-STACK REPLACEMENT
+// ============================================================================
+
+void TieredExecutor::OnCall(DecodedFunction& func) {
+    if (func.native || func.promotion_failed) return;
+    func.profile.call_counts[func.ir->GetName()] = func.calls;
+    if (reoptimizer_.ShouldReoptimize(func.profile)) Promote(func);
+}
+
+bool TieredExecutor::OnBackEdge(DecodedFunction& func, int header, std::vector<int64_t>& registers, int64_t& result) {
+    func.profile.block_counts[func.header_names[header]] = func.back_edges[header];
+    if (!reoptimizer_.ShouldReoptimize(func.profile)) return false;
+
+    // Later calls get the optimized code; this frame moves over at the header
+    if (!func.native && !func.promotion_failed) Promote(func);
+    if (!func.osr_allowed[header]) return false;
+    return EnterOSR(func, header, registers, result);
+}
+
+std::vector<std::string> TieredExecutor::GetCallClosure(const DecodedFunction& func) const {
+    std::vector<std::string> closure;
+    std::vector<bool> seen(functions_.size(), false);
+    std::vector<const DecodedFunction*> work(1, &func);
+    seen[function_index_.at(func.ir->GetName())] = true;
+    while (!work.empty()) {
+        const DecodedFunction* current = work.back();
+        work.pop_back();
+        closure.push_back(current->ir->GetName());
+        for (const auto& op : current->code) {
+            if (op.kind != OpKind::Call || seen[op.callee]) continue;
+            seen[op.callee] = true;
+            work.push_back(&functions_[op.callee]);
+        }
+    }
+    return closure;
+}
+
+JITCompiler* TieredExecutor::NewCompiler() {
+    compiled_.emplace_back(new JITCompiler());
+    JITCompiler* jit = compiled_.back().get();
+    for (const auto& symbol : symbols_) jit->AddSymbol(symbol.first, symbol.second);
+    jit->SetFrameEntries(true);
+    return jit;
+}
+
+void TieredExecutor::Promote(DecodedFunction& func) {
+    const std::string name = func.ir->GetName();
+    std::vector<std::string> closure = GetCallClosure(func);
+
+    std::unique_ptr<IR::Module> module(new IR::Module());
+    for (const auto& callee : closure) CloneFunction(*functions_[function_index_[callee]].ir, *module);
+
+    // The optimizer reports on std::cout; keep it out of the program's output
+    CIAMOptimizer optimizer;
+    optimizer.SetOptimizationLevel(2);
+    optimizer.SetThreadCount(1);
+    std::ostringstream discard;
+    std::streambuf* saved = verbose_ ? nullptr : std::cout.rdbuf(discard.rdbuf());
+    optimizer.Optimize(*module);
+    if (saved) std::cout.rdbuf(saved);
+
+    JITCompiler* jit = NewCompiler();
+    if (!jit->Compile(*module)) {
+        func.promotion_failed = true;
+        if (verbose_) std::cout << "[Tier] Could not promote '" << name << "': " << jit->GetError() << "\n";
+        return;
+    }
+
+    // Every function of the closure switches to the optimized code
+    for (const auto& optimized : module->GetFunctions()) {
+        DecodedFunction& target = functions_[function_index_[optimized->GetName()]];
+        const auto& blocks = optimized->GetBlocks();
+        JITCompiler::FrameEntry entry = blocks.empty() ? nullptr
+            : jit->GetFrameEntry(optimized->GetName(), blocks[0]->GetName());
+        if (!entry) continue;
+        target.native = entry;
+        target.native_slots = jit->GetRegisterSlots(optimized->GetName());
+        target.native_frame.assign(std::max<size_t>(target.native_slots, target.ir->GetParameters().size()), 0);
+    }
+    optimized_modules_.push_back(std::move(module));
+    stats_.promotions++;
+    stats_.functions_compiled += closure.size();
+
+    if (verbose_) {
+        std::cout << "[Tier] Promoted '" << name << "' after " << func.calls << " calls ("
+                  << closure.size() << " functions, " << jit->GetCodeSize() << " bytes in "
+                  << jit->GetCompileMilliseconds() << " ms)\n";
+    }
+}
+
+bool TieredExecutor::EnterOSR(DecodedFunction& func, int header, std::vector<int64_t>& registers, int64_t& result) {
+    const std::string name = func.ir->GetName();
+    if (!func.osr_code) {
+        std::vector<std::string> closure = GetCallClosure(func);
+        JITCompiler* jit = NewCompiler();
+        if (!jit->Compile(module_, std::unordered_set<std::string>(closure.begin(), closure.end()))) {
+            std::fill(func.osr_allowed.begin(), func.osr_allowed.end(), false);
+            if (verbose_) std::cout << "[Tier] No OSR for '" << name << "': " << jit->GetError() << "\n";
+            return false;
+        }
+        func.osr_code = jit;
+    }
+
+    JITCompiler::FrameEntry entry = func.osr_code->GetFrameEntry(name, func.header_names[header]);
+    if (!entry) {
+        func.osr_allowed[header] = false;
+        return false;
+    }
+    if (registers.size() < static_cast<size_t>(func.osr_code->GetRegisterSlots(name))) {
+        registers.resize(func.osr_code->GetRegisterSlots(name), 0);
+    }
+
+    stats_.osr_entries++;
+    if (verbose_) {
+        std::cout << "[Tier] OSR into '" << name << "' at '" << func.header_names[header]
+                  << "' after " << func.back_edges[header] << " iterations\n";
+    }
+    result = entry(registers.data());
+    return true;
+}
+
+} // namespace JIT
+} // namespace Snow
@@ -0,0 +1,135 @@
+#pragma once
+
+#include "JITCompiler.h"
+#include "../BubbleRuntime/BubbleRuntime.h"
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+namespace Snow {
+namespace JIT {
+
+// ============================================================================
+// TIERED EXECUTION
+// Tier 0 is a direct-threaded interpreter over pre-decoded IR (computed
+// goto on GCC/Clang, a switch elsewhere), so a program starts running at
+// once. Every call and every taken loop back-edge bumps a counter, and
+// AdaptiveReoptimizer::ShouldReoptimize decides from those counts when a
+// function is hot. A hot function and everything it calls are cloned and
+// optimized by CIAMOptimizer at -O2, then JIT-compiled. From then on calls
+// go to the machine code.
+//
+// A loop that gets hot in a frame already running in the interpreter moves
+// over through on-stack replacement at its header. The optimized code
+// renames registers and reshapes loops, so OSR enters a baseline
+// compilation of the unmodified IR instead. That compilation keeps the
+// interpreter's register numbering, so the live frame is simply copied
+// into its slots.
+// ============================================================================
+
+class TieredExecutor {
+public:
+    explicit TieredExecutor(const IR::Module& module);
+
+    // Calls / back-edges before a function is promoted (default 1000)
+    void SetThreshold(double count) { reoptimizer_.SetReoptimizationThreshold(count); }
+    void SetVerbose(bool verbose) { verbose_ = verbose; }
+    void AddSymbol(const std::string& name, void* address) { symbols_[name] = address; }
+
+    // Runs a function with no arguments; false (see GetError) if the
+    // program cannot be decoded, compiled or run
+    bool Run(const std::string& name, int64_t& result);
+    const std::string& GetError() const { return error_; }
+
+    struct Stats {
+        uint64_t interpreted_calls = 0;
+        uint64_t native_calls = 0;
+        uint64_t promotions = 0;
+        uint64_t functions_compiled = 0;
+        uint64_t osr_entries = 0;
+        void Print() const;
+    };
+    const Stats& GetStats() const { return stats_; }
+
+private:
+    enum class OpKind : uint8_t {
+        Mov, Load, Store, Add, Sub, Mul, Div, Cmp,
+        Jmp, Je, Jne, Jg, Jl, Jge, Jle,
+        Call, CallSymbol, Wait, Ret,
+        Count
+    };
+
+    struct Value {
+        enum Kind : uint8_t { Register, Immediate, Memory } kind = Immediate;
+        int32_t reg = 0;
+        int64_t value = 0;
+    };
+
+    struct Op {
+        const void* handler = nullptr;  // Threaded dispatch target
+        OpKind kind = OpKind::Ret;
+        int32_t dest = 0;
+        Value a, b;
+        int32_t target = -1;            // Branch target (op index)
+        int32_t header = -1;            // Loop header id if this branch is a back-edge
+        int32_t callee = -1;            // Module function index
+        void* symbol = nullptr;         // Runtime function
+        uint32_t first_arg = 0;
+        uint32_t arg_count = 0;
+    };
+
+    struct DecodedFunction {
+        const IR::Function* ir = nullptr;
+        std::vector<Op> code;
+        std::vector<Value> call_args;
+        int registers = 1;
+        bool threaded = false;
+
+        // Loop headers: block name, op index, back-edge count, OSR state
+        std::vector<std::string> header_names;
+        std::vector<uint64_t> back_edges;
+        std::vector<bool> osr_allowed;
+
+        // Profile seen by the reoptimizer and the tier the calls go to
+        uint64_t calls = 0;
+        AdvancedOptimization::ProfileData profile;
+        bool promotion_failed = false;
+        JITCompiler::FrameEntry native = nullptr;
+        int native_slots = 0;
+        std::vector<int64_t> native_frame;
+        JITCompiler* osr_code = nullptr;
+    };
+
+    const IR::Module& module_;
+    BubbleRuntime::AdaptiveReoptimizer reoptimizer_;
+    std::unordered_map<std::string, void*> symbols_;
+    std::vector<DecodedFunction> functions_;
+    std::unordered_map<std::string, int> function_index_;
+    std::vector<std::unique_ptr<IR::Module>> optimized_modules_;
+    std::vector<std::unique_ptr<JITCompiler>> compiled_;
+    bool verbose_;
+    Stats stats_;
+    std::string error_;
+
+    bool Decode();
+    bool DecodeFunction(DecodedFunction& func);
+    Value DecodeOperand(const IR::Operand& op) const;
+
+    int64_t Call(int index, const int64_t* args, uint32_t count);
+    int64_t Execute(DecodedFunction& func, const int64_t* args, uint32_t count);
+
+    // Called every kCheckInterval events; true if the frame finished
+    // natively through OSR, with its return value in 'result'
+    bool OnBackEdge(DecodedFunction& func, int header, std::vector<int64_t>& registers, int64_t& result);
+    void OnCall(DecodedFunction& func);
+
+    std::vector<std::string> GetCallClosure(const DecodedFunction& func) const;
+    void Promote(DecodedFunction& func);
+    bool EnterOSR(DecodedFunction& func, int header, std::vector<int64_t>& registers, int64_t& result);
+    JITCompiler* NewCompiler();
+};
+
+} // namespace JIT
+} // namespace Snow
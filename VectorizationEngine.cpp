@@ -0,0 +1,1208 @@
+#include "AdvancedOptimizer.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <map>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+namespace Snow {
+namespace AdvancedOptimization {
+
+using SSA::SSAValue;
+using SSA::SSAInstruction;
+using SSA::SSABasicBlock;
+using SSA::SSAFunction;
+using OpCode = SSAInstruction::OpCode;
+
+namespace {
+
+// coef * i + base + offset, with 'base' a value that is the same in every
+// iteration (or null). Addresses of vectorizable accesses have coef == 8.
+struct Affine {
+    int64_t coef = 0;
+    SSAValue* base = nullptr;
+    int64_t offset = 0;
+};
+
+bool IsConstant(const SSAValue* value) {
+    return value->GetKind() == SSAValue::Kind::Constant;
+}
+
+bool IsTerminator(const SSAInstruction& instr) {
+    auto op = instr.GetOpCode();
+    return op == OpCode::Br || op == OpCode::CondBr || op == OpCode::Ret;
+}
+
+bool HasResult(OpCode op) {
+    return op != OpCode::Store && op != OpCode::VectorStore &&
+           op != OpCode::Br && op != OpCode::CondBr && op != OpCode::Ret;
+}
+
+std::unique_ptr<SSAInstruction> Create(SSAFunction& func, OpCode op,
+                                       const std::vector<SSAValue*>& operands, int width) {
+    auto instr = std::make_unique<SSAInstruction>(op);
+    for (SSAValue* operand : operands) instr->AddOperand(operand);
+    instr->SetVectorWidth(width);
+    if (HasResult(op)) instr->SetResult(func.CreateValue(SSAValue::Kind::Register));
+    return instr;
+}
+
+SSAValue* Append(SSAFunction& func, SSABasicBlock* block, OpCode op,
+                 const std::vector<SSAValue*>& operands, int width = 1) {
+    auto instr = Create(func, op, operands, width);
+    SSAValue* result = instr->GetResult();
+    block->AddInstruction(std::move(instr));
+    return result;
+}
+
+OpCode VectorOpFor(OpCode op) {
+    switch (op) {
+        case OpCode::Add: return OpCode::VectorAdd;
+        case OpCode::Sub: return OpCode::VectorSub;
+        default: return OpCode::VectorMul;
+    }
+}
+
+int64_t FloorPowerOfTwo(int64_t value) {
+    int64_t result = 1;
+    while (result * 2 <= value) result *= 2;
+    return result;
+}
+
+// Split an address into base + constant offset through Add/Sub of constants
+std::pair<SSAValue*, int64_t> SplitAddress(SSAValue* address,
+                                           const std::unordered_map<SSAValue*, SSAInstruction*>& def) {
+    int64_t offset = 0;
+    while (true) {
+        auto it = def.find(address);
+        if (it == def.end()) break;
+        const SSAInstruction* instr = it->second;
+        const auto& ops = instr->GetOperands();
+        if (instr->GetOpCode() == OpCode::Add && IsConstant(ops[1])) {
+            offset += ops[1]->GetConstantValue();
+            address = ops[0];
+        } else if (instr->GetOpCode() == OpCode::Add && IsConstant(ops[0])) {
+            offset += ops[0]->GetConstantValue();
+            address = ops[1];
+        } else if (instr->GetOpCode() == OpCode::Sub && IsConstant(ops[1])) {
+            offset -= ops[1]->GetConstantValue();
+            address = ops[0];
+        } else {
+            break;
+        }
+    }
+    return std::make_pair(address, offset);
+}
+
+// Trip count assumed when the bounds are not constants
+const int64_t kAssumedTripCount = 1000;
+
+// Below this the vector loop is not worth its setup and code size
+const double kMinSpeedup = 1.15;
+
+// SLP trees deeper than this end in a VectorBuild of the scalars
+const int kMaxSLPDepth = 8;
+
+} // namespace
+
+// ============================================================================
+// LOOP PLAN
+// Everything AnalyzeLoop learns about one candidate loop:
+//
+//   preheader:  ...                       br header
+//   header:     i = phi [start, i.next]   acc = phi [init, acc.next]
+//               c = lt i, limit           condbr c, body, exit
+//   body:       ... loads, stores, add/sub/mul ...
+//               acc.next = add acc, x     i.next = add i, 1     br header
+// ============================================================================
+
+struct VectorizationEngine::LoopPlan {
+    struct Access {
+        SSAInstruction* instr;
+        SSAValue* base;
+        int64_t offset;
+        bool is_store;
+        size_t position;  // Index in the body block
+    };
+
+    struct Reduction {
+        SSAInstruction* phi;
+        SSAInstruction* update;  // acc.next = add acc, addend
+        SSAValue* addend;
+    };
+
+    SSABasicBlock* preheader = nullptr;
+    SSABasicBlock* header = nullptr;
+    SSABasicBlock* body = nullptr;
+    SSABasicBlock* exit = nullptr;
+    size_t entry_edge = 0;   // Header predecessor index of the preheader
+    size_t latch_edge = 0;   // Header predecessor index of the body
+
+    SSAInstruction* iv_phi = nullptr;
+    SSAInstruction* iv_next = nullptr;
+    SSAValue* start = nullptr;
+    SSAValue* limit = nullptr;
+    int64_t trip_count = -1;
+
+    std::vector<Reduction> reductions;
+    std::unordered_set<SSAValue*> allocas;         // Distinct stack objects never alias
+    std::unordered_set<SSAValue*> loop_defined;    // Results of header and body instructions
+    std::unordered_map<SSAValue*, Affine> affine;  // Body values linear in i
+    std::unordered_set<SSAValue*> vector;          // Body values with one value per lane
+    std::unordered_set<SSAValue*> uniform_splats;  // Loop-defined uniform values used as lanes
+    std::vector<Access> accesses;
+    std::vector<std::pair<SSAValue*, SSAValue*>> alias_checks;
+
+    int width = 0;
+    double speedup = 0;
+};
+
+// ============================================================================
+// VECTORIZATION ENGINE
+// ============================================================================
+
+VectorizationEngine::VectorizationEngine() {
+    SetTarget(DetectHostTarget());
+}
+
+VectorizationEngine::~VectorizationEngine() = default;
+
+void VectorizationEngine::SetTarget(SIMDTarget target) {
+    target_ = target;
+    switch (target) {
+        case SIMDTarget::SSE2:
+        case SIMDTarget::SSE4_2:
+        case SIMDTarget::AVX:     // AVX1 has no 256-bit integer ops
+            vector_width_ = 2;
+            break;
+        case SIMDTarget::AVX2:
+        case SIMDTarget::AVX512:  // No EVEX encodings yet: runs the AVX2 code
+            vector_width_ = 4;
+            break;
+    }
+}
+
+VectorizationEngine::SIMDTarget VectorizationEngine::DetectHostTarget() {
+    // SNOW_SIMD=sse2|sse4.2|avx|avx2|avx512 overrides detection
+    if (const char* forced = std::getenv("SNOW_SIMD")) {
+        std::string name(forced);
+        if (name == "sse2") return SIMDTarget::SSE2;
+        if (name == "sse4.2") return SIMDTarget::SSE4_2;
+        if (name == "avx") return SIMDTarget::AVX;
+        if (name == "avx2") return SIMDTarget::AVX2;
+        if (name == "avx512") return SIMDTarget::AVX512;
+    }
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int info[4];
+    __cpuid(info, 0);
+    int max_leaf = info[0];
+    __cpuid(info, 1);
+    bool sse42 = (info[2] & (1 << 20)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+    bool ymm_state = (xcr0 & 0x6) == 0x6;
+    bool zmm_state = (xcr0 & 0xE6) == 0xE6;
+    bool avx2 = false;
+    bool avx512 = false;
+    if (max_leaf >= 7) {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+        avx512 = (info[1] & (1 << 16)) != 0;
+    }
+    if (avx512 && zmm_state) return SIMDTarget::AVX512;
+    if (avx2 && ymm_state) return SIMDTarget::AVX2;
+    if (avx && ymm_state) return SIMDTarget::AVX;
+    if (sse42) return SIMDTarget::SSE4_2;
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    // __builtin_cpu_supports also checks that the OS saves the wider registers
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return SIMDTarget::AVX512;
+    if (__builtin_cpu_supports("avx2")) return SIMDTarget::AVX2;
+    if (__builtin_cpu_supports("avx")) return SIMDTarget::AVX;
+    if (__builtin_cpu_supports("sse4.2")) return SIMDTarget::SSE4_2;
+#endif
+    return SIMDTarget::SSE2;  // Every x86-64 CPU has it
+}
+
+int VectorizationEngine::VectorizeLoops(SSAFunction& func) {
+    int vectorized = 0;
+    for (const AdvancedOptimizer::Loop& loop : FindInnermostLoops(func)) {
+        if (VectorizeLoop(func, loop)) vectorized++;
+    }
+    return vectorized;
+}
+
+bool VectorizationEngine::VectorizeLoop(SSAFunction& func, const AdvancedOptimizer::Loop& loop) {
+    plan_.reset(new LoopPlan());
+    for (const auto& block : func.GetBlocks()) {
+        for (const auto& instr : block->GetInstructions()) {
+            if (instr->GetOpCode() == OpCode::Alloca && instr->GetResult()) {
+                plan_->allocas.insert(instr->GetResult());
+            }
+        }
+    }
+
+    bool vectorized = CanVectorize(loop);
+    if (vectorized) {
+        GenerateVectorCode(func, loop);
+        stats_.loops_vectorized++;
+        stats_.estimated_speedup +=
+            (plan_->speedup - stats_.estimated_speedup) / stats_.loops_vectorized;
+    }
+    plan_.reset();
+    return vectorized;
+}
+
+bool VectorizationEngine::CanVectorize(const AdvancedOptimizer::Loop& loop) {
+    LoopPlan& plan = *plan_;
+    stats_.loops_analyzed++;
+
+    if (!AnalyzeLoop(loop, plan)) {
+        stats_.rejected_shape++;
+        return false;
+    }
+    if (!CheckDependences(plan)) {
+        stats_.rejected_dependence++;
+        return false;
+    }
+    plan.speedup = EstimateSpeedup(plan);
+    if (plan.speedup < kMinSpeedup) {
+        stats_.rejected_cost++;
+        return false;
+    }
+    return true;
+}
+
+// ============================================================================
+// LOOP DETECTION
+// Same construction as the register allocator: retreating DFS edges are the
+// back edges of a reducible CFG; loops sharing a header are merged.
+// ============================================================================
+
+std::vector<AdvancedOptimizer::Loop> VectorizationEngine::FindInnermostLoops(SSAFunction& func) {
+    std::vector<AdvancedOptimizer::Loop> result;
+    const auto& blocks = func.GetBlocks();
+    size_t count = blocks.size();
+    if (count == 0) return result;
+
+    std::unordered_map<SSABasicBlock*, int> index;
+    for (size_t b = 0; b < count; ++b) index[blocks[b].get()] = static_cast<int>(b);
+
+    std::vector<int> dfs_state(count, 0); // 0 = unvisited, 1 = on stack, 2 = done
+    std::vector<std::pair<int, int>> back_edges;
+    std::function<void(int)> visit = [&](int b) {
+        dfs_state[b] = 1;
+        for (SSABasicBlock* succ : blocks[b]->GetSuccessors()) {
+            int s = index[succ];
+            if (dfs_state[s] == 1) {
+                back_edges.push_back(std::make_pair(b, s));
+            } else if (dfs_state[s] == 0) {
+                visit(s);
+            }
+        }
+        dfs_state[b] = 2;
+    };
+    visit(0);
+
+    std::map<int, std::vector<bool>> loops;
+    for (const auto& edge : back_edges) {
+        std::vector<bool>& body = loops[edge.second];
+        body.resize(count, false);
+        body[edge.second] = true;
+
+        std::vector<int> work;
+        if (!body[edge.first]) {
+            body[edge.first] = true;
+            work.push_back(edge.first);
+        }
+        while (!work.empty()) {
+            int b = work.back();
+            work.pop_back();
+            for (SSABasicBlock* pred : blocks[b]->GetPredecessors()) {
+                int p = index[pred];
+                if (!body[p]) {
+                    body[p] = true;
+                    work.push_back(p);
+                }
+            }
+        }
+    }
+
+    for (const auto& loop : loops) {
+        bool innermost = true;
+        for (const auto& other : loops) {
+            if (other.first != loop.first && loop.second[other.first]) innermost = false;
+        }
+        if (!innermost) continue;
+
+        AdvancedOptimizer::Loop info;
+        info.header = blocks[loop.first].get();
+        for (size_t b = 0; b < count; ++b) {
+            if (loop.second[b]) info.blocks.push_back(blocks[b].get());
+        }
+        info.trip_count = -1;
+        info.is_vectorizable = false;
+        result.push_back(info);
+    }
+    return result;
+}
+
+// ============================================================================
+// SHAPE AND OPERAND ANALYSIS
+// ============================================================================
+
+bool VectorizationEngine::AnalyzeLoop(const AdvancedOptimizer::Loop& loop, LoopPlan& plan) {
+    SSABasicBlock* header = loop.header;
+    if (loop.blocks.size() != 2) return false;
+    SSABasicBlock* body = loop.blocks[0] == header ? loop.blocks[1] : loop.blocks[0];
+
+    // Header: entered from one preheader and one latch, leaves to body or exit
+    const auto& header_preds = header->GetPredecessors();
+    if (header_preds.size() != 2) return false;
+    plan.latch_edge = header_preds[0] == body ? 0 : 1;
+    plan.entry_edge = 1 - plan.latch_edge;
+    if (header_preds[plan.latch_edge] != body) return false;
+    plan.preheader = header_preds[plan.entry_edge];
+    if (plan.preheader == body || plan.preheader == header) return false;
+
+    if (header->GetSuccessors().size() != 2 || header->GetSuccessors()[0] != body) return false;
+    plan.exit = header->GetSuccessors()[1];
+    if (plan.exit == header || plan.exit == body) return false;
+
+    if (body->GetPredecessors().size() != 1 || body->GetSuccessors().size() != 1 ||
+        body->GetSuccessors()[0] != header) {
+        return false;
+    }
+
+    const auto& pre_instrs = plan.preheader->GetInstructions();
+    if (plan.preheader->GetSuccessors().size() != 1 || pre_instrs.empty() ||
+        pre_instrs.back()->GetOpCode() != OpCode::Br) {
+        return false;
+    }
+
+    const auto& body_instrs = body->GetInstructions();
+    if (body_instrs.empty() || body_instrs.back()->GetOpCode() != OpCode::Br) return false;
+
+    plan.header = header;
+    plan.body = body;
+    for (SSABasicBlock* block : {header, body}) {
+        for (const auto& instr : block->GetInstructions()) {
+            if (instr->GetResult()) plan.loop_defined.insert(instr->GetResult());
+        }
+    }
+    auto invariant = [&](SSAValue* value) { return plan.loop_defined.count(value) == 0; };
+
+    // Header: phis, then 'c = lt i, limit', then 'condbr c'
+    const auto& header_instrs = header->GetInstructions();
+    size_t n = header_instrs.size();
+    if (n < 3) return false;
+    SSAInstruction* compare = header_instrs[n - 2].get();
+    SSAInstruction* branch = header_instrs[n - 1].get();
+    if (branch->GetOpCode() != OpCode::CondBr || compare->GetOpCode() != OpCode::Lt ||
+        branch->GetOperands().size() != 1 || branch->GetOperands()[0] != compare->GetResult()) {
+        return false;
+    }
+    for (size_t k = 0; k + 2 < n; ++k) {
+        if (header_instrs[k]->GetOpCode() != OpCode::Phi) return false;
+    }
+
+    plan.limit = compare->GetOperands()[1];
+    if (!invariant(plan.limit)) return false;
+
+    std::unordered_map<SSAValue*, SSAInstruction*> body_def;
+    for (const auto& instr : body_instrs) {
+        if (instr->GetResult()) body_def[instr->GetResult()] = instr.get();
+    }
+    auto body_instr = [&](SSAValue* value) -> SSAInstruction* {
+        auto it = body_def.find(value);
+        return it == body_def.end() ? nullptr : it->second;
+    };
+
+    // Induction variable: i = phi [start, i + 1]; other phis must be sum reductions
+    for (size_t k = 0; k + 2 < n; ++k) {
+        SSAInstruction* phi = header_instrs[k].get();
+        if (phi->GetOperands().size() != 2) return false;
+        SSAValue* entry = phi->GetOperands()[plan.entry_edge];
+        SSAInstruction* update = body_instr(phi->GetOperands()[plan.latch_edge]);
+        if (!invariant(entry) || !update || update->GetOpCode() != OpCode::Add) return false;
+
+        const auto& ops = update->GetOperands();
+        SSAValue* other = nullptr;
+        if (ops[0] == phi->GetResult()) other = ops[1];
+        else if (ops[1] == phi->GetResult()) other = ops[0];
+        if (!other) return false;
+
+        if (phi->GetResult() == compare->GetOperands()[0]) {
+            if (!IsConstant(other) || other->GetConstantValue() != 1) return false;
+            plan.iv_phi = phi;
+            plan.iv_next = update;
+            plan.start = entry;
+        } else {
+            plan.reductions.push_back(LoopPlan::Reduction{phi, update, other});
+        }
+    }
+    if (!plan.iv_phi) return false;
+
+    if (IsConstant(plan.start) && IsConstant(plan.limit)) {
+        plan.trip_count = std::max<int64_t>(
+            0, plan.limit->GetConstantValue() - plan.start->GetConstantValue());
+    }
+
+    // A reduction's running value is only visible to its own update
+    for (const auto& red : plan.reductions) {
+        for (SSABasicBlock* block : {header, body}) {
+            for (const auto& instr : block->GetInstructions()) {
+                if (instr.get() == red.update || instr.get() == red.phi) continue;
+                for (SSAValue* op : instr->GetOperands()) {
+                    if (op == red.phi->GetResult() || op == red.update->GetResult()) return false;
+                }
+            }
+        }
+    }
+
+    // Classify body values: affine in i (scalar), or one value per lane (vector)
+    enum class Kind { Affine, Vector, Invalid };
+    auto classify = [&](SSAValue* value, Affine& out) -> Kind {
+        if (value == plan.iv_phi->GetResult()) {
+            out = Affine{1, nullptr, 0};
+            return Kind::Affine;
+        }
+        if (IsConstant(value)) {
+            out = Affine{0, nullptr, value->GetConstantValue()};
+            return Kind::Affine;
+        }
+        if (invariant(value)) {
+            out = Affine{0, value, 0};
+            return Kind::Affine;
+        }
+        auto it = plan.affine.find(value);
+        if (it != plan.affine.end()) {
+            out = it->second;
+            return Kind::Affine;
+        }
+        return plan.vector.count(value) ? Kind::Vector : Kind::Invalid;
+    };
+
+    // Lanes need a value per iteration: vectors, or uniform scalars broadcast to all lanes
+    auto lane_operand = [&](SSAValue* value) -> bool {
+        Affine a;
+        Kind kind = classify(value, a);
+        if (kind == Kind::Vector) return true;
+        if (kind != Kind::Affine || a.coef != 0) return false;
+        if (!invariant(value)) plan.uniform_splats.insert(value);
+        return true;
+    };
+
+    for (size_t pos = 0; pos + 1 < body_instrs.size(); ++pos) {
+        SSAInstruction* instr = body_instrs[pos].get();
+        const auto& ops = instr->GetOperands();
+        OpCode op = instr->GetOpCode();
+
+        bool is_reduction = false;
+        for (const auto& red : plan.reductions) {
+            if (red.update == instr) is_reduction = true;
+        }
+        if (is_reduction) {
+            SSAValue* addend = ops[0];
+            for (const auto& red : plan.reductions) {
+                if (red.update == instr) addend = red.addend;
+            }
+            if (!lane_operand(addend)) return false;
+            continue;
+        }
+
+        if (op == OpCode::Load || op == OpCode::Store) {
+            SSAValue* address = op == OpCode::Load ? ops[0] : ops[1];
+            Affine a;
+            if (classify(address, a) != Kind::Affine || a.coef != 8) return false;
+            if (op == OpCode::Store && !lane_operand(ops[0])) return false;
+            plan.accesses.push_back(
+                LoopPlan::Access{instr, a.base, a.offset, op == OpCode::Store, pos});
+            if (op == OpCode::Load) plan.vector.insert(instr->GetResult());
+            continue;
+        }
+
+        if (op != OpCode::Add && op != OpCode::Sub && op != OpCode::Mul) return false;
+        if (ops.size() != 2 || !instr->GetResult()) return false;
+
+        Affine a, b;
+        Kind ka = classify(ops[0], a);
+        Kind kb = classify(ops[1], b);
+        if (ka == Kind::Invalid || kb == Kind::Invalid) return false;
+
+        if (ka == Kind::Affine && kb == Kind::Affine) {
+            Affine r;
+            bool linear = true;
+            if (op == OpCode::Add) {
+                linear = !(a.base && b.base);
+                r = Affine{a.coef + b.coef, a.base ? a.base : b.base, a.offset + b.offset};
+            } else if (op == OpCode::Sub) {
+                linear = b.base == nullptr;
+                r = Affine{a.coef - b.coef, a.base, a.offset - b.offset};
+            } else {
+                bool a_const = a.coef == 0 && !a.base;
+                bool b_const = b.coef == 0 && !b.base;
+                const Affine& x = a_const ? b : a;
+                int64_t k = a_const ? a.offset : b.offset;
+                linear = (a_const || b_const) && (!x.base || k == 1);
+                r = Affine{x.coef * k, x.base, x.offset * k};
+            }
+            if (!linear) {
+                // Invariant but not linear in i: a fresh symbol, still usable as a base
+                if (a.coef != 0 || b.coef != 0) return false;
+                r = Affine{0, instr->GetResult(), 0};
+            }
+            plan.affine[instr->GetResult()] = r;
+            continue;
+        }
+
+        if (!lane_operand(ops[0]) || !lane_operand(ops[1])) return false;
+        plan.vector.insert(instr->GetResult());
+    }
+
+    return !plan.accesses.empty() || !plan.reductions.empty();
+}
+
+// ============================================================================
+// DEPENDENCE TESTING
+// Accesses off the same base are compared by iteration distance d: the
+// element one touches in iteration j the other touches in iteration j + d.
+// A vector iteration runs every instruction for W lanes before the next, so
+// a pair is safe when its order within the body already matches the scalar
+// order, or when |d| >= W keeps both ends in different vector iterations.
+// ============================================================================
+
+bool VectorizationEngine::CheckDependences(LoopPlan& plan) {
+    int64_t width = vector_width_;
+
+    for (const auto& store : plan.accesses) {
+        if (!store.is_store) continue;
+        for (const auto& other : plan.accesses) {
+            if (&other == &store || other.base != store.base) continue;
+
+            int64_t diff = store.offset - other.offset;
+            if (diff % 8 != 0) return false;  // Partially overlapping words
+            int64_t d = diff / 8;
+            if (d == 0) continue;
+
+            bool ordered;
+            if (other.is_store) {
+                ordered = false;
+            } else if (d > 0) {
+                ordered = other.position > store.position;  // Read after the write it needs
+            } else {
+                ordered = other.position < store.position;  // Read before the write that clobbers it
+            }
+            if (ordered) continue;
+
+            int64_t distance = std::abs(d);
+            if (distance < width) width = FloorPowerOfTwo(distance);
+        }
+    }
+    if (width < 2) return false;
+
+    // Accesses off different bases: distinct stack objects never overlap, other
+    // bases are checked at run time if they are available in the preheader
+    std::map<SSAValue*, bool> bases;  // base -> has a store
+    for (const auto& access : plan.accesses) {
+        bases[access.base] = bases[access.base] || access.is_store;
+    }
+    for (auto a = bases.begin(); a != bases.end(); ++a) {
+        for (auto b = std::next(a); b != bases.end(); ++b) {
+            if (!a->second && !b->second) continue;
+            if (!a->first || !b->first) return false;
+            if (plan.allocas.count(a->first) && plan.allocas.count(b->first)) continue;
+            if (plan.loop_defined.count(a->first) || plan.loop_defined.count(b->first)) {
+                return false;
+            }
+            plan.alias_checks.push_back(std::make_pair(a->first, b->first));
+        }
+    }
+
+    plan.width = static_cast<int>(width);
+    return true;
+}
+
+// ============================================================================
+// COST MODEL
+// Reciprocal throughputs in cycles for 64-bit lanes. No x86 target below
+// AVX-512DQ multiplies 64-bit lanes, so VectorMul is a pmuludq sequence.
+// ============================================================================
+
+double VectorizationEngine::VectorCost(OpCode op) const {
+    bool sse = target_ == SIMDTarget::SSE2 || target_ == SIMDTarget::SSE4_2;
+    bool ymm = target_ == SIMDTarget::AVX2 || target_ == SIMDTarget::AVX512;
+
+    switch (op) {
+        case OpCode::VectorLoad:
+        case OpCode::VectorStore:
+            return 1;
+        case OpCode::VectorAdd:
+        case OpCode::VectorSub:
+            return sse ? 1.5 : 1;  // Two-operand SSE needs a copy when dst != src1
+        case OpCode::VectorMul:
+            return sse ? 11 : 8;
+        case OpCode::VectorSplat:
+            return 2;
+        case OpCode::VectorBuild:
+            return ymm ? 7 : 3;   // movq per lane, then unpack/insert
+        case OpCode::VectorReduceAdd:
+            return ymm ? 5 : 3;
+        default:
+            return 1;
+    }
+}
+
+double VectorizationEngine::EstimateSpeedup(const LoopPlan& plan) const {
+    const int W = plan.width;
+    double scalar = 2;      // Compare and branch
+    double vector = 2 + 1;  // Compare, branch and the wide induction step
+
+    for (const auto& instr : plan.body->GetInstructions()) {
+        if (IsTerminator(*instr)) continue;
+        scalar += 1;
+
+        OpCode op = instr->GetOpCode();
+        if (op == OpCode::Load) {
+            vector += VectorCost(OpCode::VectorLoad);
+        } else if (op == OpCode::Store) {
+            vector += VectorCost(OpCode::VectorStore);
+        } else if (instr->GetResult() && plan.vector.count(instr->GetResult())) {
+            vector += VectorCost(VectorOpFor(op));
+        } else {
+            bool reduction = false;
+            for (const auto& red : plan.reductions) reduction = reduction || red.update == instr.get();
+            vector += reduction ? VectorCost(OpCode::VectorAdd) : 1;
+        }
+    }
+    vector += plan.uniform_splats.size() * VectorCost(OpCode::VectorSplat);
+
+    // Once per loop entry: bounds, broadcasts, alias checks and final reductions
+    double setup = 4 + 4.0 * plan.alias_checks.size();
+    setup += plan.reductions.size() * (VectorCost(OpCode::VectorSplat) +
+                                       VectorCost(OpCode::VectorReduceAdd) + 1);
+    for (const auto& instr : plan.body->GetInstructions()) {
+        for (SSAValue* op : instr->GetOperands()) {
+            if (plan.loop_defined.count(op) == 0 && op != plan.start) setup += 0.5;
+        }
+    }
+
+    int64_t trips = plan.trip_count >= 0 ? plan.trip_count : kAssumedTripCount;
+    if (trips == 0) return 0;
+    double scalar_total = scalar * trips;
+    double vector_total = setup + vector * (trips / W) + scalar * (trips % W);
+    return scalar_total / vector_total;
+}
+
+// ============================================================================
+// CODE GENERATION
+//
+//   preheader:  cnt = limit - start   vlim = limit - (cnt & (W-1))
+//               broadcasts, alias checks         condbr ok, vec.header, header
+//   vec.header: vi = phi [start, vi + W]   vacc = phi [0, vacc.next]
+//               condbr (lt vi, vlim), vec.body, vec.exit
+//   vec.body:   the body on W lanes                         br vec.header
+//   vec.exit:   acc0 = init + reduce(vacc)                  br header
+//
+// The original loop becomes the scalar epilogue: it resumes at i = vi with
+// the partial sums, and still runs alone when an alias check fails.
+// ============================================================================
+
+void VectorizationEngine::GenerateVectorCode(SSAFunction& func, const AdvancedOptimizer::Loop& /*loop*/) {
+    LoopPlan& plan = *plan_;
+    const int W = plan.width;
+    SSABasicBlock* pre = plan.preheader;
+    SSABasicBlock* header = plan.header;
+
+    pre->RemoveInstruction(pre->GetInstructions().size() - 1);  // Re-emitted below
+
+    SSAValue* count = Append(func, pre, OpCode::Sub, {plan.limit, plan.start});
+    SSAValue* rest = Append(func, pre, OpCode::And, {count, func.CreateConstant(W - 1)});
+    SSAValue* vector_limit = Append(func, pre, OpCode::Sub, {plan.limit, rest});
+
+    SSAValue* all_ok = nullptr;
+    for (const auto& pair : plan.alias_checks) {
+        int64_t lo[2] = {INT64_MAX, INT64_MAX};
+        int64_t hi[2] = {INT64_MIN, INT64_MIN};
+        for (const auto& access : plan.accesses) {
+            int side = access.base == pair.first ? 0 : access.base == pair.second ? 1 : -1;
+            if (side < 0) continue;
+            lo[side] = std::min(lo[side], access.offset);
+            hi[side] = std::max(hi[side], access.offset);
+        }
+
+        // Disjoint when one footprint ends before the other starts
+        SSAValue* span = Append(func, pre, OpCode::Mul, {count, func.CreateConstant(8)});
+        SSAValue* gap1 = Append(func, pre, OpCode::Sub, {pair.second, pair.first});
+        SSAValue* need1 = Append(func, pre, OpCode::Add, {span, func.CreateConstant(hi[0] - lo[1])});
+        SSAValue* ok1 = Append(func, pre, OpCode::Ge, {gap1, need1});
+        SSAValue* gap2 = Append(func, pre, OpCode::Sub, {pair.first, pair.second});
+        SSAValue* need2 = Append(func, pre, OpCode::Add, {span, func.CreateConstant(hi[1] - lo[0])});
+        SSAValue* ok2 = Append(func, pre, OpCode::Ge, {gap2, need2});
+        SSAValue* ok = Append(func, pre, OpCode::Or, {ok1, ok2});
+        all_ok = all_ok ? Append(func, pre, OpCode::And, {all_ok, ok}) : ok;
+        stats_.runtime_alias_checks++;
+    }
+
+    SSABasicBlock* vec_header = func.CreateBasicBlock(header->GetName() + ".vec");
+    SSABasicBlock* vec_body = func.CreateBasicBlock(plan.body->GetName() + ".vec");
+    SSABasicBlock* vec_exit = func.CreateBasicBlock(header->GetName() + ".vec.exit");
+
+    // Vector header: induction and accumulator phis, then the bound test
+    auto vi_phi = std::make_unique<SSAInstruction>(OpCode::Phi);
+    SSAValue* vi = func.CreateValue(SSAValue::Kind::Register);
+    vi_phi->SetResult(vi);
+    vi_phi->AddOperand(plan.start);
+    SSAInstruction* vi_phi_ptr = vi_phi.get();
+    vec_header->AddInstruction(std::move(vi_phi));
+
+    std::vector<SSAInstruction*> acc_phis;
+    std::unordered_map<SSAValue*, SSAValue*> lane_map;  // Scalar body value -> vector value
+    for (const auto& red : plan.reductions) {
+        SSAValue* zero = Append(func, pre, OpCode::VectorSplat, {func.CreateConstant(0)}, W);
+        auto phi = std::make_unique<SSAInstruction>(OpCode::Phi);
+        SSAValue* vacc = func.CreateValue(SSAValue::Kind::Register);
+        phi->SetResult(vacc);
+        phi->SetVectorWidth(W);
+        phi->AddOperand(zero);
+        acc_phis.push_back(phi.get());
+        vec_header->AddInstruction(std::move(phi));
+        lane_map[red.phi->GetResult()] = vacc;
+    }
+    SSAValue* in_range = Append(func, vec_header, OpCode::Lt, {vi, vector_limit});
+    Append(func, vec_header, OpCode::CondBr, {in_range});
+
+    // Vector body
+    std::unordered_map<SSAValue*, SSAValue*> scalar_map;  // Affine body value -> clone
+    std::unordered_map<SSAValue*, SSAValue*> splats;      // Invariant -> preheader broadcast
+    std::unordered_map<SSAValue*, SSAValue*> body_splats; // Uniform body value -> broadcast
+    scalar_map[plan.iv_phi->GetResult()] = vi;
+
+    auto scalar = [&](SSAValue* value) {
+        auto it = scalar_map.find(value);
+        return it == scalar_map.end() ? value : it->second;
+    };
+    auto lanes = [&](SSAValue* value) -> SSAValue* {
+        auto it = lane_map.find(value);
+        if (it != lane_map.end()) return it->second;
+        if (plan.loop_defined.count(value)) {
+            SSAValue*& splat = body_splats[value];
+            if (!splat) splat = Append(func, vec_body, OpCode::VectorSplat, {scalar(value)}, W);
+            return splat;
+        }
+        SSAValue*& splat = splats[value];
+        if (!splat) splat = Append(func, pre, OpCode::VectorSplat, {value}, W);
+        return splat;
+    };
+
+    std::vector<SSAValue*> acc_next(plan.reductions.size(), nullptr);
+    const auto& body_instrs = plan.body->GetInstructions();
+    for (size_t pos = 0; pos + 1 < body_instrs.size(); ++pos) {
+        SSAInstruction* instr = body_instrs[pos].get();
+        const auto& ops = instr->GetOperands();
+        OpCode op = instr->GetOpCode();
+
+        int reduction = -1;
+        for (size_t r = 0; r < plan.reductions.size(); ++r) {
+            if (plan.reductions[r].update == instr) reduction = static_cast<int>(r);
+        }
+
+        if (reduction >= 0) {
+            const auto& red = plan.reductions[reduction];
+            acc_next[reduction] = Append(func, vec_body, OpCode::VectorAdd,
+                                         {lane_map[red.phi->GetResult()], lanes(red.addend)}, W);
+        } else if (op == OpCode::Load) {
+            lane_map[instr->GetResult()] =
+                Append(func, vec_body, OpCode::VectorLoad, {scalar(ops[0])}, W);
+        } else if (op == OpCode::Store) {
+            Append(func, vec_body, OpCode::VectorStore, {lanes(ops[0]), scalar(ops[1])}, W);
+        } else if (plan.vector.count(instr->GetResult())) {
+            lane_map[instr->GetResult()] =
+                Append(func, vec_body, VectorOpFor(op), {lanes(ops[0]), lanes(ops[1])}, W);
+        } else {
+            scalar_map[instr->GetResult()] =
+                Append(func, vec_body, op, {scalar(ops[0]), scalar(ops[1])});
+        }
+    }
+    SSAValue* vi_next = Append(func, vec_body, OpCode::Add, {vi, func.CreateConstant(W)});
+    Append(func, vec_body, OpCode::Br, {});
+
+    vi_phi_ptr->AddOperand(vi_next);
+    for (size_t r = 0; r < acc_phis.size(); ++r) acc_phis[r]->AddOperand(acc_next[r]);
+
+    // Vector exit: fold the lanes into the scalar accumulators
+    std::vector<SSAValue*> acc_start;
+    for (const auto& red : plan.reductions) {
+        SSAValue* sum = Append(func, vec_exit, OpCode::VectorReduceAdd,
+                               {lane_map[red.phi->GetResult()]}, W);
+        SSAValue* init = red.phi->GetOperands()[plan.entry_edge];
+        acc_start.push_back(Append(func, vec_exit, OpCode::Add, {init, sum}));
+    }
+    Append(func, vec_exit, OpCode::Br, {});
+
+    // Scalar loop resumes where the vector loop stopped
+    std::vector<SSAValue*> original_entry;
+    for (const auto& instr : header->GetInstructions()) {
+        if (instr->GetOpCode() != OpCode::Phi) break;
+        original_entry.push_back(instr->GetOperands()[plan.entry_edge]);
+    }
+    plan.iv_phi->SetOperand(plan.entry_edge, vi);
+    for (size_t r = 0; r < plan.reductions.size(); ++r) {
+        plan.reductions[r].phi->SetOperand(plan.entry_edge, acc_start[r]);
+    }
+    header->ReplacePredecessor(pre, vec_exit);
+    if (all_ok) {
+        header->AddPredecessor(pre);
+        size_t k = 0;
+        for (const auto& instr : header->GetInstructions()) {
+            if (instr->GetOpCode() != OpCode::Phi) break;
+            instr->AddOperand(original_entry[k++]);
+        }
+    }
+
+    // Wire the CFG
+    pre->ReplaceSuccessor(header, vec_header);
+    if (all_ok) {
+        pre->AddSuccessor(header);
+        Append(func, pre, OpCode::CondBr, {all_ok});
+    } else {
+        Append(func, pre, OpCode::Br, {});
+    }
+    vec_header->AddPredecessor(pre);
+    vec_header->AddPredecessor(vec_body);
+    vec_header->AddSuccessor(vec_body);
+    vec_header->AddSuccessor(vec_exit);
+    vec_body->AddPredecessor(vec_header);
+    vec_body->AddSuccessor(vec_header);
+    vec_exit->AddPredecessor(vec_header);
+    vec_exit->AddSuccessor(header);
+}
+
+// ============================================================================
+// SLP VECTORIZATION (Larsen & Amarasinghe, PLDI 2000, bottom-up variant)
+// Seeds are stores to consecutive words in one block. Their values are
+// packed lane by lane: isomorphic Add/Sub/Mul become one vector op, loads
+// of consecutive words one vector load, equal values a splat and anything
+// else a VectorBuild. The packed code replaces the last store of the group.
+// ============================================================================
+
+struct VectorizationEngine::SLPTree {
+    enum class Kind { Op, Load, Splat, Build };
+
+    struct Node {
+        Kind kind = Kind::Build;
+        OpCode op = OpCode::Add;
+        std::vector<SSAInstruction*> lanes;  // Op and Load nodes
+        std::vector<SSAValue*> values;
+        std::vector<int> children;
+    };
+
+    std::unordered_map<SSAValue*, SSAInstruction*> def;  // Whole function
+    std::unordered_map<SSAValue*, int> uses;
+    std::unordered_set<SSAValue*> allocas;
+    std::unordered_map<SSAInstruction*, size_t> position; // This block only
+    std::unordered_set<SSAInstruction*> members;          // Scalars the tree replaces
+    std::vector<Node> nodes;                              // Children before parents
+};
+
+void VectorizationEngine::PerformSLPVectorization(SSAFunction& func) {
+    for (const auto& block : func.GetBlocks()) {
+        std::unordered_set<SSAInstruction*> tried;
+        bool changed = true;
+
+        while (changed) {
+            changed = false;
+
+            std::unordered_map<SSAValue*, SSAInstruction*> def;
+            for (const auto& b : func.GetBlocks()) {
+                for (const auto& instr : b->GetInstructions()) {
+                    if (instr->GetResult()) def[instr->GetResult()] = instr.get();
+                }
+            }
+
+            // Stores by base in first-seen order, each base's stores by offset
+            std::vector<SSAValue*> bases;
+            std::unordered_map<SSAValue*, std::map<int64_t, SSAInstruction*>> by_base;
+            std::unordered_set<SSAValue*> ambiguous;  // Same word stored twice
+            for (const auto& instr : block->GetInstructions()) {
+                if (instr->GetOpCode() != OpCode::Store) continue;
+                auto address = SplitAddress(instr->GetOperands()[1], def);
+                auto& stores = by_base[address.first];
+                if (stores.empty()) bases.push_back(address.first);
+                if (!stores.emplace(address.second, instr.get()).second) ambiguous.insert(address.first);
+            }
+
+            for (SSAValue* base : bases) {
+                if (changed || ambiguous.count(base)) continue;
+
+                std::vector<SSAInstruction*> run;
+                int64_t next = 0;
+                for (const auto& entry : by_base[base]) {
+                    if (run.empty() || entry.first != next) run.clear();
+                    run.push_back(entry.second);
+                    next = entry.first + 8;
+                    if (static_cast<int>(run.size()) < vector_width_) continue;
+
+                    if (!tried.count(run[0])) {
+                        if (VectorizeStoreGroup(func, *block, run)) {
+                            changed = true;
+                            break;
+                        }
+                        tried.insert(run[0]);
+                        stats_.slp_rejected++;
+                    }
+                    run.clear();
+                }
+            }
+        }
+    }
+}
+
+int VectorizationEngine::BuildSLPNode(SLPTree& tree, const std::vector<SSAValue*>& lanes, int depth) {
+    SLPTree::Node node;
+    node.values = lanes;
+
+    auto defining_op = [&](SSAValue* value) -> int {
+        auto it = tree.def.find(value);
+        return it == tree.def.end() ? -1 : static_cast<int>(it->second->GetOpCode());
+    };
+
+    if (std::all_of(lanes.begin(), lanes.end(), [&](SSAValue* v) { return v == lanes[0]; })) {
+        node.kind = SLPTree::Kind::Splat;
+        tree.nodes.push_back(node);
+        return static_cast<int>(tree.nodes.size()) - 1;
+    }
+
+    // Every lane a single-use scalar of this block with the same opcode
+    std::vector<SSAInstruction*> instrs;
+    bool isomorphic = depth < kMaxSLPDepth;
+    for (SSAValue* value : lanes) {
+        if (!isomorphic) break;
+        auto it = tree.def.find(value);
+        SSAInstruction* instr = it == tree.def.end() ? nullptr : it->second;
+        isomorphic = instr && tree.position.count(instr) && !tree.members.count(instr) &&
+                     tree.uses[value] == 1 &&
+                     std::find(instrs.begin(), instrs.end(), instr) == instrs.end() &&
+                     (instrs.empty() || instr->GetOpCode() == instrs[0]->GetOpCode());
+        instrs.push_back(instr);
+    }
+
+    if (isomorphic) {
+        OpCode op = instrs[0]->GetOpCode();
+
+        if (op == OpCode::Load) {
+            auto first = SplitAddress(instrs[0]->GetOperands()[0], tree.def);
+            bool consecutive = true;
+            for (size_t k = 1; k < instrs.size(); ++k) {
+                auto address = SplitAddress(instrs[k]->GetOperands()[0], tree.def);
+                consecutive = consecutive && address.first == first.first &&
+                              address.second == first.second + 8 * static_cast<int64_t>(k);
+            }
+            if (consecutive) {
+                node.kind = SLPTree::Kind::Load;
+                node.op = op;
+                node.lanes = instrs;
+                tree.members.insert(instrs.begin(), instrs.end());
+                tree.nodes.push_back(node);
+                return static_cast<int>(tree.nodes.size()) - 1;
+            }
+        } else if (op == OpCode::Add || op == OpCode::Sub || op == OpCode::Mul) {
+            tree.members.insert(instrs.begin(), instrs.end());
+
+            // Commuted lanes are swapped back so their operands line up with lane 0
+            std::vector<SSAValue*> left, right;
+            for (SSAInstruction* instr : instrs) {
+                SSAValue* a = instr->GetOperands()[0];
+                SSAValue* b = instr->GetOperands()[1];
+                if (!left.empty() && op != OpCode::Sub &&
+                    defining_op(a) != defining_op(left[0]) && defining_op(b) == defining_op(left[0])) {
+                    std::swap(a, b);
+                }
+                left.push_back(a);
+                right.push_back(b);
+            }
+            node.kind = SLPTree::Kind::Op;
+            node.op = op;
+            node.lanes = instrs;
+            node.children.push_back(BuildSLPNode(tree, left, depth + 1));
+            node.children.push_back(BuildSLPNode(tree, right, depth + 1));
+            tree.nodes.push_back(node);
+            return static_cast<int>(tree.nodes.size()) - 1;
+        }
+    }
+
+    node.kind = SLPTree::Kind::Build;
+    tree.nodes.push_back(node);
+    return static_cast<int>(tree.nodes.size()) - 1;
+}
+
+bool VectorizationEngine::VectorizeStoreGroup(SSAFunction& func, SSABasicBlock& block,
+                                              const std::vector<SSAInstruction*>& stores) {
+    SLPTree tree;
+    for (const auto& b : func.GetBlocks()) {
+        for (const auto& instr : b->GetInstructions()) {
+            if (instr->GetResult()) tree.def[instr->GetResult()] = instr.get();
+            if (instr->GetOpCode() == OpCode::Alloca) tree.allocas.insert(instr->GetResult());
+            for (SSAValue* op : instr->GetOperands()) tree.uses[op]++;
+        }
+    }
+    const auto& instrs = block.GetInstructions();
+    for (size_t q = 0; q < instrs.size(); ++q) tree.position[instrs[q].get()] = q;
+
+    const int W = static_cast<int>(stores.size());
+    std::vector<SSAValue*> values;
+    size_t insert_at = 0;
+    for (SSAInstruction* store : stores) {
+        values.push_back(store->GetOperands()[0]);
+        insert_at = std::max(insert_at, tree.position[store]);
+        tree.members.insert(store);
+    }
+    int root = BuildSLPNode(tree, values, 0);
+
+    // Packed loads run at the last store and packed stores happen there too:
+    // nothing the scalars are moved across may touch the same memory
+    struct Access {
+        SSAValue* base;
+        int64_t offset;
+        int64_t size;
+        size_t position;
+    };
+    auto access_of = [&](SSAInstruction* instr, SSAValue* address, size_t position) {
+        auto split = SplitAddress(address, tree.def);
+        return Access{split.first, split.second, 8 * int64_t(instr->GetVectorWidth()), position};
+    };
+    auto may_alias = [&](const Access& a, const Access& b) {
+        if (a.base == b.base) return a.offset < b.offset + b.size && b.offset < a.offset + a.size;
+        return !(tree.allocas.count(a.base) && tree.allocas.count(b.base));
+    };
+
+    std::vector<Access> loads, seeds;
+    for (SSAInstruction* store : stores) {
+        seeds.push_back(access_of(store, store->GetOperands()[1], tree.position[store]));
+    }
+    size_t first = seeds[0].position;
+    for (const auto& node : tree.nodes) {
+        if (node.kind != SLPTree::Kind::Load) continue;
+        for (SSAInstruction* load : node.lanes) {
+            loads.push_back(access_of(load, load->GetOperands()[0], tree.position[load]));
+            first = std::min(first, loads.back().position);
+        }
+    }
+    for (const Access& seed : seeds) first = std::min(first, seed.position);
+
+    for (const Access& load : loads) {
+        for (const Access& seed : seeds) {
+            if (seed.position < load.position && may_alias(load, seed)) return false;
+        }
+    }
+    for (size_t q = first + 1; q < insert_at; ++q) {
+        SSAInstruction* instr = instrs[q].get();
+        if (tree.members.count(instr)) continue;
+
+        OpCode op = instr->GetOpCode();
+        if (op == OpCode::Call) return false;
+        bool writes = op == OpCode::Store || op == OpCode::VectorStore;
+        bool reads = op == OpCode::Load || op == OpCode::VectorLoad;
+        if (!writes && !reads) continue;
+
+        Access other = access_of(instr, instr->GetOperands()[writes ? 1 : 0], q);
+        for (const Access& seed : seeds) {
+            if (seed.position < q && may_alias(seed, other)) return false;
+        }
+        if (writes) {
+            for (const Access& load : loads) {
+                if (load.position < q && may_alias(load, other)) return false;
+            }
+        }
+    }
+
+    // Profitability: scalar instructions removed against the packed sequence
+    double scalar = W;
+    double vector = VectorCost(OpCode::VectorStore);
+    int packs = 1;
+    for (const auto& node : tree.nodes) {
+        switch (node.kind) {
+            case SLPTree::Kind::Op:
+                scalar += W;
+                vector += VectorCost(VectorOpFor(node.op));
+                packs++;
+                break;
+            case SLPTree::Kind::Load:
+                scalar += W;
+                vector += VectorCost(OpCode::VectorLoad);
+                packs++;
+                break;
+            case SLPTree::Kind::Splat:
+                vector += VectorCost(OpCode::VectorSplat);
+                break;
+            case SLPTree::Kind::Build:
+                vector += VectorCost(OpCode::VectorBuild);
+                break;
+        }
+    }
+    if (scalar - vector <= 0) return false;
+
+    // Emit the packed tree in front of the last store, then drop the scalars
+    std::vector<SSAValue*> packed(tree.nodes.size(), nullptr);
+    size_t at = insert_at;
+    auto emit = [&](OpCode op, const std::vector<SSAValue*>& operands) {
+        auto instr = Create(func, op, operands, W);
+        SSAValue* result = instr->GetResult();
+        block.InsertInstruction(at++, std::move(instr));
+        return result;
+    };
+    for (size_t n = 0; n < tree.nodes.size(); ++n) {
+        const auto& node = tree.nodes[n];
+        switch (node.kind) {
+            case SLPTree::Kind::Splat:
+                packed[n] = emit(OpCode::VectorSplat, {node.values[0]});
+                break;
+            case SLPTree::Kind::Build:
+                packed[n] = emit(OpCode::VectorBuild, node.values);
+                break;
+            case SLPTree::Kind::Load:
+                packed[n] = emit(OpCode::VectorLoad, {node.lanes[0]->GetOperands()[0]});
+                break;
+            case SLPTree::Kind::Op:
+                packed[n] = emit(VectorOpFor(node.op),
+                                 {packed[node.children[0]], packed[node.children[1]]});
+                break;
+        }
+    }
+    emit(OpCode::VectorStore, {packed[root], stores[0]->GetOperands()[1]});
+
+    for (size_t q = block.GetInstructions().size(); q-- > 0;) {
+        if (tree.members.count(block.GetInstructions()[q].get())) block.RemoveInstruction(q);
+    }
+
+    stats_.slp_trees++;
+    stats_.slp_packs += packs;
+    stats_.slp_cycles_saved += scalar - vector;
+    return true;
+}
+
+void VectorizationEngine::Stats::Print(const std::string& label) const {
+    std::cout << "\n=== Vectorization (" << label << ") ===\n";
+    std::cout << "Loops analyzed: " << loops_analyzed << "\n";
+    std::cout << "Loops vectorized: " << loops_vectorized << "\n";
+    std::cout << "Rejected (shape): " << rejected_shape << "\n";
+    std::cout << "Rejected (dependence): " << rejected_dependence << "\n";
+    std::cout << "Rejected (cost): " << rejected_cost << "\n";
+    std::cout << "Runtime alias checks: " << runtime_alias_checks << "\n";
+    std::cout << "Estimated speedup: " << estimated_speedup << "x\n";
+    std::cout << "SLP store groups packed: " << slp_trees << "\n";
+    std::cout << "SLP packs formed: " << slp_packs << "\n";
+    std::cout << "SLP groups kept scalar: " << slp_rejected << "\n";
+    std::cout << "SLP cycles saved: " << slp_cycles_saved << "\n";
+}
+
+} // namespace AdvancedOptimization
+} // namespace Snow
@@ -0,0 +1,327 @@
+#include "VirtualMachine.h"
+#include "../Runtime/Runtime.h"
+#include <stdexcept>
+#include <limits>
+#include <algorithm>
+
+#if defined(__GNUC__)
+#define SNOW_COMPUTED_GOTO 1
+#endif
+
+namespace Snow {
+namespace VM {
+
+namespace {
+
+// ============================================================================
+// RUNTIME BINDINGS
+// ============================================================================
+
+int64_t SnowSay(int64_t value) { Runtime::Say(value); return 0; }
+int64_t SnowShowDod(int64_t value) { Runtime::ShowDod(value); return 0; }
+int64_t SnowGetCurrentTime() { return Runtime::GetCurrentTime(); }
+int64_t SnowAbs(int64_t value) { return Runtime::Abs(value); }
+int64_t SnowMin(int64_t a, int64_t b) { return Runtime::Min(a, b); }
+int64_t SnowMax(int64_t a, int64_t b) { return Runtime::Max(a, b); }
+
+int64_t SnowWait(int64_t nanoseconds) {
+    if (nanoseconds > 0) Runtime::Wait(nanoseconds);
+    return 0;
+}
+
+int64_t SnowAllocate(int64_t size) {
+    return reinterpret_cast<int64_t>(Runtime::Allocate(static_cast<size_t>(size)));
+}
+
+int64_t SnowDeallocate(int64_t pointer) {
+    Runtime::Deallocate(reinterpret_cast<void*>(pointer));
+    return 0;
+}
+
+int64_t CallNative(void* function, const int64_t* a, uint32_t count) {
+    typedef int64_t (*F0)();
+    typedef int64_t (*F1)(int64_t);
+    typedef int64_t (*F2)(int64_t, int64_t);
+    typedef int64_t (*F3)(int64_t, int64_t, int64_t);
+    typedef int64_t (*F4)(int64_t, int64_t, int64_t, int64_t);
+    typedef int64_t (*F5)(int64_t, int64_t, int64_t, int64_t, int64_t);
+    typedef int64_t (*F6)(int64_t, int64_t, int64_t, int64_t, int64_t, int64_t);
+    switch (count) {
+        case 0: return reinterpret_cast<F0>(function)();
+        case 1: return reinterpret_cast<F1>(function)(a[0]);
+        case 2: return reinterpret_cast<F2>(function)(a[0], a[1]);
+        case 3: return reinterpret_cast<F3>(function)(a[0], a[1], a[2]);
+        case 4: return reinterpret_cast<F4>(function)(a[0], a[1], a[2], a[3]);
+        case 5: return reinterpret_cast<F5>(function)(a[0], a[1], a[2], a[3], a[4]);
+        case 6: return reinterpret_cast<F6>(function)(a[0], a[1], a[2], a[3], a[4], a[5]);
+    }
+    throw std::runtime_error("Native calls take at most 6 arguments");
+}
+
+int64_t Divide(int64_t dividend, int64_t divisor) {
+    if (divisor == 0) throw std::runtime_error("Division by zero");
+    if (divisor == -1 && dividend == std::numeric_limits<int64_t>::min()) {
+        throw std::runtime_error("Division overflow");
+    }
+    return dividend / divisor;
+}
+
+const size_t kDefaultStackRegisters = 1 << 18;   // 2 MB
+
+} // anonymous namespace
+
+VirtualMachine::VirtualMachine()
+    : module_(nullptr), wait_handler_(nullptr), stack_size_(kDefaultStackRegisters) {
+    AddSymbol("Say", reinterpret_cast<void*>(&SnowSay));
+    AddSymbol("Wait", reinterpret_cast<void*>(&SnowWait));
+    AddSymbol("ShowDod", reinterpret_cast<void*>(&SnowShowDod));
+    AddSymbol("GetCurrentTime", reinterpret_cast<void*>(&SnowGetCurrentTime));
+    AddSymbol("Abs", reinterpret_cast<void*>(&SnowAbs));
+    AddSymbol("Min", reinterpret_cast<void*>(&SnowMin));
+    AddSymbol("Max", reinterpret_cast<void*>(&SnowMax));
+    AddSymbol("Allocate", reinterpret_cast<void*>(&SnowAllocate));
+    AddSymbol("Deallocate", reinterpret_cast<void*>(&SnowDeallocate));
+}
+
+bool VirtualMachine::Load(const BytecodeModule& module) {
+    error_.clear();
+    natives_.clear();
+    for (const auto& name : module.natives) {
+        auto symbol = symbols_.find(name);
+        if (symbol == symbols_.end()) {
+            error_ = "Undefined function '" + name + "'";
+            return false;
+        }
+        natives_.push_back(symbol->second);
+    }
+    module_ = &module;
+    sites_.assign(module.sites, 0);
+    site_seen_.assign(module.sites, false);
+    captures_.clear();
+    return true;
+}
+
+bool VirtualMachine::Run(const std::string& function, int64_t& result) {
+    if (!module_) {
+        error_ = "No module loaded";
+        return false;
+    }
+    int index = module_->FindFunction(function);
+    if (index < 0) {
+        error_ = "No function named '" + function + "'";
+        return false;
+    }
+    return Run(static_cast<uint32_t>(index), result);
+}
+
+bool VirtualMachine::Run(uint32_t function, int64_t& result) {
+    if (!module_) {
+        error_ = "No module loaded";
+        return false;
+    }
+    if (function >= module_->functions.size()) {
+        error_ = "No function #" + std::to_string(function);
+        return false;
+    }
+    const BytecodeFunction& func = module_->functions[function];
+    if (stack_.size() != stack_size_) stack_.assign(stack_size_, 0);
+    if (func.registers > stack_.size()) {
+        error_ = "Stack overflow";
+        return false;
+    }
+    std::fill(stack_.begin(), stack_.begin() + func.registers, 0);
+
+    try {
+        result = Execute(function, 0);
+    } catch (const std::exception& e) {
+        error_ = e.what();
+        return false;
+    }
+    return true;
+}
+
+int64_t VirtualMachine::Execute(uint32_t function, size_t base) {
+    const BytecodeFunction& func = module_->functions[function];
+    const uint32_t* code = module_->code.data();
+    const int64_t* k = module_->constants.data();
+    int64_t* r = stack_.data() + base;
+    const uint32_t* pc = code + func.entry;
+    int64_t lhs = 0, rhs = 0;
+
+#define SNOW_SRC(word) (((word) & 1) ? k[(word) >> 1] : r[(word) >> 1])
+#define SNOW_A() (pc[0] >> 8)
+
+#ifdef SNOW_COMPUTED_GOTO
+    // Order matches Bytecode
+    static const void* const handlers[] = {
+        &&op_MOV, &&op_LOAD, &&op_STORE, &&op_ADD, &&op_SUB, &&op_MUL, &&op_DIV, &&op_CMP,
+        &&op_JMP, &&op_JE, &&op_JNE, &&op_JG, &&op_JL, &&op_JGE, &&op_JLE,
+        &&op_CALL, &&op_CALLN, &&op_RET, &&op_WAIT, &&op_DODECAP, &&op_SAMPLE, &&op_DELTA,
+        &&op_CMP_JE, &&op_CMP_JNE, &&op_CMP_JG, &&op_CMP_JL, &&op_CMP_JGE, &&op_CMP_JLE, &&op_MOV_ADD
+    };
+    static_assert(sizeof(handlers) / sizeof(handlers[0]) == static_cast<size_t>(Bytecode::Count),
+                  "handler table out of sync with Bytecode");
+#define SNOW_DISPATCH() goto *handlers[*pc & 0xFF]
+#define SNOW_OP(name) op_##name:
+#else
+#define SNOW_DISPATCH() goto dispatch
+#define SNOW_OP(name) case Bytecode::name:
+#endif
+
+#define SNOW_BRANCH_IF(condition)                       \
+    pc = (condition) ? code + SNOW_A() : pc + 1;        \
+    SNOW_DISPATCH();
+
+#define SNOW_CMP_BRANCH_IF(condition)                   \
+    lhs = SNOW_SRC(pc[1]);                              \
+    rhs = SNOW_SRC(pc[2]);                              \
+    pc = (condition) ? code + SNOW_A() : pc + 3;        \
+    SNOW_DISPATCH();
+
+#ifdef SNOW_COMPUTED_GOTO
+    SNOW_DISPATCH();
+#else
+dispatch:
+    switch (DecodeOpcode(*pc)) {
+#endif
+
+    SNOW_OP(MOV)
+        r[SNOW_A()] = SNOW_SRC(pc[1]);
+        pc += 2;
+        SNOW_DISPATCH();
+
+    SNOW_OP(LOAD)
+        r[SNOW_A()] = *reinterpret_cast<const int64_t*>(SNOW_SRC(pc[1]));
+        pc += 2;
+        SNOW_DISPATCH();
+
+    SNOW_OP(STORE)
+        *reinterpret_cast<int64_t*>(SNOW_SRC(pc[1])) = SNOW_SRC(pc[2]);
+        pc += 3;
+        SNOW_DISPATCH();
+
+    SNOW_OP(ADD)
+        r[SNOW_A()] = static_cast<int64_t>(static_cast<uint64_t>(SNOW_SRC(pc[1])) + static_cast<uint64_t>(SNOW_SRC(pc[2])));
+        pc += 3;
+        SNOW_DISPATCH();
+
+    SNOW_OP(SUB)
+        r[SNOW_A()] = static_cast<int64_t>(static_cast<uint64_t>(SNOW_SRC(pc[1])) - static_cast<uint64_t>(SNOW_SRC(pc[2])));
+        pc += 3;
+        SNOW_DISPATCH();
+
+    SNOW_OP(MUL)
+        r[SNOW_A()] = static_cast<int64_t>(static_cast<uint64_t>(SNOW_SRC(pc[1])) * static_cast<uint64_t>(SNOW_SRC(pc[2])));
+        pc += 3;
+        SNOW_DISPATCH();
+
+    SNOW_OP(DIV)
+        r[SNOW_A()] = Divide(SNOW_SRC(pc[1]), SNOW_SRC(pc[2]));
+        pc += 3;
+        SNOW_DISPATCH();
+
+    SNOW_OP(CMP)
+        lhs = SNOW_SRC(pc[1]);
+        rhs = SNOW_SRC(pc[2]);
+        pc += 3;
+        SNOW_DISPATCH();
+
+    SNOW_OP(JMP)
+        pc = code + SNOW_A();
+        SNOW_DISPATCH();
+
+    SNOW_OP(JE)  SNOW_BRANCH_IF(lhs == rhs)
+    SNOW_OP(JNE) SNOW_BRANCH_IF(lhs != rhs)
+    SNOW_OP(JG)  SNOW_BRANCH_IF(lhs > rhs)
+    SNOW_OP(JL)  SNOW_BRANCH_IF(lhs < rhs)
+    SNOW_OP(JGE) SNOW_BRANCH_IF(lhs >= rhs)
+    SNOW_OP(JLE) SNOW_BRANCH_IF(lhs <= rhs)
+
+    SNOW_OP(CALL) {
+        // The callee's frame starts right above this one; result in R0
+        const BytecodeFunction& callee = module_->functions[SNOW_A()];
+        size_t callee_base = base + func.registers;
+        if (callee_base + callee.registers > stack_.size()) throw std::runtime_error("Stack overflow");
+        int64_t* frame = r + func.registers;
+        uint32_t count = pc[1];
+        std::fill(frame, frame + callee.registers, 0);
+        for (uint32_t i = 0; i < count && i < callee.registers; i++) frame[i] = SNOW_SRC(pc[2 + i]);
+        r[0] = Execute(SNOW_A(), callee_base);
+        pc += 2 + count;
+        SNOW_DISPATCH();
+    }
+
+    SNOW_OP(CALLN) {
+        int64_t args[6];
+        uint32_t count = pc[1];
+        for (uint32_t i = 0; i < count && i < 6; i++) args[i] = SNOW_SRC(pc[2 + i]);
+        r[0] = CallNative(natives_[SNOW_A()], args, count);
+        pc += 2 + count;
+        SNOW_DISPATCH();
+    }
+
+    SNOW_OP(RET)
+        return r[0];
+
+    SNOW_OP(WAIT) {
+        int64_t nanoseconds = SNOW_SRC(pc[1]);
+        if (wait_handler_) {
+            wait_handler_(nanoseconds);
+        } else if (nanoseconds > 0) {
+            Runtime::Wait(nanoseconds);
+        }
+        pc += 2;
+        SNOW_DISPATCH();
+    }
+
+    SNOW_OP(DODECAP)
+        r[SNOW_A()] = SNOW_SRC(pc[1]);
+        captures_.push_back(r[SNOW_A()]);
+        pc += 3;
+        SNOW_DISPATCH();
+
+    SNOW_OP(SAMPLE)
+        r[SNOW_A()] = sites_[pc[2]] = SNOW_SRC(pc[1]);
+        pc += 3;
+        SNOW_DISPATCH();
+
+    SNOW_OP(DELTA) {
+        int64_t value = SNOW_SRC(pc[1]);
+        uint32_t site = pc[2];
+        r[SNOW_A()] = site_seen_[site] ? value - sites_[site] : 0;
+        sites_[site] = value;
+        site_seen_[site] = true;
+        pc += 3;
+        SNOW_DISPATCH();
+    }
+
+    SNOW_OP(CMP_JE)  SNOW_CMP_BRANCH_IF(lhs == rhs)
+    SNOW_OP(CMP_JNE) SNOW_CMP_BRANCH_IF(lhs != rhs)
+    SNOW_OP(CMP_JG)  SNOW_CMP_BRANCH_IF(lhs > rhs)
+    SNOW_OP(CMP_JL)  SNOW_CMP_BRANCH_IF(lhs < rhs)
+    SNOW_OP(CMP_JGE) SNOW_CMP_BRANCH_IF(lhs >= rhs)
+    SNOW_OP(CMP_JLE) SNOW_CMP_BRANCH_IF(lhs <= rhs)
+
+    SNOW_OP(MOV_ADD)
+        r[SNOW_A()] = SNOW_SRC(pc[1]);
+        r[pc[2]] = static_cast<int64_t>(static_cast<uint64_t>(SNOW_SRC(pc[3])) + static_cast<uint64_t>(SNOW_SRC(pc[4])));
+        pc += 5;
+        SNOW_DISPATCH();
+
+#ifndef SNOW_COMPUTED_GOTO
+        case Bytecode::Count:
+            break;
+    }
+    throw std::runtime_error("Invalid bytecode");
+#endif
+
+#undef SNOW_CMP_BRANCH_IF
+#undef SNOW_BRANCH_IF
+#undef SNOW_OP
+#undef SNOW_DISPATCH
+#undef SNOW_A
+#undef SNOW_SRC
+}
+
+} // namespace VM
+} // namespace Snow
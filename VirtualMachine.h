@@ -0,0 +1,65 @@
+#pragma once
+
+#include "Bytecode.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+namespace Snow {
+namespace VM {
+
+// ============================================================================
+// VIRTUAL MACHINE
+// Runs BytecodeModules on any host. Dispatch is a computed goto through a
+// handler table on GCC/Clang and a switch elsewhere. All frames live in one
+// register stack; a call's frame starts right above its caller's.
+//
+// The temporal instructions are implemented by the VM itself:
+//   WAIT     sleeps for the given number of nanoseconds (or calls the
+//            wait handler, if one is set)
+//   DODECAP  copies its source and appends it to the capture trace
+//   SAMPLE   copies its source and remembers it as the site's last sample
+//   DELTA    the source minus the value it had at this site last time
+//            (0 the first time)
+// ============================================================================
+
+class VirtualMachine {
+public:
+    typedef void (*WaitHandler)(int64_t nanoseconds);
+
+    VirtualMachine();
+
+    // Runtime functions for CALLN, taking and returning int64_t (at most 6
+    // arguments). The defaults bind Snow::Runtime like the JIT does.
+    void AddSymbol(const std::string& name, void* address) { symbols_[name] = address; }
+    void SetWaitHandler(WaitHandler handler) { wait_handler_ = handler; }
+    void SetStackSize(size_t registers) { stack_size_ = registers; }
+
+    // Binds natives and resets per-run state; the module must outlive the VM
+    bool Load(const BytecodeModule& module);
+    bool Run(const std::string& function, int64_t& result);
+    // By index into the module's functions (see BytecodeModule::FindFunction).
+    // Site state and captures carry over from earlier runs until the next Load.
+    bool Run(uint32_t function, int64_t& result);
+
+    const std::vector<int64_t>& GetCaptures() const { return captures_; }
+    const std::string& GetError() const { return error_; }
+
+private:
+    const BytecodeModule* module_;
+    std::unordered_map<std::string, void*> symbols_;
+    std::vector<void*> natives_;
+    std::vector<int64_t> stack_;
+    std::vector<int64_t> sites_;
+    std::vector<bool> site_seen_;
+    std::vector<int64_t> captures_;
+    WaitHandler wait_handler_;
+    size_t stack_size_;
+    std::string error_;
+
+    int64_t Execute(uint32_t function, size_t base);
+};
+
+} // namespace VM
+} // namespace Snow
@@ -0,0 +1,43 @@
+#include "X64Target.h"
+#include <algorithm>
+
+namespace Snow {
+namespace X64 {
+
+const char* GetRegisterName(int reg) {
+    static const char* names[] = {
+        "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+        "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"
+    };
+
+    if (reg >= 0 && reg < 16) {
+        return names[reg];
+    }
+    return "?";
+}
+
+const ABIInfo& GetABIInfo(TargetABI abi) {
+    static const ABIInfo win64 = {
+        { RCX, R8, R9, R10 },
+        { RBX, RSI, RDI, R12, R13, R14, R15 },
+        { RCX, RDX, R8, R9 },
+        32
+    };
+
+    static const ABIInfo sysv = {
+        { RCX, RSI, RDI, R8, R9, R10 },
+        { RBX, R12, R13, R14, R15 },
+        { RDI, RSI, RDX, RCX, R8, R9 },
+        0
+    };
+
+    return abi == TargetABI::Win64 ? win64 : sysv;
+}
+
+bool IsCalleeSaved(TargetABI abi, int reg) {
+    const auto& saved = GetABIInfo(abi).allocatable_callee_saved;
+    return reg == RBP || std::find(saved.begin(), saved.end(), reg) != saved.end();
+}
+
+} // namespace X64
+} // namespace Snow
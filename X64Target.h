@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+
+namespace Snow {
+namespace X64 {
+
+// ============================================================================
+// x86_64 REGISTERS
+// Numbered in hardware encoding order (ModRM.reg/rm with REX.R/B extension)
+// ============================================================================
+
+enum Register {
+    RAX = 0, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14, R15,
+    NoRegister = -1
+};
+
+const char* GetRegisterName(int reg);
+
+// ============================================================================
+// CALLING CONVENTIONS
+// rax, rdx and r11 are never allocated: rax carries return values and the
+// dividend, rdx the high half of division, r11 is the code generator's scratch.
+// ============================================================================
+
+enum class TargetABI {
+    Win64,  // Microsoft x64 (Windows PE)
+    SysV    // System V AMD64 (Linux ELF)
+};
+
+struct ABIInfo {
+    std::vector<int> allocatable_caller_saved; // Clobbered by calls
+    std::vector<int> allocatable_callee_saved; // Must be saved if used
+    std::vector<int> argument_registers;
+    int shadow_space;                           // Bytes the caller reserves above args
+};
+
+const ABIInfo& GetABIInfo(TargetABI abi);
+
+bool IsCalleeSaved(TargetABI abi, int reg);
+
+} // namespace X64
+} // namespace Snow
@@ -2,14 +2,24 @@
 #include "Lexer/Lexer.h"
 #include "Parser/Parser.h"
 #include "IR/IRGenerator.h"
+#include "SSA/SSA.h"
 #include "Optimizer/Optimizer.h"
+#include "AdvancedOptimization/AdvancedOptimizer.h"
+#include "HyperOptimization/HyperOptimizer.h"
 #include "CodeGen/CodeGenerator.h"
+#include "JIT/JITCompiler.h"
+#include "JIT/SSACompiler.h"
+#include "JIT/TieredExecutor.h"
+#include "VM/VirtualMachine.h"
 #include "Runtime/Runtime.h"
 
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <cstdlib>
+#include <algorithm>
+#include <chrono>
 
 using namespace Snow;
 
@@ -39,16 +49,443 @@ void PrintBanner() {
 void PrintUsage(const char* program_name) {
     std::cout << "Usage: " << program_name << " <source.sno> [options]\n";
     std::cout << "\nOptions:\n";
-    std::cout << "  -o <file>    Output file (default: output.asm)\n";
+    std::cout << "  -o <file>    Output file (default: output.o, output.asm with -S)\n";
+    std::cout << "  -S           Emit NASM assembly instead of an object file (implied by -o *.asm)\n";
     std::cout << "  -O0          No optimization\n";
  std::cout << "  -O1          Basic optimization (default)\n";
     std::cout << "  -O2  Advanced optimization\n";
+    std::cout << "  -O3          Maximum optimization\n";
+    std::cout << "  -unroll <n>  Loop unroll factor (default: by level)\n";
+    std::cout << "  -align-loops <n>  Align loop headers to n bytes (default: 16, 0 = off)\n";
+    std::cout << "  -mcpu <cpu>  Scheduling model: skylake (default), zen3\n";
+    std::cout << "  -l1-cache <kb>, -l2-cache <kb>  Cache sizes loop nests are tiled for (default: 32, 1024)\n";
+    std::cout << "  -prefetch <n>  Insert software prefetches at -O<n> and up (default: 0 = off)\n";
+    std::cout << "  -target <abi>  Calling convention: sysv, win64 (default: sysv for objects, win64 with -S)\n";
+    std::cout << "  -j <n>       Optimizer threads (default: all cores)\n";
  std::cout << "  -emit-ir     Emit IR instead of assembly\n";
-    std::cout << "  -v           Verbose output\n";
+    std::cout << "  --jit        Compile to memory and run main immediately\n";
+    std::cout << "  --tiered     Interpret main, JIT-compile hot functions at -O2\n";
+    std::cout << "  --run        Compile to bytecode and run main in the VM\n";
+    std::cout << "  --benchmark  Time main in the VM and as native code (JIT)\n";
+    std::cout << "  --benchmark-div  Time base-12 digit loops with and without constant divisors\n";
+    std::cout << "  --benchmark-simd  Time SSA loop kernels compiled scalar and vectorized\n";
+    std::cout << "  --ssa        Also build SSA form and report what the SSA optimizers do\n";
+    std::cout << "  -v           Verbose output (with optimizer pass timings)\n";
     std::cout << "  -h, --help   Show this help message\n";
     std::cout << "\n";
 }
 
+// Runs main 'runs' times in the VM and as JIT-compiled native code, with
+// waits skipped so only execution is measured
+int64_t SkipWait(int64_t) { return 0; }
+void SkipWaitVM(int64_t) {}
+
+int RunBenchmark(const IR::Module& module, int runs) {
+    typedef std::chrono::steady_clock Clock;
+    auto elapsed_us = [](Clock::time_point start) {
+        return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+    };
+
+    Clock::time_point start = Clock::now();
+    VM::BytecodeCompiler bytecode_compiler;
+    VM::BytecodeModule bytecode;
+    if (!bytecode_compiler.Compile(module, bytecode)) {
+        std::cerr << "Error: Bytecode compilation failed: " << bytecode_compiler.GetError() << "\n";
+        return 1;
+    }
+    double bytecode_compile_us = elapsed_us(start);
+
+    start = Clock::now();
+    JIT::JITCompiler jit;
+    jit.AddSymbol("_snow_wait", reinterpret_cast<void*>(&SkipWait));
+    if (!jit.Compile(module) || !jit.GetFunction("main")) {
+        std::cerr << "Error: JIT compilation failed: " << jit.GetError() << "\n";
+        return 1;
+    }
+    double jit_compile_us = elapsed_us(start);
+
+    // Load and look up main once, then one untimed run each, so setup (the
+    // VM's register stack, binding natives) is not counted
+    VM::VirtualMachine vm;
+    vm.SetWaitHandler(&SkipWaitVM);
+    JIT::JITCompiler::EntryPoint entry = jit.GetFunction("main");
+    uint32_t vm_main = static_cast<uint32_t>(bytecode.FindFunction("main"));
+    int64_t vm_result = 0;
+    if (!vm.Load(bytecode) || !vm.Run(vm_main, vm_result)) {
+        std::cerr << "Error: VM execution failed: " << vm.GetError() << "\n";
+        return 1;
+    }
+    entry();
+
+    start = Clock::now();
+    for (int i = 0; i < runs; i++) vm.Run(vm_main, vm_result);
+    double vm_us = elapsed_us(start) / runs;
+
+    start = Clock::now();
+    for (int i = 0; i < runs; i++) entry();
+    double native_us = elapsed_us(start) / runs;
+
+    std::cout << "[Benchmark] " << runs << " runs of main\n";
+    std::cout << "  Bytecode: " << bytecode.code.size() << " words, " << bytecode.constants.size()
+              << " constants, " << bytecode_compiler.GetFusedCount() << " superinstructions, compiled in "
+              << bytecode_compile_us << " us\n";
+    std::cout << "  Native:   " << jit.GetCodeSize() << " bytes, compiled in " << jit_compile_us << " us\n";
+    std::cout << "  VM:       " << vm_us << " us/run\n";
+    std::cout << "  Native:   " << native_us << " us/run\n";
+    if (native_us > 0) std::cout << "  VM/native: " << vm_us / native_us << "x\n";
+    return 0;
+}
+
+// Builds a base-12 formatting kernel: the digits of every number from 1 to
+// 'count', summed. With 'constant_divisor' the DIV and MUL read the
+// immediate 12; without, they read a register holding 12, which the JIT
+// can only divide by with idiv.
+void BuildDigitLoop(IR::Module& module, const std::string& name, int64_t count, bool constant_divisor) {
+    using IR::Instruction;
+    using IR::Operand;
+    using IR::OpCode;
+    IR::Function* func = module.CreateFunction(name);
+    func->AllocateRegister(); // R0
+    Operand n = Operand::Register(func->AllocateRegister());
+    Operand x = Operand::Register(func->AllocateRegister());
+    Operand q = Operand::Register(func->AllocateRegister());
+    Operand t = Operand::Register(func->AllocateRegister());
+    Operand sum = Operand::Register(func->AllocateRegister());
+    Operand base = constant_divisor ? Operand::Immediate(12) : Operand::Register(func->AllocateRegister());
+
+    IR::BasicBlock* entry = func->CreateBlock("entry");
+    entry->AddInstruction(Instruction(OpCode::MOV, n, Operand::Immediate(1)));
+    entry->AddInstruction(Instruction(OpCode::MOV, sum, Operand::Immediate(0)));
+    if (!constant_divisor) entry->AddInstruction(Instruction(OpCode::MOV, base, Operand::Immediate(12)));
+
+    IR::BasicBlock* outer = func->CreateBlock("number");
+    outer->AddInstruction(Instruction(OpCode::CMP, n, Operand::Immediate(count)));
+    outer->AddInstruction(Instruction(OpCode::JG, Operand::Label("done")));
+    outer->AddInstruction(Instruction(OpCode::MOV, x, n));
+
+    IR::BasicBlock* digit = func->CreateBlock("digit");
+    digit->AddInstruction(Instruction(OpCode::CMP, x, Operand::Immediate(0)));
+    digit->AddInstruction(Instruction(OpCode::JLE, Operand::Label("next")));
+    digit->AddInstruction(Instruction(OpCode::DIV, q, x, base));
+    digit->AddInstruction(Instruction(OpCode::MUL, t, q, base));
+    digit->AddInstruction(Instruction(OpCode::SUB, t, x, t));        // x mod 12
+    digit->AddInstruction(Instruction(OpCode::ADD, sum, sum, t));
+    digit->AddInstruction(Instruction(OpCode::MOV, x, q));
+    digit->AddInstruction(Instruction(OpCode::JMP, Operand::Label("digit")));
+
+    IR::BasicBlock* next = func->CreateBlock("next");
+    next->AddInstruction(Instruction(OpCode::ADD, n, n, Operand::Immediate(1)));
+    next->AddInstruction(Instruction(OpCode::JMP, Operand::Label("number")));
+
+    IR::BasicBlock* done = func->CreateBlock("done");
+    done->AddInstruction(Instruction(OpCode::MOV, Operand::Register(0), sum));
+    done->AddInstruction(Instruction(OpCode::RET));
+}
+
+// Times the digit loop JIT-compiled with idiv and with multiply-high
+// division, against DecToDod in the C++ runtime
+int RunDivisionBenchmark(int64_t count) {
+    typedef std::chrono::steady_clock Clock;
+    auto elapsed_ms = [](Clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    };
+
+    IR::Module module;
+    BuildDigitLoop(module, "digits_idiv", count, false);
+    BuildDigitLoop(module, "digits_magic", count, true);
+
+    JIT::JITCompiler jit;
+    if (!jit.Compile(module)) {
+        std::cerr << "Error: JIT compilation failed: " << jit.GetError() << "\n";
+        return 1;
+    }
+
+    std::cout << "[Benchmark] Base-12 digits of 1.." << count << "\n";
+    const char* names[] = { "digits_idiv", "digits_magic" };
+    const char* labels[] = { "idiv:          ", "multiply-high: " };
+    int64_t results[2] = { 0, 0 };
+    for (int k = 0; k < 2; k++) {
+        JIT::JITCompiler::EntryPoint entry = jit.GetFunction(names[k]);
+        Clock::time_point start = Clock::now();
+        results[k] = entry();
+        std::cout << "  " << labels[k] << elapsed_ms(start) << " ms (digit sum " << results[k] << ")\n";
+    }
+
+    Clock::time_point start = Clock::now();
+    size_t digits = 0;
+    for (int64_t n = 1; n <= count; n++) digits += Runtime::DecToDod(n).size();
+    std::cout << "  DecToDod:      " << elapsed_ms(start) << " ms (" << digits << " digits)\n";
+
+    if (results[0] != results[1]) {
+        std::cerr << "Error: Results differ\n";
+        return 1;
+    }
+    return 0;
+}
+
+// Appends 'op operands' to a hand-built SSA block; the result, if any, is
+// a fresh register
+SSA::SSAValue* AppendSSA(SSA::SSAFunction* func, SSA::SSABasicBlock* block, SSA::SSAInstruction::OpCode op,
+                         const std::vector<SSA::SSAValue*>& operands, bool has_result = true) {
+    auto instr = std::make_unique<SSA::SSAInstruction>(op);
+    for (SSA::SSAValue* operand : operands) instr->AddOperand(operand);
+    SSA::SSAValue* result = nullptr;
+    if (has_result) {
+        result = func->CreateValue(SSA::SSAValue::Kind::Register);
+        instr->SetResult(result);
+    }
+    block->AddInstruction(std::move(instr));
+    return result;
+}
+
+// Builds 'name(a, b, c, n)': a counted loop over i in [0, n) by 'step', in
+// the shape the loop vectorizer takes when the step is 1. 'body' emits one
+// iteration given i and the byte offset 8*i; with 'sum', the value it
+// returns is accumulated and the function returns the total, else it
+// returns 0.
+template <typename Body>
+void BuildWordLoop(SSA::SSAModule& module, const std::string& name, int64_t step, bool sum, Body body) {
+    using SSA::SSAValue;
+    using OpCode = SSA::SSAInstruction::OpCode;
+    SSA::SSAFunction* func = module.CreateFunction(name);
+    std::vector<SSAValue*> params;
+    for (int k = 0; k < 4; k++) params.push_back(func->CreateValue(SSAValue::Kind::Parameter));
+    SSAValue* zero = func->CreateConstant(0);
+
+    SSA::SSABasicBlock* entry = func->CreateBasicBlock("entry");
+    SSA::SSABasicBlock* header = func->CreateBasicBlock("loop");
+    SSA::SSABasicBlock* loop_body = func->CreateBasicBlock("body");
+    SSA::SSABasicBlock* exit = func->CreateBasicBlock("exit");
+    entry->AddSuccessor(header);
+    header->AddPredecessor(entry);
+    header->AddPredecessor(loop_body);
+    header->AddSuccessor(loop_body);
+    header->AddSuccessor(exit);
+    loop_body->AddPredecessor(header);
+    loop_body->AddSuccessor(header);
+    exit->AddPredecessor(header);
+
+    AppendSSA(func, entry, OpCode::Br, {}, false);
+
+    auto i_phi = std::make_unique<SSA::SSAInstruction>(OpCode::Phi);
+    SSAValue* i = func->CreateValue(SSAValue::Kind::Register);
+    i_phi->SetResult(i);
+    i_phi->AddOperand(zero);
+    SSA::SSAInstruction* i_phi_ptr = i_phi.get();
+    header->AddInstruction(std::move(i_phi));
+
+    SSA::SSAInstruction* acc_phi_ptr = nullptr;
+    SSAValue* acc = nullptr;
+    if (sum) {
+        auto acc_phi = std::make_unique<SSA::SSAInstruction>(OpCode::Phi);
+        acc = func->CreateValue(SSAValue::Kind::Register);
+        acc_phi->SetResult(acc);
+        acc_phi->AddOperand(zero);
+        acc_phi_ptr = acc_phi.get();
+        header->AddInstruction(std::move(acc_phi));
+    }
+    SSAValue* in_range = AppendSSA(func, header, OpCode::Lt, {i, params[3]});
+    AppendSSA(func, header, OpCode::CondBr, {in_range}, false);
+
+    SSAValue* offset = AppendSSA(func, loop_body, OpCode::Mul, {i, func->CreateConstant(8)});
+    SSAValue* value = body(func, loop_body, params, i, offset);
+    if (sum) acc_phi_ptr->AddOperand(AppendSSA(func, loop_body, OpCode::Add, {acc, value}));
+    i_phi_ptr->AddOperand(AppendSSA(func, loop_body, OpCode::Add, {i, func->CreateConstant(step)}));
+    AppendSSA(func, loop_body, OpCode::Br, {}, false);
+
+    AppendSSA(func, exit, OpCode::Ret, {sum ? acc : zero}, false);
+}
+
+// Three word kernels: 'sum(a, _, _, n)' adds up a[0..n),
+// 'scale_add(out, x, y, n)' sets out[i] = x[i]*3 + y[i], and
+// 'base12(out, hi, lo, n)' sets out[i] = i*144 + hi[i]*12 + lo[i], unrolled
+// 'lanes' times with the loads first so SLP can pack the words (n must be
+// a multiple of 'lanes')
+void BuildSIMDKernels(SSA::SSAModule& module, int lanes) {
+    using SSA::SSAValue;
+    using OpCode = SSA::SSAInstruction::OpCode;
+    BuildWordLoop(module, "sum", 1, true,
+        [](SSA::SSAFunction* func, SSA::SSABasicBlock* block, const std::vector<SSAValue*>& params,
+           SSAValue* /*i*/, SSAValue* offset) {
+            SSAValue* address = AppendSSA(func, block, OpCode::Add, {params[0], offset});
+            return AppendSSA(func, block, OpCode::Load, {address});
+        });
+    BuildWordLoop(module, "scale_add", 1, false,
+        [](SSA::SSAFunction* func, SSA::SSABasicBlock* block, const std::vector<SSAValue*>& params,
+           SSAValue* /*i*/, SSAValue* offset) {
+            SSAValue* x = AppendSSA(func, block, OpCode::Load,
+                                    {AppendSSA(func, block, OpCode::Add, {params[1], offset})});
+            SSAValue* y = AppendSSA(func, block, OpCode::Load,
+                                    {AppendSSA(func, block, OpCode::Add, {params[2], offset})});
+            SSAValue* scaled = AppendSSA(func, block, OpCode::Mul, {x, func->CreateConstant(3)});
+            SSAValue* result = AppendSSA(func, block, OpCode::Add, {scaled, y});
+            SSAValue* out = AppendSSA(func, block, OpCode::Add, {params[0], offset});
+            AppendSSA(func, block, OpCode::Store, {result, out}, false);
+            return static_cast<SSAValue*>(nullptr);
+        });
+    BuildWordLoop(module, "base12", lanes, false,
+        [lanes](SSA::SSAFunction* func, SSA::SSABasicBlock* block, const std::vector<SSAValue*>& params,
+                SSAValue* i, SSAValue* offset) {
+            SSAValue* hi = AppendSSA(func, block, OpCode::Add, {params[1], offset});
+            SSAValue* lo = AppendSSA(func, block, OpCode::Add, {params[2], offset});
+            SSAValue* out = AppendSSA(func, block, OpCode::Add, {params[0], offset});
+            SSAValue* twelve = func->CreateConstant(12);
+            SSAValue* top = AppendSSA(func, block, OpCode::Mul, {i, func->CreateConstant(144)});
+            std::vector<SSAValue*> his, los, values;
+            for (int k = 0; k < lanes; k++) {
+                SSAValue* word = func->CreateConstant(8 * k);
+                his.push_back(AppendSSA(func, block, OpCode::Load, {AppendSSA(func, block, OpCode::Add, {hi, word})}));
+                los.push_back(AppendSSA(func, block, OpCode::Load, {AppendSSA(func, block, OpCode::Add, {lo, word})}));
+            }
+            for (int k = 0; k < lanes; k++) {
+                SSAValue* digits = AppendSSA(func, block, OpCode::Add,
+                                             {AppendSSA(func, block, OpCode::Mul, {his[k], twelve}), los[k]});
+                SSAValue* index = AppendSSA(func, block, OpCode::Add, {top, func->CreateConstant(144 * k)});
+                values.push_back(AppendSSA(func, block, OpCode::Add, {index, digits}));
+            }
+            for (int k = 0; k < lanes; k++) {
+                SSAValue* word = func->CreateConstant(8 * k);
+                AppendSSA(func, block, OpCode::Store, {values[k], AppendSSA(func, block, OpCode::Add, {out, word})}, false);
+            }
+            return static_cast<SSAValue*>(nullptr);
+        });
+}
+
+// Compiles the SSA kernels as they are and after loop and SLP vectorization
+// for the host, runs both on the same data and times them
+int RunSIMDBenchmark(int64_t words, int runs) {
+    typedef std::chrono::steady_clock Clock;
+    auto elapsed_ms = [](Clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    };
+
+    AdvancedOptimization::VectorizationEngine vectorizer;
+    int lanes = vectorizer.GetVectorWidth();
+    SSA::SSAModule scalar_module;
+    SSA::SSAModule vector_module;
+    BuildSIMDKernels(scalar_module, lanes);
+    BuildSIMDKernels(vector_module, lanes);
+
+    int vectorized = 0;
+    for (const auto& func : vector_module.GetFunctions()) {
+        vectorized += vectorizer.VectorizeLoops(*func);
+        vectorizer.PerformSLPVectorization(*func);
+    }
+
+    JIT::SSACompiler scalar;
+    JIT::SSACompiler packed;
+    packed.SetVectorWidth(lanes);
+    if (!scalar.Compile(scalar_module) || !packed.Compile(vector_module)) {
+        std::cerr << "Error: SSA compilation failed: " << scalar.GetError() << packed.GetError() << "\n";
+        return 1;
+    }
+
+    // x and y are also the high and low base-12 digits for base12
+    std::vector<int64_t> x(static_cast<size_t>(words));
+    std::vector<int64_t> y(x.size());
+    for (size_t k = 0; k < x.size(); k++) {
+        x[k] = static_cast<int64_t>(k * 7 % 12);
+        y[k] = static_cast<int64_t>(k % 12);
+    }
+
+    std::cout << "[Benchmark] " << words << " words, " << runs << " runs, " << lanes << " lanes: "
+              << vectorized << " loops vectorized, " << vectorizer.GetStats().slp_trees
+              << " store groups packed, " << packed.GetVectorInstructions() << " vector instructions emitted\n";
+
+    const int kKernels = 3;
+    const char* kernels[kKernels] = { "sum", "scale_add", "base12" };
+    const char* labels[kKernels] = { "sum       ", "scale_add ", "base12    " };
+    JIT::SSACompiler* compilers[2] = { &scalar, &packed };
+    double times[2][kKernels] = {};
+    int64_t sums[2] = { 0, 0 };
+    std::vector<int64_t> out[2][kKernels];
+    for (int k = 0; k < 2; k++) {
+        for (int kernel = 0; kernel < kKernels; kernel++) {
+            JIT::SSACompiler::EntryPoint entry = compilers[k]->GetFunction(kernels[kernel]);
+            out[k][kernel].assign(x.size(), 0);
+            int64_t c = reinterpret_cast<int64_t>(out[k][kernel].data());
+            int64_t a = reinterpret_cast<int64_t>(x.data());
+            int64_t b = reinterpret_cast<int64_t>(y.data());
+
+            Clock::time_point start = Clock::now();
+            for (int run = 0; run < runs; run++) {
+                if (kernel == 0) sums[k] = entry(a, 0, 0, words);
+                else entry(c, a, b, words);
+            }
+            times[k][kernel] = elapsed_ms(start);
+        }
+    }
+
+    for (int kernel = 0; kernel < kKernels; kernel++) {
+        std::cout << "  " << labels[kernel] << "scalar: " << times[0][kernel] << " ms\n";
+        std::cout << "  " << labels[kernel] << "vector: " << times[1][kernel] << " ms ("
+                  << times[0][kernel] / times[1][kernel] << "x)\n";
+    }
+
+    bool same = sums[0] == sums[1];
+    for (int kernel = 0; kernel < kKernels; kernel++) same = same && out[0][kernel] == out[1][kernel];
+    if (!same) {
+        std::cerr << "Error: Results differ\n";
+        return 1;
+    }
+    return 0;
+}
+
+// Builds SSA form from the AST and runs the SSA engines over it. Only the
+// report comes out of this: code generation still works on the IR.
+void RunSSAPipeline(const AST::Program& program, int opt_level, X64::MicroArch micro_arch,
+                    const AdvancedOptimization::CacheConfig& cache, int prefetch_level,
+                    X64::TargetABI target_abi, unsigned thread_count, bool verbose) {
+    SSA::SSABuilder builder;
+    std::unique_ptr<SSA::SSAModule> module = builder.BuildFromAST(program);
+    std::cout << "[SSA] Built " << module->GetFunctions().size() << " functions\n";
+
+    // Function-level cleanups (strength reduction among them) run in parallel
+    HyperOptimization::HyperOptimizer hyper;
+    hyper.SetThreadCount(thread_count);
+    hyper.Optimize(*module, opt_level);
+    std::cout << "[SSA] Strength reductions: " << hyper.GetStats().strength_reductions << "\n";
+
+    // Loop and block optimizations next, so allocation sees the code they leave
+    AdvancedOptimization::AdvancedOptimizer optimizer;
+    optimizer.SetOptimizationLevel(opt_level);
+    optimizer.SetMicroArch(micro_arch);
+    optimizer.SetCacheConfig(cache);
+    optimizer.EnablePrefetching(prefetch_level);
+    optimizer.Optimize(*module);
+
+    const AdvancedOptimization::AdvancedOptimizer::OptimizationStats& optimized = optimizer.GetStats();
+    std::cout << "[SSA] Loop nests interchanged: " << optimized.loops_interchanged
+              << ", tiled: " << optimized.loops_tiled << "\n";
+    std::cout << "[SSA] Loops vectorized: " << optimized.loops_vectorized << "\n";
+    std::cout << "[SSA] SLP packs formed: " << optimized.slp_packs_formed << " ("
+              << optimized.slp_cycles_saved << " estimated cycles saved)\n";
+    std::cout << "[SSA] Prefetches inserted: " << optimized.prefetches_inserted << "\n";
+    std::cout << "[SSA] Blocks scheduled: " << optimized.blocks_scheduled << " ("
+              << optimized.schedule_cycles_saved << " estimated cycles saved)\n";
+    std::cout << "[SSA] Loops pipelined: " << optimized.loops_pipelined << "\n";
+
+    // -O3 colors the interference graph, lower levels use linear scan
+    AdvancedOptimization::RegisterAllocator::Stats allocation;
+    for (const auto& func : module->GetFunctions()) {
+        AdvancedOptimization::RegisterAllocator allocator;
+        allocator.SetOptimizationLevel(opt_level);
+        allocator.SetTargetABI(target_abi);
+        allocator.Allocate(*func);
+
+        const AdvancedOptimization::RegisterAllocator::Stats& stats = allocator.GetStats();
+        if (verbose) {
+            stats.Print(func->GetName());
+        }
+        allocation.values += stats.values;
+        allocation.spilled += stats.spilled;
+        allocation.copies_coalesced += stats.copies_coalesced;
+    }
+    std::cout << "[SSA] Register allocation: " << allocation.values << " values, "
+              << allocation.spilled << " spilled, " << allocation.copies_coalesced
+              << " phi copies coalesced\n";
+}
+
 int main(int argc, char* argv[]) {
     PrintBanner();
     
@@ -59,10 +496,27 @@ PrintUsage(argv[0]);
     }
     
  std::string input_file;
-    std::string output_file = "output.asm";
+    std::string output_file;
     bool emit_ir = false;
+    bool emit_assembly = false;
+    bool jit = false;
+    bool tiered = false;
+    bool run_vm = false;
+    bool benchmark = false;
+    bool benchmark_division = false;
+    bool benchmark_simd = false;
+    bool ssa = false;
   bool verbose = false;
     bool optimize = true;
+    int opt_level = 1;
+    int unroll_factor = 0;
+    int loop_alignment = 16;
+    unsigned thread_count = 0;
+    X64::MicroArch micro_arch = X64::MicroArch::Skylake;
+    AdvancedOptimization::CacheConfig cache;
+    int prefetch_level = 0;
+    X64::TargetABI target_abi = X64::TargetABI::SysV;
+    bool target_set = false;
     
     for (int i = 1; i < argc; ++i) {
         std::string arg = argv[i];
@@ -74,8 +528,66 @@ PrintUsage(argv[0]);
      output_file = argv[++i];
         } else if (arg == "-O0") {
        optimize = false;
+        } else if (arg == "-O1" || arg == "-O2" || arg == "-O3") {
+            opt_level = arg[2] - '0';
+        } else if (arg == "-unroll" && i + 1 < argc) {
+            unroll_factor = std::atoi(argv[++i]);
+        } else if (arg == "-align-loops" && i + 1 < argc) {
+            loop_alignment = std::atoi(argv[++i]);
+            if (loop_alignment < 0 || (loop_alignment & (loop_alignment - 1)) != 0) {
+                std::cerr << "Error: Loop alignment must be a power of two or 0\n";
+                return 1;
+            }
+        } else if ((arg == "-l1-cache" || arg == "-l2-cache") && i + 1 < argc) {
+            int kb = std::atoi(argv[++i]);
+            if (kb <= 0) {
+                std::cerr << "Error: Cache size must be a positive number of KB\n";
+                return 1;
+            }
+            (arg == "-l1-cache" ? cache.l1_kb : cache.l2_kb) = kb;
+        } else if (arg == "-prefetch" && i + 1 < argc) {
+            prefetch_level = std::atoi(argv[++i]);
+            if (prefetch_level < 0 || prefetch_level > 3) {
+                std::cerr << "Error: Prefetch level must be 0-3\n";
+                return 1;
+            }
+        } else if (arg == "-j" && i + 1 < argc) {
+            thread_count = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "-mcpu" && i + 1 < argc) {
+            std::string cpu = argv[++i];
+            if (!X64::ParseMicroArch(cpu.c_str(), micro_arch)) {
+                std::cerr << "Error: Unknown CPU: " << cpu << "\n";
+                return 1;
+            }
    } else if (arg == "-emit-ir") {
 emit_ir = true;
+        } else if (arg == "-S") {
+            emit_assembly = true;
+        } else if (arg == "--jit") {
+            jit = true;
+        } else if (arg == "--tiered") {
+            tiered = true;
+        } else if (arg == "--run") {
+            run_vm = true;
+        } else if (arg == "--benchmark") {
+            benchmark = true;
+        } else if (arg == "--benchmark-div") {
+            benchmark_division = true;
+        } else if (arg == "--benchmark-simd") {
+            benchmark_simd = true;
+        } else if (arg == "--ssa") {
+            ssa = true;
+        } else if (arg == "-target" && i + 1 < argc) {
+            std::string target = argv[++i];
+            target_set = true;
+            if (target == "sysv") {
+                target_abi = X64::TargetABI::SysV;
+            } else if (target == "win64") {
+                target_abi = X64::TargetABI::Win64;
+            } else {
+                std::cerr << "Error: Unknown target: " << target << "\n";
+                return 1;
+            }
         } else if (arg == "-v") {
  verbose = true;
     } else if (arg[0] != '-') {
@@ -83,10 +595,26 @@ emit_ir = true;
      }
     }
     
+    if (benchmark_division) {
+        return RunDivisionBenchmark(5000000);
+    }
+    if (benchmark_simd) {
+        return RunSIMDBenchmark(1 << 16, 200);
+    }
+    
 if (input_file.empty()) {
    std::cerr << "Error: No input file specified\n";
         return 1;
     }
+    if (output_file.empty()) {
+        output_file = emit_assembly ? "output.asm" : "output.o";
+    } else if (output_file.size() > 4 && output_file.compare(output_file.size() - 4, 4, ".asm") == 0) {
+        emit_assembly = true;
+    }
+    if (!target_set) {
+        // ELF64 objects link against SysV code; NASM text keeps the win64/link flow
+        target_abi = emit_assembly ? X64::TargetABI::Win64 : X64::TargetABI::SysV;
+    }
  
   try {
         // ====================================================================
@@ -120,6 +648,12 @@ if (input_file.empty()) {
    std::cout << "[AST] Statements: " << program->GetStatements().size() << "\n";
    }
     
+        // SSA engines: a report only, the IR pipeline below is unaffected
+        if (ssa) {
+            RunSSAPipeline(*program, optimize ? opt_level : 0, micro_arch, cache, prefetch_level,
+                           target_abi, thread_count, verbose);
+        }
+    
   // 4. IR Generation
         std::cout << "[IRGen] Generating intermediate representation...\n";
      IRGenerator ir_gen;
@@ -130,9 +664,14 @@ IR::Module* module = ir_gen.Generate(*program);
    module->Print();
         }
    
-        // 5. Optimization (CIAM)
-  if (optimize) {
+        // 5. Optimization (CIAM); tiered runs optimize hot code on demand
+  if (optimize && !(tiered && !emit_ir)) {
        CIAMOptimizer optimizer;
+            optimizer.SetOptimizationLevel(opt_level);
+            optimizer.SetUnrollFactor(unroll_factor);
+            optimizer.SetMicroArch(micro_arch);
+            optimizer.SetVerbose(verbose);
+            optimizer.SetThreadCount(thread_count);
   optimizer.Optimize(*module);
     }
      
@@ -141,24 +680,108 @@ std::cout << "\n[IR] Optimized IR:\n";
       module->Print();
     }
 
+        // 6. Benchmark: VM against native code
+        if (benchmark && !emit_ir) {
+            return RunBenchmark(*module, 1000);
+        }
+
+        // 6. VM: run the bytecode, the program's result is the exit code
+        if (run_vm && !emit_ir) {
+            std::cout << "[VM] Compiling to bytecode...\n";
+            VM::BytecodeCompiler bytecode_compiler;
+            VM::BytecodeModule bytecode;
+            if (!bytecode_compiler.Compile(*module, bytecode)) {
+                std::cerr << "Error: Bytecode compilation failed: " << bytecode_compiler.GetError() << "\n";
+                return 1;
+            }
+            if (verbose) bytecode.Disassemble(std::cout);
+            std::cout << "[VM] " << bytecode.GetSizeInBytes() << " bytes of bytecode\n\n";
+
+            VM::VirtualMachine vm;
+            int64_t result = 0;
+            if (!vm.Load(bytecode) || !vm.Run("main", result)) {
+                std::cerr << "Error: VM execution failed: " << vm.GetError() << "\n";
+                return 1;
+            }
+            if (verbose) {
+                for (int64_t value : vm.GetCaptures()) {
+                    std::cout << "[VM] Captured " << Runtime::DecToDod(value) << "\n";
+                }
+            }
+            return static_cast<int>(result);
+        }
+
+        // 6. Tiered: interpret, promote hot functions to machine code
+        if (tiered && !emit_ir) {
+            JIT::TieredExecutor executor(*module);
+            executor.SetVerbose(verbose);
+            int64_t result = 0;
+            if (!executor.Run("main", result)) {
+                std::cerr << "Error: Tiered execution failed: " << executor.GetError() << "\n";
+                return 1;
+            }
+            if (verbose) executor.GetStats().Print();
+            return static_cast<int>(result);
+        }
+
+        // 6. JIT: run in-process, the program's result is the exit code
+        if (jit && !emit_ir) {
+            std::cout << "[JIT] Compiling to executable memory...\n";
+            JIT::JITCompiler compiler;
+            if (!compiler.Compile(*module)) {
+                std::cerr << "Error: JIT compilation failed: " << compiler.GetError() << "\n";
+                return 1;
+            }
+            JIT::JITCompiler::EntryPoint entry = compiler.GetFunction("main");
+            if (!entry) {
+                std::cerr << "Error: No main function to run\n";
+                return 1;
+            }
+            std::cout << "[JIT] " << compiler.GetCodeSize() << " bytes in "
+                      << compiler.GetCompileMilliseconds() << " ms\n\n";
+            return static_cast<int>(entry());
+        }
+
   // 6. Code Generation
      if (!emit_ir) {
-std::cout << "[CodeGen] Generating x86_64 assembly...\n";
+std::cout << (emit_assembly ? "[CodeGen] Generating x86_64 assembly...\n"
+                                     : "[CodeGen] Generating x86_64 machine code...\n");
  CodeGenerator codegen;
+        codegen.SetTargetABI(target_abi);
+        codegen.SetEmitAssembly(emit_assembly);
+        codegen.SetLoopAlignment(loop_alignment);
+        codegen.SetPrefetching(optimize && prefetch_level > 0 && opt_level >= prefetch_level, micro_arch);
+        codegen.SetVerbose(verbose);
        
        if (!codegen.Generate(*module, output_file)) {
 std::cerr << "Error: Code generation failed\n";
     return 1;
         }
+            if (emit_assembly) {
+                std::cout << "[CodeGen] " << codegen.GetMilliseconds() << " ms\n";
+            } else {
+                std::cout << "[CodeGen] " << codegen.GetCode().size() << " bytes in "
+                          << codegen.GetMilliseconds() << " ms\n";
+            }
         }
         
   // Success!
         std::cout << "\n✓ Compilation successful!\n";
    if (!emit_ir) {
     std::cout << "  Output: " << output_file << "\n";
-      std::cout << "\n  To assemble and link (using NASM):\n";
-       std::cout << "    nasm -f win64 " << output_file << " -o output.obj\n";
-std::cout << "    link output.obj /SUBSYSTEM:CONSOLE /OUT:program.exe\n";
+            if (emit_assembly) {
+                std::cout << "\n  To assemble and link (using NASM):\n";
+                if (target_abi == X64::TargetABI::Win64) {
+                    std::cout << "    nasm -f win64 " << output_file << " -o output.obj\n";
+                    std::cout << "    link output.obj /SUBSYSTEM:CONSOLE /OUT:program.exe\n";
+                } else {
+                    std::cout << "    nasm -f elf64 " << output_file << " -o output.o\n";
+                    std::cout << "    gcc output.o runtime.o -o program\n";
+                }
+            } else {
+                std::cout << "\n  To link (ELF64 object, with a runtime providing _snow_wait):\n";
+                std::cout << "    gcc " << output_file << " runtime.o -o program\n";
+            }
         }
 std::cout << "\n";
  